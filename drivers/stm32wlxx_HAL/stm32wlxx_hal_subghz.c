@@ -55,6 +55,16 @@
       (+) Write Register (1 byte) in blocking mode using @ref HAL_SUBGHZ_WriteRegister()
       (+) Read Register (1 byte) in blocking mode using @ref HAL_SUBGHZ_ReadRegister()
 
+    *** DMA mode IO operation      ***
+    =====================================
+    [..]
+      (+) Write a Data Buffer using @ref HAL_SUBGHZ_WriteBuffer_DMA(), completion in
+          @ref HAL_SUBGHZ_WriteBufferCpltCallback()
+      (+) Read a Data Buffer using @ref HAL_SUBGHZ_ReadBuffer_DMA(), completion in
+          @ref HAL_SUBGHZ_ReadBufferCpltCallback()
+      (+) The handle stays locked until then: blocking calls from thread mode wait
+          for the transfer, the radio IRQ is deferred and served on completion.
+
     *** SUBGHZ HAL driver macros list ***
     =====================================
     [..]
@@ -64,11 +74,13 @@
 /* Includes ------------------------------------------------------------------*/
 #include "subghz.h"
 #include "subghz_support.h"
+#include "timebase.h"
 #include "mprintf.h"
 #include "pin_defs.h"
 #include "stm32wlxx_ll_gpio.h"
 
 #include "stm32wlxx_hal_subghz.h"
+#include "stm32wlxx_ll_bus.h"
 #include "stm32wlxx_ll_exti.h"
 #include "stm32wlxx_ll_pwr.h"
 #include "stm32wlxx_ll_rcc.h"
@@ -92,20 +104,25 @@
   * @{
   */
 #define SUBGHZ_DEFAULT_TIMEOUT     100U    /* HAL Timeout in ms               */
+#define SUBGHZ_NSS_WAKEUP_TIME     2000U   /* NSS low pulse waking the radio, in us */
 #define SUBGHZ_DUMMY_DATA          0xFFU   /* SUBGHZSPI Dummy Data use for Tx */
 #define SUBGHZ_DEEP_SLEEP_ENABLE   1U      /* SUBGHZ Radio in Deep Sleep      */
 #define SUBGHZ_DEEP_SLEEP_DISABLE  0U      /* SUBGHZ Radio not in Deep Sleep  */
-
-/* SystemCoreClock dividers. Corresponding to time execution of while loop.   */
-#define SUBGHZ_DEFAULT_LOOP_TIME   ((SystemCoreClock*28U)>>19U)
-#define SUBGHZ_RFBUSY_LOOP_TIME    ((SystemCoreClock*24U)>>20U)
-#define SUBGHZ_NSS_LOOP_TIME       ((SystemCoreClock*24U)>>16U)
+#define SUBGHZSPI_MAX_FREQ         16000000U /* SUBGHZSPI max clock (Hz)     */
+#define SUBGHZSPI_FIFO_DEPTH       4U      /* SUBGHZSPI FIFO depth in bytes   */
+#define SUBGHZ_PRESCALER_TEST_REG  0x06C7U /* Scratch register, last syncword byte */
+#define SUBGHZ_SLEEP_WARM_START    0x04U   /* SET_SLEEP: keep the configuration  */
 /**
   * @}
   */
 
 /* Private macros ------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
+/* DMA source for the dummy bytes clocked out while reading a buffer */
+static const uint8_t subghz_dma_dummy_tx = SUBGHZ_DUMMY_DATA;
+/* DMA sink for the bytes clocked in while writing a buffer */
+static uint8_t subghz_dma_sink;
+
 /* Private function prototypes -----------------------------------------------*/
 /** @defgroup SUBGHZ_Private_Functions SUBGHZ Private Functions
   * @{
@@ -114,8 +131,31 @@ void              SUBGHZSPI_Init(uint32_t BaudratePrescaler);
 void              SUBGHZSPI_DeInit(void);
 HAL_StatusTypeDef SUBGHZSPI_Transmit(SUBGHZ_HandleTypeDef *hsubghz, uint8_t Data);
 HAL_StatusTypeDef SUBGHZSPI_Receive(SUBGHZ_HandleTypeDef *hsubghz, uint8_t *pData);
+HAL_StatusTypeDef SUBGHZSPI_TransmitReceive(SUBGHZ_HandleTypeDef *hsubghz, const uint8_t *pTxData, uint8_t *pRxData,
+                                            uint16_t Size);
+HAL_StatusTypeDef SUBGHZSPI_Transfer(SUBGHZ_HandleTypeDef *hsubghz, const uint8_t *pHeader, uint16_t HeaderSize,
+                                     const uint8_t *pTxData, uint8_t *pRxData, uint16_t Size);
 HAL_StatusTypeDef SUBGHZ_WaitOnBusy(SUBGHZ_HandleTypeDef *hsubghz);
+void              SUBGHZ_WaitOnDma(SUBGHZ_HandleTypeDef *hsubghz);
+HAL_StatusTypeDef SUBGHZ_SpinOnBusy(SUBGHZ_HandleTypeDef *hsubghz);
 HAL_StatusTypeDef SUBGHZ_CheckDeviceReady(SUBGHZ_HandleTypeDef *hsubghz);
+uint32_t          SUBGHZ_IsRadioBusy(void);
+uint32_t          SUBGHZ_ShadowCmdInEffect(SUBGHZ_HandleTypeDef *hsubghz, SUBGHZ_RadioSetCmd_t Command,
+                                           const uint8_t *pBuffer, uint16_t Size);
+void              SUBGHZ_ShadowUpdate(SUBGHZ_HandleTypeDef *hsubghz, SUBGHZ_RadioSetCmd_t Command,
+                                      const uint8_t *pBuffer, uint16_t Size);
+HAL_StatusTypeDef SUBGHZ_TestPattern(SUBGHZ_HandleTypeDef *hsubghz, uint8_t Pattern);
+uint32_t          SUBGHZ_RegCacheIndex(uint16_t Address);
+uint32_t          SUBGHZ_RegCacheMatch(SUBGHZ_HandleTypeDef *hsubghz, uint16_t Address, const uint8_t *pBuffer,
+                                       uint16_t Size);
+uint32_t          SUBGHZ_RegCacheLoad(SUBGHZ_HandleTypeDef *hsubghz, uint16_t Address, uint8_t *pBuffer,
+                                      uint16_t Size);
+void              SUBGHZ_RegCacheStore(SUBGHZ_HandleTypeDef *hsubghz, uint16_t Address, const uint8_t *pBuffer,
+                                       uint16_t Size);
+void              SUBGHZ_RegCacheDrop(SUBGHZ_HandleTypeDef *hsubghz, uint16_t Address, uint16_t Size);
+void              SUBGHZ_DMA_Init(void);
+void              SUBGHZ_DMA_Start(uint8_t *pTxData, uint32_t TxIncrement, uint8_t *pRxData, uint32_t RxIncrement,
+                                   uint16_t Size);
 /**
   * @}
   */
@@ -141,6 +181,9 @@ HAL_StatusTypeDef SUBGHZ_CheckDeviceReady(SUBGHZ_HandleTypeDef *hsubghz);
       (+) Call the function HAL_SUBGHZ_Init() to configure SUBGHZSPI peripheral
           and initialize SUBGHZ Handle.
 
+      (+) Call the function HAL_SUBGHZ_ConfigFastestPrescaler() once the radio is
+          out of reset to run SUBGHZSPI at the highest clock it accepts.
+
       (+) Call the function HAL_SUBGHZ_DeInit() to restore the default configuration
           of the SUBGHZ peripheral.
 
@@ -161,7 +204,7 @@ HAL_StatusTypeDef SUBGHZ_CheckDeviceReady(SUBGHZ_HandleTypeDef *hsubghz);
 HAL_StatusTypeDef HAL_SUBGHZ_Init(SUBGHZ_HandleTypeDef *hsubghz)
 {
   HAL_StatusTypeDef status;
-  __IO uint32_t count;
+  deadline_t deadline;
   HAL_SUBGHZ_StateTypeDef subghz_state;
 
   /* Check the hsubghz handle allocation */
@@ -184,6 +227,9 @@ HAL_StatusTypeDef HAL_SUBGHZ_Init(SUBGHZ_HandleTypeDef *hsubghz)
     /* Allocate lock resource and initialize it */
     hsubghz->Lock = HAL_UNLOCKED;
 
+    /* Start the cycle counter all HAL timeouts are measured against */
+    timebase_init();
+
     // Init the low level hardware : GPIO, CLOCK, NVIC...
 
 #if defined(CM0PLUS)
@@ -192,6 +238,10 @@ HAL_StatusTypeDef HAL_SUBGHZ_Init(SUBGHZ_HandleTypeDef *hsubghz)
 #else
     /* Enable EXTI 44 : Radio IRQ ITs for CPU1 */
     LL_EXTI_EnableIT_32_63(LL_EXTI_LINE_44);
+
+    /* Enable EXTI 45 : Radio busy released, wakes the CPU1 from RFBUSY waits */
+    LL_EXTI_EnableFallingTrig_32_63(LL_EXTI_LINE_45);
+    LL_EXTI_EnableIT_32_63(LL_EXTI_LINE_45);
 #endif /* CM0PLUS */
   }
 
@@ -204,18 +254,18 @@ HAL_StatusTypeDef HAL_SUBGHZ_Init(SUBGHZ_HandleTypeDef *hsubghz)
     LL_RCC_RF_DisableReset();
 
     /* Verify that Radio in reset status flag is set */
-    count  = SUBGHZ_DEFAULT_TIMEOUT * SUBGHZ_DEFAULT_LOOP_TIME;
+    deadline = deadline_from_ms(SUBGHZ_DEFAULT_TIMEOUT);
 
-    do
+    while (LL_RCC_IsRFUnderReset() != 0UL)
     {
-      if (count == 0U)
+      if (deadline_expired(&deadline))
       {
         status  = HAL_ERROR;
         hsubghz->ErrorCode = HAL_SUBGHZ_ERROR_TIMEOUT;
         break;
       }
-      count--;
-    } while (LL_RCC_IsRFUnderReset() != 0UL);
+    }
+    hsubghz->SpinCycles += timebase_elapsed(deadline.start);
 
     /* Asserts the reset signal of the Radio peripheral */
     LL_PWR_UnselectSUBGHZSPI_NSS();
@@ -237,7 +287,37 @@ HAL_StatusTypeDef HAL_SUBGHZ_Init(SUBGHZ_HandleTypeDef *hsubghz)
     /* Initialize SUBGHZSPI Peripheral */
     SUBGHZSPI_Init(hsubghz->Init.BaudratePrescaler);
 
-    hsubghz->DeepSleep = SUBGHZ_DEEP_SLEEP_ENABLE;
+    /* Initialize the DMA channels used for buffer transfers */
+    SUBGHZ_DMA_Init();
+    hsubghz->DmaTransfer = SUBGHZ_DMA_TRANSFER_NONE;
+    hsubghz->SpiBurst = SUBGHZ_SPI_BURST_ENABLE;
+
+    hsubghz->Radio.FallbackMode = SUBGHZ_RADIO_MODE_STANDBY_RC;
+    hsubghz->Radio.IrqMask = 0U;
+    hsubghz->Radio.RxContinuous = 0U;
+    hsubghz->Radio.WakeupSkipped = 0U;
+    hsubghz->Radio.StatusSkipped = 0U;
+    hsubghz->Radio.CommandSkipped = 0U;
+    hsubghz->IrqDeferred = 0U;
+
+    /* Register values are unknown until written or read again */
+    HAL_SUBGHZ_InvalidateRegCache(hsubghz);
+    hsubghz->RegCache.Hits = 0U;
+    hsubghz->RegCache.Misses = 0U;
+    hsubghz->RegCache.SavedBytes = 0U;
+
+    if (subghz_state == HAL_SUBGHZ_STATE_RESET)
+    {
+      /* Radio just left reset, it boots into standby RC: no wakeup needed */
+      hsubghz->Radio.Mode = SUBGHZ_RADIO_MODE_STANDBY_RC;
+      hsubghz->DeepSleep = SUBGHZ_DEEP_SLEEP_DISABLE;
+      hsubghz->Radio.WakeupSkipped++;
+    }
+    else
+    {
+      hsubghz->Radio.Mode = SUBGHZ_RADIO_MODE_UNKNOWN;
+      hsubghz->DeepSleep = SUBGHZ_DEEP_SLEEP_ENABLE;
+    }
     hsubghz->ErrorCode = HAL_SUBGHZ_ERROR_NONE;
   }
 
@@ -246,6 +326,58 @@ HAL_StatusTypeDef HAL_SUBGHZ_Init(SUBGHZ_HandleTypeDef *hsubghz)
   return status;
 }
 
+/**
+  * @brief  Switch SUBGHZSPI to the fastest baudrate prescaler the radio accepts.
+  * @note   The candidate is the smallest prescaler keeping SCK below
+  *         SUBGHZSPI_MAX_FREQ for the current PCLK3. It is kept only if a
+  *         pattern written to a scratch register reads back intact, otherwise
+  *         the next slower prescaler is tried. The scratch register is part of
+  *         the sync word and must be rewritten by the radio configuration.
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *         the handle information for SUBGHZ module.
+  * @retval HAL status, HAL_ERROR restores the previous prescaler
+  */
+HAL_StatusTypeDef HAL_SUBGHZ_ConfigFastestPrescaler(SUBGHZ_HandleTypeDef *hsubghz)
+{
+  LL_RCC_ClocksTypeDef clocks;
+  uint32_t previous = hsubghz->Init.BaudratePrescaler;
+  uint32_t prescaler = SUBGHZSPI_BAUDRATEPRESCALER_2;
+  uint32_t divider = 2U;
+
+  LL_RCC_GetSystemClocksFreq(&clocks);
+
+  while (((clocks.HCLK3_Frequency / divider) > SUBGHZSPI_MAX_FREQ) &&
+         (prescaler != SUBGHZSPI_BAUDRATEPRESCALER_256))
+  {
+    prescaler += SPI_CR1_BR_0;
+    divider <<= 1U;
+  }
+
+  for (;;)
+  {
+    SUBGHZSPI_Init(prescaler);
+    hsubghz->Init.BaudratePrescaler = prescaler;
+    hsubghz->ErrorCode = HAL_SUBGHZ_ERROR_NONE;
+
+    if ((SUBGHZ_TestPattern(hsubghz, 0x5AU) == HAL_OK) && (SUBGHZ_TestPattern(hsubghz, 0xA5U) == HAL_OK))
+    {
+      return HAL_OK;
+    }
+
+    if (prescaler == SUBGHZSPI_BAUDRATEPRESCALER_256)
+    {
+      break;
+    }
+    prescaler += SPI_CR1_BR_0;
+  }
+
+  SUBGHZSPI_Init(previous);
+  hsubghz->Init.BaudratePrescaler = previous;
+  hsubghz->ErrorCode = HAL_SUBGHZ_ERROR_NONE;
+
+  return HAL_ERROR;
+}
+
 /**
   * @brief  De-Initialize the SUBGHZ peripheral.
   * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
@@ -255,7 +387,7 @@ HAL_StatusTypeDef HAL_SUBGHZ_Init(SUBGHZ_HandleTypeDef *hsubghz)
 HAL_StatusTypeDef HAL_SUBGHZ_DeInit(SUBGHZ_HandleTypeDef *hsubghz)
 {
   HAL_StatusTypeDef status;
-  __IO uint32_t count;
+  deadline_t deadline;
 
   /* Check the SUBGHZ handle allocation */
   if (hsubghz == NULL)
@@ -285,6 +417,10 @@ HAL_StatusTypeDef HAL_SUBGHZ_DeInit(SUBGHZ_HandleTypeDef *hsubghz)
   /* Disable EXTI 44 : Radio IRQ ITs for CPU1 */
   LL_EXTI_DisableIT_32_63(LL_EXTI_LINE_44);
 
+  /* Disable EXTI 45 : Radio busy released */
+  LL_EXTI_DisableIT_32_63(LL_EXTI_LINE_45);
+  LL_EXTI_DisableFallingTrig_32_63(LL_EXTI_LINE_45);
+
   /* Disable wakeup signal of the Radio peripheral */
   LL_PWR_SetRadioBusyTrigger(LL_PWR_RADIO_BUSY_TRIGGER_NONE);
 #endif /* CM0PLUS */
@@ -296,18 +432,18 @@ HAL_StatusTypeDef HAL_SUBGHZ_DeInit(SUBGHZ_HandleTypeDef *hsubghz)
   LL_RCC_RF_EnableReset();
 
   /* Verify that Radio in reset status flag is set */
-  count  = SUBGHZ_DEFAULT_TIMEOUT * SUBGHZ_DEFAULT_LOOP_TIME;
+  deadline = deadline_from_ms(SUBGHZ_DEFAULT_TIMEOUT);
 
-  do
+  while (LL_RCC_IsRFUnderReset() != 1UL)
   {
-    if (count == 0U)
+    if (deadline_expired(&deadline))
     {
       status  = HAL_ERROR;
       hsubghz->ErrorCode = HAL_SUBGHZ_ERROR_TIMEOUT;
       break;
     }
-    count--;
-  } while (LL_RCC_IsRFUnderReset() != 1UL);
+  }
+  hsubghz->SpinCycles += timebase_elapsed(deadline.start);
 
   hsubghz->ErrorCode = HAL_SUBGHZ_ERROR_NONE;
   hsubghz->State     = HAL_SUBGHZ_STATE_RESET;
@@ -347,6 +483,12 @@ HAL_StatusTypeDef HAL_SUBGHZ_DeInit(SUBGHZ_HandleTypeDef *hsubghz)
             after finishing transfer.
        (++) Read operation: The read operation is performed using polling mode
             These APIs return the HAL status.
+       (++) DMA buffer operation: the payload of a buffer write or read is moved
+            by DMA1 through the SUBGHZSPI DMAMUX requests. The API returns once
+            the transfer is started, the handle stays locked until the transfer
+            completes and HAL_SUBGHZ_WriteBufferCpltCallback() or
+            HAL_SUBGHZ_ReadBufferCpltCallback() is called from
+            HAL_SUBGHZ_DMA_IRQHandler().
 
     (#) Blocking mode functions are :
         (++) HAL_SUBGHZ_ExecSetCmd(
@@ -358,6 +500,23 @@ HAL_StatusTypeDef HAL_SUBGHZ_DeInit(SUBGHZ_HandleTypeDef *hsubghz)
         (++) HAL_SUBGHZ_WriteRegister()
         (++) HAL_SUBGHZ_ReadRegister()
 
+    (#) Non-Blocking mode functions with DMA are :
+        (++) HAL_SUBGHZ_WriteBuffer_DMA()
+        (++) HAL_SUBGHZ_ReadBuffer_DMA()
+        They take longer than the blocking transfers from NSS low to the
+        callback, at any size; the CPU is free while the bytes move. The
+        completion interrupt does not wait on RFBUSY, the next access does.
+
+    (#) Non-Blocking mode function with RFBUSY interrupt is :
+        (++) HAL_SUBGHZ_ExecSetCmd_IT()
+
+    (#) Blocking mode function replaying a pre-encoded command script is :
+        (++) HAL_SUBGHZ_ExecScript()
+
+    (#) Register accesses go through a write-through cache of the registers
+        only the firmware writes (HAL_SUBGHZ_GetRegCache()): unchanged writes
+        and reads of known values do not reach the radio.
+
 @endverbatim
   * @{
   */
@@ -377,9 +536,20 @@ HAL_StatusTypeDef HAL_SUBGHZ_WriteRegisters(SUBGHZ_HandleTypeDef *hsubghz,
                                             uint16_t Size)
 {
   HAL_StatusTypeDef status;
+  uint8_t header[3U];
+
+  SUBGHZ_WaitOnDma(hsubghz);
 
   if (hsubghz->State == HAL_SUBGHZ_STATE_READY)
   {
+    /* Nothing to send if the radio already holds these values */
+    if (SUBGHZ_RegCacheMatch(hsubghz, Address, pBuffer, Size) != 0U)
+    {
+      hsubghz->RegCache.Hits++;
+      hsubghz->RegCache.SavedBytes += 3U + (uint32_t)Size;
+      return HAL_OK;
+    }
+
     /* Process Locked */
     __HAL_LOCK(hsubghz);
 
@@ -390,18 +560,17 @@ HAL_StatusTypeDef HAL_SUBGHZ_WriteRegisters(SUBGHZ_HandleTypeDef *hsubghz,
     /* NSS = 0 */
     LL_PWR_SelectSUBGHZSPI_NSS();
 
-    (void)SUBGHZSPI_Transmit(hsubghz, SUBGHZ_RADIO_WRITE_REGISTER);
-    (void)SUBGHZSPI_Transmit(hsubghz, (uint8_t)((Address & 0xFF00U) >> 8U));
-    (void)SUBGHZSPI_Transmit(hsubghz, (uint8_t)(Address & 0x00FFU));
+    header[0] = SUBGHZ_RADIO_WRITE_REGISTER;
+    header[1] = (uint8_t)((Address & 0xFF00U) >> 8U);
+    header[2] = (uint8_t)(Address & 0x00FFU);
 
-    for (uint16_t i = 0U; i < Size; i++)
-    {
-      (void)SUBGHZSPI_Transmit(hsubghz, pBuffer[i]);
-    }
+    (void)SUBGHZSPI_Transfer(hsubghz, header, 3U, pBuffer, NULL, Size);
 
     /* NSS = 1 */
     LL_PWR_UnselectSUBGHZSPI_NSS();
 
+    SUBGHZ_RegCacheStore(hsubghz, Address, pBuffer, Size);
+
     (void)SUBGHZ_WaitOnBusy(hsubghz);
 
     if (hsubghz->ErrorCode != HAL_SUBGHZ_ERROR_NONE)
@@ -441,10 +610,20 @@ HAL_StatusTypeDef HAL_SUBGHZ_ReadRegisters(SUBGHZ_HandleTypeDef *hsubghz,
                                            uint16_t Size)
 {
   HAL_StatusTypeDef status;
-  uint8_t *pData = pBuffer;
+  uint8_t header[4U];
+
+  SUBGHZ_WaitOnDma(hsubghz);
 
   if (hsubghz->State == HAL_SUBGHZ_STATE_READY)
   {
+    /* Firmware owned registers are known without asking the radio */
+    if (SUBGHZ_RegCacheLoad(hsubghz, Address, pBuffer, Size) != 0U)
+    {
+      hsubghz->RegCache.Hits++;
+      hsubghz->RegCache.SavedBytes += 4U + (uint32_t)Size;
+      return HAL_OK;
+    }
+
     /* Process Locked */
     __HAL_LOCK(hsubghz);
 
@@ -453,20 +632,18 @@ HAL_StatusTypeDef HAL_SUBGHZ_ReadRegisters(SUBGHZ_HandleTypeDef *hsubghz,
     /* NSS = 0 */
     LL_PWR_SelectSUBGHZSPI_NSS();
 
-    (void)SUBGHZSPI_Transmit(hsubghz, SUBGHZ_RADIO_READ_REGISTER);
-    (void)SUBGHZSPI_Transmit(hsubghz, (uint8_t)((Address & 0xFF00U) >> 8U));
-    (void)SUBGHZSPI_Transmit(hsubghz, (uint8_t)(Address & 0x00FFU));
-    (void)SUBGHZSPI_Transmit(hsubghz, 0U);
+    header[0] = SUBGHZ_RADIO_READ_REGISTER;
+    header[1] = (uint8_t)((Address & 0xFF00U) >> 8U);
+    header[2] = (uint8_t)(Address & 0x00FFU);
+    header[3] = 0U;
 
-    for (uint16_t i = 0U; i < Size; i++)
-    {
-      (void)SUBGHZSPI_Receive(hsubghz, (pData));
-      pData++;
-    }
+    (void)SUBGHZSPI_Transfer(hsubghz, header, 4U, NULL, pBuffer, Size);
 
     /* NSS = 1 */
     LL_PWR_UnselectSUBGHZSPI_NSS();
 
+    SUBGHZ_RegCacheStore(hsubghz, Address, pBuffer, Size);
+
     (void)SUBGHZ_WaitOnBusy(hsubghz);
 
     if (hsubghz->ErrorCode != HAL_SUBGHZ_ERROR_NONE)
@@ -536,12 +713,22 @@ HAL_StatusTypeDef HAL_SUBGHZ_ExecSetCmd(SUBGHZ_HandleTypeDef *hsubghz,
                                         uint16_t Size)
 {
   HAL_StatusTypeDef status;
+  uint8_t opcode;
 
   /* LORA Modulation not available on STM32WLx4xx devices */
   assert_param(IS_SUBGHZ_MODULATION_SUPPORTED(Command, pBuffer[0U]));
 
+  SUBGHZ_WaitOnDma(hsubghz);
+
   if (hsubghz->State == HAL_SUBGHZ_STATE_READY)
   {
+    /* Nothing to send if the radio is already in the requested mode */
+    if (SUBGHZ_ShadowCmdInEffect(hsubghz, Command, pBuffer, Size) != 0U)
+    {
+      hsubghz->Radio.CommandSkipped++;
+      return HAL_OK;
+    }
+
     /* Process Locked */
     __HAL_LOCK(hsubghz);
 
@@ -560,16 +747,15 @@ HAL_StatusTypeDef HAL_SUBGHZ_ExecSetCmd(SUBGHZ_HandleTypeDef *hsubghz,
     /* NSS = 0 */
     LL_PWR_SelectSUBGHZSPI_NSS();
 
-    (void)SUBGHZSPI_Transmit(hsubghz, (uint8_t)Command);
+    opcode = (uint8_t)Command;
 
-    for (uint16_t i = 0U; i < Size; i++)
-    {
-      (void)SUBGHZSPI_Transmit(hsubghz, pBuffer[i]);
-    }
+    (void)SUBGHZSPI_Transfer(hsubghz, &opcode, 1U, pBuffer, NULL, Size);
 
     /* NSS = 1 */
     LL_PWR_UnselectSUBGHZSPI_NSS();
 
+    SUBGHZ_ShadowUpdate(hsubghz, Command, pBuffer, Size);
+
     if (Command != RADIO_SET_SLEEP)
     {
       (void)SUBGHZ_WaitOnBusy(hsubghz);
@@ -597,6 +783,240 @@ HAL_StatusTypeDef HAL_SUBGHZ_ExecSetCmd(SUBGHZ_HandleTypeDef *hsubghz,
   }
 }
 
+/**
+  * @brief  Send a command to configure the peripheral without waiting for the
+  *         radio to process it.
+  * @note   The call returns as soon as the command is on the bus. The radio
+  *         keeps RFBUSY high while it executes the command, its falling edge
+  *         (EXTI line 45) calls HAL_SUBGHZ_CmdCpltCallback() from
+  *         HAL_SUBGHZ_RFBUSY_IRQHandler(). Any following SUBGHZ operation still
+  *         waits for RFBUSY before touching the bus.
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *         the configuration information for the specified SUBGHZ.
+  * @param  Command configuration for peripheral
+  * @param  pBuffer pointer to a data buffer
+  * @param  Size    amount of data to be sent
+  * @retval HAL status
+  */
+HAL_StatusTypeDef HAL_SUBGHZ_ExecSetCmd_IT(SUBGHZ_HandleTypeDef *hsubghz,
+                                           SUBGHZ_RadioSetCmd_t Command,
+                                           uint8_t *pBuffer,
+                                           uint16_t Size)
+{
+  HAL_StatusTypeDef status;
+  uint8_t opcode;
+
+  /* LORA Modulation not available on STM32WLx4xx devices */
+  assert_param(IS_SUBGHZ_MODULATION_SUPPORTED(Command, pBuffer[0U]));
+
+  SUBGHZ_WaitOnDma(hsubghz);
+
+  if (hsubghz->State == HAL_SUBGHZ_STATE_READY)
+  {
+    /* Nothing to send if the radio is already in the requested mode */
+    if (SUBGHZ_ShadowCmdInEffect(hsubghz, Command, pBuffer, Size) != 0U)
+    {
+      hsubghz->Radio.CommandSkipped++;
+      return HAL_OK;
+    }
+
+    /* Process Locked */
+    __HAL_LOCK(hsubghz);
+
+    /* Need to wakeup Radio if already in Sleep at startup */
+    (void)SUBGHZ_CheckDeviceReady(hsubghz);
+
+    if ((Command == RADIO_SET_SLEEP) || (Command == RADIO_SET_RXDUTYCYCLE))
+    {
+      hsubghz->DeepSleep = SUBGHZ_DEEP_SLEEP_ENABLE;
+    }
+    else
+    {
+      hsubghz->DeepSleep = SUBGHZ_DEEP_SLEEP_DISABLE;
+    }
+
+    /* Armed before NSS rises so the RFBUSY edge cannot be missed */
+    hsubghz->BusyPending = (Command != RADIO_SET_SLEEP) ? 1U : 0U;
+
+    /* NSS = 0 */
+    LL_PWR_SelectSUBGHZSPI_NSS();
+
+    opcode = (uint8_t)Command;
+
+    (void)SUBGHZSPI_Transfer(hsubghz, &opcode, 1U, pBuffer, NULL, Size);
+
+    /* NSS = 1 */
+    LL_PWR_UnselectSUBGHZSPI_NSS();
+
+    SUBGHZ_ShadowUpdate(hsubghz, Command, pBuffer, Size);
+
+    if (hsubghz->ErrorCode != HAL_SUBGHZ_ERROR_NONE)
+    {
+      status = HAL_ERROR;
+    }
+    else
+    {
+      status = HAL_OK;
+    }
+
+    hsubghz->State = HAL_SUBGHZ_STATE_READY;
+
+    /* Process Unlocked */
+    __HAL_UNLOCK(hsubghz);
+
+    return status;
+  }
+  else
+  {
+    return HAL_BUSY;
+  }
+}
+
+/**
+  * @brief  Check whether a command sent with HAL_SUBGHZ_ExecSetCmd_IT() is
+  *         still being processed by the radio.
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *         the configuration information for the specified SUBGHZ.
+  * @retval 1 while the radio is busy with the command, 0 otherwise
+  */
+uint32_t HAL_SUBGHZ_IsCmdPending(SUBGHZ_HandleTypeDef *hsubghz)
+{
+  if ((hsubghz->BusyPending != 0U) && (SUBGHZ_IsRadioBusy() == 0U))
+  {
+    hsubghz->BusyPending = 0U;
+  }
+  return hsubghz->BusyPending;
+}
+
+/**
+  * @brief  Replay a pre-encoded command script in a single pass
+  * @note   Each frame holds the exact bytes of one command, register or buffer
+  *         access, so nothing is encoded at run time. The radio is woken up
+  *         once, and RFBUSY is only awaited ahead of the next frame: polled
+  *         after SUBGHZ_SCRIPT_SPIN frames, slept on after SUBGHZ_SCRIPT_SLEEP
+  *         ones. The last frame is not awaited, the next access does it.
+  *         Mode commands already in effect are skipped as in
+  *         HAL_SUBGHZ_ExecSetCmd().
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *         the configuration information for the specified SUBGHZ.
+  * @param  pScript pointer to the script, usually a const array in flash
+  * @param  Size    script size in bytes
+  * @retval HAL status
+  */
+HAL_StatusTypeDef HAL_SUBGHZ_ExecScript(SUBGHZ_HandleTypeDef *hsubghz, const uint8_t *pScript, uint16_t Size)
+{
+  HAL_StatusTypeDef status;
+  SUBGHZ_RadioSetCmd_t command;
+  const uint8_t *frame;
+  uint32_t offset;
+  uint32_t sent;
+  uint16_t address;
+  uint8_t length;
+  uint8_t flags;
+  uint8_t wait;
+
+  SUBGHZ_WaitOnDma(hsubghz);
+
+  if (hsubghz->State == HAL_SUBGHZ_STATE_READY)
+  {
+    /* Process Locked */
+    __HAL_LOCK(hsubghz);
+
+    hsubghz->State = HAL_SUBGHZ_STATE_BUSY;
+
+    /* Need to wakeup Radio if already in Sleep at startup */
+    (void)SUBGHZ_CheckDeviceReady(hsubghz);
+
+    status = HAL_OK;
+    wait = SUBGHZ_SCRIPT_SPIN;
+    sent = 0U;
+    offset = 0U;
+
+    while ((offset < Size) && (hsubghz->ErrorCode == HAL_SUBGHZ_ERROR_NONE))
+    {
+      length = pScript[offset];
+      if ((length == 0U) || ((offset + SUBGHZ_SCRIPT_FRAME_HEADER + length) > Size))
+      {
+        /* Malformed script, stop before sending a truncated frame */
+        status = HAL_ERROR;
+        break;
+      }
+      flags = pScript[offset + 1U];
+      frame = &pScript[offset + SUBGHZ_SCRIPT_FRAME_HEADER];
+      offset += SUBGHZ_SCRIPT_FRAME_HEADER + length;
+
+      command = (SUBGHZ_RadioSetCmd_t)frame[0U];
+      if (SUBGHZ_ShadowCmdInEffect(hsubghz, command, &frame[1U], (uint16_t)(length - 1U)) != 0U)
+      {
+        hsubghz->Radio.CommandSkipped++;
+        continue;
+      }
+      if (((uint8_t)command == SUBGHZ_RADIO_WRITE_REGISTER) && (length > 3U))
+      {
+        address = (uint16_t)(((uint16_t)frame[1U] << 8U) | frame[2U]);
+        if (SUBGHZ_RegCacheMatch(hsubghz, address, &frame[3U], (uint16_t)(length - 3U)) != 0U)
+        {
+          hsubghz->RegCache.Hits++;
+          hsubghz->RegCache.SavedBytes += length;
+          continue;
+        }
+        SUBGHZ_RegCacheStore(hsubghz, address, &frame[3U], (uint16_t)(length - 3U));
+      }
+
+      /* The radio takes a new frame only once done with the previous one */
+      if (sent != 0U)
+      {
+        if (wait == SUBGHZ_SCRIPT_SLEEP)
+        {
+          (void)SUBGHZ_WaitOnBusy(hsubghz);
+        }
+        else
+        {
+          (void)SUBGHZ_SpinOnBusy(hsubghz);
+        }
+      }
+
+      if ((command == RADIO_SET_SLEEP) || (command == RADIO_SET_RXDUTYCYCLE))
+      {
+        hsubghz->DeepSleep = SUBGHZ_DEEP_SLEEP_ENABLE;
+      }
+      else
+      {
+        hsubghz->DeepSleep = SUBGHZ_DEEP_SLEEP_DISABLE;
+      }
+
+      /* NSS = 0 */
+      LL_PWR_SelectSUBGHZSPI_NSS();
+
+      (void)SUBGHZSPI_TransmitReceive(hsubghz, frame, NULL, length);
+
+      /* NSS = 1 */
+      LL_PWR_UnselectSUBGHZSPI_NSS();
+
+      SUBGHZ_ShadowUpdate(hsubghz, command, &frame[1U], (uint16_t)(length - 1U));
+
+      wait = flags;
+      sent++;
+    }
+
+    if (hsubghz->ErrorCode != HAL_SUBGHZ_ERROR_NONE)
+    {
+      status = HAL_ERROR;
+    }
+
+    hsubghz->State = HAL_SUBGHZ_STATE_READY;
+
+    /* Process Unlocked */
+    __HAL_UNLOCK(hsubghz);
+
+    return status;
+  }
+  else
+  {
+    return HAL_BUSY;
+  }
+}
+
 /**
   * @brief  Retrieve a status from the peripheral
   * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
@@ -612,7 +1032,9 @@ HAL_StatusTypeDef HAL_SUBGHZ_ExecGetCmd(SUBGHZ_HandleTypeDef *hsubghz,
                                         uint16_t Size)
 {
   HAL_StatusTypeDef status;
-  uint8_t *pData = pBuffer;
+  uint8_t opcode;
+
+  SUBGHZ_WaitOnDma(hsubghz);
 
   if (hsubghz->State == HAL_SUBGHZ_STATE_READY)
   {
@@ -624,16 +1046,12 @@ HAL_StatusTypeDef HAL_SUBGHZ_ExecGetCmd(SUBGHZ_HandleTypeDef *hsubghz,
     /* NSS = 0 */
     LL_PWR_SelectSUBGHZSPI_NSS();
 
-    (void)SUBGHZSPI_Transmit(hsubghz, (uint8_t)Command);
+    opcode = (uint8_t)Command;
 
     /* Use to flush the Status (First byte) receive from SUBGHZ as not use */
     // (void)SUBGHZSPI_Transmit(hsubghz, 0x00U);
 
-    for (uint16_t i = 0U; i < Size; i++)
-    {
-      (void)SUBGHZSPI_Receive(hsubghz, (pData));
-      pData++;
-    }
+    (void)SUBGHZSPI_Transfer(hsubghz, &opcode, 1U, NULL, pBuffer, Size);
 
     /* NSS = 1 */
     LL_PWR_UnselectSUBGHZSPI_NSS();
@@ -677,6 +1095,9 @@ HAL_StatusTypeDef HAL_SUBGHZ_WriteBuffer(SUBGHZ_HandleTypeDef *hsubghz,
                                          uint16_t Size)
 {
   HAL_StatusTypeDef status;
+  uint8_t header[2U];
+
+  SUBGHZ_WaitOnDma(hsubghz);
 
   if (hsubghz->State == HAL_SUBGHZ_STATE_READY)
   {
@@ -688,13 +1109,10 @@ HAL_StatusTypeDef HAL_SUBGHZ_WriteBuffer(SUBGHZ_HandleTypeDef *hsubghz,
     /* NSS = 0 */
     LL_PWR_SelectSUBGHZSPI_NSS();
 
-    (void)SUBGHZSPI_Transmit(hsubghz, SUBGHZ_RADIO_WRITE_BUFFER);
-    (void)SUBGHZSPI_Transmit(hsubghz, Offset);
+    header[0] = SUBGHZ_RADIO_WRITE_BUFFER;
+    header[1] = Offset;
 
-    for (uint16_t i = 0U; i < Size; i++)
-    {
-      (void)SUBGHZSPI_Transmit(hsubghz, pBuffer[i]);
-    }
+    (void)SUBGHZSPI_Transfer(hsubghz, header, 2U, pBuffer, NULL, Size);
     /* NSS = 1 */
     LL_PWR_UnselectSUBGHZSPI_NSS();
 
@@ -737,7 +1155,9 @@ HAL_StatusTypeDef HAL_SUBGHZ_ReadBuffer(SUBGHZ_HandleTypeDef *hsubghz,
                                         uint16_t Size)
 {
   HAL_StatusTypeDef status;
-  uint8_t *pData = pBuffer;
+  uint8_t header[2U];
+
+  SUBGHZ_WaitOnDma(hsubghz);
 
   if (hsubghz->State == HAL_SUBGHZ_STATE_READY)
   {
@@ -749,15 +1169,12 @@ HAL_StatusTypeDef HAL_SUBGHZ_ReadBuffer(SUBGHZ_HandleTypeDef *hsubghz,
     /* NSS = 0 */
     LL_PWR_SelectSUBGHZSPI_NSS();
 
-    (void)SUBGHZSPI_Transmit(hsubghz, SUBGHZ_RADIO_READ_BUFFER);
-    (void)SUBGHZSPI_Transmit(hsubghz, Offset);
+    header[0] = SUBGHZ_RADIO_READ_BUFFER;
+    header[1] = Offset;
+
     // (void)SUBGHZSPI_Transmit(hsubghz, 0x00U);
 
-    for (uint16_t i = 0U; i < Size; i++)
-    {
-      (void)SUBGHZSPI_Receive(hsubghz, (pData));
-      pData++;
-    }
+    (void)SUBGHZSPI_Transfer(hsubghz, header, 2U, NULL, pBuffer, Size);
 
     /* NSS = 1 */
     LL_PWR_UnselectSUBGHZSPI_NSS();
@@ -787,352 +1204,1263 @@ HAL_StatusTypeDef HAL_SUBGHZ_ReadBuffer(SUBGHZ_HandleTypeDef *hsubghz,
 }
 
 /**
-  * @brief  Handle SUBGHZ interrupt request.
+  * @brief  Write data buffer inside payload of peripheral with DMA
   * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
-  *               the configuration information for the specified SUBGHZ module.
-  * @retval None
+  *         the configuration information for the specified SUBGHZ.
+  * @param  Offset  Offset inside payload
+  * @param  pBuffer pointer to a data buffer, must stay valid until
+  *         HAL_SUBGHZ_WriteBufferCpltCallback() is called
+  * @param  Size    amount of data to be sent
+  * @retval HAL status
   */
-void HAL_SUBGHZ_IRQHandler(SUBGHZ_HandleTypeDef *hsubghz)
+HAL_StatusTypeDef HAL_SUBGHZ_WriteBuffer_DMA(SUBGHZ_HandleTypeDef *hsubghz,
+                                             uint8_t Offset,
+                                             uint8_t *pBuffer,
+                                             uint16_t Size)
 {
-  uint8_t tmpisr[3U] = {0U};
-  uint16_t itsource;
-
-  /* Retrieve Interrupts from SUBGHZ Irq Register */
-  HAL_SUBGHZ_ExecGetCmd(hsubghz, RADIO_GET_IRQSTATUS, tmpisr, 3U);
-  itsource = tmpisr[1U];
-  itsource = (itsource << 8U) | tmpisr[2U];
-
-  printf_("irqstatus = %#04x\r\n", itsource);
-
-  /* Clear SUBGHZ Irq Register */
-  HAL_SUBGHZ_ExecSetCmd(hsubghz, RADIO_CLR_IRQSTATUS, tmpisr+1, 2U);
+  uint8_t header[2U];
 
-  // if there is an error, don't do anything else
-  if (SUBGHZ_CHECK_IT_SOURCE(itsource, SUBGHZ_IRQ_ERROR) != RESET)
+  if ((pBuffer == NULL) || (Size == 0U))
   {
-    // if you need more info about the error source, look at the packet status
-    return;
+    return HAL_ERROR;
   }
 
-  /* Packet transmission completed Interrupt */
-  if (SUBGHZ_CHECK_IT_SOURCE(itsource, SUBGHZ_IRQ_TXDONE) != RESET)
-  {
-    // do something
-  }
+  SUBGHZ_WaitOnDma(hsubghz);
 
-  /* Packet received Interrupt */
-  if (SUBGHZ_CHECK_IT_SOURCE(itsource, SUBGHZ_IRQ_RXDONE) != RESET)
+  if (hsubghz->State == HAL_SUBGHZ_STATE_READY)
   {
-    // do something
-    uint8_t packet_status[4];
-    // subghz_radio_getstatus();
-    subghz_radio_getPacketStatus(packet_status, true);
-    LL_GPIO_TogglePin(LED1_GPIO_Port, LED1_Pin);
-    subghz_read_rx_buffer();
-  }
+    /* Process Locked, released in HAL_SUBGHZ_DMA_IRQHandler() */
+    __HAL_LOCK(hsubghz);
 
-  /* Preamble Detected Interrupt */
-  if (SUBGHZ_CHECK_IT_SOURCE(itsource, SUBGHZ_IRQ_PREAMBLE_DETECTED) != RESET)
-  {
-    // do something
-  }
+    hsubghz->State = HAL_SUBGHZ_STATE_BUSY;
+    hsubghz->DmaTransfer = SUBGHZ_DMA_TRANSFER_WRITE;
+
+    (void)SUBGHZ_CheckDeviceReady(hsubghz);
+
+    /* NSS = 0 */
+    LL_PWR_SelectSUBGHZSPI_NSS();
+
+    header[0] = SUBGHZ_RADIO_WRITE_BUFFER;
+    header[1] = Offset;
+    (void)SUBGHZSPI_TransmitReceive(hsubghz, header, NULL, 2U);
+
+    /* Payload goes out of pBuffer, received bytes are discarded */
+    hsubghz->SpiBytes += Size;
+    SUBGHZ_DMA_Start(pBuffer, LL_DMA_MEMORY_INCREMENT, &subghz_dma_sink, LL_DMA_MEMORY_NOINCREMENT, Size);
+
+    return HAL_OK;
+  }
+  else
+  {
+    return HAL_BUSY;
+  }
+}
+
+/**
+  * @brief  Read data buffer inside payload of peripheral with DMA
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *         the configuration information for the specified SUBGHZ.
+  * @param  Offset  Offset inside payload
+  * @param  pBuffer pointer to a data buffer, content is valid once
+  *         HAL_SUBGHZ_ReadBufferCpltCallback() is called
+  * @param  Size    amount of data to be received
+  * @retval HAL status
+  */
+HAL_StatusTypeDef HAL_SUBGHZ_ReadBuffer_DMA(SUBGHZ_HandleTypeDef *hsubghz,
+                                            uint8_t Offset,
+                                            uint8_t *pBuffer,
+                                            uint16_t Size)
+{
+  uint8_t header[2U];
+
+  if ((pBuffer == NULL) || (Size == 0U))
+  {
+    return HAL_ERROR;
+  }
+
+  SUBGHZ_WaitOnDma(hsubghz);
+
+  if (hsubghz->State == HAL_SUBGHZ_STATE_READY)
+  {
+    /* Process Locked, released in HAL_SUBGHZ_DMA_IRQHandler() */
+    __HAL_LOCK(hsubghz);
+
+    hsubghz->State = HAL_SUBGHZ_STATE_BUSY;
+    hsubghz->DmaTransfer = SUBGHZ_DMA_TRANSFER_READ;
+
+    (void)SUBGHZ_CheckDeviceReady(hsubghz);
+
+    /* NSS = 0 */
+    LL_PWR_SelectSUBGHZSPI_NSS();
+
+    header[0] = SUBGHZ_RADIO_READ_BUFFER;
+    header[1] = Offset;
+    (void)SUBGHZSPI_TransmitReceive(hsubghz, header, NULL, 2U);
+
+    /* Dummy bytes go out, payload is stored in pBuffer */
+    hsubghz->SpiBytes += Size;
+    SUBGHZ_DMA_Start((uint8_t *)&subghz_dma_dummy_tx, LL_DMA_MEMORY_NOINCREMENT, pBuffer, LL_DMA_MEMORY_INCREMENT,
+                     Size);
+
+    return HAL_OK;
+  }
+  else
+  {
+    return HAL_BUSY;
+  }
+}
+
+/**
+  * @brief  Handle SUBGHZ interrupt request.
+  * @note   When the interrupt preempts a HAL call holding the handle lock,
+  *         the radio IRQ is masked and left pending instead of failing its
+  *         SPI accesses: HAL_SUBGHZ_ResumeIRQ() unmasks it once the lock is
+  *         released. The entry time stays the one of the first attempt.
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *               the configuration information for the specified SUBGHZ module.
+  * @retval None
+  */
+void HAL_SUBGHZ_IRQHandler(SUBGHZ_HandleTypeDef *hsubghz)
+{
+  uint8_t tmpisr[3U] = {0U};
+  uint16_t itsource;
+
+  /* Time reference for the callbacks, taken before any SPI access */
+  if (hsubghz->IrqDeferred == 0U)
+  {
+    hsubghz->IrqCycles = timebase_now();
+  }
+
+  if (hsubghz->Lock == HAL_LOCKED)
+  {
+    hsubghz->IrqDeferred = 1U;
+    NVIC_DisableIRQ(SUBGHZ_Radio_IRQn);
+    return;
+  }
+  hsubghz->IrqDeferred = 0U;
+
+  /* A radio raising an IRQ out of sniff mode is awake, no NSS pulse needed */
+  if ((hsubghz->DeepSleep == SUBGHZ_DEEP_SLEEP_ENABLE) &&
+      (hsubghz->Radio.Mode == SUBGHZ_RADIO_MODE_RX_DUTYCYCLE))
+  {
+    hsubghz->DeepSleep = SUBGHZ_DEEP_SLEEP_DISABLE;
+    hsubghz->Radio.Mode = SUBGHZ_RADIO_MODE_RX;
+    hsubghz->Radio.WakeupSkipped++;
+  }
+
+  /* Retrieve Interrupts from SUBGHZ Irq Register */
+  HAL_SUBGHZ_ExecGetCmd(hsubghz, RADIO_GET_IRQSTATUS, tmpisr, 3U);
+  itsource = tmpisr[1U];
+  itsource = (itsource << 8U) | tmpisr[2U];
+
+  /* End of TX, of a single RX or timeout: the radio is in its fallback mode */
+  if ((SUBGHZ_CHECK_IT_SOURCE(itsource, SUBGHZ_IRQ_TXDONE) != RESET) ||
+      (SUBGHZ_CHECK_IT_SOURCE(itsource, SUBGHZ_IRQ_RX_TX_TIMEOUT) != RESET) ||
+      ((SUBGHZ_CHECK_IT_SOURCE(itsource, SUBGHZ_IRQ_RXDONE) != RESET) && (hsubghz->Radio.RxContinuous == 0U)))
+  {
+    hsubghz->Radio.Mode = hsubghz->Radio.FallbackMode;
+  }
+
+  /* Clear SUBGHZ Irq Register */
+  HAL_SUBGHZ_ExecSetCmd(hsubghz, RADIO_CLR_IRQSTATUS, tmpisr+1, 2U);
+
+  // if there is an error, don't do anything else
+  if (SUBGHZ_CHECK_IT_SOURCE(itsource, SUBGHZ_IRQ_ERROR) != RESET)
+  {
+    // if you need more info about the error source, look at the packet status
+    HAL_SUBGHZ_CRCErrorCallback(hsubghz);
+    return;
+  }
+
+  /* Packet transmission completed Interrupt */
+  if (SUBGHZ_CHECK_IT_SOURCE(itsource, SUBGHZ_IRQ_TXDONE) != RESET)
+  {
+    HAL_SUBGHZ_TxCpltCallback(hsubghz);
+  }
+
+  /* Packet received Interrupt */
+  if (SUBGHZ_CHECK_IT_SOURCE(itsource, SUBGHZ_IRQ_RXDONE) != RESET)
+  {
+    HAL_SUBGHZ_RxCpltCallback(hsubghz);
+  }
+
+  /* Preamble Detected Interrupt */
+  if (SUBGHZ_CHECK_IT_SOURCE(itsource, SUBGHZ_IRQ_PREAMBLE_DETECTED) != RESET)
+  {
+    HAL_SUBGHZ_PreambleDetectedCallback(hsubghz);
+  }
 
   /*  Valid sync word detected Interrupt */
   if (SUBGHZ_CHECK_IT_SOURCE(itsource, SUBGHZ_IRQ_SYNCWORD_VALID) != RESET)
   {
-    // do something
+    HAL_SUBGHZ_SyncWordValidCallback(hsubghz);
   }
 
   /* Rx or Tx Timeout Interrupt */
   if (SUBGHZ_CHECK_IT_SOURCE(itsource, SUBGHZ_IRQ_RX_TX_TIMEOUT) != RESET)
   {
-    // do something
+    HAL_SUBGHZ_RxTxTimeoutCallback(hsubghz);
+  }
+}
+
+/**
+  * @brief  Unmask a radio IRQ deferred by HAL_SUBGHZ_IRQHandler().
+  * @note   To be called from thread mode, e.g. from the main loop, the pending
+  *         IRQ is then served as soon as this returns.
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *               the configuration information for the specified SUBGHZ module.
+  * @retval None
+  */
+void HAL_SUBGHZ_ResumeIRQ(SUBGHZ_HandleTypeDef *hsubghz)
+{
+  if ((hsubghz->IrqDeferred != 0U) && (hsubghz->Lock == HAL_UNLOCKED))
+  {
+    NVIC_EnableIRQ(SUBGHZ_Radio_IRQn);
+  }
+}
+
+/**
+  * @brief  Handle SUBGHZ DMA interrupt request.
+  * @note   Called from the interrupt handler of SUBGHZ_DMA_RX_CHANNEL. The RX
+  *         channel completes after the last byte has been clocked on the bus,
+  *         so it marks the end of both buffer writes and buffer reads. The bus
+  *         and the handle are released here without waiting on RFBUSY.
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *               the configuration information for the specified SUBGHZ module.
+  * @retval None
+  */
+void HAL_SUBGHZ_DMA_IRQHandler(SUBGHZ_HandleTypeDef *hsubghz)
+{
+  uint8_t transfer;
+
+  if (LL_DMA_IsActiveFlag_TE1(DMA1) != 0UL)
+  {
+    hsubghz->ErrorCode = HAL_SUBGHZ_ERROR_DMA;
+  }
+  else if (LL_DMA_IsActiveFlag_TC1(DMA1) == 0UL)
+  {
+    return;
+  }
+  LL_DMA_ClearFlag_GI1(DMA1);
+
+  /* Stop the SUBGHZSPI requests before releasing the bus */
+  LL_SPI_DisableDMAReq_TX(SUBGHZSPI);
+  LL_DMA_DisableChannel(DMA1, SUBGHZ_DMA_TX_CHANNEL);
+  LL_DMA_DisableChannel(DMA1, SUBGHZ_DMA_RX_CHANNEL);
+  LL_SPI_DisableDMAReq_RX(SUBGHZSPI);
+
+  /* NSS = 1. RFBUSY is left to the next access, every one starts with
+     SUBGHZ_CheckDeviceReady() */
+  LL_PWR_UnselectSUBGHZSPI_NSS();
+
+  transfer = hsubghz->DmaTransfer;
+  hsubghz->DmaTransfer = SUBGHZ_DMA_TRANSFER_NONE;
+  hsubghz->State = HAL_SUBGHZ_STATE_READY;
+
+  /* Process Unlocked */
+  __HAL_UNLOCK(hsubghz);
+
+  if (transfer == SUBGHZ_DMA_TRANSFER_WRITE)
+  {
+    HAL_SUBGHZ_WriteBufferCpltCallback(hsubghz);
+  }
+  else if (transfer == SUBGHZ_DMA_TRANSFER_READ)
+  {
+    HAL_SUBGHZ_ReadBufferCpltCallback(hsubghz);
+  }
+  else
+  {
+    /* Spurious request, nothing to report */
+  }
+
+  /* A radio IRQ that came in during the transfer is served now */
+  HAL_SUBGHZ_ResumeIRQ(hsubghz);
+}
+
+/**
+  * @brief  Handle the radio busy released interrupt (EXTI line 45).
+  * @note   Shares the SUBGHZ_Radio vector with the radio IRQ. Call it when the
+  *         EXTI line 45 flag is set, the radio IRQ is a level and re-enters the
+  *         vector on its own if it is asserted too.
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *               the configuration information for the specified SUBGHZ module.
+  * @retval None
+  */
+void HAL_SUBGHZ_RFBUSY_IRQHandler(SUBGHZ_HandleTypeDef *hsubghz)
+{
+  LL_EXTI_ClearFlag_32_63(LL_EXTI_LINE_45);
+  LL_PWR_ClearFlag_RFBUSY();
+
+  /* Synchronous waiters re-check RFBUSY themselves once woken up */
+  if ((hsubghz->BusyPending != 0U) && (SUBGHZ_IsRadioBusy() == 0U))
+  {
+    hsubghz->BusyPending = 0U;
+    HAL_SUBGHZ_CmdCpltCallback(hsubghz);
+  }
+}
+
+/**
+  * @brief  Packet transmission completed callback.
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *               the configuration information for the specified SUBGHZ module.
+  * @retval None
+  */
+__WEAK void HAL_SUBGHZ_TxCpltCallback(SUBGHZ_HandleTypeDef *hsubghz)
+{
+  /* Prevent unused argument(s) compilation warning */
+  (void)hsubghz;
+}
+
+/**
+  * @brief  Packet received callback.
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *               the configuration information for the specified SUBGHZ module.
+  * @retval None
+  */
+__WEAK void HAL_SUBGHZ_RxCpltCallback(SUBGHZ_HandleTypeDef *hsubghz)
+{
+  /* Prevent unused argument(s) compilation warning */
+  (void)hsubghz;
+}
+
+/**
+  * @brief  Preamble detected callback.
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *               the configuration information for the specified SUBGHZ module.
+  * @retval None
+  */
+__WEAK void HAL_SUBGHZ_PreambleDetectedCallback(SUBGHZ_HandleTypeDef *hsubghz)
+{
+  /* Prevent unused argument(s) compilation warning */
+  (void)hsubghz;
+}
+
+/**
+  * @brief  Valid sync word detected callback.
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *               the configuration information for the specified SUBGHZ module.
+  * @retval None
+  */
+__WEAK void HAL_SUBGHZ_SyncWordValidCallback(SUBGHZ_HandleTypeDef *hsubghz)
+{
+  /* Prevent unused argument(s) compilation warning */
+  (void)hsubghz;
+}
+
+/**
+  * @brief  Packet received with a CRC error callback.
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *               the configuration information for the specified SUBGHZ module.
+  * @retval None
+  */
+__WEAK void HAL_SUBGHZ_CRCErrorCallback(SUBGHZ_HandleTypeDef *hsubghz)
+{
+  /* Prevent unused argument(s) compilation warning */
+  (void)hsubghz;
+}
+
+/**
+  * @brief  RX or TX timeout callback.
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *               the configuration information for the specified SUBGHZ module.
+  * @retval None
+  */
+__WEAK void HAL_SUBGHZ_RxTxTimeoutCallback(SUBGHZ_HandleTypeDef *hsubghz)
+{
+  /* Prevent unused argument(s) compilation warning */
+  (void)hsubghz;
+}
+
+/**
+  * @brief  Command sent with HAL_SUBGHZ_ExecSetCmd_IT() processed callback.
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *               the configuration information for the specified SUBGHZ module.
+  * @retval None
+  */
+__WEAK void HAL_SUBGHZ_CmdCpltCallback(SUBGHZ_HandleTypeDef *hsubghz)
+{
+  /* Prevent unused argument(s) compilation warning */
+  (void)hsubghz;
+}
+
+/**
+  * @brief  Buffer write through DMA completed callback.
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *               the configuration information for the specified SUBGHZ module.
+  * @retval None
+  */
+__WEAK void HAL_SUBGHZ_WriteBufferCpltCallback(SUBGHZ_HandleTypeDef *hsubghz)
+{
+  /* Prevent unused argument(s) compilation warning */
+  (void)hsubghz;
+}
+
+/**
+  * @brief  Buffer read through DMA completed callback.
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *               the configuration information for the specified SUBGHZ module.
+  * @retval None
+  */
+__WEAK void HAL_SUBGHZ_ReadBufferCpltCallback(SUBGHZ_HandleTypeDef *hsubghz)
+{
+  /* Prevent unused argument(s) compilation warning */
+  (void)hsubghz;
+}
+
+/**
+  * @}
+  */
+
+/** @defgroup SUBGHZ_Exported_Functions_Group3 Peripheral State and Errors functions
+  * @brief   SUBGHZ control functions
+  *
+@verbatim
+ ===============================================================================
+                      ##### Peripheral State and Errors functions #####
+ ===============================================================================
+    [..]
+    This subsection provides a set of functions allowing to control the SUBGHZ.
+     (+) HAL_SUBGHZ_GetState() API can be helpful to check in run-time the state of the SUBGHZ peripheral
+     (+) HAL_SUBGHZ_GetError() check in run-time Errors occurring during communication
+     (+) HAL_SUBGHZ_GetSpinCycles() measure the CPU time spent waiting on the radio
+     (+) HAL_SUBGHZ_GetSpiBytes() count the bytes exchanged with the radio
+     (+) HAL_SUBGHZ_GetRadioMode() get the radio mode, without SPI access when known
+     (+) HAL_SUBGHZ_GetRadioShadow() get the radio state shadow and its counters
+     (+) HAL_SUBGHZ_GetRegCache() get the register cache and its hit/miss counters
+     (+) HAL_SUBGHZ_InvalidateRegCache() forget the cached register values
+@endverbatim
+  * @{
+  */
+
+/**
+  * @brief  Return the SUBGHZ handle state.
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *         the handle information for SUBGHZ module.
+  * @retval SUBGHZ state
+  */
+HAL_SUBGHZ_StateTypeDef HAL_SUBGHZ_GetState(SUBGHZ_HandleTypeDef *hsubghz)
+{
+  /* Return SUBGHZ handle state */
+  return hsubghz->State;
+}
+
+/**
+  * @brief  Return the SUBGHZ error code.
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *         the handle information for SUBGHZ module.
+  * @retval SUBGHZ error code in bitmap format
+  */
+uint32_t HAL_SUBGHZ_GetError(SUBGHZ_HandleTypeDef *hsubghz)
+{
+  /* Return SUBGHZ ErrorCode */
+  return hsubghz->ErrorCode;
+}
+
+/**
+  * @brief  Return the CPU cycles the SUBGHZ driver spent waiting.
+  * @note   Covers every bounded wait of the driver: SPI transfers, RFBUSY,
+  *         the NSS wakeup pulse and the RF reset polls.
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *         the handle information for SUBGHZ module.
+  * @retval Cycle count, wraps at 2^32
+  */
+uint32_t HAL_SUBGHZ_GetSpinCycles(SUBGHZ_HandleTypeDef *hsubghz)
+{
+  return hsubghz->SpinCycles;
+}
+
+/**
+  * @brief  Return the bytes the SUBGHZ driver clocked on SUBGHZSPI.
+  * @note   Counts both directions of every transfer once, opcodes, headers
+  *         and status bytes included, buffer transfers through DMA as well.
+  *         The difference over an operation is its SPI cost.
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *         the handle information for SUBGHZ module.
+  * @retval Byte count, wraps at 2^32
+  */
+uint32_t HAL_SUBGHZ_GetSpiBytes(SUBGHZ_HandleTypeDef *hsubghz)
+{
+  return hsubghz->SpiBytes;
+}
+
+/**
+  * @brief  Return the radio mode, from the state shadow whenever it is known.
+  * @note   A GET_STATUS is only sent when the shadow cannot follow the radio:
+  *         after a reset with RF ready, after CAD, or while in TX or single RX
+  *         without the IRQ reporting its end routed to the CPU.
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *         the handle information for SUBGHZ module.
+  * @param  pMode pointer to the radio mode
+  * @retval HAL status
+  */
+HAL_StatusTypeDef HAL_SUBGHZ_GetRadioMode(SUBGHZ_HandleTypeDef *hsubghz, SUBGHZ_RadioModeTypeDef *pMode)
+{
+  HAL_StatusTypeDef status;
+  SUBGHZ_RadioModeTypeDef mode = hsubghz->Radio.Mode;
+  uint8_t radio_status;
+  uint32_t known;
+
+  switch (mode)
+  {
+    case SUBGHZ_RADIO_MODE_UNKNOWN:
+      known = 0U;
+      break;
+    case SUBGHZ_RADIO_MODE_TX:
+      known = hsubghz->Radio.IrqMask & SUBGHZ_IRQ_TXDONE;
+      break;
+    case SUBGHZ_RADIO_MODE_RX:
+      known = hsubghz->Radio.RxContinuous | (hsubghz->Radio.IrqMask & SUBGHZ_IRQ_RXDONE);
+      break;
+    default:
+      known = 1U;
+      break;
+  }
+
+  if (known != 0U)
+  {
+    hsubghz->Radio.StatusSkipped++;
+    *pMode = mode;
+    return HAL_OK;
+  }
+
+  status = HAL_SUBGHZ_ExecGetCmd(hsubghz, RADIO_GET_STATUS, &radio_status, 1U);
+  if (status != HAL_OK)
+  {
+    return status;
+  }
+
+  mode = (SUBGHZ_RadioModeTypeDef)((radio_status & 0x70U) >> 4U);
+  if ((mode < SUBGHZ_RADIO_MODE_STANDBY_RC) || (mode > SUBGHZ_RADIO_MODE_TX))
+  {
+    mode = SUBGHZ_RADIO_MODE_UNKNOWN;
+  }
+  hsubghz->Radio.Mode = mode;
+  *pMode = mode;
+
+  return HAL_OK;
+}
+
+/**
+  * @brief  Return the radio state shadow and its saved transaction counters.
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *         the handle information for SUBGHZ module.
+  * @retval Pointer to the radio state shadow
+  */
+const SUBGHZ_RadioShadowTypeDef *HAL_SUBGHZ_GetRadioShadow(SUBGHZ_HandleTypeDef *hsubghz)
+{
+  return &hsubghz->Radio;
+}
+
+/**
+  * @brief  Return the register cache and its hit/miss counters.
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *         the handle information for SUBGHZ module.
+  * @retval Pointer to the register cache
+  */
+const SUBGHZ_RegCacheTypeDef *HAL_SUBGHZ_GetRegCache(SUBGHZ_HandleTypeDef *hsubghz)
+{
+  return &hsubghz->RegCache;
+}
+
+/**
+  * @brief  Forget the cached register values, the next accesses go to the radio.
+  * @note   Called on radio reset and cold sleep, to be called as well when
+  *         the radio is reconfigured behind the HAL.
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *         the handle information for SUBGHZ module.
+  * @retval None
+  */
+void HAL_SUBGHZ_InvalidateRegCache(SUBGHZ_HandleTypeDef *hsubghz)
+{
+  hsubghz->RegCache.Valid = 0U;
+}
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/** @addtogroup SUBGHZ_Private_Functions
+  * @brief   Private functions
+  * @{
+  */
+
+/**
+  * @brief  Initializes the SUBGHZSPI peripheral
+  * @param  BaudratePrescaler SPI Baudrate prescaler
+  * @retval None
+  */
+void SUBGHZSPI_Init(uint32_t BaudratePrescaler)
+{
+  /* Check the parameters */
+  assert_param(IS_SUBGHZ_ALL_INSTANCE(SUBGHZSPI));
+
+  /* Disable SUBGHZSPI Peripheral */
+  CLEAR_BIT(SUBGHZSPI->CR1, SPI_CR1_SPE);
+
+  /*----------------------- SPI CR1 Configuration ----------------------------*
+   *             SPI Mode: Master                                             *
+   *   Communication Mode: 2 lines (Full-Duplex)                              *
+   *       Clock polarity: Low                                                *
+   *                phase: 1st Edge                                           *
+   *       NSS management: Internal (Done with External bit inside PWR        *
+   *  Communication speed: BaudratePrescaler                             *
+   *            First bit: MSB                                                *
+   *      CRC calculation: Disable                                            *
+   *--------------------------------------------------------------------------*/
+  WRITE_REG(SUBGHZSPI->CR1, (SPI_CR1_MSTR | SPI_CR1_SSI | BaudratePrescaler | SPI_CR1_SSM));
+
+  /*----------------------- SPI CR2 Configuration ----------------------------*
+   *            Data Size: 8bits                                              *
+   *              TI Mode: Disable                                            *
+   *            NSS Pulse: Disable                                            *
+   *    Rx FIFO Threshold: 8bits                                              *
+   *--------------------------------------------------------------------------*/
+  WRITE_REG(SUBGHZSPI->CR2, (SPI_CR2_FRXTH |  SPI_CR2_DS_0 | SPI_CR2_DS_1 | SPI_CR2_DS_2));
+
+  /* Enable SUBGHZSPI Peripheral */
+  SET_BIT(SUBGHZSPI->CR1, SPI_CR1_SPE);
+}
+
+/**
+  * @brief  DeInitializes the SUBGHZSPI peripheral
+  * @retval None
+  */
+void  SUBGHZSPI_DeInit(void)
+{
+  /* Check the parameters */
+  assert_param(IS_SUBGHZ_ALL_INSTANCE(SUBGHZSPI));
+
+  /* Disable SUBGHZSPI Peripheral */
+  CLEAR_BIT(SUBGHZSPI->CR1, SPI_CR1_SPE);
+}
+
+/**
+  * @brief  Initializes the DMA channels serving the SUBGHZSPI requests
+  * @note   Only the static part of the configuration is done here, addresses,
+  *         increment modes and lengths are set per transfer.
+  * @retval None
+  */
+void SUBGHZ_DMA_Init(void)
+{
+  LL_AHB1_GRP1_EnableClock(LL_AHB1_GRP1_PERIPH_DMAMUX1);
+  LL_AHB1_GRP1_EnableClock(LL_AHB1_GRP1_PERIPH_DMA1);
+
+  LL_DMA_ConfigTransfer(DMA1, SUBGHZ_DMA_RX_CHANNEL,
+                        LL_DMA_DIRECTION_PERIPH_TO_MEMORY | LL_DMA_MODE_NORMAL | LL_DMA_PERIPH_NOINCREMENT |
+                        LL_DMA_MEMORY_INCREMENT | LL_DMA_PDATAALIGN_BYTE | LL_DMA_MDATAALIGN_BYTE |
+                        LL_DMA_PRIORITY_VERYHIGH);
+  LL_DMA_SetPeriphRequest(DMA1, SUBGHZ_DMA_RX_CHANNEL, LL_DMAMUX_REQ_SUBGHZSPI_RX);
+  LL_DMA_SetPeriphAddress(DMA1, SUBGHZ_DMA_RX_CHANNEL, LL_SPI_DMA_GetRegAddr(SUBGHZSPI));
+
+  LL_DMA_ConfigTransfer(DMA1, SUBGHZ_DMA_TX_CHANNEL,
+                        LL_DMA_DIRECTION_MEMORY_TO_PERIPH | LL_DMA_MODE_NORMAL | LL_DMA_PERIPH_NOINCREMENT |
+                        LL_DMA_MEMORY_INCREMENT | LL_DMA_PDATAALIGN_BYTE | LL_DMA_MDATAALIGN_BYTE |
+                        LL_DMA_PRIORITY_HIGH);
+  LL_DMA_SetPeriphRequest(DMA1, SUBGHZ_DMA_TX_CHANNEL, LL_DMAMUX_REQ_SUBGHZSPI_TX);
+  LL_DMA_SetPeriphAddress(DMA1, SUBGHZ_DMA_TX_CHANNEL, LL_SPI_DMA_GetRegAddr(SUBGHZSPI));
+
+  /* Only the RX channel reports, it is the last one to complete */
+  LL_DMA_EnableIT_TC(DMA1, SUBGHZ_DMA_RX_CHANNEL);
+  LL_DMA_EnableIT_TE(DMA1, SUBGHZ_DMA_RX_CHANNEL);
+}
+
+/**
+  * @brief  Start a full duplex DMA transfer on SUBGHZSPI
+  * @note   NSS must already be selected. The RX request is enabled before the
+  *         channels and the TX request last, as required by the SPI peripheral.
+  * @param  pTxData  bytes to clock out
+  * @param  TxIncrement LL_DMA_MEMORY_INCREMENT or LL_DMA_MEMORY_NOINCREMENT
+  * @param  pRxData  storage for the bytes clocked in
+  * @param  RxIncrement LL_DMA_MEMORY_INCREMENT or LL_DMA_MEMORY_NOINCREMENT
+  * @param  Size  amount of data to transfer
+  * @retval None
+  */
+void SUBGHZ_DMA_Start(uint8_t *pTxData, uint32_t TxIncrement, uint8_t *pRxData, uint32_t RxIncrement,
+                      uint16_t Size)
+{
+  LL_DMA_ClearFlag_GI1(DMA1);
+  LL_DMA_ClearFlag_GI2(DMA1);
+
+  LL_DMA_SetMemoryIncMode(DMA1, SUBGHZ_DMA_RX_CHANNEL, RxIncrement);
+  LL_DMA_SetMemoryAddress(DMA1, SUBGHZ_DMA_RX_CHANNEL, (uint32_t)pRxData);
+  LL_DMA_SetDataLength(DMA1, SUBGHZ_DMA_RX_CHANNEL, Size);
+
+  LL_DMA_SetMemoryIncMode(DMA1, SUBGHZ_DMA_TX_CHANNEL, TxIncrement);
+  LL_DMA_SetMemoryAddress(DMA1, SUBGHZ_DMA_TX_CHANNEL, (uint32_t)pTxData);
+  LL_DMA_SetDataLength(DMA1, SUBGHZ_DMA_TX_CHANNEL, Size);
+
+  LL_SPI_EnableDMAReq_RX(SUBGHZSPI);
+  LL_DMA_EnableChannel(DMA1, SUBGHZ_DMA_RX_CHANNEL);
+  LL_DMA_EnableChannel(DMA1, SUBGHZ_DMA_TX_CHANNEL);
+  LL_SPI_EnableDMAReq_TX(SUBGHZSPI);
+}
+
+/**
+  * @brief  Transmit data through SUBGHZSPI peripheral
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *         the handle information for SUBGHZ module.
+  * @param  Data  data to transmit
+  * @retval HAL status
+  */
+HAL_StatusTypeDef SUBGHZSPI_Transmit(SUBGHZ_HandleTypeDef *hsubghz,
+                                     uint8_t Data)
+{
+  return (SUBGHZSPI_TransmitReceive(hsubghz, &Data, NULL, 1U));
+}
+
+/**
+  * @brief  Receive data through SUBGHZSPI peripheral
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *         the handle information for SUBGHZ module.
+  * @param  pData  pointer on data to receive
+  * @retval HAL status
+  */
+HAL_StatusTypeDef SUBGHZSPI_Receive(SUBGHZ_HandleTypeDef *hsubghz,
+                                    uint8_t *pData)
+{
+  return (SUBGHZSPI_TransmitReceive(hsubghz, NULL, pData, 1U));
+}
+
+/**
+  * @brief  Burst transfer through SUBGHZSPI peripheral
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *         the handle information for SUBGHZ module.
+  * @param  pTxData  data to transmit, NULL to transmit dummy bytes
+  * @param  pRxData  storage for the received data, NULL to discard it
+  * @param  Size  amount of data to transfer
+  * @retval HAL status
+  */
+HAL_StatusTypeDef SUBGHZSPI_TransmitReceive(SUBGHZ_HandleTypeDef *hsubghz,
+                                            const uint8_t *pTxData,
+                                            uint8_t *pRxData,
+                                            uint16_t Size)
+{
+  return (SUBGHZSPI_Transfer(hsubghz, NULL, 0U, pTxData, pRxData, Size));
+}
+
+/**
+  * @brief  Command header and its data in one burst through SUBGHZSPI
+  * @note   Up to SUBGHZSPI_FIFO_DEPTH bytes are kept in flight: the TX FIFO is
+  *         refilled as soon as it has room and the RX FIFO is drained in
+  *         lockstep, so the RX FIFO can never overrun. The data follows the
+  *         header without the FIFO running dry in between, the bytes received
+  *         during the header are discarded. The timeout deadline restarts
+  *         each time a byte moves.
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *         the handle information for SUBGHZ module.
+  * @param  pHeader  opcode and arguments, NULL when HeaderSize is 0
+  * @param  HeaderSize  amount of header bytes
+  * @param  pTxData  data to transmit, NULL to transmit dummy bytes
+  * @param  pRxData  storage for the data received after the header, NULL to
+  *         discard it
+  * @param  Size  amount of data to transfer after the header
+  * @retval HAL status
+  */
+HAL_StatusTypeDef SUBGHZSPI_Transfer(SUBGHZ_HandleTypeDef *hsubghz,
+                                     const uint8_t *pHeader,
+                                     uint16_t HeaderSize,
+                                     const uint8_t *pTxData,
+                                     uint8_t *pRxData,
+                                     uint16_t Size)
+{
+  HAL_StatusTypeDef status = HAL_OK;
+  deadline_t deadline;
+  uint32_t total = (uint32_t)HeaderSize + Size;
+  uint32_t tx_count = 0U;
+  uint32_t rx_count = 0U;
+  uint8_t data;
+  uint32_t sr;
+  uint32_t start;
+#if defined (__GNUC__)
+  __IO uint8_t *spidr = ((__IO uint8_t *)&SUBGHZSPI->DR);
+#endif /* __GNUC__ */
+
+  if ((hsubghz->SpiBurst == SUBGHZ_SPI_BURST_DISABLE) && (HeaderSize != 0U))
+  {
+    /* Former path: the header drains before the data starts */
+    (void)SUBGHZSPI_Transfer(hsubghz, NULL, 0U, pHeader, NULL, HeaderSize);
+    return (SUBGHZSPI_Transfer(hsubghz, NULL, 0U, pTxData, pRxData, Size));
+  }
+
+  /* Initialize Timeout */
+  deadline = deadline_from_ms(SUBGHZ_DEFAULT_TIMEOUT);
+  start = deadline.start;
+
+  while (rx_count < total)
+  {
+    sr = READ_REG(SUBGHZSPI->SR);
+
+    /* Keep the TX FIFO fed while the RX FIFO has room for the answer */
+    if ((tx_count < total) && ((tx_count - rx_count) < SUBGHZSPI_FIFO_DEPTH) &&
+        ((sr & SPI_SR_TXE) == SPI_SR_TXE))
+    {
+      if (tx_count < HeaderSize)
+      {
+        data = pHeader[tx_count];
+      }
+      else
+      {
+        data = (pTxData != NULL) ? pTxData[tx_count - HeaderSize] : SUBGHZ_DUMMY_DATA;
+      }
+#if defined (__GNUC__)
+      *spidr = data;
+#else
+      *((__IO uint8_t *)&SUBGHZSPI->DR) = data;
+#endif /* __GNUC__ */
+      tx_count++;
+      deadline_restart(&deadline);
+    }
+
+    if ((sr & SPI_SR_RXNE) == SPI_SR_RXNE)
+    {
+#if defined (__GNUC__)
+      data = *spidr;
+#else
+      data = *((__IO uint8_t *)&SUBGHZSPI->DR);
+#endif /* __GNUC__ */
+      if ((pRxData != NULL) && (rx_count >= HeaderSize))
+      {
+        pRxData[rx_count - HeaderSize] = data;
+      }
+      rx_count++;
+      deadline_restart(&deadline);
+    }
+    else if (deadline_expired(&deadline))
+    {
+      status = HAL_ERROR;
+      hsubghz->ErrorCode = HAL_SUBGHZ_ERROR_TIMEOUT;
+      break;
+    }
+    else
+    {
+      /* Byte still on the wire */
+    }
   }
+  hsubghz->SpinCycles += timebase_elapsed(start);
+  hsubghz->SpiBytes += rx_count;
+
+  return status;
 }
 
 /**
-  * @}
+  * @brief  Check if peripheral is ready
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *         the handle information for SUBGHZ module.
+  * @retval HAL status
   */
+HAL_StatusTypeDef SUBGHZ_CheckDeviceReady(SUBGHZ_HandleTypeDef *hsubghz)
+{
+  deadline_t deadline;
 
-/** @defgroup SUBGHZ_Exported_Functions_Group3 Peripheral State and Errors functions
-  * @brief   SUBGHZ control functions
-  *
-@verbatim
- ===============================================================================
-                      ##### Peripheral State and Errors functions #####
- ===============================================================================
-    [..]
-    This subsection provides a set of functions allowing to control the SUBGHZ.
-     (+) HAL_SUBGHZ_GetState() API can be helpful to check in run-time the state of the SUBGHZ peripheral
-     (+) HAL_SUBGHZ_GetError() check in run-time Errors occurring during communication
-@endverbatim
-  * @{
-  */
+  /* Wakeup radio in case of sleep mode: Select-Unselect radio */
+  if (hsubghz->DeepSleep == SUBGHZ_DEEP_SLEEP_ENABLE)
+  {
+    /* Initialize NSS switch Delay */
+    deadline = deadline_from_us(SUBGHZ_NSS_WAKEUP_TIME);
+
+    /* NSS = 0; */
+    LL_PWR_SelectSUBGHZSPI_NSS();
+
+    /* Wait Radio wakeup */
+    while (!deadline_expired(&deadline))
+    {
+    }
+    hsubghz->SpinCycles += timebase_elapsed(deadline.start);
+
+    /* NSS = 1 */
+    LL_PWR_UnselectSUBGHZSPI_NSS();
+  }
+  return (SUBGHZ_WaitOnBusy(hsubghz));
+}
 
 /**
-  * @brief  Return the SUBGHZ handle state.
+  * @brief  Check whether a mode command would leave the radio unchanged
   * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
   *         the handle information for SUBGHZ module.
-  * @retval SUBGHZ state
+  * @param  Command command about to be sent
+  * @param  pBuffer command parameters
+  * @param  Size    amount of parameters
+  * @retval 1 if the radio is known to be in the requested mode already
   */
-HAL_SUBGHZ_StateTypeDef HAL_SUBGHZ_GetState(SUBGHZ_HandleTypeDef *hsubghz)
+uint32_t SUBGHZ_ShadowCmdInEffect(SUBGHZ_HandleTypeDef *hsubghz, SUBGHZ_RadioSetCmd_t Command,
+                                  const uint8_t *pBuffer, uint16_t Size)
 {
-  /* Return SUBGHZ handle state */
-  return hsubghz->State;
+  SUBGHZ_RadioModeTypeDef mode = hsubghz->Radio.Mode;
+
+  if ((Command == RADIO_SET_STANDBY) && (Size >= 1U))
+  {
+    return ((pBuffer[0U] == 0U) ? (mode == SUBGHZ_RADIO_MODE_STANDBY_RC) :
+            (mode == SUBGHZ_RADIO_MODE_STANDBY_HSE32)) ? 1U : 0U;
+  }
+  if (Command == RADIO_SET_FS)
+  {
+    return (mode == SUBGHZ_RADIO_MODE_FS) ? 1U : 0U;
+  }
+  return 0U;
 }
 
 /**
-  * @brief  Return the SUBGHZ error code.
+  * @brief  Follow the radio mode from a command sent to the radio
   * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
   *         the handle information for SUBGHZ module.
-  * @retval SUBGHZ error code in bitmap format
+  * @param  Command command sent
+  * @param  pBuffer command parameters
+  * @param  Size    amount of parameters
+  * @retval None
   */
-uint32_t HAL_SUBGHZ_GetError(SUBGHZ_HandleTypeDef *hsubghz)
+void SUBGHZ_ShadowUpdate(SUBGHZ_HandleTypeDef *hsubghz, SUBGHZ_RadioSetCmd_t Command,
+                         const uint8_t *pBuffer, uint16_t Size)
 {
-  /* Return SUBGHZ ErrorCode */
-  return hsubghz->ErrorCode;
-}
+  SUBGHZ_RadioShadowTypeDef *radio = &hsubghz->Radio;
 
-/**
-  * @}
-  */
+  switch (Command)
+  {
+    case RADIO_SET_SLEEP:
+      radio->Mode = SUBGHZ_RADIO_MODE_SLEEP;
+      /* Cold start: registers are not retained */
+      if ((Size >= 1U) && ((pBuffer[0U] & SUBGHZ_SLEEP_WARM_START) == 0U))
+      {
+        HAL_SUBGHZ_InvalidateRegCache(hsubghz);
+      }
+      break;
+    case RADIO_SET_BUFFERBASEADDRESS:
+      if (Size >= 1U)
+      {
+        SUBGHZ_RegCacheStore(hsubghz, SUBGHZ_REG_TX_BASE_ADDRESS, pBuffer, 1U);
+      }
+      break;
+    case RADIO_SET_STANDBY:
+      radio->Mode = ((Size >= 1U) && (pBuffer[0U] != 0U)) ? SUBGHZ_RADIO_MODE_STANDBY_HSE32 :
+                    SUBGHZ_RADIO_MODE_STANDBY_RC;
+      break;
+    case RADIO_SET_FS:
+      radio->Mode = SUBGHZ_RADIO_MODE_FS;
+      break;
+    case RADIO_SET_TX:
+    case RADIO_SET_TXCONTINUOUSWAVE:
+    case RADIO_SET_TXCONTINUOUSPREAMBLE:
+      radio->Mode = SUBGHZ_RADIO_MODE_TX;
+      radio->RxContinuous = 0U;
+      break;
+    case RADIO_SET_RX:
+      radio->Mode = SUBGHZ_RADIO_MODE_RX;
+      /* Timeout 0xFFFFFF: the radio stays in RX after each packet */
+      radio->RxContinuous = ((Size >= 3U) && (pBuffer[0U] == 0xFFU) && (pBuffer[1U] == 0xFFU) &&
+                             (pBuffer[2U] == 0xFFU)) ? 1U : 0U;
+      break;
+    case RADIO_SET_RXDUTYCYCLE:
+      radio->Mode = SUBGHZ_RADIO_MODE_RX_DUTYCYCLE;
+      radio->RxContinuous = 0U;
+      break;
+    case RADIO_SET_CAD:
+      radio->Mode = SUBGHZ_RADIO_MODE_UNKNOWN;
+      break;
+    case RADIO_SET_TXFALLBACKMODE:
+      if (Size >= 1U)
+      {
+        radio->FallbackMode = (pBuffer[0U] == 0x40U) ? SUBGHZ_RADIO_MODE_FS :
+                              (pBuffer[0U] == 0x30U) ? SUBGHZ_RADIO_MODE_STANDBY_HSE32 :
+                              SUBGHZ_RADIO_MODE_STANDBY_RC;
+      }
+      break;
+    case RADIO_CFG_DIOIRQ:
+      if (Size >= 2U)
+      {
+        radio->IrqMask = (uint16_t)(((uint16_t)pBuffer[0U] << 8U) | pBuffer[1U]);
+      }
+      break;
+    default:
+      break;
+  }
+}
 
 /**
-  * @}
+  * @brief  Write then read back a pattern through the register cache
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *         the handle information for SUBGHZ module.
+  * @param  Pattern value written to the test register
+  * @retval HAL_OK if the pattern was read back
   */
+HAL_StatusTypeDef SUBGHZ_TestPattern(SUBGHZ_HandleTypeDef *hsubghz, uint8_t Pattern)
+{
+  uint8_t value = (uint8_t)~Pattern;
 
-/** @addtogroup SUBGHZ_Private_Functions
-  * @brief   Private functions
-  * @{
-  */
+  /* The test register is cached: drop it so both accesses go over SPI */
+  SUBGHZ_RegCacheDrop(hsubghz, SUBGHZ_PRESCALER_TEST_REG, 1U);
+  if (HAL_SUBGHZ_WriteRegister(hsubghz, SUBGHZ_PRESCALER_TEST_REG, Pattern) != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+  SUBGHZ_RegCacheDrop(hsubghz, SUBGHZ_PRESCALER_TEST_REG, 1U);
+  if ((HAL_SUBGHZ_ReadRegister(hsubghz, SUBGHZ_PRESCALER_TEST_REG, &value) != HAL_OK) || (value != Pattern))
+  {
+    SUBGHZ_RegCacheDrop(hsubghz, SUBGHZ_PRESCALER_TEST_REG, 1U);
+    return HAL_ERROR;
+  }
+  return HAL_OK;
+}
 
 /**
-  * @brief  Initializes the SUBGHZSPI peripheral
-  * @param  BaudratePrescaler SPI Baudrate prescaler
-  * @retval None
+  * @brief  Locate a register in the register cache
+  * @param  Address register address
+  * @retval Cache entry, SUBGHZ_REGCACHE_ENTRIES if the register is not cached
   */
-void SUBGHZSPI_Init(uint32_t BaudratePrescaler)
+uint32_t SUBGHZ_RegCacheIndex(uint16_t Address)
 {
-  /* Check the parameters */
-  assert_param(IS_SUBGHZ_ALL_INSTANCE(SUBGHZSPI));
-
-  /* Disable SUBGHZSPI Peripheral */
-  CLEAR_BIT(SUBGHZSPI->CR1, SPI_CR1_SPE);
-
-  /*----------------------- SPI CR1 Configuration ----------------------------*
-   *             SPI Mode: Master                                             *
-   *   Communication Mode: 2 lines (Full-Duplex)                              *
-   *       Clock polarity: Low                                                *
-   *                phase: 1st Edge                                           *
-   *       NSS management: Internal (Done with External bit inside PWR        *
-   *  Communication speed: BaudratePrescaler                             *
-   *            First bit: MSB                                                *
-   *      CRC calculation: Disable                                            *
-   *--------------------------------------------------------------------------*/
-  WRITE_REG(SUBGHZSPI->CR1, (SPI_CR1_MSTR | SPI_CR1_SSI | BaudratePrescaler | SPI_CR1_SSM));
-
-  /*----------------------- SPI CR2 Configuration ----------------------------*
-   *            Data Size: 8bits                                              *
-   *              TI Mode: Disable                                            *
-   *            NSS Pulse: Disable                                            *
-   *    Rx FIFO Threshold: 8bits                                              *
-   *--------------------------------------------------------------------------*/
-  WRITE_REG(SUBGHZSPI->CR2, (SPI_CR2_FRXTH |  SPI_CR2_DS_0 | SPI_CR2_DS_1 | SPI_CR2_DS_2));
-
-  /* Enable SUBGHZSPI Peripheral */
-  SET_BIT(SUBGHZSPI->CR1, SPI_CR1_SPE);
+  if ((Address >= SUBGHZ_REGCACHE_WINDOW_BASE) &&
+      (Address < (SUBGHZ_REGCACHE_WINDOW_BASE + SUBGHZ_REGCACHE_WINDOW_SIZE)))
+  {
+    return (uint32_t)Address - SUBGHZ_REGCACHE_WINDOW_BASE;
+  }
+  if (Address == SUBGHZ_REG_TX_BASE_ADDRESS)
+  {
+    return SUBGHZ_REGCACHE_WINDOW_SIZE;
+  }
+  return SUBGHZ_REGCACHE_ENTRIES;
 }
 
 /**
-  * @brief  DeInitializes the SUBGHZSPI peripheral
-  * @retval None
+  * @brief  Check whether the radio already holds the values about to be written
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *         the handle information for SUBGHZ module.
+  * @param  Address first register
+  * @param  pBuffer values to write
+  * @param  Size    amount of registers
+  * @retval 1 if every register is cached with the same value
   */
-void  SUBGHZSPI_DeInit(void)
+uint32_t SUBGHZ_RegCacheMatch(SUBGHZ_HandleTypeDef *hsubghz, uint16_t Address, const uint8_t *pBuffer,
+                              uint16_t Size)
 {
-  /* Check the parameters */
-  assert_param(IS_SUBGHZ_ALL_INSTANCE(SUBGHZSPI));
+  SUBGHZ_RegCacheTypeDef *cache = &hsubghz->RegCache;
+  uint32_t index;
+  uint16_t i;
 
-  /* Disable SUBGHZSPI Peripheral */
-  CLEAR_BIT(SUBGHZSPI->CR1, SPI_CR1_SPE);
+  for (i = 0U; i < Size; i++)
+  {
+    index = SUBGHZ_RegCacheIndex((uint16_t)(Address + i));
+    if ((index == SUBGHZ_REGCACHE_ENTRIES) || ((cache->Valid & (1UL << index)) == 0U) ||
+        (cache->Value[index] != pBuffer[i]))
+    {
+      /* Count misses on cached registers only */
+      if (SUBGHZ_RegCacheIndex(Address) != SUBGHZ_REGCACHE_ENTRIES)
+      {
+        cache->Misses++;
+      }
+      return 0U;
+    }
+  }
+  return (Size != 0U) ? 1U : 0U;
 }
 
 /**
-  * @brief  Transmit data through SUBGHZSPI peripheral
+  * @brief  Read registers from the register cache
   * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
   *         the handle information for SUBGHZ module.
-  * @param  Data  data to transmit
-  * @retval HAL status
+  * @param  Address first register
+  * @param  pBuffer destination of the values
+  * @param  Size    amount of registers
+  * @retval 1 if every register was cached, pBuffer is then filled
   */
-HAL_StatusTypeDef SUBGHZSPI_Transmit(SUBGHZ_HandleTypeDef *hsubghz,
-                                     uint8_t Data)
+uint32_t SUBGHZ_RegCacheLoad(SUBGHZ_HandleTypeDef *hsubghz, uint16_t Address, uint8_t *pBuffer, uint16_t Size)
 {
-  HAL_StatusTypeDef status = HAL_OK;
-  __IO uint32_t count;
+  SUBGHZ_RegCacheTypeDef *cache = &hsubghz->RegCache;
+  uint32_t index;
+  uint16_t i;
 
-  /* Handle Tx transmission from SUBGHZSPI peripheral to Radio ****************/
-  /* Initialize Timeout */
-  count = SUBGHZ_DEFAULT_TIMEOUT * SUBGHZ_DEFAULT_LOOP_TIME;
-
-  /* Wait until TXE flag is set */
-  do
+  for (i = 0U; i < Size; i++)
   {
-    if (count == 0U)
+    index = SUBGHZ_RegCacheIndex((uint16_t)(Address + i));
+    if ((index == SUBGHZ_REGCACHE_ENTRIES) || ((cache->Valid & (1UL << index)) == 0U))
     {
-      status = HAL_ERROR;
-      hsubghz->ErrorCode = HAL_SUBGHZ_ERROR_TIMEOUT;
-      break;
+      if (SUBGHZ_RegCacheIndex(Address) != SUBGHZ_REGCACHE_ENTRIES)
+      {
+        cache->Misses++;
+      }
+      return 0U;
     }
-    count--;
-  } while (READ_BIT(SUBGHZSPI->SR, SPI_SR_TXE) != (SPI_SR_TXE));
-
-  /* Transmit Data*/
-#if defined (__GNUC__)
-  __IO uint8_t *spidr = ((__IO uint8_t *)&SUBGHZSPI->DR);
-  *spidr = Data;
-#else
-  *((__IO uint8_t *)&SUBGHZSPI->DR) = Data;
-#endif /* __GNUC__ */
+  }
+  for (i = 0U; i < Size; i++)
+  {
+    pBuffer[i] = cache->Value[SUBGHZ_RegCacheIndex((uint16_t)(Address + i))];
+  }
+  return (Size != 0U) ? 1U : 0U;
+}
 
-  /* Handle Rx transmission from SUBGHZSPI peripheral to Radio ****************/
-  /* Initialize Timeout */
-  count = SUBGHZ_DEFAULT_TIMEOUT * SUBGHZ_DEFAULT_LOOP_TIME;
+/**
+  * @brief  Record register values known to be in the radio
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *         the handle information for SUBGHZ module.
+  * @param  Address first register
+  * @param  pBuffer register values
+  * @param  Size    amount of registers
+  * @retval None
+  */
+void SUBGHZ_RegCacheStore(SUBGHZ_HandleTypeDef *hsubghz, uint16_t Address, const uint8_t *pBuffer, uint16_t Size)
+{
+  SUBGHZ_RegCacheTypeDef *cache = &hsubghz->RegCache;
+  uint32_t index;
+  uint16_t i;
 
-  /* Wait until RXNE flag is set */
-  do
+  for (i = 0U; i < Size; i++)
   {
-    if (count == 0U)
+    index = SUBGHZ_RegCacheIndex((uint16_t)(Address + i));
+    if (index != SUBGHZ_REGCACHE_ENTRIES)
     {
-      status = HAL_ERROR;
-      hsubghz->ErrorCode = HAL_SUBGHZ_ERROR_TIMEOUT;
-      break;
+      cache->Value[index] = pBuffer[i];
+      cache->Valid |= (1UL << index);
     }
-    count--;
-  } while (READ_BIT(SUBGHZSPI->SR, SPI_SR_RXNE) != (SPI_SR_RXNE));
-
-  /* Flush Rx data */
-  READ_REG(SUBGHZSPI->DR);
-
-  return status;
+  }
 }
 
 /**
-  * @brief  Receive data through SUBGHZSPI peripheral
+  * @brief  Forget cached register values
   * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
   *         the handle information for SUBGHZ module.
-  * @param  pData  pointer on data to receive
-  * @retval HAL status
+  * @param  Address first register
+  * @param  Size    amount of registers
+  * @retval None
   */
-HAL_StatusTypeDef SUBGHZSPI_Receive(SUBGHZ_HandleTypeDef *hsubghz,
-                                    uint8_t *pData)
+void SUBGHZ_RegCacheDrop(SUBGHZ_HandleTypeDef *hsubghz, uint16_t Address, uint16_t Size)
 {
-  HAL_StatusTypeDef status = HAL_OK;
-  __IO uint32_t count;
-
-  /* Handle Tx transmission from SUBGHZSPI peripheral to Radio ****************/
-  /* Initialize Timeout */
-  count = SUBGHZ_DEFAULT_TIMEOUT * SUBGHZ_DEFAULT_LOOP_TIME;
+  uint32_t index;
+  uint16_t i;
 
-  /* Wait until TXE flag is set */
-  do
+  for (i = 0U; i < Size; i++)
   {
-    if (count == 0U)
+    index = SUBGHZ_RegCacheIndex((uint16_t)(Address + i));
+    if (index != SUBGHZ_REGCACHE_ENTRIES)
     {
-      status = HAL_ERROR;
-      hsubghz->ErrorCode = HAL_SUBGHZ_ERROR_TIMEOUT;
-      break;
+      hsubghz->RegCache.Valid &= ~(1UL << index);
     }
-    count--;
-  } while (READ_BIT(SUBGHZSPI->SR, SPI_SR_TXE) != (SPI_SR_TXE));
+  }
+}
 
-  /* Transmit Data*/
-#if defined (__GNUC__)
-  __IO uint8_t *spidr = ((__IO uint8_t *)&SUBGHZSPI->DR);
-  *spidr = SUBGHZ_DUMMY_DATA;
-#else
-  *((__IO uint8_t *)&SUBGHZSPI->DR) = SUBGHZ_DUMMY_DATA;
-#endif /* __GNUC__ */
+/**
+  * @brief  Read the radio busy signal
+  * @retval 1 while the radio is busy, 0 otherwise
+  */
+uint32_t SUBGHZ_IsRadioBusy(void)
+{
+  return (LL_PWR_IsActiveFlag_RFBUSYS() & LL_PWR_IsActiveFlag_RFBUSYMS());
+}
 
-  /* Handle Rx transmission from SUBGHZSPI peripheral to Radio ****************/
-  /* Initialize Timeout */
-  count = SUBGHZ_DEFAULT_TIMEOUT * SUBGHZ_DEFAULT_LOOP_TIME;
+/**
+  * @brief  Wait in thread mode for a DMA buffer transfer to release the handle
+  * @note   A transfer holds the handle until HAL_SUBGHZ_DMA_IRQHandler() runs,
+  *         which takes a few microseconds: a blocking call from the main loop
+  *         waits for it instead of failing with HAL_BUSY. Interrupt handlers
+  *         don't wait, the DMA interrupt may not preempt them.
+  * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
+  *         the handle information for SUBGHZ module.
+  * @retval None
+  */
+void SUBGHZ_WaitOnDma(SUBGHZ_HandleTypeDef *hsubghz)
+{
+  deadline_t deadline;
 
-  /* Wait until RXNE flag is set */
-  do
+  if ((hsubghz->DmaTransfer == SUBGHZ_DMA_TRANSFER_NONE) || (__get_IPSR() != 0U))
   {
-    if (count == 0U)
-    {
-      status = HAL_ERROR;
-      hsubghz->ErrorCode = HAL_SUBGHZ_ERROR_TIMEOUT;
-      break;
-    }
-    count--;
-  } while (READ_BIT(SUBGHZSPI->SR, SPI_SR_RXNE) != (SPI_SR_RXNE));
-
-  /* Retrieve pData */
-  *pData = (uint8_t)(READ_REG(SUBGHZSPI->DR));
+    return;
+  }
 
-  return status;
+  deadline = deadline_from_ms(SUBGHZ_DEFAULT_TIMEOUT);
+  while ((hsubghz->DmaTransfer != SUBGHZ_DMA_TRANSFER_NONE) && !deadline_expired(&deadline))
+  {
+  }
+  hsubghz->SpinCycles += timebase_elapsed(deadline.start);
 }
 
 /**
-  * @brief  Check if peripheral is ready
+  * @brief  Wait busy flag low from peripheral
+  * @note   From thread mode, with the SUBGHZ_Radio interrupt enabled, the core
+  *         sleeps in WFI until the RFBUSY falling edge (EXTI line 45) wakes it.
+  *         The SysTick interrupt is enabled meanwhile to bound the wait. The
+  *         check and the WFI run with PRIMASK set, so an edge arriving in
+  *         between keeps the interrupt pending and WFI returns at once.
+  *         From handler mode, or before the interrupt is enabled, RFBUSY is
+  *         polled. Only the cycles the core is awake count in SpinCycles.
   * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
   *         the handle information for SUBGHZ module.
   * @retval HAL status
   */
-HAL_StatusTypeDef SUBGHZ_CheckDeviceReady(SUBGHZ_HandleTypeDef *hsubghz)
+HAL_StatusTypeDef SUBGHZ_WaitOnBusy(SUBGHZ_HandleTypeDef *hsubghz)
 {
-  __IO uint32_t count;
+  HAL_StatusTypeDef status;
+  uint32_t start_tick;
+  uint32_t awake;
 
-  /* Wakeup radio in case of sleep mode: Select-Unselect radio */
-  if (hsubghz->DeepSleep == SUBGHZ_DEEP_SLEEP_ENABLE)
-  {
-    /* Initialize NSS switch Delay */
-    count  = SUBGHZ_NSS_LOOP_TIME;
+  status = HAL_OK;
 
-    /* NSS = 0; */
-    LL_PWR_SelectSUBGHZSPI_NSS();
+  if ((__get_IPSR() == 0U) && (__get_PRIMASK() == 0U) && (NVIC_GetEnableIRQ(SUBGHZ_Radio_IRQn) != 0U))
+  {
+    timebase_tick_wakeup(true);
+    start_tick = timebase_ticks();
+    awake = timebase_now();
 
-    /* Wait Radio wakeup */
-    do
+    for (;;)
     {
-      count--;
-    } while (count != 0UL);
+      __disable_irq();
 
-    /* NSS = 1 */
-    LL_PWR_UnselectSUBGHZSPI_NSS();
+      if (SUBGHZ_IsRadioBusy() == 0U)
+      {
+        __enable_irq();
+        break;
+      }
+      if ((timebase_ticks() - start_tick) > SUBGHZ_DEFAULT_TIMEOUT)
+      {
+        __enable_irq();
+        status  = HAL_ERROR;
+        hsubghz->ErrorCode = HAL_SUBGHZ_ERROR_RF_BUSY;
+        break;
+      }
+
+      hsubghz->SpinCycles += timebase_elapsed(awake);
+      __WFI();
+      awake = timebase_now();
+
+      /* Pending RFBUSY or SysTick interrupt is served here */
+      __enable_irq();
+    }
+    hsubghz->SpinCycles += timebase_elapsed(awake);
+
+    timebase_tick_wakeup(false);
+    return status;
   }
-  return (SUBGHZ_WaitOnBusy(hsubghz));
+
+  return (SUBGHZ_SpinOnBusy(hsubghz));
 }
 
 /**
-  * @brief  Wait busy flag low from peripheral
+  * @brief  Poll busy flag low from peripheral
+  * @note   Used where the radio is known to release RFBUSY within a few
+  *         microseconds, sleeping would cost more than it saves.
   * @param  hsubghz pointer to a SUBGHZ_HandleTypeDef structure that contains
   *         the handle information for SUBGHZ module.
   * @retval HAL status
   */
-HAL_StatusTypeDef SUBGHZ_WaitOnBusy(SUBGHZ_HandleTypeDef *hsubghz)
+HAL_StatusTypeDef SUBGHZ_SpinOnBusy(SUBGHZ_HandleTypeDef *hsubghz)
 {
   HAL_StatusTypeDef status;
-  __IO uint32_t count;
-  uint32_t mask;
+  deadline_t deadline;
 
   status = HAL_OK;
-  count  = SUBGHZ_DEFAULT_TIMEOUT * SUBGHZ_RFBUSY_LOOP_TIME;
+  deadline = deadline_from_ms(SUBGHZ_DEFAULT_TIMEOUT);
 
   /* Wait until Busy signal is set */
-  do
+  while (SUBGHZ_IsRadioBusy() != 0U)
   {
-    mask = LL_PWR_IsActiveFlag_RFBUSYMS();
-
-    if (count == 0U)
+    if (deadline_expired(&deadline))
     {
       status  = HAL_ERROR;
       hsubghz->ErrorCode = HAL_SUBGHZ_ERROR_RF_BUSY;
       break;
     }
-    count--;
-  } while ((LL_PWR_IsActiveFlag_RFBUSYS()& mask) == 1UL);
+  }
+  hsubghz->SpinCycles += timebase_elapsed(deadline.start);
 
   return status;
 }
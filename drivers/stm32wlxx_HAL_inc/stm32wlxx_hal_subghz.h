@@ -28,6 +28,7 @@ extern "C" {
 
 /* Include low level driver */
 #include "stm32wlxx_ll_spi.h"
+#include "stm32wlxx_ll_dma.h"
 
 /**
   * @brief  HAL Status structures definition
@@ -113,6 +114,62 @@ typedef enum
   HAL_SUBGHZ_CAD_DETECTED                   = 0x01U,    /*!< Channel activity detected                   */
 } HAL_SUBGHZ_CadStatusTypeDef;
 
+/**
+  * @brief  HAL SUBGHZ Radio mode structure definition
+  * @note   Values from STANDBY_RC to TX match the mode field of GET_STATUS.
+  */
+typedef enum
+{
+  SUBGHZ_RADIO_MODE_UNKNOWN                 = 0x00U,    /*!< Mode not known, status must be read         */
+  SUBGHZ_RADIO_MODE_SLEEP                   = 0x01U,    /*!< Sleep, needs an NSS wakeup pulse            */
+  SUBGHZ_RADIO_MODE_STANDBY_RC              = 0x02U,    /*!< Standby on RC 13 MHz                        */
+  SUBGHZ_RADIO_MODE_STANDBY_HSE32           = 0x03U,    /*!< Standby on HSE32                            */
+  SUBGHZ_RADIO_MODE_FS                      = 0x04U,    /*!< Frequency synthesis                         */
+  SUBGHZ_RADIO_MODE_RX                      = 0x05U,    /*!< Receive                                     */
+  SUBGHZ_RADIO_MODE_TX                      = 0x06U,    /*!< Transmit                                    */
+  SUBGHZ_RADIO_MODE_RX_DUTYCYCLE            = 0x07U,    /*!< Sniff mode, sleeping between RX windows     */
+} SUBGHZ_RadioModeTypeDef;
+
+/**
+  * @brief  SUBGHZ Radio state shadow structure definition
+  * @note   Tracks the radio mode from the commands sent and the IRQs handled,
+  *         the counters give the SPI transactions this saved.
+  */
+typedef struct
+{
+  __IO SUBGHZ_RadioModeTypeDef              Mode;          /*!< Current radio mode                       */
+  SUBGHZ_RadioModeTypeDef                   FallbackMode;  /*!< Mode entered after TX, RX or timeout     */
+  uint16_t                                  IrqMask;       /*!< IRQs routed to the CPU (CFG_DIOIRQ)      */
+  uint8_t                                   RxContinuous;  /*!< RX started without timeout nor exit      */
+  uint32_t                                  WakeupSkipped; /*!< NSS wakeup pulses not needed             */
+  uint32_t                                  StatusSkipped; /*!< GET_STATUS answered from the shadow      */
+  uint32_t                                  CommandSkipped; /*!< Mode commands already in effect         */
+} SUBGHZ_RadioShadowTypeDef;
+
+/**
+  * @brief  SUBGHZ register cache definition
+  * @note   Registers only the firmware writes: packet engine window (CRC,
+  *         sync word, node and broadcast addresses) and the TX base address.
+  */
+#define SUBGHZ_REGCACHE_WINDOW_BASE         0x06B8U   /*!< First cached packet engine register    */
+#define SUBGHZ_REGCACHE_WINDOW_SIZE         24U       /*!< Cached packet engine registers          */
+#define SUBGHZ_REG_TX_BASE_ADDRESS          0x0802U   /*!< TX base set by SET_BUFFERBASEADDRESS    */
+#define SUBGHZ_REGCACHE_ENTRIES             (SUBGHZ_REGCACHE_WINDOW_SIZE + 1U)
+
+/**
+  * @brief  SUBGHZ register cache structure definition
+  * @note   Write-through: writes reach the radio only when a value changes,
+  *         reads are answered from RAM once a value is known.
+  */
+typedef struct
+{
+  uint8_t                                   Value[SUBGHZ_REGCACHE_ENTRIES]; /*!< Register values       */
+  uint32_t                                  Valid;      /*!< One bit per entry, set once known           */
+  uint32_t                                  Hits;       /*!< Accesses served without SPI                 */
+  uint32_t                                  Misses;     /*!< Accesses of cached registers sent over SPI  */
+  uint32_t                                  SavedBytes; /*!< SPI bytes the hits did not transfer         */
+} SUBGHZ_RegCacheTypeDef;
+
 /**
   * @brief  SUBGHZ handle Structure definition
   */
@@ -128,6 +185,24 @@ typedef struct
 
   __IO uint32_t                             ErrorCode;  /*!< SUBGHZ Error code                           */
 
+  __IO uint8_t                              DmaTransfer; /*!< SUBGHZ buffer transfer ongoing through DMA  */
+
+  uint32_t                                  SpinCycles; /*!< CPU cycles spent in bounded waits           */
+
+  uint32_t                                  SpiBytes;   /*!< Bytes clocked on SUBGHZSPI, DMA included    */
+
+  uint8_t                                   SpiBurst;   /*!< Command header and data in one SPI burst    */
+
+  __IO uint8_t                              BusyPending; /*!< SUBGHZ command sent without waiting on RFBUSY */
+
+  SUBGHZ_RadioShadowTypeDef                 Radio;      /*!< SUBGHZ Radio state shadow                   */
+
+  SUBGHZ_RegCacheTypeDef                    RegCache;   /*!< SUBGHZ Radio register cache                 */
+
+  uint32_t                                  IrqCycles;  /*!< Cycle count at the last radio IRQ entry     */
+
+  __IO uint8_t                              IrqDeferred; /*!< Radio IRQ masked while the HAL was locked  */
+
 } SUBGHZ_HandleTypeDef;
 
 /*
@@ -197,6 +272,7 @@ typedef enum
 #define HAL_SUBGHZ_ERROR_NONE               (0x00000000U)   /*!< No error                         */
 #define HAL_SUBGHZ_ERROR_TIMEOUT            (0x00000001U)   /*!< Timeout Error                    */
 #define HAL_SUBGHZ_ERROR_RF_BUSY            (0x00000002U)   /*!< RF Busy Error                    */
+#define HAL_SUBGHZ_ERROR_DMA                (0x00000004U)   /*!< DMA transfer Error               */
 /**
   * @}
   */
@@ -220,12 +296,47 @@ typedef enum
   * @}
   */
 
+/** @defgroup SUBGHZ_SPI_Burst SUBGHZ SPI burst
+  * @brief  How a command header and its data share the bus, set in SpiBurst.
+  *         Disabled, the header drains from the FIFO before the data starts,
+  *         as the original driver did; kept to measure the difference.
+  * @{
+  */
+#define SUBGHZ_SPI_BURST_DISABLE            0x00U
+#define SUBGHZ_SPI_BURST_ENABLE             0x01U
+/**
+  * @}
+  */
+
 /* Private constants ---------------------------------------------------------*/
 /** @defgroup SUBGHZ_Private_Constants SUBGHZ Private Constants
   * @{
   */
 
 
+/**
+  * @brief SUBGHZ DMA buffer transfer definition
+  */
+#define SUBGHZ_DMA_TRANSFER_NONE            0x00U
+#define SUBGHZ_DMA_TRANSFER_WRITE           0x01U
+#define SUBGHZ_DMA_TRANSFER_READ            0x02U
+
+/**
+  * @brief SUBGHZ DMA channels definition (requests routed through DMAMUX1)
+  */
+#define SUBGHZ_DMA_RX_CHANNEL               LL_DMA_CHANNEL_1
+#define SUBGHZ_DMA_TX_CHANNEL               LL_DMA_CHANNEL_2
+#define SUBGHZ_DMA_RX_IRQn                  DMA1_Channel1_IRQn
+
+/**
+  * @brief SUBGHZ command script definition
+  *        A script is a sequence of frames: [length][flags][length bytes],
+  *        the bytes being sent as is between NSS falling and rising edges.
+  */
+#define SUBGHZ_SCRIPT_FRAME_HEADER          2U
+#define SUBGHZ_SCRIPT_SPIN                  0x00U  /*!< Radio busy for microseconds after the frame */
+#define SUBGHZ_SCRIPT_SLEEP                 0x01U  /*!< Radio busy long enough to sleep on RFBUSY   */
+
 /**
   * @brief SUBGHZSPI_Interrupts SUBGHZSPI Interrupts
   */
@@ -299,6 +410,7 @@ typedef enum
 /* Initialization/de-initialization functions  ********************************/
 HAL_StatusTypeDef HAL_SUBGHZ_Init(SUBGHZ_HandleTypeDef *hsubghz);
 HAL_StatusTypeDef HAL_SUBGHZ_DeInit(SUBGHZ_HandleTypeDef *hsubghz);
+HAL_StatusTypeDef HAL_SUBGHZ_ConfigFastestPrescaler(SUBGHZ_HandleTypeDef *hsubghz);
 /**
   * @}
   */
@@ -309,6 +421,10 @@ HAL_StatusTypeDef HAL_SUBGHZ_DeInit(SUBGHZ_HandleTypeDef *hsubghz);
 /* I/O operation functions  ***************************************************/
 HAL_StatusTypeDef HAL_SUBGHZ_ExecSetCmd(SUBGHZ_HandleTypeDef *hsubghz, SUBGHZ_RadioSetCmd_t Command, uint8_t *pBuffer,
                                         uint16_t Size);
+HAL_StatusTypeDef HAL_SUBGHZ_ExecSetCmd_IT(SUBGHZ_HandleTypeDef *hsubghz, SUBGHZ_RadioSetCmd_t Command,
+                                           uint8_t *pBuffer, uint16_t Size);
+uint32_t          HAL_SUBGHZ_IsCmdPending(SUBGHZ_HandleTypeDef *hsubghz);
+HAL_StatusTypeDef HAL_SUBGHZ_ExecScript(SUBGHZ_HandleTypeDef *hsubghz, const uint8_t *pScript, uint16_t Size);
 HAL_StatusTypeDef HAL_SUBGHZ_ExecGetCmd(SUBGHZ_HandleTypeDef *hsubghz, SUBGHZ_RadioGetCmd_t Command, uint8_t *pBuffer,
                                         uint16_t Size);
 HAL_StatusTypeDef HAL_SUBGHZ_WriteBuffer(SUBGHZ_HandleTypeDef *hsubghz, uint8_t Offset, uint8_t *pBuffer,
@@ -323,7 +439,26 @@ HAL_StatusTypeDef HAL_SUBGHZ_ReadRegisters(SUBGHZ_HandleTypeDef *hsubghz, uint16
 HAL_StatusTypeDef HAL_SUBGHZ_WriteRegister(SUBGHZ_HandleTypeDef *hsubghz, uint16_t Address, uint8_t Value);
 HAL_StatusTypeDef HAL_SUBGHZ_ReadRegister(SUBGHZ_HandleTypeDef *hsubghz, uint16_t Address, uint8_t *pValue);
 
+HAL_StatusTypeDef HAL_SUBGHZ_WriteBuffer_DMA(SUBGHZ_HandleTypeDef *hsubghz, uint8_t Offset, uint8_t *pBuffer,
+                                             uint16_t Size);
+HAL_StatusTypeDef HAL_SUBGHZ_ReadBuffer_DMA(SUBGHZ_HandleTypeDef *hsubghz, uint8_t Offset, uint8_t *pBuffer,
+                                            uint16_t Size);
+
 void HAL_SUBGHZ_IRQHandler(SUBGHZ_HandleTypeDef *hsubghz);
+void HAL_SUBGHZ_ResumeIRQ(SUBGHZ_HandleTypeDef *hsubghz);
+void HAL_SUBGHZ_DMA_IRQHandler(SUBGHZ_HandleTypeDef *hsubghz);
+void HAL_SUBGHZ_RFBUSY_IRQHandler(SUBGHZ_HandleTypeDef *hsubghz);
+
+void HAL_SUBGHZ_TxCpltCallback(SUBGHZ_HandleTypeDef *hsubghz);
+void HAL_SUBGHZ_RxCpltCallback(SUBGHZ_HandleTypeDef *hsubghz);
+void HAL_SUBGHZ_PreambleDetectedCallback(SUBGHZ_HandleTypeDef *hsubghz);
+void HAL_SUBGHZ_SyncWordValidCallback(SUBGHZ_HandleTypeDef *hsubghz);
+void HAL_SUBGHZ_CRCErrorCallback(SUBGHZ_HandleTypeDef *hsubghz);
+void HAL_SUBGHZ_RxTxTimeoutCallback(SUBGHZ_HandleTypeDef *hsubghz);
+void HAL_SUBGHZ_CmdCpltCallback(SUBGHZ_HandleTypeDef *hsubghz);
+
+void HAL_SUBGHZ_WriteBufferCpltCallback(SUBGHZ_HandleTypeDef *hsubghz);
+void HAL_SUBGHZ_ReadBufferCpltCallback(SUBGHZ_HandleTypeDef *hsubghz);
 /**
   * @}
   */
@@ -334,6 +469,12 @@ void HAL_SUBGHZ_IRQHandler(SUBGHZ_HandleTypeDef *hsubghz);
 /* Peripheral State and Error functions ***************************************/
 HAL_SUBGHZ_StateTypeDef HAL_SUBGHZ_GetState(SUBGHZ_HandleTypeDef *hsubghz);
 uint32_t                HAL_SUBGHZ_GetError(SUBGHZ_HandleTypeDef *hsubghz);
+uint32_t                HAL_SUBGHZ_GetSpinCycles(SUBGHZ_HandleTypeDef *hsubghz);
+uint32_t                HAL_SUBGHZ_GetSpiBytes(SUBGHZ_HandleTypeDef *hsubghz);
+HAL_StatusTypeDef       HAL_SUBGHZ_GetRadioMode(SUBGHZ_HandleTypeDef *hsubghz, SUBGHZ_RadioModeTypeDef *pMode);
+const SUBGHZ_RadioShadowTypeDef *HAL_SUBGHZ_GetRadioShadow(SUBGHZ_HandleTypeDef *hsubghz);
+const SUBGHZ_RegCacheTypeDef *HAL_SUBGHZ_GetRegCache(SUBGHZ_HandleTypeDef *hsubghz);
+void                    HAL_SUBGHZ_InvalidateRegCache(SUBGHZ_HandleTypeDef *hsubghz);
 /**
   * @}
   */
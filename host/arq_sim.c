@@ -0,0 +1,886 @@
+// arq_sim.c -- the firmware ARQ and bulk transfer between simulated radios on one channel
+
+#include "arq_sim.h"
+#include "arq.h"
+#include "bulk.h"
+#include "tx_power.h"
+#include "node_table.h"
+#include "phy.h"
+#include "frame.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+// frames are timed by their phy profile, see phy.h
+#define SIM_NETWORK					0x5A			// ADDRESS
+#define SIM_RSSI					-80				// dBm, every frame heard without a path loss
+#define SIM_FADING_DB				4.0				// standard deviation over the path loss, per frame
+#define SIM_CAPTURE_DB				6				// a frame survives others this much weaker than it
+#define SIM_PATH_1M_DB				31.0			// free space at 1 m, 868 MHz
+#define SIM_PATH_EXPONENT			3.0				// dB per decade of distance / 10
+#define SIM_GOLDEN_ANGLE			2.39996323		// radians between one remote and the next around the base
+
+#define SIM_TURNAROUND_US			300		// queued to the first preamble bit: SET_FS, buffer write, PLL, PA ramp
+#define SIM_STEP_US					5
+#define SIM_QUEUE_DEPTH				8
+#define SIM_TIME_LIMIT_US			3000000000U
+#define SIM_ADDR_REMOTE				0x1234			// the first remote, the others follow
+#define SIM_NODES					(ARQ_SIM_REMOTES + 1U)
+
+enum
+{
+	SIM_IDLE = 0,				// listening if the node listens, else asleep in FS
+	SIM_TX,						// from the queue to TXDONE
+	SIM_WINDOW					// reply window, RX with a timeout
+};
+
+typedef struct
+{
+	arq_link_t *link;
+	bool bulk;					// a bulk SACK request
+	uint16_t to;				// the node the frame is for
+	uint32_t reply_us;
+	uint8_t profile;
+	uint8_t power;				// tx_power level
+	int8_t rssi;				// as heard by the receiving radio
+	uint8_t len;
+	uint8_t data[BULK_FRAME_LEN];
+} sim_frame_t;
+
+// a frame's window over, for the ARQ link or the bulk transfer
+typedef struct
+{
+	arq_link_t *link;
+	bool bulk;
+	bool replied;
+	uint16_t to;
+	uint8_t profile;
+} sim_closed_t;
+
+// a node's own transmission as the other radios see it
+typedef struct
+{
+	bool on;
+	uint32_t start;				// first preamble bit
+	uint32_t sync;
+	uint32_t end;
+	sim_frame_t frame;
+} sim_air_t;
+
+typedef struct sim_node sim_node_t;
+typedef struct sim_peer sim_peer_t;
+
+// what a node trades with one peer: the base has one per remote, a
+// remote the base
+struct sim_peer
+{
+	sim_node_t *node;
+	sim_peer_t *back;			// the peer's for this node
+	uint16_t addr;
+
+	// messages to the peer
+	uint32_t messages;
+	uint32_t next;
+	uint32_t next_us;			// not before
+	uint32_t delivered;
+	uint32_t gave_up;
+	uint32_t false_acks;		// delivered by the ARQ, never taken by the peer
+	uint32_t done_us;
+
+	// messages from the peer
+	uint8_t *taken;				// per message number
+	int64_t last;				// highest message number taken
+	uint32_t taken_count;
+	uint32_t repeats;
+	uint32_t disorder;			// taken twice or after a later one
+
+	// blob pushed to the peer
+	bool bulk_started;
+	bool bulk_over;
+	bulk_result_t bulk_result;
+	uint8_t bulk_profile;
+	uint32_t bulk_start_us;
+	uint32_t bulk_end_us;
+	bulk_stats_t bulk_before;	// the node's as the blob started
+	bulk_stats_t bulk_stats;	// and as it ended
+};
+
+struct sim_node
+{
+	char name[12];
+	arq_t arq;
+	bulk_t bulk;
+	bool listens;
+	bool own_listens;			// when no bulk session keeps it listening
+	uint8_t node_addr;			// the radio's node address, the broadcast one is SIM_NETWORK
+	uint8_t rx_profile;			// outside reply windows
+	uint32_t path_loss;			// dB to the base, 0 for the base
+	tx_power_t power;
+	sim_peer_t peers[ARQ_SIM_REMOTES];
+	uint32_t peer_count;
+
+	// radio, the part the ISR runs on the target
+	sim_frame_t queue[SIM_QUEUE_DEPTH];
+	uint32_t head;
+	uint32_t tail;
+	int state;
+	sim_frame_t active;
+	uint32_t window_end;
+	sim_air_t air;
+	uint32_t synced[SIM_NODES];	// per sender, the sync word time of its last frame looked at
+	const sim_node_t *from;		// the sender of the frame being received, NULL for none
+	sim_frame_t incoming;
+	uint32_t incoming_end;
+	uint32_t lost;
+	uint32_t collided;			// frames lost to another on the air, or missed while receiving one
+	uint32_t aborted;			// receptions cut short by a TX
+
+	// handed from the radio to the main loop
+	sim_closed_t closed[SIM_QUEUE_DEPTH];
+	uint32_t closed_count;
+	sim_frame_t rx[SIM_QUEUE_DEPTH];
+	uint32_t rx_us[SIM_QUEUE_DEPTH];
+	uint32_t rx_count;
+
+	// blobs pushed to the peers, each bulk_size bytes; and the one taken
+	uint32_t bulk_size;
+	bool bulk_adr;				// on the peer's profile, else PHY_NETWORK
+	uint32_t blob_size;
+	uint8_t *blob;
+	uint8_t *blob_seen;			// per byte, written by the sink
+	uint32_t blob_rewrites;
+};
+
+static uint64_t sim_random;
+static double sim_loss;
+static sim_node_t sim_nodes[SIM_NODES];		// the base, then the remotes
+static uint32_t sim_node_count;
+static uint32_t sim_interval_us;
+static uint32_t sim_paths[SIM_NODES][SIM_NODES];	// dB, 0 for every frame heard at SIM_RSSI
+static sim_node_t *sim_on_air[SIM_NODES];	// nodes with a frame queued to the air or on it
+static uint32_t sim_on_air_count;
+
+static double sim_chance(void)
+{
+	sim_random ^= sim_random << 13;
+	sim_random ^= sim_random >> 7;
+	sim_random ^= sim_random << 17;
+	return (double)(sim_random >> 11) / (double)(1ULL << 53);
+}
+
+// normal, mean 0 and deviation 1
+static double sim_gauss(void)
+{
+	return sqrt(-2.0 * log(1.0 - sim_chance())) * cos(2.0 * M_PI * sim_chance());
+}
+
+static uint32_t sim_path(const sim_node_t *a, const sim_node_t *b)
+{
+	return sim_paths[a - sim_nodes][b - sim_nodes];
+}
+
+// dB between every two nodes: a remote's own to the base, and between
+// remotes by where they are. each is as far from the base as its path
+// loss makes it, log-distance, and a golden angle around from the one
+// before, so the population spreads out on every side
+static void sim_place(void)
+{
+	double x[SIM_NODES];
+	double y[SIM_NODES];
+	double d;
+	uint32_t i;
+	uint32_t j;
+
+	for(i = 1; i < sim_node_count; i++){
+		d = pow(10.0, (sim_nodes[i].path_loss - SIM_PATH_1M_DB) / (10.0 * SIM_PATH_EXPONENT));
+		x[i] = d * cos(i * SIM_GOLDEN_ANGLE);
+		y[i] = d * sin(i * SIM_GOLDEN_ANGLE);
+	}
+	for(i = 0; i < sim_node_count; i++){
+		for(j = 0; j < sim_node_count; j++){
+			if(i == j){
+				sim_paths[i][j] = 0;
+			}
+			else if((i == 0) || (j == 0)){
+				sim_paths[i][j] = sim_nodes[i + j].path_loss;
+			}
+			else if((sim_nodes[i].path_loss == 0) || (sim_nodes[j].path_loss == 0)){
+				sim_paths[i][j] = 0;
+			}
+			else{
+				d = hypot(x[i] - x[j], y[i] - y[j]);
+				sim_paths[i][j] = (uint32_t)(SIM_PATH_1M_DB + 10.0 * SIM_PATH_EXPONENT * log10((d > 1.0) ? d : 1.0));
+			}
+		}
+	}
+}
+
+// dBm a node's frame arrives with at another, before the fading
+static double sim_dbm(const sim_node_t *sender, const sim_node_t *receiver)
+{
+	uint32_t path = sim_path(sender, receiver);
+
+	return (path == 0) ? SIM_RSSI : tx_power_levels[sender->air.frame.power].dbm - (double)path;
+}
+
+// the RSSI a frame arrives with, and whether it is lost: sim_loss, and
+// over a path loss that fades from frame to frame a chance of 1% at the
+// profile's sensitivity, ten times less for each 1.5 dB over it and the
+// steep rise of a GFSK receiver under it
+static bool sim_lost(sim_frame_t *frame, const sim_node_t *sender, const sim_node_t *receiver)
+{
+	double margin;
+	double lost;
+
+	if(sim_path(sender, receiver) == 0){
+		frame->rssi = SIM_RSSI;
+		return sim_chance() < sim_loss;
+	}
+	margin = sim_dbm(sender, receiver) + SIM_FADING_DB * sim_gauss();
+	frame->rssi = (int8_t)((margin < -128.0) ? -128.0 : margin);
+	margin -= phy_profiles[frame->profile].sensitivity;
+	lost = 1.0 - (1.0 - sim_loss) * (1.0 - 1.0 / (1.0 + 99.0 * pow(10.0, margin / 1.5)));
+	return sim_chance() < lost;
+}
+
+// another frame on the air at a receiver, less than SIM_CAPTURE_DB under
+// the one it takes, which the CRC then fails on
+static bool sim_collides(const sim_node_t *node, const sim_node_t *sender, int8_t rssi, uint32_t now)
+{
+	const sim_node_t *other;
+	uint32_t i;
+
+	for(i = 0; i < sim_on_air_count; i++){
+		other = sim_on_air[i];
+		if((other != node) && (other != sender) && (now >= other->air.start) &&
+			(sim_dbm(other, node) > rssi - SIM_CAPTURE_DB)){
+			return true;
+		}
+	}
+	return false;
+}
+
+static uint32_t sim_get32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static sim_peer_t *sim_peer(sim_node_t *node, uint16_t addr)
+{
+	uint32_t i;
+
+	for(i = 0; i < node->peer_count; i++){
+		if(node->peers[i].addr == addr){
+			return &node->peers[i];
+		}
+	}
+	return NULL;
+}
+
+// the power control's index for a node: the base's entry for it in the
+// node table, which frames heard create as tx_power_radio does, and a
+// remote's one peer
+static uint32_t sim_power_peer(sim_node_t *node, uint16_t addr, bool create)
+{
+	sim_peer_t *peer = sim_peer(node, addr);
+
+	if(node == &sim_nodes[0]){
+		return node_table_number(node_table_lookup(addr, create));
+	}
+	return (peer != NULL) ? (uint32_t)(peer - node->peers) : TX_POWER_UNTRACKED;
+}
+
+// arq_send_fn: into the radio's queue, as tx_queue_submit(), at the
+// power for the node the frame is to
+static bool sim_send(void *ctx, arq_link_t *link, const uint8_t *data, uint8_t len, uint32_t reply_us)
+{
+	sim_node_t *node = ctx;
+	sim_frame_t *frame;
+
+	if(node->head - node->tail == SIM_QUEUE_DEPTH){
+		return false;
+	}
+	frame = &node->queue[node->head++ % SIM_QUEUE_DEPTH];
+	frame->link = link;
+	frame->bulk = false;
+	frame->to = frame_get16(&data[FRAME_HEADER_LEN]);
+	frame->reply_us = reply_us;
+	frame->profile = PHY_NETWORK;
+	frame->power = tx_power_level(&node->power, sim_power_peer(node, frame->to, false));
+	frame->len = len;
+	memcpy(frame->data, data, len);
+	return true;
+}
+
+// bulk_send_fn: the same queue, a window asked for is the SACK's
+static bool sim_bulk_send(void *ctx, const uint8_t *data, uint8_t len, uint32_t reply_us, uint8_t profile)
+{
+	sim_node_t *node = ctx;
+	sim_frame_t *frame;
+
+	if(!sim_send(ctx, NULL, data, len, reply_us)){
+		return false;
+	}
+	frame = &node->queue[(node->head - 1U) % SIM_QUEUE_DEPTH];
+	frame->bulk = (reply_us != 0);
+	frame->profile = profile;
+	return true;
+}
+
+// bulk_listen_fn: the radio's node address, profile and whether it listens
+static void sim_bulk_listen(void *ctx, bool on, uint8_t addr, uint8_t profile)
+{
+	sim_node_t *node = ctx;
+
+	node->node_addr = addr;
+	node->rx_profile = profile;
+	node->listens = on || node->own_listens;
+}
+
+// the blob's bytes, from their offset
+static uint8_t sim_blob_byte(uint32_t offset)
+{
+	return (uint8_t)((offset * 167U) ^ (offset >> 8) ^ (offset >> 16));
+}
+
+static void sim_bulk_source(void *ctx, uint32_t offset, uint8_t *data, uint32_t len)
+{
+	uint32_t i;
+
+	(void)ctx;
+	for(i = 0; i < len; i++){
+		data[i] = sim_blob_byte(offset + i);
+	}
+}
+
+static void sim_bulk_sink(void *ctx, uint16_t peer, uint32_t offset, const uint8_t *data, uint32_t len)
+{
+	sim_node_t *node = ctx;
+	uint32_t i;
+
+	(void)peer;
+	if(offset + len > node->blob_size){
+		node->blob_rewrites++;
+		return;
+	}
+	for(i = 0; i < len; i++){
+		if(node->blob_seen[offset + i]){
+			node->blob_rewrites++;
+		}
+		node->blob[offset + i] = data[i];
+		node->blob_seen[offset + i] = 1;
+	}
+}
+
+// a sender's ctx is the peer the blob went to, a receiver's its node and
+// the result BULK_RECEIVED
+static void sim_bulk_done(const bulk_t *bulk, bulk_result_t result, void *ctx)
+{
+	sim_peer_t *peer = ctx;
+
+	if(result != BULK_RECEIVED){
+		peer->bulk_over = true;
+		peer->bulk_result = result;
+		peer->bulk_profile = bulk->tx.profile;
+		peer->bulk_start_us = bulk->tx.start_us;
+		peer->bulk_end_us = bulk->tx.end_us;
+		peer->bulk_stats = bulk->stats;
+	}
+}
+
+static void sim_done(const arq_link_t *link, arq_result_t result, void *ctx)
+{
+	sim_peer_t *peer = ctx;
+	uint32_t message = sim_get32(&link->frame[ARQ_HEADER_LEN]);
+
+	if(result == ARQ_DELIVERED){
+		peer->delivered++;
+		if(!peer->back->taken[message]){
+			peer->false_acks++;
+		}
+	}
+	else{
+		peer->gave_up++;
+	}
+}
+
+// the frame and its window are over, the main loop hears of it next
+static void sim_close(sim_node_t *node, bool replied)
+{
+	sim_closed_t *closed;
+
+	node->state = SIM_IDLE;
+	if((node->active.link != NULL) || node->active.bulk){
+		closed = &node->closed[node->closed_count++];
+		closed->link = node->active.link;
+		closed->bulk = node->active.bulk;
+		closed->replied = replied;
+		closed->to = node->active.to;
+		closed->profile = node->active.profile;
+	}
+}
+
+// heard if receiving on the frame's profile at the sync word, which also
+// stops the window timer, and then only with a destination the radio
+// filters for and nothing else on the air as strong. a radio already
+// taking a frame misses the next
+static void sim_sync(sim_node_t *node, sim_node_t *sender, uint32_t now)
+{
+	const sim_frame_t *frame = &sender->air.frame;
+	uint8_t profile = (node->state == SIM_WINDOW) ? node->active.profile : node->rx_profile;
+
+	node->synced[sender - sim_nodes] = sender->air.sync;
+	if(!((node->state == SIM_WINDOW) || ((node->state == SIM_IDLE) && node->listens)) ||
+		(frame->profile != profile) ||
+		((frame->data[FRAME_DST_OFFSET] != node->node_addr) && (frame->data[FRAME_DST_OFFSET] != SIM_NETWORK))){
+		return;
+	}
+	if(node->from != NULL){
+		node->collided++;
+		return;
+	}
+	node->incoming = *frame;
+	if(sim_lost(&node->incoming, sender, node)){
+		node->lost++;
+	}
+	else if(sim_collides(node, sender, node->incoming.rssi, now)){
+		node->collided++;
+	}
+	else{
+		node->from = sender;
+		node->incoming_end = sender->air.end;
+	}
+}
+
+static void sim_radio(sim_node_t *node, uint32_t now)
+{
+	sim_node_t *sender;
+	uint32_t i;
+
+	if((node->state == SIM_TX) && (now >= node->air.end)){
+		node->air.on = false;
+		for(i = 0; sim_on_air[i] != node; i++){
+		}
+		sim_on_air[i] = sim_on_air[--sim_on_air_count];
+		if(node->active.reply_us != 0){
+			node->state = SIM_WINDOW;
+			node->window_end = now + node->active.reply_us;
+		}
+		else{
+			sim_close(node, false);
+		}
+	}
+
+	for(i = 0; i < sim_on_air_count; i++){
+		sender = sim_on_air[i];
+		if((sender != node) && (now >= sender->air.sync) && (node->synced[sender - sim_nodes] != sender->air.sync)){
+			sim_sync(node, sender, now);
+		}
+	}
+	if((node->from != NULL) && sim_collides(node, node->from, node->incoming.rssi, now)){
+		node->from = NULL;
+		node->collided++;
+	}
+	if((node->from != NULL) && (now >= node->incoming_end)){
+		node->from = NULL;
+		node->rx[node->rx_count] = node->incoming;
+		node->rx_us[node->rx_count++] = now;
+		if(node->state == SIM_WINDOW){
+			sim_close(node, true);
+		}
+	}
+	if((node->state == SIM_WINDOW) && (node->from == NULL) && (now >= node->window_end)){
+		sim_close(node, false);
+	}
+
+	// the next frame goes out at once, out of any RX in progress
+	if((node->state == SIM_IDLE) && (node->head != node->tail)){
+		if(node->from != NULL){
+			node->from = NULL;
+			node->aborted++;
+		}
+		node->active = node->queue[node->tail++ % SIM_QUEUE_DEPTH];
+		node->state = SIM_TX;
+		node->air.on = true;
+		node->air.start = now + SIM_TURNAROUND_US;
+		node->air.sync = node->air.start + phy_sync_us(node->active.profile);
+		node->air.end = node->air.start + phy_airtime_us(node->active.profile, node->active.len);
+		node->air.frame = node->active;
+		sim_on_air[sim_on_air_count++] = node;
+	}
+}
+
+static void sim_take(sim_node_t *node, const sim_frame_t *frame)
+{
+	sim_peer_t *peer = sim_peer(node, frame_src(frame->data));
+	uint32_t message = sim_get32(&frame->data[ARQ_HEADER_LEN]);
+
+	if(peer == NULL){
+		return;
+	}
+	if((message >= peer->back->messages) || peer->taken[message] || ((int64_t)message <= peer->last)){
+		peer->disorder++;
+		return;
+	}
+	peer->taken[message] = 1;
+	peer->last = message;
+	peer->taken_count++;
+}
+
+static void sim_repeat(sim_node_t *node, const sim_frame_t *frame)
+{
+	sim_peer_t *peer = sim_peer(node, frame_src(frame->data));
+
+	if(peer != NULL){
+		peer->repeats++;
+	}
+}
+
+static bool sim_peer_done(const sim_peer_t *peer)
+{
+	return peer->delivered + peer->gave_up == peer->messages;
+}
+
+// what the main loop does on the target, in its order: windows closed,
+// frames received, then retries, the bulk transfer and new messages.
+// the power control hears of both as arq_radio and bulk_radio tell it
+static void sim_main(sim_node_t *node, uint32_t now)
+{
+	const sim_frame_t *frame;
+	sim_peer_t *peer;
+	node_t *entry;
+	uint8_t data[4];
+	uint8_t profile;
+	uint32_t i;
+
+	for(i = 0; i < node->closed_count; i++){
+		if(!node->closed[i].replied){
+			tx_power_miss(&node->power, sim_power_peer(node, node->closed[i].to, true), node->closed[i].profile);
+		}
+		if(node->closed[i].bulk){
+			bulk_window_closed(&node->bulk, node->closed[i].replied);
+		}
+		else{
+			arq_window_closed(&node->arq, node->closed[i].link);
+		}
+	}
+	node->closed_count = 0;
+
+	for(i = 0; i < node->rx_count; i++){
+		frame = &node->rx[i];
+		if(bulk_rx(&node->bulk, frame->data, frame->len, node->rx_us[i], frame->rssi)){
+			if((frame->len >= BULK_SACK_LEN) && (frame_type(frame->data) == FRAME_SACK)){
+				tx_power_feedback(&node->power, sim_power_peer(node, frame_src(frame->data), true),
+					(int8_t)frame->data[BULK_RSSI_OFFSET]);
+			}
+			continue;
+		}
+		switch(arq_rx(&node->arq, frame->data, frame->len, node->rx_us[i], frame->rssi))
+		{
+			case ARQ_RX_DATA:
+				// the base's node table stops repeats a link handed on
+				// let through, as subghz_packet_received() does
+				if((node == &sim_nodes[0]) &&
+					(node_table_rx(frame->data, frame->len, node->rx_us[i], frame->rssi, &entry) == NODE_RX_DUP)){
+					sim_repeat(node, frame);
+				}
+				else{
+					sim_take(node, frame);
+				}
+				break;
+			case ARQ_RX_DUP:
+				sim_repeat(node, frame);
+				break;
+			case ARQ_RX_ACK:
+				if(frame->len >= ARQ_ACK_LEN){
+					tx_power_feedback(&node->power, sim_power_peer(node, frame_src(frame->data), true),
+						(int8_t)frame->data[ARQ_RSSI_OFFSET]);
+				}
+				break;
+			default:
+				break;
+		}
+	}
+	node->rx_count = 0;
+
+	// a receiver's retries wait for the session's end, the sender is
+	// deaf while it sends fragments
+	if(!node->bulk.rx.active){
+		arq_poll(&node->arq, now);
+	}
+	bulk_poll(&node->bulk, now);
+
+	for(i = 0; i < node->peer_count; i++){
+		peer = &node->peers[i];
+
+		// one blob at a time, each after the node's own messages to its
+		// peer, which tell the power control about it
+		if((node->bulk_size != 0) && !peer->bulk_started && sim_peer_done(peer) && !bulk_busy(&node->bulk)){
+			profile = node->bulk_adr ? tx_power_profile(&node->power, sim_power_peer(node, peer->addr, false)) : PHY_NETWORK;
+			peer->bulk_before = node->bulk.stats;
+			peer->bulk_started = bulk_send(&node->bulk, peer->addr, node->bulk_size, profile, sim_bulk_source,
+				sim_bulk_done, peer, now);
+		}
+
+		// a receiver holds its own messages back while a session is open
+		if((peer->next < peer->messages) && (now >= peer->next_us) && !node->bulk.rx.active &&
+			arq_ready(&node->arq, peer->addr)){
+			data[0] = (uint8_t)peer->next;
+			data[1] = (uint8_t)(peer->next >> 8);
+			data[2] = (uint8_t)(peer->next >> 16);
+			data[3] = (uint8_t)(peer->next >> 24);
+			if(arq_send(&node->arq, peer->addr, data, sizeof(data), sim_done, peer, now)){
+				peer->next++;
+				peer->next_us = now + sim_interval_us;
+			}
+		}
+		if((peer->done_us == 0) && sim_peer_done(peer)){
+			peer->done_us = now;
+		}
+	}
+}
+
+static void sim_node_init(sim_node_t *node, uint16_t addr, bool listens, uint32_t path_loss)
+{
+	memset(node, 0, sizeof(*node));
+	node->listens = listens;
+	node->own_listens = listens;
+	node->node_addr = SIM_NETWORK;
+	node->rx_profile = PHY_NETWORK;
+	node->path_loss = path_loss;
+	tx_power_init(&node->power);
+	arq_init(&node->arq, addr, SIM_NETWORK, sim_send, node);
+	bulk_init(&node->bulk, addr, SIM_NETWORK, sim_bulk_send, sim_bulk_listen, node);
+	bulk_accept(&node->bulk, sim_bulk_sink, sim_bulk_done, node);
+}
+
+// the base and a remote as each other's peers, with the messages each
+// sends the other, the first ones at a random time in the interval
+static void sim_pair(sim_node_t *base, sim_node_t *remote, uint32_t downlink, uint32_t uplink)
+{
+	sim_peer_t *down = &base->peers[base->peer_count++];
+	sim_peer_t *up = &remote->peers[remote->peer_count++];
+
+	down->node = remote;
+	down->back = up;
+	down->addr = remote->arq.addr;
+	down->messages = downlink;
+	down->last = -1;
+	down->taken = calloc(uplink + 1U, 1);
+	down->next_us = (uint32_t)(sim_chance() * sim_interval_us);
+	up->node = base;
+	up->back = down;
+	up->addr = base->arq.addr;
+	up->messages = uplink;
+	up->last = -1;
+	up->taken = calloc(downlink + 1U, 1);
+	up->next_us = (uint32_t)(sim_chance() * sim_interval_us);
+}
+
+static bool sim_finished(const sim_node_t *node)
+{
+	uint32_t i;
+
+	for(i = 0; i < node->peer_count; i++){
+		if(!sim_peer_done(&node->peers[i]) || ((node->bulk_size != 0) && !node->peers[i].bulk_over)){
+			return false;
+		}
+	}
+	return true;
+}
+
+static void sim_report(sim_node_t *node, const sim_peer_t *peer)
+{
+	const arq_link_t *link = arq_link(&node->arq, peer->addr, false);
+	const arq_link_stats_t *s;
+
+	if(peer->messages == 0){
+		return;
+	}
+	if(link == NULL){
+		printf("  %s to %s: %u messages, %u delivered, %u given up, link handed on\n",
+			node->name, peer->node->name, peer->messages, peer->delivered, peer->gave_up);
+	}
+	else{
+		s = &link->stats;
+		printf("  %s to %s: %u messages, %u delivered, %u given up, %u retries, %.2f transmissions each\n",
+			node->name, peer->node->name, peer->messages, peer->delivered, peer->gave_up, s->retries,
+			(double)s->transmissions / peer->messages);
+		printf("  %s to %s: RTT %u min, %u avg, %u max us, delivered after 1..4 tries %u %u %u %u, %.1f messages/s\n",
+			node->name, peer->node->name, (s->rtt_samples != 0) ? s->rtt_min : 0,
+			(s->rtt_samples != 0) ? (uint32_t)(s->rtt_total / s->rtt_samples) : 0, s->rtt_max,
+			s->tries[0], s->tries[1], s->tries[2], s->tries[3],
+			(peer->done_us != 0) ? peer->delivered * 1e6 / peer->done_us : 0.0);
+	}
+	printf("  %s took %u, %u repeats, %u out of order, %u lost, %u collided, %u cut short\n",
+		peer->node->name, peer->back->taken_count, peer->back->repeats, peer->back->disorder,
+		peer->node->lost, peer->node->collided, peer->node->aborted);
+}
+
+// the node's bulk counters over the one blob
+static void sim_bulk_report(const sim_node_t *node, const sim_peer_t *peer)
+{
+	const bulk_stats_t *b = &peer->bulk_before;
+	const bulk_stats_t *e = &peer->bulk_stats;
+	const bulk_stats_t *r = &peer->node->bulk.stats;
+	uint32_t us = peer->bulk_end_us - peer->bulk_start_us;
+	uint32_t bps = bulk_goodput_bps(node->bulk_size, us);
+	uint32_t rate = phy_profiles[peer->bulk_profile].bit_rate;
+
+	if(node->bulk_size == 0){
+		return;
+	}
+	printf("  bulk %s to %s: %u bytes %s in %.2f s, %u rounds, %u fragments, %u repeats, %u opens, %u polls, "
+		"%u no SACK\n", node->name, peer->node->name, node->bulk_size,
+		(peer->bulk_result == BULK_DELIVERED) ? "delivered" : "given up", us / 1e6, e->rounds - b->rounds,
+		e->fragments - b->fragments, e->repeats - b->repeats, e->opens - b->opens, e->polls - b->polls,
+		e->no_sack - b->no_sack);
+	printf("  bulk %s to %s: goodput %u bps, %.1f%% of %u bps; %s took %u fragments, %u repeats, %u SACKs sent\n",
+		node->name, peer->node->name, bps, bps * 100.0 / rate, rate, peer->node->name,
+		r->rx_fragments, r->rx_dups, r->sacks_sent);
+}
+
+// every message delivered or given up, none taken twice or out of order,
+// none reported delivered that wasn't taken; a blob delivered arrived
+// whole and as sent, every byte written once
+static bool sim_check(const sim_node_t *node, const sim_peer_t *peer)
+{
+	const sim_node_t *other = peer->node;
+	uint32_t i;
+
+	if(!sim_peer_done(peer) || (peer->false_acks != 0) ||
+		(peer->back->disorder != 0) || (peer->back->taken_count < peer->delivered)){
+		return false;
+	}
+	if((node->bulk_size == 0) || (peer->bulk_result != BULK_DELIVERED)){
+		return true;
+	}
+	if((other->bulk.stats.rx_complete != 1) || (other->blob_rewrites != 0)){
+		return false;
+	}
+	for(i = 0; i < node->bulk_size; i++){
+		if(!other->blob_seen[i] || (other->blob[i] != sim_blob_byte(i))){
+			return false;
+		}
+	}
+	return true;
+}
+
+int arq_sim_run(const arq_sim_config_t *config, arq_sim_result_t *result)
+{
+	sim_node_t *base = &sim_nodes[0];
+	sim_node_t *remote;
+	sim_peer_t *peer;
+	uint32_t remotes = (config->remotes != 0) ? config->remotes : 1U;
+	uint32_t first_us = UINT32_MAX;
+	uint32_t last_us = 0;
+	uint32_t now;
+	uint32_t i;
+	bool finished;
+	bool ok = true;
+
+	if(remotes > ARQ_SIM_REMOTES){
+		return 1;
+	}
+	sim_random = 0x2545F4914F6CDD1DULL ^ config->seed;
+	sim_loss = config->loss;
+	sim_interval_us = config->interval_us;
+	sim_node_count = remotes + 1U;
+	sim_on_air_count = 0;
+	node_table_init();
+
+	sim_node_init(base, FRAME_ADDR_BASE, true, 0);
+	snprintf(base->name, sizeof(base->name), "base");
+	base->bulk_size = config->bulk_size;
+	base->bulk_adr = config->adr;
+	for(i = 0; i < remotes; i++){
+		remote = &sim_nodes[1U + i];
+		sim_node_init(remote, (uint16_t)(SIM_ADDR_REMOTE + i), config->remote_listens,
+			(config->path_losses != NULL) ? config->path_losses[i] : config->path_loss);
+		snprintf(remote->name, sizeof(remote->name), (remotes == 1U) ? "remote" : "remote %u", i);
+		remote->blob_size = config->bulk_size;
+		remote->blob = calloc(config->bulk_size + 1U, 1);
+		remote->blob_seen = calloc(config->bulk_size + 1U, 1);
+		sim_pair(base, remote, config->downlink, config->uplink);
+	}
+	sim_place();
+
+	for(now = SIM_STEP_US; now < SIM_TIME_LIMIT_US; now += SIM_STEP_US){
+		for(i = sim_node_count; i-- > 0; ){
+			sim_radio(&sim_nodes[i], now);
+		}
+		finished = true;
+		for(i = sim_node_count; i-- > 0; ){
+			sim_main(&sim_nodes[i], now);
+			finished = finished && sim_finished(&sim_nodes[i]);
+		}
+		if(finished){
+			break;
+		}
+	}
+
+	if(!config->quiet){
+		printf("arq sim: %.0f%% loss, %u remote%s %s, %.2f s simulated\n", config->loss * 100.0, remotes,
+			(remotes == 1U) ? "" : "s", config->remote_listens ? "listening" : "in ACK windows only", now / 1e6);
+		for(i = 1; i < sim_node_count; i++){
+			sim_report(&sim_nodes[i], &sim_nodes[i].peers[0]);
+		}
+		for(i = 0; i < base->peer_count; i++){
+			sim_report(base, &base->peers[i]);
+		}
+		for(i = 0; i < base->peer_count; i++){
+			sim_bulk_report(base, &base->peers[i]);
+		}
+	}
+
+	if(result != NULL){
+		memset(result, 0, sizeof(*result));
+	}
+	for(i = 0; i < base->peer_count; i++){
+		peer = &base->peers[i];
+		if(peer->bulk_started){
+			first_us = (peer->bulk_start_us < first_us) ? peer->bulk_start_us : first_us;
+			last_us = (peer->bulk_end_us > last_us) ? peer->bulk_end_us : last_us;
+		}
+		if(result != NULL){
+			result->remote[i].bytes = (peer->bulk_result == BULK_DELIVERED) ? config->bulk_size : 0;
+			result->remote[i].us = peer->bulk_end_us - peer->bulk_start_us;
+			result->remote[i].profile = peer->bulk_profile;
+			result->remote[i].dbm =
+				tx_power_levels[tx_power_level(&base->power, sim_power_peer(base, peer->addr, false))].dbm;
+			result->bulk_bytes += result->remote[i].bytes;
+			result->blobs += (result->remote[i].bytes != 0);
+		}
+		ok = ok && sim_check(base, peer) && sim_check(peer->node, peer->back);
+	}
+	if(result != NULL){
+		result->bulk_us = (last_us > first_us) ? last_us - first_us : 0;
+	}
+
+	ok = ok && (now < SIM_TIME_LIMIT_US);
+	remote = &sim_nodes[1];
+	if(ok && (remotes == 1U) && (config->loss == 0.0) && (config->downlink == 0) && (config->bulk_size == 0)){
+		// nothing lost and nothing in the way: every frame answered at once
+		ok = (remote->arq.links[0].stats.retries == 0);
+	}
+	for(i = 0; ok && (config->bulk_size != 0) && (i < base->peer_count); i++){
+		// without a path loss every blob gets through, and with one
+		// remote and nothing lost nothing is sent twice
+		peer = &base->peers[i];
+		ok = ((peer->node->path_loss != 0) || (peer->bulk_result == BULK_DELIVERED)) &&
+			((remotes != 1U) || (config->loss != 0.0) || (peer->bulk_stats.repeats == peer->bulk_before.repeats));
+	}
+	for(i = 0; i < sim_node_count; i++){
+		while(sim_nodes[i].peer_count > 0){
+			free(sim_nodes[i].peers[--sim_nodes[i].peer_count].taken);
+		}
+		free(sim_nodes[i].blob);
+		free(sim_nodes[i].blob_seen);
+	}
+	return ok ? 0 : 1;
+}
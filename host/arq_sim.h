@@ -0,0 +1,78 @@
+/*
+ * arq_sim.h
+ *
+ * the firmware ARQ (inc/arq.h) between simulated radios on one channel:
+ * the base station and one remote, or as many as ARQ_SIM_REMOTES at
+ * once. each radio is half duplex, sends its queue back to back and
+ * opens the RX window a frame asks for, the way tx_queue.c and trx.c
+ * drive the real one; a frame is heard only by a radio receiving when
+ * its sync word comes in and not already taking another, and is then
+ * lost with the configured chance, or to any other frame on the air
+ * that comes in less than 6 dB under it. time is simulated,
+ * in steps of a few us.
+ *
+ * each message carries its number, so the receiving side can tell a
+ * repeat or a gap that the ARQ let through; the base's node table drops
+ * repeats first, as on the target. a node sends its messages back to
+ * back, or an interval apart from a random start, as a population would
+ * report.
+ *
+ * the base can also push a blob to each remote through the bulk
+ * transfer (inc/bulk.h), one after the other, each once the base's
+ * messages to that remote are through, checked byte for byte at the
+ * remote. radios filter on the destination byte as the real ones do, on
+ * their node address and on the network address as the broadcast one,
+ * and hear only frames on the profile they are on.
+ *
+ * with a path loss each node runs the power control (inc/tx_power.h) on
+ * the ACKs and SACKs, per peer: the base's index is the remote's number,
+ * as its node table entry would be. frames are lost by their margin over
+ * the sensitivity of their profile on top of the configured chance;
+ * remotes are as far from each other as the farther of the two is from
+ * the base. with adr each blob goes on the profile the base picked for
+ * its remote.
+ */
+
+#ifndef __ARQ_SIM_H
+#define __ARQ_SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ARQ_SIM_REMOTES				32		// most remotes the base serves at once
+
+typedef struct
+{
+	double loss;				// chance a frame goes unheard by the other radio
+	uint32_t remotes;			// up to ARQ_SIM_REMOTES, 0 for one
+	uint32_t uplink;			// messages from each remote to the base
+	uint32_t downlink;			// messages from the base to each remote
+	uint32_t interval_us;		// between a node's messages to a peer, 0 for back to back
+	bool remote_listens;		// false: a remote hears only in its ACK windows, as on the target
+	uint32_t bulk_size;			// bytes the base pushes to each remote, 0 for none
+	uint32_t path_loss;			// dB from each remote to the base, 0 for every frame heard at -80 dBm
+	const uint32_t *path_losses;	// per remote, NULL for path_loss to every one
+	bool adr;					// the blob on the remote's profile, else the network's
+	bool quiet;					// no report
+	uint32_t seed;
+} arq_sim_config_t;
+
+typedef struct
+{
+	uint32_t bytes;				// delivered
+	uint32_t us;				// bulk_send() to the last SACK or the give up
+	uint8_t profile;			// the blob's
+	int8_t dbm;					// the base's power for the remote at the end
+} arq_sim_blob_t;
+
+typedef struct
+{
+	uint32_t bulk_bytes;		// delivered, every remote's
+	uint32_t bulk_us;			// the first blob's bulk_send() to the last one's end
+	uint32_t blobs;				// delivered
+	arq_sim_blob_t remote[ARQ_SIM_REMOTES];
+} arq_sim_result_t;
+
+int arq_sim_run(const arq_sim_config_t *config, arq_sim_result_t *result);
+
+#endif /* __ARQ_SIM_H */
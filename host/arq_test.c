@@ -0,0 +1,122 @@
+// arq_test.c -- the firmware ARQ and bulk transfer on the host: two
+// simulated radios at a few loss rates, and the base's links recycled
+// over more remotes than it has
+
+#include "arq_sim.h"
+#include "arq.h"
+#include "frame.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+
+typedef struct
+{
+	uint8_t frame[ARQ_MAX_FRAME];
+	uint8_t len;
+} arq_capture_t;
+
+static bool arq_capture_send(void *ctx, arq_link_t *link, const uint8_t *frame, uint8_t len, uint32_t reply_us)
+{
+	arq_capture_t *capture = ctx;
+
+	(void)link;
+	(void)reply_us;
+	memcpy(capture->frame, frame, len);
+	capture->len = len;
+	return true;
+}
+
+// the base sending to three times ARQ_LINKS remotes in turn, twice over,
+// one link held by a frame still with the radio: the idle links go round
+// the others, the busy one is kept, and every frame takes the next of the
+// node's sequence numbers, so each remote takes the next frame for new
+static int arq_links_test(void)
+{
+	static const uint8_t data[4] = { 1, 2, 3, 4 };
+	arq_t base;
+	arq_t remote;
+	arq_capture_t sent;
+	arq_capture_t acked;
+	uint8_t ack[ARQ_ACK_LEN];
+	arq_link_t *held;
+	arq_link_t *link;
+	uint32_t delivered = 0;
+	uint32_t taken = 0;
+	uint32_t wrong = 0;
+	uint16_t seq = 0;
+	uint32_t round;
+	uint32_t k;
+
+	arq_init(&base, FRAME_ADDR_BASE, 0x5A, arq_capture_send, &sent);
+	wrong += !arq_send(&base, 0x2FFF, data, sizeof(data), NULL, NULL, 0);
+	held = arq_link(&base, 0x2FFF, false);
+	seq++;
+	for(round = 0; round < 2; round++){
+		for(k = 0; k < 3 * ARQ_LINKS; k++){
+			if(!arq_send(&base, (uint16_t)(0x3000 + k), data, sizeof(data), NULL, NULL, 0) ||
+				(frame_seq(sent.frame) != seq++)){
+				wrong++;
+				continue;
+			}
+			// the remote's own link to the base is as old as the test
+			arq_init(&remote, (uint16_t)(0x3000 + k), 0x5A, arq_capture_send, &acked);
+			if(round != 0){
+				link = arq_link(&remote, FRAME_ADDR_BASE, true);
+				link->rx_valid = true;
+				link->rx_seq = (uint16_t)(seq - 1U - 3 * ARQ_LINKS);
+			}
+			taken += (arq_rx(&remote, sent.frame, sent.len, 0, -70) == ARQ_RX_DATA);
+			link = arq_link(&base, (uint16_t)(0x3000 + k), false);
+			memcpy(ack, acked.frame, sizeof(ack));
+			if((arq_rx(&base, ack, sizeof(ack), 100, -70) != ARQ_RX_ACK) || (link->state != ARQ_IDLE)){
+				wrong++;
+			}
+			delivered += (link->stats.delivered == 1);
+			arq_window_closed(&base, link);
+		}
+	}
+	wrong += (arq_link(&base, 0x2FFF, false) != held) || (held->state != ARQ_WAIT);
+	printf("arq links: %u frames to %u remotes over %u links, %u delivered, %u taken as new, %u links recycled, %s\n",
+		2 * 3 * ARQ_LINKS, 3 * ARQ_LINKS, ARQ_LINKS, delivered, taken, base.recycled,
+		((wrong == 0) && (delivered == 2 * 3 * ARQ_LINKS) && (taken == delivered) &&
+			(base.recycled == 2 * 3 * ARQ_LINKS - (ARQ_LINKS - 1U))) ? "ok" : "FAILED");
+
+	return ((wrong == 0) && (delivered == 2 * 3 * ARQ_LINKS) && (taken == delivered) &&
+		(base.recycled == 2 * 3 * ARQ_LINKS - (ARQ_LINKS - 1U))) ? 0 : 1;
+}
+
+// the ARQ from the remote to the base at rising loss, the remote hearing
+// only in its ACK windows as on the target, then both ways with both
+// listening. last a 64 KiB bulk push to a remote sending its own messages
+// and hearing the open in one of its ACK windows
+static int arq_test(void)
+{
+	static const double losses[] = { 0.0, 0.1, 0.2, 0.4 };
+	arq_sim_config_t config = { .uplink = 1000, .downlink = 0, .remote_listens = false, .seed = 3 };
+	int failed = 0;
+	uint32_t i;
+
+	for(i = 0; i < sizeof(losses) / sizeof(losses[0]); i++){
+		config.loss = losses[i];
+		failed |= arq_sim_run(&config, NULL);
+	}
+	config.loss = 0.1;
+	config.downlink = 1000;
+	config.remote_listens = true;
+	failed |= arq_sim_run(&config, NULL);
+
+	config = (arq_sim_config_t){ .uplink = 200, .downlink = 0, .remote_listens = false, .bulk_size = 65536, .seed = 5 };
+	for(i = 0; i < 3; i++){
+		config.loss = losses[i];
+		failed |= arq_sim_run(&config, NULL);
+	}
+	return failed | arq_links_test();
+}
+
+int main(void)
+{
+	return arq_test();
+}
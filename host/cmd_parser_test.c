@@ -0,0 +1,108 @@
+// cmd_parser_test.c -- the firmware command parser on the host, fed the
+// way the LPUART DMA ring feeds it
+
+#include "hostlink_decode.h"
+#include "cmd_parser.h"
+#include "hostlink_proto.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define TEST_RING_SIZE				512		// small, so frames wrap often
+
+typedef struct
+{
+	uint32_t records;
+	uint32_t mismatches;
+	uint8_t expect[HOSTLINK_MAX_PAYLOAD];
+	uint32_t expect_len;
+} parser_check_t;
+
+static void on_command(const cmd_record_t *rec, void *ctx)
+{
+	parser_check_t *check = ctx;
+
+	check->records++;
+	if((rec->type != HOSTLINK_CMD_PING) || (rec->len != check->expect_len)
+		|| (memcmp(rec->payload, check->expect, rec->len) != 0)){
+		check->mismatches++;
+	}
+}
+
+// the firmware parser fed the way the LPUART DMA feeds it: bytes land in
+// a ring and the parser is told the write position after bursts of
+// random length. every frame is decoded before the next is written so
+// its payload can be compared
+static int parser_test(void)
+{
+	static uint8_t ring[TEST_RING_SIZE];
+	cmd_parser_t parser;
+	parser_check_t check = {0};
+	uint8_t frame[HOSTLINK_MAX_FRAME];
+	uint32_t head = 0;
+	uint32_t sent = 0;
+	uint32_t len;
+	uint32_t i;
+	size_t n;
+	size_t at;
+	size_t burst;
+
+	cmd_parser_init(&parser, ring, sizeof(ring), on_command, &check);
+	srand(2);
+	for(len = 0; len < 4 * HOSTLINK_MAX_PAYLOAD; len++){
+		check.expect_len = len % (HOSTLINK_MAX_PAYLOAD + 1);
+		for(i = 0; i < check.expect_len; i++){
+			check.expect[i] = (rand() % 4 == 0) ? 0 : (uint8_t)rand();
+		}
+		n = hostlink_encode(HOSTLINK_CMD_PING, check.expect, check.expect_len, frame);
+		for(at = 0; at < n; at += burst){
+			burst = 1 + (size_t)rand() % 64;
+			if(burst > n - at){
+				burst = n - at;
+			}
+			for(i = 0; i < burst; i++){
+				ring[head++ % sizeof(ring)] = frame[at + i];
+			}
+			cmd_parser_feed(&parser, head % sizeof(ring));
+		}
+		sent++;
+	}
+
+	// a corrupted frame, garbage longer than any frame, then a good one
+	n = hostlink_encode(HOSTLINK_CMD_PING, "x", 1, frame);
+	frame[3] ^= 0x01;
+	for(i = 0; i < n; i++){
+		ring[head++ % sizeof(ring)] = frame[i];
+	}
+	cmd_parser_feed(&parser, head % sizeof(ring));
+	for(i = 0; i < HOSTLINK_MAX_FRAME + 10; i++){
+		ring[head++ % sizeof(ring)] = 0x55;
+		if(i % 100 == 0){
+			cmd_parser_feed(&parser, head % sizeof(ring));
+		}
+	}
+	ring[head++ % sizeof(ring)] = HOSTLINK_DELIMITER;
+	check.expect_len = 1;
+	check.expect[0] = 'y';
+	n = hostlink_encode(HOSTLINK_CMD_PING, "y", 1, frame);
+	for(i = 0; i < n; i++){
+		ring[head++ % sizeof(ring)] = frame[i];
+	}
+	cmd_parser_feed(&parser, head % sizeof(ring));
+	sent++;
+
+	printf("command parser: %u records sent, %u decoded, %u mismatched, %u wrapped, %u crc errors, %u overruns\n",
+		sent, check.records, check.mismatches, parser.stats.wrapped, parser.stats.crc_errors, parser.stats.overruns);
+
+	return ((check.records == sent) && (check.mismatches == 0) && (parser.stats.crc_errors == 1)
+		&& (parser.stats.overruns == 1)) ? 0 : 1;
+}
+
+int main(void)
+{
+	return parser_test();
+}
@@ -0,0 +1,226 @@
+// fhss_test.c -- the FHSS engine on the host: hop sequence, channel words,
+// calibration band caching, the dwell schedule and the beacon sync
+
+#include "fhss.h"
+#include "frame.h"
+#include "phy.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+
+// the sequence as fhss.h specifies it, worked out apart from fhss.c
+static void reference_sequence(uint32_t seed, uint8_t *sequence)
+{
+	uint32_t x = (seed != 0) ? seed : FHSS_DEFAULT_SEED;
+	uint32_t i;
+	uint32_t j;
+	uint8_t tmp;
+
+	for(i = 0; i < FHSS_CHANNELS; i++){
+		sequence[i] = (uint8_t)i;
+	}
+	for(i = FHSS_CHANNELS - 1; i > 0; i--){
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		j = x % (i + 1);
+		tmp = sequence[i];
+		sequence[i] = sequence[j];
+		sequence[j] = tmp;
+	}
+}
+
+// the remotes' shuffle is the base's: same seed, same order, every
+// channel once, and the position table its inverse
+static int sequence_test(void)
+{
+	static fhss_t fhss;
+	static fhss_t other;
+	uint8_t expected[FHSS_CHANNELS];
+	bool seen[FHSS_CHANNELS] = {0};
+	uint32_t wrong = 0;
+	uint32_t in_order = 0;
+	uint32_t i;
+
+	fhss_init(&fhss, 0);
+	reference_sequence(0, expected);
+	for(i = 0; i < FHSS_CHANNELS; i++){
+		if((fhss.sequence[i] != expected[i]) || seen[fhss.sequence[i]] || (fhss.position[fhss.sequence[i]] != i)){
+			wrong++;
+		}
+		seen[fhss.sequence[i]] = true;
+		if(fhss.sequence[i] == i){
+			in_order++;
+		}
+	}
+	fhss_init(&other, FHSS_DEFAULT_SEED);
+	if(memcmp(fhss.sequence, other.sequence, sizeof(fhss.sequence)) != 0){
+		wrong++;
+	}
+	fhss_init(&other, 12345);
+	reference_sequence(12345, expected);
+	if((memcmp(other.sequence, expected, sizeof(expected)) != 0) ||
+		(memcmp(fhss.sequence, other.sequence, sizeof(fhss.sequence)) == 0)){
+		wrong++;
+	}
+
+	printf("fhss sequence: %u channels, starts %u %u %u %u, %u in place, %u wrong, %s\n", FHSS_CHANNELS,
+		fhss.sequence[0], fhss.sequence[1], fhss.sequence[2], fhss.sequence[3], in_order, wrong,
+		(wrong == 0) ? "ok" : "FAILED");
+	return (wrong == 0) ? 0 : 1;
+}
+
+// every word is the 64-bit conversion SetRfFrequency() did at each call,
+// and the plan finds its channels and nothing between them
+static int channel_test(void)
+{
+	static fhss_t fhss;
+	uint32_t wrong = 0;
+	uint32_t freq;
+	uint32_t word;
+	uint32_t i;
+	const fhss_channel_t *ch;
+
+	fhss_init(&fhss, 0);
+	for(i = 0; i < FHSS_CHANNELS; i++){
+		freq = fhss_frequency((uint8_t)i);
+		word = (uint32_t)(((uint64_t)freq << 25) / PHY_XTAL_FREQ);
+		ch = &fhss.channels[i];
+		if((ch->word[0] != (uint8_t)(word >> 24)) || (ch->word[1] != (uint8_t)(word >> 16)) ||
+			(ch->word[2] != (uint8_t)(word >> 8)) || (ch->word[3] != (uint8_t)word) ||
+			(ch->cal[0] != (freq - PHY_CAL_STEP) / PHY_CAL_STEP) || (ch->cal[1] != (freq + PHY_CAL_STEP) / PHY_CAL_STEP) ||
+			(fhss_position(&fhss, freq) != fhss.position[i])){
+			wrong++;
+		}
+	}
+	// 915 MHz, the boot channel: 915e6 * 2^25 / 32e6
+	ch = &fhss.channels[(915000000 - FHSS_BASE_FREQ) / FHSS_SPACING];
+	if((ch->word[0] != 0x39) || (ch->word[1] != 0x30) || (ch->word[2] != 0x00) || (ch->word[3] != 0x00)){
+		wrong++;
+	}
+	if((fhss_position(&fhss, 915100000) != FHSS_OFF_PLAN) || (fhss_position(&fhss, FHSS_BASE_FREQ - FHSS_SPACING) != FHSS_OFF_PLAN) ||
+		(fhss_position(&fhss, fhss_frequency(FHSS_CHANNELS - 1) + FHSS_SPACING) != FHSS_OFF_PLAN)){
+		wrong++;
+	}
+
+	printf("fhss channels: %u to %u kHz, %u words and calibration bands wrong, %s\n",
+		fhss_frequency(0) / 1000U, fhss_frequency(FHSS_CHANNELS - 1) / 1000U, wrong, (wrong == 0) ? "ok" : "FAILED");
+	return (wrong == 0) ? 0 : 1;
+}
+
+// three times round the sequence: a calibration exactly where the band
+// differs from the one before, none for a retune to the same channel,
+// and one again once the calibration is lost
+static int calibration_test(void)
+{
+	static fhss_t fhss;
+	const fhss_channel_t *ch;
+	uint32_t expected = 0;
+	uint32_t band = 0;
+	uint32_t wrong = 0;
+	uint32_t hops = 3 * FHSS_CHANNELS;
+	uint32_t i;
+
+	fhss_init(&fhss, 0);
+	for(i = 0; i < hops; i++){
+		ch = fhss_select(&fhss, i);
+		if(fhss_band_changed(&fhss, ch->cal) != (ch->cal[0] != band)){
+			wrong++;
+		}
+		if(ch->cal[0] != band){
+			band = ch->cal[0];
+			expected++;
+		}
+		if(fhss_band_changed(&fhss, ch->cal)){
+			wrong++;
+		}
+	}
+	if(fhss.stats.calibrations != expected){
+		wrong++;
+	}
+	fhss_invalidate_calibration(&fhss);
+	if(!fhss_band_changed(&fhss, fhss.channels[fhss.channel].cal)){
+		wrong++;
+	}
+
+	printf("fhss calibration: %u hops, %u calibrations, %u without the band cache, %u wrong, %s\n",
+		hops, expected, hops, wrong, (wrong == 0) ? "ok" : "FAILED");
+	return (wrong == 0) ? 0 : 1;
+}
+
+// the base's dwells with the clock wrapping under them, the guards at
+// either end, and a remote on a clock 123456789 us off taking the
+// schedule from a beacon
+static int schedule_test(void)
+{
+	static fhss_t base;
+	static fhss_t remote;
+	uint8_t beacon[FHSS_BEACON_LEN];
+	uint32_t offset = 123456789U;
+	uint32_t t0 = 0xFFFFFFFFU - FHSS_DWELL_US;
+	uint32_t wrong = 0;
+	uint32_t now;
+
+	fhss_init(&base, 0);
+	fhss_select(&base, 7);
+	fhss_start(&base, t0);
+
+	if(fhss_tx_allowed(&base, t0 + FHSS_GUARD_US - 1, 1000) || !fhss_tx_allowed(&base, t0 + FHSS_GUARD_US, 1000) ||
+		!fhss_tx_allowed(&base, t0 + FHSS_DWELL_US - FHSS_GUARD_US - 1000, 1000) ||
+		fhss_tx_allowed(&base, t0 + FHSS_DWELL_US - FHSS_GUARD_US - 999, 1000) ||
+		fhss_tx_allowed(&base, t0 + FHSS_DWELL_US, 0) || fhss_dwell_expired(&base, t0 + FHSS_DWELL_US - 1) ||
+		!fhss_dwell_expired(&base, t0 + FHSS_DWELL_US)){
+		wrong++;
+	}
+
+	// a hop 3.5 dwells on, across the wrap, lands on the schedule
+	now = t0 + 3 * FHSS_DWELL_US + FHSS_DWELL_US / 2;
+	fhss_select(&base, fhss_advance(&base, now));
+	if((base.index != 10) || (base.dwell_start != t0 + 3 * FHSS_DWELL_US) || (base.channel != base.sequence[10])){
+		wrong++;
+	}
+
+	// the beacon goes out 1500 us into the dwell, the remote hears it start
+	now = base.dwell_start + 1500;
+	frame_header(beacon, 0x5A, FRAME_ADDR_BASE, 0, FRAME_BEACON);
+	fhss_beacon(&base, now, beacon);
+	fhss_init(&remote, 0);
+	if(remote.synced || fhss_tx_allowed(&remote, 0, 0) ||
+		!fhss_beacon_sync(&remote, beacon, sizeof(beacon), now + offset)){
+		wrong++;
+	}
+	if((remote.index != base.index) || (remote.dwell_start != base.dwell_start + offset - FHSS_LEAD_US) || !remote.synced){
+		wrong++;
+	}
+	// both hop to the same position, the remote FHSS_LEAD_US first
+	now = base.dwell_start + FHSS_DWELL_US;
+	if(!fhss_dwell_expired(&remote, now + offset - FHSS_LEAD_US) || fhss_dwell_expired(&remote, now + offset - FHSS_LEAD_US - 1) ||
+		(fhss_advance(&remote, now + offset) != fhss_advance(&base, now))){
+		wrong++;
+	}
+
+	beacon[FRAME_TYPE_OFFSET] = FRAME_ACK;
+	if(fhss_beacon_sync(&remote, beacon, sizeof(beacon), 0)){
+		wrong++;
+	}
+	beacon[FRAME_TYPE_OFFSET] = FRAME_BEACON;
+	if(fhss_beacon_sync(&remote, beacon, sizeof(beacon) - 1, 0)){
+		wrong++;
+	}
+	beacon[FRAME_HEADER_LEN] = FHSS_CHANNELS;
+	if(fhss_beacon_sync(&remote, beacon, sizeof(beacon), 0) || (remote.stats.syncs != 1) || (base.stats.beacons != 1)){
+		wrong++;
+	}
+
+	printf("fhss schedule: %u us dwells, %u us guards, remote %u us ahead after a beacon, %u wrong, %s\n",
+		FHSS_DWELL_US, FHSS_GUARD_US, FHSS_LEAD_US, wrong, (wrong == 0) ? "ok" : "FAILED");
+	return (wrong == 0) ? 0 : 1;
+}
+
+int main(void)
+{
+	return sequence_test() | channel_test() | calibration_test() | schedule_test();
+}
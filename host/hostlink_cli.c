@@ -0,0 +1,451 @@
+// hostlink_cli.c -- print the records a base station sends over LPUART
+//
+// usage: hostlink [-s] [-b baud] [-c command]... [device]
+//        hostlink -t
+//        hostlink -a loss%
+//
+// reads the serial device (raw, 8N1) or stdin when none is given and
+// prints one line per record. -s adds a rate line on stderr every
+// second. each -c sends a command first, one of
+//   ping | listen <mode> | freq <Hz> | preamble <bits> |
+//   output text|binary | policy <n> | fallback rc|hse32|fs |
+//   send <hex bytes> | arq <peer>:<hex bytes> |
+//   arqcfg <retries>,<ACK timeout us>,<backoff us>,<max backoff us> |
+//   bulk <peer>:<bytes of the firmware image>
+// to the device, or as frames to stdout when there is none. -t
+// round-trips generated records through the encoder and decoder and
+// prints the text vs binary throughput at 115200 baud. -a runs
+// the ARQ simulation at the loss rate given, with traffic both ways.
+
+#include "hostlink_decode.h"
+#include "arq_sim.h"
+#include "frame.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+
+#define DEFAULT_BAUD				115200
+#define UART_BITS_PER_BYTE			10		// start, 8 data, stop
+#define MAX_COMMANDS				16
+
+typedef struct
+{
+	uint64_t packets;
+	uint64_t telemetry;
+	uint64_t logs;
+} cli_counts_t;
+
+static const char *const tlm_rx_names[HOSTLINK_TLM_RX_COUNT] = {
+	"packets", "dropped", "ring_high_water", "ring_overflows",
+	"nodes", "nodes_untracked", "host_frames", "host_bytes"
+};
+
+static void print_packet(const hostlink_record_t *rec)
+{
+	hostlink_packet_t hdr;
+	const uint8_t *payload = rec->payload + sizeof(hdr);
+	uint32_t len;
+	uint32_t i;
+
+	if(rec->len < sizeof(hdr)){
+		printf("packet: short record, %u bytes\n", rec->len);
+		return;
+	}
+	memcpy(&hdr, rec->payload, sizeof(hdr));
+	len = rec->len - sizeof(hdr);
+
+	printf("packet %10u us rssi %4d/%4d flags %#04x", hdr.time_us, hdr.rssi_sync, hdr.rssi_avg, hdr.flags);
+	if(len >= FRAME_HEADER_LEN){
+		printf(" src %#06x seq %5u type %u", frame_src(payload), frame_seq(payload), frame_type(payload));
+	}
+	printf(" len %2u:", len);
+	for(i = 0; i < len; i++){
+		printf(" %02x", payload[i]);
+	}
+	printf("\n");
+}
+
+static void print_telemetry(const hostlink_record_t *rec)
+{
+	uint32_t count = (rec->len - 1U) / 4U;
+	uint32_t value;
+	uint32_t i;
+
+	if(rec->len < 1){
+		printf("telemetry: empty record\n");
+		return;
+	}
+	printf("telemetry group %u:", rec->payload[0]);
+	for(i = 0; i < count; i++){
+		memcpy(&value, &rec->payload[1 + 4 * i], sizeof(value));
+		if((rec->payload[0] == HOSTLINK_TLM_RX) && (i < HOSTLINK_TLM_RX_COUNT)){
+			printf(" %s=%u", tlm_rx_names[i], value);
+		}
+		else{
+			printf(" [%u]=%u", i, value);
+		}
+	}
+	printf("\n");
+}
+
+static void on_record(const hostlink_record_t *rec, void *ctx)
+{
+	cli_counts_t *counts = ctx;
+
+	switch(rec->type)
+	{
+		case HOSTLINK_REC_PACKET:
+			counts->packets++;
+			print_packet(rec);
+			break;
+		case HOSTLINK_REC_TELEMETRY:
+			counts->telemetry++;
+			print_telemetry(rec);
+			break;
+		case HOSTLINK_REC_LOG:
+			counts->logs++;
+			printf("log: %.*s\n", rec->len, (const char *)rec->payload);
+			break;
+		case HOSTLINK_REC_ACK:
+			if(rec->len == HOSTLINK_ACK_LEN){
+				printf("ack: command %#04x tag %u status %u\n", rec->payload[0], rec->payload[1], rec->payload[2]);
+				break;
+			}
+			// fall through
+		default:
+			printf("record type %#04x, %u bytes\n", rec->type, rec->len);
+			break;
+	}
+	fflush(stdout);
+}
+
+static speed_t baud_constant(long baud)
+{
+	switch(baud)
+	{
+		case 9600:		return B9600;
+		case 19200:		return B19200;
+		case 38400:		return B38400;
+		case 57600:		return B57600;
+		case 115200:	return B115200;
+		case 230400:	return B230400;
+		case 460800:	return B460800;
+		case 921600:	return B921600;
+		default:		return B0;
+	}
+}
+
+static int open_serial(const char *path, long baud)
+{
+	struct termios tio;
+	speed_t speed = baud_constant(baud);
+	int fd;
+
+	if(speed == B0){
+		fprintf(stderr, "unsupported baud rate %ld\n", baud);
+		return -1;
+	}
+	fd = open(path, O_RDWR | O_NOCTTY);
+	if(fd < 0){
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	if(tcgetattr(fd, &tio) == 0){
+		cfmakeraw(&tio);
+		cfsetispeed(&tio, speed);
+		cfsetospeed(&tio, speed);
+		tio.c_cflag |= CLOCAL | CREAD;
+		tio.c_cc[VMIN] = 1;
+		tio.c_cc[VTIME] = 0;
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+	return fd;
+}
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// hex digits to bytes, false on anything else
+static bool encode_hex(const char *hex, uint8_t *payload, size_t *len, size_t size)
+{
+	unsigned int byte;
+
+	for(; (hex[0] != '\0') && (hex[1] != '\0') && (*len < size); hex += 2){
+		if(sscanf(hex, "%2x", &byte) != 1){
+			return false;
+		}
+		payload[(*len)++] = (uint8_t)byte;
+	}
+	return true;
+}
+
+// a command line argument as a command frame, 0 if not understood
+static size_t encode_command(const char *text, uint8_t tag, uint8_t *frame)
+{
+	uint8_t payload[HOSTLINK_MAX_PAYLOAD];
+	char name[16];
+	char arg[2 * HOSTLINK_MAX_PAYLOAD] = "";
+	unsigned long value;
+	size_t len = 1;
+	uint8_t type;
+
+	payload[0] = tag;
+	if(sscanf(text, "%15s %499s", name, arg) < 1){
+		return 0;
+	}
+	value = strtoul(arg, NULL, 0);
+
+	if(strcmp(name, "ping") == 0){
+		type = HOSTLINK_CMD_PING;
+	}
+	else if(strcmp(name, "listen") == 0){
+		type = HOSTLINK_CMD_LISTEN;
+		payload[len++] = (uint8_t)value;
+	}
+	else if(strcmp(name, "freq") == 0){
+		type = HOSTLINK_CMD_FREQUENCY;
+		for(int i = 0; i < 4; i++){
+			payload[len++] = (uint8_t)(value >> (8 * i));
+		}
+	}
+	else if(strcmp(name, "preamble") == 0){
+		type = HOSTLINK_CMD_PREAMBLE;
+		frame_put16(&payload[len], (uint16_t)value);
+		len += 2;
+	}
+	else if(strcmp(name, "output") == 0){
+		type = HOSTLINK_CMD_OUTPUT;
+		payload[len++] = (strcmp(arg, "binary") == 0) ? 1 : 0;
+	}
+	else if(strcmp(name, "policy") == 0){
+		type = HOSTLINK_CMD_TX_POLICY;
+		payload[len++] = (uint8_t)value;
+	}
+	else if(strcmp(name, "fallback") == 0){
+		type = HOSTLINK_CMD_FALLBACK;
+		payload[len++] = (strcmp(arg, "fs") == 0) ? 0x40 : (strcmp(arg, "hse32") == 0) ? 0x30 : 0x20;
+	}
+	else if(strcmp(name, "send") == 0){
+		type = HOSTLINK_CMD_SEND;
+		if(!encode_hex(arg, payload, &len, sizeof(payload))){
+			return 0;
+		}
+	}
+	else if(strcmp(name, "arq") == 0){
+		char *data;
+
+		type = HOSTLINK_CMD_ARQ_SEND;
+		frame_put16(&payload[len], (uint16_t)strtoul(arg, &data, 0));
+		len += 2;
+		if((*data != ':') || !encode_hex(data + 1, payload, &len, sizeof(payload))){
+			return 0;
+		}
+	}
+	else if(strcmp(name, "arqcfg") == 0){
+		unsigned long values[4];
+
+		type = HOSTLINK_CMD_ARQ;
+		if(sscanf(arg, "%lu,%lu,%lu,%lu", &values[0], &values[1], &values[2], &values[3]) != 4){
+			return 0;
+		}
+		payload[len++] = (uint8_t)values[0];
+		for(int v = 1; v < 4; v++){
+			for(int i = 0; i < 4; i++){
+				payload[len++] = (uint8_t)(values[v] >> (8 * i));
+			}
+		}
+	}
+	else if(strcmp(name, "bulk") == 0){
+		char *size;
+
+		type = HOSTLINK_CMD_BULK;
+		frame_put16(&payload[len], (uint16_t)strtoul(arg, &size, 0));
+		len += 2;
+		if(*size != ':'){
+			return 0;
+		}
+		value = strtoul(size + 1, NULL, 0);
+		for(int i = 0; i < 4; i++){
+			payload[len++] = (uint8_t)(value >> (8 * i));
+		}
+	}
+	else{
+		return 0;
+	}
+	return hostlink_encode(type, payload, len, frame);
+}
+
+// text the firmware prints per packet in text mode, for the comparison
+static int text_line_len(uint32_t len)
+{
+	char line[160];
+
+	return snprintf(line, sizeof(line),
+		"rx %u bytes from %#06x seq %u at %u.%u, rssi %d/%d dBm, flags %#04x, %u lost %u dup\r\n",
+		len, 0x1234, 12345, 43210, 123456, -87, -88, 0, 3, 1);
+}
+
+// round trip through the encoder and decoder, then bytes and packets per
+// second for each output format at DEFAULT_BAUD
+static int self_test(void)
+{
+	hostlink_decoder_t dec;
+	cli_counts_t counts = {0};
+	uint8_t payload[HOSTLINK_MAX_PAYLOAD];
+	uint8_t frame[HOSTLINK_MAX_FRAME];
+	uint32_t sent = 0;
+	uint32_t len;
+	uint32_t i;
+	size_t n;
+	FILE *out = stdout;
+
+	// the records go to /dev/null, only the counts matter here
+	stdout = fopen("/dev/null", "w");
+	hostlink_decoder_init(&dec, on_record, &counts);
+	srand(1);
+	for(len = 0; len <= HOSTLINK_MAX_PAYLOAD; len++){
+		for(i = 0; i < len; i++){
+			// plenty of zeros to exercise the COBS runs
+			payload[i] = (rand() % 4 == 0) ? 0 : (uint8_t)rand();
+		}
+		n = hostlink_encode(HOSTLINK_REC_PACKET, payload, len, frame);
+		hostlink_decoder_feed(&dec, frame, n);
+		sent++;
+	}
+	// a corrupted frame must be rejected, and the next one still decoded
+	n = hostlink_encode(HOSTLINK_REC_LOG, "corrupt", 7, frame);
+	frame[3] ^= 0x20;
+	hostlink_decoder_feed(&dec, frame, n);
+	n = hostlink_encode(HOSTLINK_REC_LOG, "intact", 6, frame);
+	hostlink_decoder_feed(&dec, frame, n);
+	fclose(stdout);
+	stdout = out;
+
+	printf("round trip: %u packet records sent, %llu decoded, %llu log, %llu crc errors, %llu cobs errors\n",
+		sent, (unsigned long long)counts.packets, (unsigned long long)counts.logs,
+		(unsigned long long)dec.stats.crc_errors, (unsigned long long)dec.stats.cobs_errors);
+
+	printf("\n%u baud, %u bytes/s\n", DEFAULT_BAUD, DEFAULT_BAUD / UART_BITS_PER_BYTE);
+	printf("payload   hex dump       text line      binary\n");
+	for(len = 6; len <= 18; len += 6){
+		// the former dump: buffer status line, then "%#04x, " per byte read (len + 1)
+		uint32_t hex = 32 + 6 + 6 * (len + 1) + 2;
+		uint32_t text = (uint32_t)text_line_len(len);
+
+		memset(payload, 0x5A, sizeof(payload));
+		n = hostlink_encode(HOSTLINK_REC_PACKET, payload, sizeof(hostlink_packet_t) + len, frame);
+		printf("%4u B   %3u B %4u/s   %3u B %4u/s   %3zu B %4zu/s\n", len,
+			hex, DEFAULT_BAUD / UART_BITS_PER_BYTE / hex,
+			text, DEFAULT_BAUD / UART_BITS_PER_BYTE / text,
+			n, (DEFAULT_BAUD / UART_BITS_PER_BYTE) / n);
+	}
+
+	return ((counts.packets == sent) && (counts.logs == 1) && (dec.stats.crc_errors == 1)) ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+	hostlink_decoder_t dec;
+	cli_counts_t counts = {0};
+	cli_counts_t last = {0};
+	uint64_t last_bytes = 0;
+	long baud = DEFAULT_BAUD;
+	bool rates = false;
+	const char *commands[MAX_COMMANDS];
+	uint32_t command_count = 0;
+	uint8_t frame[HOSTLINK_MAX_FRAME];
+	uint8_t buf[512];
+	double next;
+	ssize_t got;
+	size_t n;
+	uint32_t i;
+	int fd = STDIN_FILENO;
+	int opt;
+
+	while((opt = getopt(argc, argv, "a:b:c:st")) != -1){
+		switch(opt)
+		{
+			case 'a':
+			{
+				arq_sim_config_t config = {
+					.loss = strtod(optarg, NULL) / 100.0, .uplink = 1000, .downlink = 1000, .remote_listens = false, .seed = 1
+				};
+
+				return arq_sim_run(&config, NULL);
+			}
+			case 'b':
+				baud = strtol(optarg, NULL, 10);
+				break;
+			case 'c':
+				if(command_count == MAX_COMMANDS){
+					fprintf(stderr, "at most %u commands\n", MAX_COMMANDS);
+					return 2;
+				}
+				commands[command_count++] = optarg;
+				break;
+			case 's':
+				rates = true;
+				break;
+			case 't':
+				return self_test();
+			default:
+				fprintf(stderr, "usage: %s [-s] [-b baud] [-c command]... [device]\n       %s -t\n       %s -a loss%%\n",
+					argv[0], argv[0], argv[0]);
+				return 2;
+		}
+	}
+	if(optind < argc){
+		fd = open_serial(argv[optind], baud);
+		if(fd < 0){
+			return 1;
+		}
+	}
+
+	// tags count from 1 so the acks can be matched up
+	for(i = 0; i < command_count; i++){
+		n = encode_command(commands[i], (uint8_t)(i + 1), frame);
+		if(n == 0){
+			fprintf(stderr, "unknown command '%s'\n", commands[i]);
+			return 2;
+		}
+		if(write((fd == STDIN_FILENO) ? STDOUT_FILENO : fd, frame, n) != (ssize_t)n){
+			fprintf(stderr, "write: %s\n", strerror(errno));
+			return 1;
+		}
+	}
+	if((command_count != 0) && (fd == STDIN_FILENO)){
+		return 0;
+	}
+
+	hostlink_decoder_init(&dec, on_record, &counts);
+	next = now_s() + 1.0;
+
+	while((got = read(fd, buf, sizeof(buf))) > 0){
+		hostlink_decoder_feed(&dec, buf, (size_t)got);
+
+		if(rates && (now_s() >= next)){
+			next += 1.0;
+			fprintf(stderr, "%llu packets/s, %llu bytes/s, %llu crc errors, %llu cobs errors\n",
+				(unsigned long long)(counts.packets - last.packets),
+				(unsigned long long)(dec.stats.bytes - last_bytes),
+				(unsigned long long)dec.stats.crc_errors, (unsigned long long)dec.stats.cobs_errors);
+			last = counts;
+			last_bytes = dec.stats.bytes;
+		}
+	}
+	return 0;
+}
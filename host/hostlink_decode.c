@@ -0,0 +1,140 @@
+// hostlink_decode.c -- COBS + CRC record decoder for the host
+
+#include "hostlink_decode.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+
+void hostlink_decoder_init(hostlink_decoder_t *dec, hostlink_record_fn on_record, void *ctx)
+{
+	memset(dec, 0, sizeof(*dec));
+	dec->on_record = on_record;
+	dec->ctx = ctx;
+}
+
+// same algorithm as the firmware: a code byte before each run of at most
+// 254 non-zero bytes, 0xFF codes carry no implied zero
+size_t hostlink_cobs_encode(const uint8_t *in, size_t len, uint8_t *out)
+{
+	size_t code_at = 0;
+	size_t o = 1;
+	uint8_t code = 1;
+	size_t i;
+
+	for(i = 0; i < len; i++){
+		if(in[i] != 0){
+			out[o++] = in[i];
+			code++;
+		}
+		if((in[i] == 0) || (code == 0xFF)){
+			out[code_at] = code;
+			code_at = o++;
+			code = 1;
+		}
+	}
+	out[code_at] = code;
+	return o;
+}
+
+// returns the decoded length, 0 for malformed input
+size_t hostlink_cobs_decode(const uint8_t *in, size_t len, uint8_t *out)
+{
+	size_t i = 0;
+	size_t o = 0;
+	uint8_t code;
+	uint8_t n;
+
+	while(i < len){
+		code = in[i++];
+		if((code == 0) || (i + code - 1 > len)){
+			return 0;
+		}
+		for(n = 1; n < code; n++){
+			out[o++] = in[i++];
+		}
+		// a zero follows every run but the last and the full ones
+		if((code != 0xFF) && (i < len)){
+			out[o++] = 0;
+		}
+	}
+	return o;
+}
+
+size_t hostlink_encode(uint8_t type, const void *payload, size_t len, uint8_t *out)
+{
+	uint8_t record[HOSTLINK_MAX_RECORD];
+	uint16_t crc;
+	size_t n;
+
+	if(len > HOSTLINK_MAX_PAYLOAD){
+		return 0;
+	}
+	record[0] = type;
+	record[1] = (uint8_t)len;
+	memcpy(&record[2], payload, len);
+	crc = hostlink_crc16(HOSTLINK_CRC_INIT, record, len + 2);
+	record[len + 2] = (uint8_t)crc;
+	record[len + 3] = (uint8_t)(crc >> 8);
+
+	n = hostlink_cobs_encode(record, len + HOSTLINK_RECORD_OVERHEAD, out);
+	out[n++] = HOSTLINK_DELIMITER;
+	return n;
+}
+
+static void hostlink_decode_frame(hostlink_decoder_t *dec)
+{
+	uint8_t record[HOSTLINK_MAX_FRAME];
+	hostlink_record_t rec;
+	size_t len;
+	uint16_t crc;
+
+	len = hostlink_cobs_decode(dec->frame, dec->len, record);
+	if((len < HOSTLINK_RECORD_OVERHEAD) || (len != (size_t)record[1] + HOSTLINK_RECORD_OVERHEAD)){
+		dec->stats.cobs_errors++;
+		return;
+	}
+	crc = hostlink_crc16(HOSTLINK_CRC_INIT, record, len - 2);
+	if((record[len - 2] != (uint8_t)crc) || (record[len - 1] != (uint8_t)(crc >> 8))){
+		dec->stats.crc_errors++;
+		return;
+	}
+	dec->stats.records++;
+
+	rec.type = record[0];
+	rec.len = record[1];
+	rec.payload = &record[2];
+	if(dec->on_record != NULL){
+		dec->on_record(&rec, dec->ctx);
+	}
+}
+
+void hostlink_decoder_feed(hostlink_decoder_t *dec, const uint8_t *data, size_t len)
+{
+	size_t i;
+
+	dec->stats.bytes += len;
+
+	for(i = 0; i < len; i++){
+		if(data[i] == HOSTLINK_DELIMITER){
+			// empty frames are back to back delimiters, nothing lost
+			if(!dec->overrun && (dec->len != 0)){
+				hostlink_decode_frame(dec);
+			}
+			dec->len = 0;
+			dec->overrun = false;
+			continue;
+		}
+		if(dec->overrun){
+			continue;
+		}
+		if(dec->len == sizeof(dec->frame)){
+			dec->stats.overruns++;
+			dec->overrun = true;
+			continue;
+		}
+		dec->frame[dec->len++] = data[i];
+	}
+}
@@ -0,0 +1,54 @@
+/*
+ * hostlink_decode.h
+ *
+ * host side of the binary LPUART link: splits the byte stream at the
+ * delimiters, undoes the COBS encoding and checks the CRC of each
+ * record, see inc/hostlink_proto.h for the format. the encoder mirrors
+ * the firmware one, for tests and for tools feeding a decoder.
+ */
+
+#ifndef __HOSTLINK_DECODE_H
+#define __HOSTLINK_DECODE_H
+
+#include "hostlink_proto.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct
+{
+	uint8_t type;
+	uint8_t len;
+	const uint8_t *payload;
+} hostlink_record_t;
+
+typedef void (*hostlink_record_fn)(const hostlink_record_t *record, void *ctx);
+
+typedef struct
+{
+	uint64_t bytes;
+	uint64_t records;
+	uint64_t crc_errors;
+	uint64_t cobs_errors;		// malformed COBS or length field
+	uint64_t overruns;			// frames longer than HOSTLINK_MAX_FRAME
+} hostlink_decoder_stats_t;
+
+typedef struct
+{
+	uint8_t frame[HOSTLINK_MAX_FRAME];
+	size_t len;
+	bool overrun;				// drop until the next delimiter
+	hostlink_record_fn on_record;
+	void *ctx;
+	hostlink_decoder_stats_t stats;
+} hostlink_decoder_t;
+
+void hostlink_decoder_init(hostlink_decoder_t *dec, hostlink_record_fn on_record, void *ctx);
+void hostlink_decoder_feed(hostlink_decoder_t *dec, const uint8_t *data, size_t len);
+
+size_t hostlink_cobs_encode(const uint8_t *in, size_t len, uint8_t *out);
+size_t hostlink_cobs_decode(const uint8_t *in, size_t len, uint8_t *out);
+size_t hostlink_encode(uint8_t type, const void *payload, size_t len, uint8_t *out);
+
+#endif /* __HOSTLINK_DECODE_H */
@@ -0,0 +1,210 @@
+// node_table_test.c -- the node table's sequence window on the host: a
+// reordered, duplicated and lossy stream across the 2^16 wrap, and
+// remotes rebooting back to seq 0
+
+#include "node_table.h"
+#include "frame.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define SEQ_TEST_REMOTES		4
+#define SEQ_TEST_SENT			50000	// per remote, 200k in all
+#define SEQ_TEST_EVENTS			(SEQ_TEST_REMOTES * SEQ_TEST_SENT * 2)
+
+typedef struct
+{
+	uint32_t at;				// delivery time, in frames sent
+	uint32_t order;				// ties keep the order they were scheduled in
+	uint32_t seq;				// unwrapped
+	uint8_t remote;
+} seq_event_t;
+
+typedef struct
+{
+	uint8_t seen[SEQ_TEST_SENT];
+	bool started;
+	uint32_t base;				// first delivered
+	uint32_t max;
+	uint32_t delivered;
+	uint32_t accepted;			// new or late
+	uint32_t lost;
+	uint32_t reordered;
+} seq_truth_t;
+
+static int seq_event_cmp(const void *a, const void *b)
+{
+	const seq_event_t *x = a;
+	const seq_event_t *y = b;
+
+	if(x->at != y->at){
+		return (x->at < y->at) ? -1 : 1;
+	}
+	return (x->order < y->order) ? -1 : (x->order > y->order);
+}
+
+// what the window must answer, from the unwrapped numbers and every one seen
+static node_rx_t seq_truth(seq_truth_t *truth, uint32_t seq)
+{
+	truth->delivered++;
+	if(!truth->started || (seq > truth->max)){
+		if(truth->started){
+			truth->lost += seq - truth->max - 1;
+		}else{
+			truth->base = seq;
+			truth->started = true;
+		}
+		truth->max = seq;
+		truth->seen[seq] = 1;
+		truth->accepted++;
+		return NODE_RX_NEW;
+	}
+	if((seq < truth->base) || truth->seen[seq] || (truth->max - seq >= NODE_SEQ_WINDOW)){
+		return NODE_RX_DUP;
+	}
+	truth->seen[seq] = 1;
+	truth->accepted++;
+	truth->lost--;
+	truth->reordered++;
+	return NODE_RX_LATE;
+}
+
+// the node table's sequence window over 200k frames from a few remotes,
+// interleaved, each crossing the 2^16 wrap: some frames dropped, some
+// sent twice, some held back by up to 40 frames, and now and then a copy
+// of one far older than the window. every verdict is checked against the
+// unwrapped stream, and each remote's counters against its totals
+static int node_seq_test(void)
+{
+	static seq_event_t events[SEQ_TEST_EVENTS];
+	static seq_truth_t truth[SEQ_TEST_REMOTES];
+	uint16_t start[SEQ_TEST_REMOTES];
+	uint8_t frame[FRAME_HEADER_LEN];
+	uint32_t count = 0;
+	uint32_t wrong = 0;
+	uint32_t sent;
+	uint32_t i;
+	uint8_t r;
+	node_t *node;
+	node_rx_t verdict;
+
+	node_table_init();
+	memset(truth, 0, sizeof(truth));
+	srand(5);
+	for(r = 0; r < SEQ_TEST_REMOTES; r++){
+		start[r] = (uint16_t)(0x10000 - 1000 - r * 7000);
+		for(sent = 0; sent < SEQ_TEST_SENT; sent++){
+			if(rand() % 100 >= 5){
+				events[count] = (seq_event_t){ sent + ((rand() % 10 == 0) ? 1 + rand() % 40 : 0), count, sent, r };
+				count++;
+			}
+			if(rand() % 100 < 2){
+				events[count] = (seq_event_t){ sent + rand() % 50, count, sent, r };
+				count++;
+			}
+			if((rand() % 1000 < 2) && (sent >= 1000)){
+				events[count] = (seq_event_t){ sent, count, sent - 100 - rand() % 900, r };
+				count++;
+			}
+		}
+	}
+	qsort(events, count, sizeof(events[0]), seq_event_cmp);
+
+	for(i = 0; i < count; i++){
+		r = events[i].remote;
+		frame_header(frame, 0, (uint16_t)(0x1000 + r), (uint16_t)(start[r] + events[i].seq), FRAME_DATA);
+		verdict = node_table_rx(frame, sizeof(frame), i, -90, &node);
+		if(verdict != seq_truth(&truth[r], events[i].seq)){
+			wrong++;
+		}
+	}
+
+	for(r = 0; r < SEQ_TEST_REMOTES; r++){
+		node = node_table_lookup((uint16_t)(0x1000 + r), false);
+		if((node == NULL) || (node->packets != truth[r].delivered) ||
+			(node->lost != truth[r].lost) || (node->lost != truth[r].max - truth[r].base + 1 - truth[r].accepted) ||
+			(node->dups != truth[r].delivered - truth[r].accepted) || (node->reordered != (uint16_t)truth[r].reordered)){
+			wrong++;
+			continue;
+		}
+		printf("seq window: remote %u from seq %u, %u frames, %u lost, %u dups, %u reordered\n",
+			r, start[r], node->packets, node->lost, node->dups, node->reordered);
+	}
+	printf("seq window: %u frames sent by %u remotes across the 2^16 wrap, %u received, %u verdicts or counters wrong, %s\n",
+		SEQ_TEST_REMOTES * SEQ_TEST_SENT, SEQ_TEST_REMOTES, count, wrong, (wrong == 0) ? "ok" : "FAILED");
+	if(node_table_get_stats()->resyncs != 0){
+		wrong++;
+	}
+
+	return (wrong == 0) ? 0 : 1;
+}
+
+// frames from addr numbered first to last, every one expected new
+static uint32_t seq_reboot_run(uint16_t addr, uint16_t first, uint16_t last, uint32_t *now_us)
+{
+	uint8_t frame[FRAME_HEADER_LEN];
+	uint32_t wrong = 0;
+	uint16_t seq = first;
+	node_t *node;
+
+	do{
+		frame_header(frame, 0, addr, seq, FRAME_DATA);
+		if(node_table_rx(frame, sizeof(frame), (*now_us)++, -90, &node) != NODE_RX_NEW){
+			wrong++;
+		}
+	} while(seq++ != last);
+	return wrong;
+}
+
+// remotes rebooting back to seq 0: from 4999, far behind, from 40000, a
+// jump ahead as far, and from 30, inside the window, after a minute off.
+// each starts over with nothing lost and a copy from after the reboot
+// is still a duplicate. a quick reboot from inside the window isn't
+// told from a repeat until the silence is long enough
+static int node_reboot_test(void)
+{
+	uint8_t frame[FRAME_HEADER_LEN];
+	uint32_t now_us = 0;
+	uint32_t wrong = 0;
+	uint32_t resyncs = node_table_get_stats()->resyncs;
+	uint16_t addr;
+	node_t *node;
+
+	wrong += seq_reboot_run(0x2000, 0, 4999, &now_us) + seq_reboot_run(0x2000, 0, 99, &now_us);
+	wrong += seq_reboot_run(0x2001, 30000, 40000, &now_us) + seq_reboot_run(0x2001, 0, 99, &now_us);
+	wrong += seq_reboot_run(0x2002, 0, 30, &now_us);
+	frame_header(frame, 0, 0x2002, 0, FRAME_DATA);
+	if(node_table_rx(frame, sizeof(frame), now_us, -90, &node) != NODE_RX_DUP){
+		wrong++;
+	}
+	frame_header(frame, 0, 0x2000, 50, FRAME_DATA);
+	if(node_table_rx(frame, sizeof(frame), now_us, -90, &node) != NODE_RX_DUP){
+		wrong++;
+	}
+	now_us += NODE_SEQ_STALE_US;
+	wrong += seq_reboot_run(0x2002, 0, 99, &now_us);
+
+	for(addr = 0x2000; addr <= 0x2002; addr++){
+		node = node_table_lookup(addr, false);
+		if((node == NULL) || (node->lost != 0) || (node->last_seq != 99)){
+			wrong++;
+		}
+	}
+	resyncs = node_table_get_stats()->resyncs - resyncs;
+	if(resyncs != 3){
+		wrong++;
+	}
+
+	printf("seq reboot: 3 remotes back at seq 0, %u resyncs, nothing lost, %u verdicts or counters wrong, %s\n",
+		resyncs, wrong, (wrong == 0) ? "ok" : "FAILED");
+	return (wrong == 0) ? 0 : 1;
+}
+
+int main(void)
+{
+	return node_seq_test() | node_reboot_test();
+}
@@ -0,0 +1,71 @@
+// population_test.c -- one base serving a population of remotes on a
+// shared channel, on the network profile and on the adaptive rate
+
+#include "arq_sim.h"
+#include "phy.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+
+// 24 remotes at path losses from 70 to 130 dB, fading 4 dB from frame
+// to frame, served by one base at once on a shared channel: each reports
+// to the base and hears from it once a second, frames from every remote
+// colliding with the others' and with the base's, and is then sent a
+// 4 KiB blob, one after the other, on the network profile and on the
+// one the base picked. that is three times the base's ARQ links and a
+// power control entry per remote. the aggregate is the bytes delivered
+// from the first blob's start to the last one's end. both runs must hold
+// the ARQ and blob checks, the adaptive one deliver every blob and its
+// aggregate be no lower than the network profile's
+static int population_test(void)
+{
+	static const uint32_t losses[] = {
+		70, 110, 85, 125, 95, 75, 120, 100, 130, 80, 105, 115,
+		90, 128, 72, 112, 98, 122, 82, 108, 118, 88, 126, 102
+	};
+	static const char *const runs[] = { "network profile", "adaptive rate" };
+	arq_sim_config_t config = { .remotes = sizeof(losses) / sizeof(losses[0]), .uplink = 10, .downlink = 10,
+		.interval_us = 1000000, .remote_listens = true, .bulk_size = 4096, .path_losses = losses, .quiet = true,
+		.seed = 9 };
+	static arq_sim_result_t result[2];
+	uint64_t same_us[2] = {0};
+	int failed[2];
+	uint32_t i;
+	uint32_t run;
+
+	printf("population: %u remotes, %u byte blobs, one base on one channel\n", config.remotes, config.bulk_size);
+	for(run = 0; run < 2; run++){
+		config.adr = (run != 0);
+		failed[run] = arq_sim_run(&config, &result[run]);
+	}
+	for(i = 0; i < config.remotes; i++){
+		printf("  %3u dB:", losses[i]);
+		for(run = 0; run < 2; run++){
+			printf("  %6u bps at %+3d dBm %s in %5.2f s", phy_profiles[result[run].remote[i].profile].bit_rate,
+				result[run].remote[i].dbm, (result[run].remote[i].bytes != 0) ? "delivered" : "given up ",
+				result[run].remote[i].us / 1e6);
+			if(result[0].remote[i].bytes != 0){
+				same_us[run] += result[run].remote[i].us;
+			}
+		}
+		printf("\n");
+	}
+	for(run = 0; run < 2; run++){
+		printf("population: %s, %u delivered, %u bytes in %.2f s, %.0f bps aggregate, %.2f s on the network's, %s\n",
+			runs[run], result[run].blobs, result[run].bulk_bytes, result[run].bulk_us / 1e6,
+			(result[run].bulk_us != 0) ? result[run].bulk_bytes * 8e6 / result[run].bulk_us : 0.0, same_us[run] / 1e6,
+			(failed[run] == 0) ? "checked" : "FAILED");
+	}
+	if((uint64_t)result[1].bulk_bytes * result[0].bulk_us < (uint64_t)result[0].bulk_bytes * result[1].bulk_us){
+		printf("population: adaptive aggregate below the network profile's, FAILED\n");
+		return 1;
+	}
+	return ((failed[0] == 0) && (failed[1] == 0) && (result[1].blobs == config.remotes)) ? 0 : 1;
+}
+
+int main(void)
+{
+	return population_test();
+}
@@ -0,0 +1,119 @@
+// ring_test.c -- the SPSC ring on the host, against a simulated interrupt
+// and against a producer thread
+
+#include "spsc_ring.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define RING_TEST_EVENTS		200000
+#define RING_TEST_ITEMS			1000000
+
+typedef struct
+{
+	spsc_ring_t *ring;
+	uint32_t refused;			// pushes the producer had to retry
+} ring_producer_t;
+
+// the radio IRQ on its own thread: every item goes in, retried while the ring is full.
+// both sides yield when they wait, a single core host still gets through
+static void *ring_producer(void *arg)
+{
+	ring_producer_t *producer = arg;
+	uintptr_t next;
+
+	for(next = 1; next <= RING_TEST_ITEMS; next++){
+		while(!spsc_ring_push(producer->ring, (void *)next)){
+			producer->refused++;
+			sched_yield();
+		}
+	}
+	return NULL;
+}
+
+// the SPSC ring with a simulated interrupt: at random points between the
+// main loop's pops it fires and pushes a burst of numbered items, dropping
+// what does not fit as subghz.c does, with the indices starting short of
+// the 2^32 wrap. every pushed item must come out once and in order, a push
+// may be refused only on a full ring. then the producer on a thread of
+// its own against a consumer popping as fast as it can
+static int ring_test(void)
+{
+	static spsc_ring_t ring;
+	ring_producer_t producer = { .ring = &ring };
+	pthread_t thread;
+	uintptr_t next = 1;
+	uintptr_t expect = 0;
+	uintptr_t item;
+	uint32_t pushed = 0;
+	uint32_t popped = 0;
+	uint32_t refused = 0;
+	uint32_t wrong = 0;
+	uint32_t burst;
+	uint32_t i;
+
+	memset(&ring, 0, sizeof(ring));
+	ring.head = ring.tail = UINT32_MAX - 1000;
+	srand(4);
+	for(i = 0; i < RING_TEST_EVENTS; i++){
+		if(rand() % 3 == 0){
+			for(burst = 1 + (uint32_t)rand() % (SPSC_RING_CAPACITY + 2); burst != 0; burst--){
+				uint32_t level = spsc_ring_count(&ring);
+
+				if(spsc_ring_push(&ring, (void *)next)){
+					pushed++;
+				}else{
+					refused++;
+					wrong += (level != SPSC_RING_CAPACITY);
+				}
+				next++;
+			}
+		}else if((item = (uintptr_t)spsc_ring_pop(&ring)) != 0){
+			wrong += (item <= expect);
+			expect = item;
+			popped++;
+		}
+	}
+	while((item = (uintptr_t)spsc_ring_pop(&ring)) != 0){
+		wrong += (item <= expect);
+		expect = item;
+		popped++;
+	}
+	printf("spsc ring: %u irq pushes across the index wrap, %u popped in order, %u refused on a full ring (%u counted), high water %u\n",
+		pushed, popped, refused, ring.overflows, ring.high_water);
+	if((popped != pushed) || (refused != ring.overflows) || (refused == 0) || (wrong != 0) ||
+		(ring.high_water != SPSC_RING_CAPACITY) || (spsc_ring_count(&ring) != 0)){
+		return 1;
+	}
+
+	memset(&ring, 0, sizeof(ring));
+	if(pthread_create(&thread, NULL, ring_producer, &producer) != 0){
+		return 1;
+	}
+	expect = 0;
+	while(expect < RING_TEST_ITEMS){
+		if((item = (uintptr_t)spsc_ring_pop(&ring)) != 0){
+			wrong += (item != expect + 1);
+			expect = item;
+		}else{
+			sched_yield();
+		}
+	}
+	pthread_join(thread, NULL);
+	printf("spsc ring: %u items from a producer thread, %u out of order, %u pushes refused (%u counted), high water %u, %s\n",
+		RING_TEST_ITEMS, wrong, producer.refused, ring.overflows, ring.high_water,
+		((wrong == 0) && (producer.refused == ring.overflows) && (ring.high_water <= SPSC_RING_CAPACITY)) ? "ok" : "FAILED");
+
+	return ((wrong == 0) && (producer.refused == ring.overflows) && (ring.high_water <= SPSC_RING_CAPACITY)) ? 0 : 1;
+}
+
+int main(void)
+{
+	return ring_test();
+}
@@ -0,0 +1,241 @@
+// rx_slot_test.c -- RX slots laid out as the firmware fills them, handed
+// to the ARQ and the bulk transfer as the radio glue hands them over
+
+#include "arq.h"
+#include "bulk.h"
+#include "packet_pool.h"
+#include "phy.h"
+#include "frame.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+
+#define TEST_RADIO_STATUS			0x54	// RX mode, data available
+
+// a frame the way subghz_rx_to_slot() reads it: ReadBuffer() without
+// the NOP returns the radio status, then the buffer from its offset
+static void rx_slot_fill(packet_slot_t *slot, const uint8_t *frame, uint8_t len, int8_t rssi)
+{
+	uint8_t read[PACKET_READ_LEN(PACKET_MAX_LEN)];
+
+	memset(slot, 0xEE, sizeof(*slot));
+	read[0] = TEST_RADIO_STATUS;
+	memcpy(&read[1], frame, len);
+	memcpy(packet_slot_read_to(slot), read, PACKET_READ_LEN(len));
+	slot->len = len;
+	slot->rec.flags = 0;
+	slot->rec.rssi_sync = rssi;
+	slot->rec.rssi_avg = rssi;
+}
+
+typedef struct
+{
+	uint8_t frame[ARQ_MAX_FRAME];
+	uint8_t len;
+	arq_link_t *link;
+	uint32_t done;
+	arq_result_t result;
+} slot_capture_t;
+
+static bool slot_capture_send(void *ctx, arq_link_t *link, const uint8_t *frame, uint8_t len, uint32_t reply_us)
+{
+	slot_capture_t *capture = ctx;
+
+	(void)reply_us;
+	memcpy(capture->frame, frame, len);
+	capture->len = len;
+	capture->link = link;
+	return true;
+}
+
+static void slot_capture_done(const arq_link_t *link, arq_result_t result, void *ctx)
+{
+	slot_capture_t *capture = ctx;
+
+	(void)link;
+	capture->done++;
+	capture->result = result;
+}
+
+#define SLOT_BULK_QUEUE				8
+#define SLOT_BULK_SIZE				(2 * BULK_FRAGMENT_DATA + 10)
+
+typedef struct
+{
+	uint8_t frame[SLOT_BULK_QUEUE][BULK_FRAME_LEN];
+	uint8_t len[SLOT_BULK_QUEUE];
+	uint32_t count;
+	bool reply;					// the last frame opened a reply window
+	int8_t sack_rssi;			// as the other side read it from its slot
+	uint32_t done;
+	bulk_result_t result;
+	uint8_t blob[SLOT_BULK_SIZE];
+	uint32_t received;
+} slot_bulk_t;
+
+static bool slot_bulk_send(void *ctx, const uint8_t *frame, uint8_t len, uint32_t reply_us, uint8_t profile)
+{
+	slot_bulk_t *side = ctx;
+
+	(void)profile;
+	if(side->count == SLOT_BULK_QUEUE){
+		return false;
+	}
+	memcpy(side->frame[side->count], frame, len);
+	side->len[side->count++] = len;
+	side->reply = (reply_us != 0);
+	return true;
+}
+
+static void slot_bulk_listen(void *ctx, bool on, uint8_t addr, uint8_t profile)
+{
+	(void)ctx;
+	(void)on;
+	(void)addr;
+	(void)profile;
+}
+
+static void slot_bulk_source(void *ctx, uint32_t offset, uint8_t *data, uint32_t len)
+{
+	uint32_t i;
+
+	(void)ctx;
+	for(i = 0; i < len; i++){
+		data[i] = (uint8_t)((offset + i) * 7U);
+	}
+}
+
+static void slot_bulk_sink(void *ctx, uint16_t peer, uint32_t offset, const uint8_t *data, uint32_t len)
+{
+	slot_bulk_t *side = ctx;
+
+	(void)peer;
+	if(offset + len <= sizeof(side->blob)){
+		memcpy(&side->blob[offset], data, len);
+		side->received += len;
+	}
+}
+
+static void slot_bulk_done(const bulk_t *bulk, bulk_result_t result, void *ctx)
+{
+	slot_bulk_t *side = ctx;
+
+	(void)bulk;
+	side->done++;
+	side->result = result;
+}
+
+// the frames one side queued, each through an RX slot to the other side
+// the way bulk_radio_rx() hands them over; a reply window closes once
+// the other side's answer is through
+static uint32_t slot_bulk_deliver(slot_bulk_t *from, bulk_t *to, int8_t rssi, uint32_t now_us, uint8_t *longest)
+{
+	packet_slot_t slot;
+	uint32_t taken = 0;
+	uint32_t i;
+
+	for(i = 0; i < from->count; i++){
+		rx_slot_fill(&slot, from->frame[i], from->len[i], rssi);
+		if(bulk_rx(to, slot.payload, slot.len, now_us, slot.rec.rssi_sync)){
+			taken++;
+		}
+		if(slot.len > *longest){
+			*longest = slot.len;
+		}
+		if((slot.len >= BULK_SACK_LEN) && (frame_type(slot.payload) == FRAME_SACK)){
+			from->sack_rssi = (int8_t)slot.payload[BULK_RSSI_OFFSET];
+		}
+	}
+	from->count = 0;
+	return taken;
+}
+
+// a two-fragment blob, full-length fragments included, from the base to
+// a remote through RX slots: every fragment must be taken whole and the
+// SACKs carry the RSSI the remote heard the polls at
+static int rx_slot_bulk_test(void)
+{
+	static bulk_t base;
+	static bulk_t remote;
+	static slot_bulk_t down;
+	static slot_bulk_t up;
+	uint8_t expect[SLOT_BULK_SIZE];
+	uint8_t longest = 0;
+	uint8_t sack_len = 0;
+	uint32_t now_us = 0;
+	uint32_t rounds;
+	bool replied;
+	int failed;
+
+	memset(&down, 0, sizeof(down));
+	memset(&up, 0, sizeof(up));
+	bulk_init(&base, FRAME_ADDR_BASE, 0x5A, slot_bulk_send, slot_bulk_listen, &down);
+	bulk_init(&remote, 0x1234, 0x5A, slot_bulk_send, slot_bulk_listen, &up);
+	bulk_accept(&remote, slot_bulk_sink, slot_bulk_done, &up);
+	bulk_send(&base, 0x1234, SLOT_BULK_SIZE, PHY_NETWORK, slot_bulk_source, slot_bulk_done, &down, now_us);
+
+	for(rounds = 0; (rounds < 100) && (down.done == 0); rounds++){
+		bulk_poll(&base, now_us);
+		replied = down.reply;
+		slot_bulk_deliver(&down, &remote, -64, now_us, &longest);
+		bulk_poll(&remote, now_us);
+		if(replied){
+			replied = slot_bulk_deliver(&up, &base, -80, now_us, &sack_len) != 0;
+			bulk_window_closed(&base, replied);
+			down.reply = false;
+		}
+		now_us += 20000;
+	}
+	slot_bulk_source(NULL, 0, expect, sizeof(expect));
+
+	failed = (down.done != 1) || (down.result != BULK_DELIVERED) || (up.received != SLOT_BULK_SIZE)
+		|| (memcmp(up.blob, expect, sizeof(expect)) != 0) || (longest != BULK_FRAME_LEN)
+		|| (sack_len != BULK_SACK_LEN) || (up.sack_rssi != -64);
+	printf("rx slot: bulk %u of %u bytes in %u rounds, %u byte fragments, SACK reports %d dBm, %s\n",
+		up.received, SLOT_BULK_SIZE, rounds, longest, up.sack_rssi, failed ? "FAILED" : "ok");
+	return failed;
+}
+
+// an ARQ exchange through RX slots laid out as the firmware fills them,
+// handed to the engines the way arq_radio_rx() hands them over: the
+// frame must come out whole and the ACK carry the RSSI it was sent with
+static int rx_slot_test(void)
+{
+	static const uint8_t data[] = { 0xA5, 0x00, 0x5A };
+	static arq_t remote;
+	static arq_t base;
+	slot_capture_t up = {0};
+	slot_capture_t down = {0};
+	packet_slot_t slot;
+	arq_rx_t data_verdict;
+	arq_rx_t ack_verdict;
+	int failed;
+
+	arq_init(&remote, 0x1234, 0x5A, slot_capture_send, &up);
+	arq_init(&base, FRAME_ADDR_BASE, 0x5A, slot_capture_send, &down);
+
+	arq_send(&remote, FRAME_ADDR_BASE, data, sizeof(data), slot_capture_done, &up, 0);
+	rx_slot_fill(&slot, up.frame, up.len, -71);
+	data_verdict = arq_rx(&base, slot.payload, slot.len, 1000, slot.rec.rssi_sync);
+
+	rx_slot_fill(&slot, down.frame, down.len, -90);
+	ack_verdict = arq_rx(&remote, slot.payload, slot.len, 2000, slot.rec.rssi_sync);
+	arq_window_closed(&remote, up.link);
+	arq_poll(&remote, 2000);
+
+	failed = (slot.status != TEST_RADIO_STATUS) || (data_verdict != ARQ_RX_DATA) || (ack_verdict != ARQ_RX_ACK)
+		|| (slot.len != ARQ_ACK_LEN) || (frame_src(slot.payload) != FRAME_ADDR_BASE)
+		|| ((int8_t)slot.payload[ARQ_RSSI_OFFSET] != -71) || (up.done != 1) || (up.result != ARQ_DELIVERED);
+	printf("rx slot: ARQ frame %s, ACK %s from 0x%04x with %d dBm, %s\n",
+		(data_verdict == ARQ_RX_DATA) ? "taken" : "missed", (ack_verdict == ARQ_RX_ACK) ? "taken" : "missed",
+		frame_src(slot.payload), (int8_t)slot.payload[ARQ_RSSI_OFFSET], failed ? "FAILED" : "ok");
+	return failed | rx_slot_bulk_test();
+}
+
+int main(void)
+{
+	return rx_slot_test();
+}
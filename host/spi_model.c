@@ -0,0 +1,224 @@
+// spi_model.c -- the SUBGHZSPI bus and the radio's buffer commands, per CPU cycle
+
+#include "spi_model.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+
+#define SPI_FIFO_DEPTH				4		// bytes, TX and RX, and the HAL's bytes in flight
+#define SPI_DUMMY					0xFF	// SUBGHZ_DUMMY_DATA
+
+// CPU cycles, estimated for the Cortex-M4 at 32 MHz with the flash wait states
+#define SPI_CPU_CALL				120		// lock, CheckDeviceReady, NSS low and high, unlock
+#define SPI_CPU_LOOP_SETUP			30		// deadline and counters of one SUBGHZSPI_Transfer() loop
+#define SPI_CPU_ITER				10		// one pass of its polling loop
+#define SPI_CPU_DMA_SETUP			80		// SUBGHZ_DMA_Start(): both channels and the request enables
+#define SPI_CPU_DMA_IRQ				150		// DMA1_Channel1 entry, flags, NSS high, unlock, callback
+#define SPI_DMA_LATENCY				4		// request to the bus access, no CPU
+
+typedef struct
+{
+	uint8_t tx[SPI_FIFO_DEPTH];
+	uint32_t tx_count;
+	uint8_t rx[SPI_FIFO_DEPTH];
+	uint32_t rx_count;
+	bool shifting;
+	uint8_t shift;
+	uint32_t shift_left;		// cycles to the end of the byte on the wire
+	uint32_t byte_cycles;
+	spi_model_radio_t *radio;
+	spi_model_result_t *result;
+	uint64_t now;
+} spi_bus_t;
+
+// the radio end of one byte: what it clocks back, and what it does with the MOSI byte
+static uint8_t radio_exchange(spi_model_radio_t *radio, uint8_t mosi)
+{
+	uint32_t position = radio->position++;
+	uint8_t miso = radio->status;
+
+	if(position == 0){
+		radio->opcode = mosi;
+	}else if(position == 1){
+		radio->offset = mosi;
+	}else if(radio->opcode == SPI_RADIO_WRITE_BUFFER){
+		radio->buffer[(uint8_t)(radio->offset + position - 2)] = mosi;
+	}else if((radio->opcode == SPI_RADIO_READ_BUFFER) && (position > 2)){
+		// the status goes out in the NOP slot the HAL does not send
+		miso = radio->buffer[(uint8_t)(radio->offset + position - 3)];
+	}
+	return miso;
+}
+
+static void bus_tick(spi_bus_t *bus)
+{
+	uint32_t i;
+
+	bus->now++;
+	if(bus->shifting){
+		if(--bus->shift_left != 0){
+			return;
+		}
+		bus->shifting = false;
+		uint8_t miso = radio_exchange(bus->radio, bus->shift);
+		if(bus->rx_count == SPI_FIFO_DEPTH){
+			bus->result->overruns++;
+		}else{
+			bus->rx[bus->rx_count++] = miso;
+		}
+	}
+	if(bus->tx_count != 0){
+		bus->shift = bus->tx[0];
+		for(i = 1; i < bus->tx_count; i++){
+			bus->tx[i - 1] = bus->tx[i];
+		}
+		bus->tx_count--;
+		bus->shifting = true;
+		bus->shift_left = bus->byte_cycles;
+		if(bus->result->mosi_len < SPI_MODEL_MAX_BYTES){
+			bus->result->mosi[bus->result->mosi_len++] = bus->shift;
+		}
+	}
+}
+
+static void bus_run(spi_bus_t *bus, uint32_t cycles)
+{
+	while(cycles-- != 0){
+		bus_tick(bus);
+	}
+}
+
+static void bus_write(spi_bus_t *bus, uint8_t data)
+{
+	bus->tx[bus->tx_count++] = data;
+}
+
+static uint8_t bus_read(spi_bus_t *bus)
+{
+	uint8_t data = bus->rx[0];
+	uint32_t i;
+
+	for(i = 1; i < bus->rx_count; i++){
+		bus->rx[i - 1] = bus->rx[i];
+	}
+	bus->rx_count--;
+	return data;
+}
+
+// the polling loop of SUBGHZSPI_Transfer(): header bytes out, their answers dropped
+static void bus_polled(spi_bus_t *bus, const uint8_t *header, uint32_t header_len,
+	const uint8_t *tx, uint8_t *rx, uint32_t len)
+{
+	uint32_t total = header_len + len;
+	uint32_t tx_done = 0;
+	uint32_t rx_done = 0;
+	bool txe;
+	bool rxne;
+	uint8_t data;
+
+	bus->result->cpu_cycles += SPI_CPU_LOOP_SETUP;
+	bus_run(bus, SPI_CPU_LOOP_SETUP);
+	while(rx_done < total){
+		// the loop reads SR once per pass
+		txe = bus->tx_count < SPI_FIFO_DEPTH;
+		rxne = bus->rx_count != 0;
+		if((tx_done < total) && ((tx_done - rx_done) < SPI_FIFO_DEPTH) && txe){
+			if(tx_done < header_len){
+				data = header[tx_done];
+			}else{
+				data = (tx != NULL) ? tx[tx_done - header_len] : SPI_DUMMY;
+			}
+			bus_write(bus, data);
+			tx_done++;
+		}
+		if(rxne){
+			data = bus_read(bus);
+			if((rx != NULL) && (rx_done >= header_len)){
+				rx[rx_done - header_len] = data;
+			}
+			rx_done++;
+		}
+		bus->result->cpu_cycles += SPI_CPU_ITER;
+		bus_run(bus, SPI_CPU_ITER);
+	}
+}
+
+// SUBGHZ_DMA_Start(): one channel feeds the TX FIFO, the other drains the RX FIFO
+static void bus_dma(spi_bus_t *bus, const uint8_t *tx, uint8_t *rx, uint32_t len)
+{
+	uint32_t tx_done = 0;
+	uint32_t rx_done = 0;
+	uint32_t tx_wait = 0;
+	uint32_t rx_wait = 0;
+	uint8_t data;
+
+	bus->result->cpu_cycles += SPI_CPU_DMA_SETUP;
+	bus_run(bus, SPI_CPU_DMA_SETUP);
+	while(rx_done < len){
+		if((tx_done < len) && (bus->tx_count < SPI_FIFO_DEPTH)){
+			if(++tx_wait == SPI_DMA_LATENCY){
+				bus_write(bus, (tx != NULL) ? tx[tx_done] : SPI_DUMMY);
+				tx_done++;
+				tx_wait = 0;
+			}
+		}
+		if(bus->rx_count != 0){
+			if(++rx_wait == SPI_DMA_LATENCY){
+				data = bus_read(bus);
+				if(rx != NULL){
+					rx[rx_done] = data;
+				}
+				rx_done++;
+				rx_wait = 0;
+			}
+		}
+		bus_tick(bus);
+	}
+	bus->result->cpu_cycles += SPI_CPU_DMA_IRQ;
+	bus_run(bus, SPI_CPU_DMA_IRQ);
+}
+
+void spi_model_radio_init(spi_model_radio_t *radio)
+{
+	memset(radio, 0, sizeof(*radio));
+	radio->status = SPI_MODEL_STATUS;
+}
+
+// one HAL buffer access, NSS low to high: the header, then len bytes out of
+// tx (dummies if NULL) with their answers into rx (dropped if NULL)
+void spi_model_transfer(spi_model_radio_t *radio, spi_model_driver_t driver, uint32_t prescaler,
+	const uint8_t *header, uint32_t header_len, const uint8_t *tx, uint8_t *rx, uint32_t len,
+	spi_model_result_t *result)
+{
+	spi_bus_t bus;
+
+	memset(&bus, 0, sizeof(bus));
+	memset(result, 0, sizeof(*result));
+	bus.byte_cycles = 8 * prescaler;
+	bus.radio = radio;
+	bus.result = result;
+	radio->position = 0;
+
+	result->cpu_cycles += SPI_CPU_CALL / 2;
+	bus_run(&bus, SPI_CPU_CALL / 2);
+	switch(driver){
+	case SPI_MODEL_SPLIT:
+		bus_polled(&bus, NULL, 0, header, NULL, header_len);
+		bus_polled(&bus, NULL, 0, tx, rx, len);
+		break;
+	case SPI_MODEL_BURST:
+		bus_polled(&bus, header, header_len, tx, rx, len);
+		break;
+	case SPI_MODEL_DMA:
+		bus_polled(&bus, NULL, 0, header, NULL, header_len);
+		bus_dma(&bus, tx, rx, len);
+		break;
+	default:
+		break;
+	}
+	result->cpu_cycles += SPI_CPU_CALL / 2;
+	bus_run(&bus, SPI_CPU_CALL / 2);
+	result->wall_cycles = (uint32_t)bus.now;
+}
@@ -0,0 +1,70 @@
+/*
+ * spi_model.h
+ *
+ * the SUBGHZSPI bus and the radio's buffer commands, byte for byte and
+ * in CPU cycles, to compare the ways the HAL moves a payload: header and
+ * data as two polled bursts (the original driver, the FIFO drained in
+ * between), as one polled burst (SUBGHZSPI_Transfer()), and the header
+ * polled with the data through the DMA (HAL_SUBGHZ_Write/ReadBuffer_DMA()).
+ *
+ * the bus has the peripheral's 4-byte TX and RX FIFOs and a shifter that
+ * clocks a byte in 8 SPI clocks. the polled loops keep at most 4 bytes in
+ * flight as the HAL does; the DMA refills the TX FIFO and drains the RX
+ * FIFO a few cycles after each request, without the CPU. the radio end
+ * answers READ_BUFFER the way the SX126x does when the NOP is not sent:
+ * the status, then the buffer from the offset.
+ *
+ * the CPU costs around the bytes (call, lock and NSS, loop set up, DMA
+ * set up and completion interrupt) are estimates for the Cortex-M4 at
+ * 32 MHz, not measurements; the bus timing follows from the prescaler.
+ *
+ * the DMA's set up and completion interrupt make its wall time longer
+ * than the polled burst's at every length, 141 us against 134 us for
+ * 255 bytes at /2. what it saves is the CPU's time, the bytes move while
+ * the core does something else.
+ */
+
+#ifndef __SPI_MODEL_H
+#define __SPI_MODEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SPI_MODEL_CORE_HZ			32000000
+#define SPI_MODEL_STATUS			0x24	// STANDBY_RC, data available
+#define SPI_RADIO_WRITE_BUFFER		0x0E
+#define SPI_RADIO_READ_BUFFER		0x1E
+#define SPI_MODEL_MAX_BYTES			(2 + 256)
+
+typedef enum
+{
+	SPI_MODEL_SPLIT = 0,		// header, then data, two polled bursts
+	SPI_MODEL_BURST,			// header and data in one polled burst
+	SPI_MODEL_DMA,				// header polled, data through the DMA
+	SPI_MODEL_DRIVERS
+} spi_model_driver_t;
+
+typedef struct
+{
+	uint8_t buffer[256];
+	uint8_t status;
+	uint32_t position;			// bytes since NSS went low
+	uint8_t opcode;
+	uint8_t offset;
+} spi_model_radio_t;
+
+typedef struct
+{
+	uint32_t wall_cycles;		// NSS low to the call's return or the DMA callback
+	uint32_t cpu_cycles;		// of those, the CPU's
+	uint32_t overruns;			// RX FIFO full when a byte came in
+	uint32_t mosi_len;
+	uint8_t mosi[SPI_MODEL_MAX_BYTES];	// every byte clocked out, header included
+} spi_model_result_t;
+
+void spi_model_radio_init(spi_model_radio_t *radio);
+void spi_model_transfer(spi_model_radio_t *radio, spi_model_driver_t driver, uint32_t prescaler,
+	const uint8_t *header, uint32_t header_len, const uint8_t *tx, uint8_t *rx, uint32_t len,
+	spi_model_result_t *result);
+
+#endif /* __SPI_MODEL_H */
@@ -0,0 +1,181 @@
+// spi_model_test.c -- the SUBGHZSPI model: split, burst and DMA buffer
+// accesses byte for byte, and what each costs on the wall and the CPU
+
+#include "spi_model.h"
+#include "packet_pool.h"
+#include "frame.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// the shortest payload the DMA moves for fewer CPU cycles than the polled burst
+static uint32_t spi_model_dma_crossover(uint32_t prescaler)
+{
+	spi_model_radio_t radio;
+	spi_model_result_t burst;
+	spi_model_result_t dma;
+	uint8_t header[2] = {SPI_RADIO_WRITE_BUFFER, 0x00};
+	uint8_t payload[255];
+	uint32_t len;
+
+	memset(payload, 0xA5, sizeof(payload));
+	spi_model_radio_init(&radio);
+	for(len = 1; len <= sizeof(payload); len++){
+		spi_model_transfer(&radio, SPI_MODEL_BURST, prescaler, header, 2, payload, NULL, len, &burst);
+		spi_model_transfer(&radio, SPI_MODEL_DMA, prescaler, header, 2, payload, NULL, len, &dma);
+		if(dma.cpu_cycles < burst.cpu_cycles){
+			return len;
+		}
+	}
+	return 0;
+}
+
+// payload lengths the dma takes longer than the burst over, NSS low to
+// the callback against NSS low to the return
+static uint32_t spi_model_dma_slower(uint32_t prescaler)
+{
+	spi_model_radio_t radio;
+	spi_model_result_t burst;
+	spi_model_result_t dma;
+	uint8_t header[2] = {SPI_RADIO_WRITE_BUFFER, 0x00};
+	uint8_t payload[255];
+	uint32_t slower = 0;
+	uint32_t len;
+
+	memset(payload, 0xA5, sizeof(payload));
+	spi_model_radio_init(&radio);
+	for(len = 1; len <= sizeof(payload); len++){
+		spi_model_transfer(&radio, SPI_MODEL_BURST, prescaler, header, 2, payload, NULL, len, &burst);
+		spi_model_transfer(&radio, SPI_MODEL_DMA, prescaler, header, 2, payload, NULL, len, &dma);
+		if(dma.wall_cycles > burst.wall_cycles){
+			slower++;
+		}
+	}
+	return slower;
+}
+
+// every driver puts the same bytes on MOSI, the write lands in the radio's
+// buffer, and the read lays status and frame out in a packet slot as
+// subghz_rx_to_slot() expects, for every payload length
+static int spi_model_exact(void)
+{
+	static const char *names[SPI_MODEL_DRIVERS] = {"split", "burst", "dma"};
+	spi_model_radio_t radio;
+	spi_model_result_t result;
+	spi_model_result_t first;
+	packet_slot_t slot[2];
+	uint8_t payload[255];
+	uint8_t header[2];
+	uint32_t checked = 0;
+	uint32_t len;
+	uint32_t i;
+	int driver;
+
+	srand(7);
+	for(len = 1; len <= sizeof(payload); len++){
+		for(i = 0; i < len; i++){
+			payload[i] = (uint8_t)rand();
+		}
+		for(driver = 0; driver < SPI_MODEL_DRIVERS; driver++){
+			// write at an offset that wraps for the long ones, as TX_BASE_ADDRESS 0x80 does
+			spi_model_radio_init(&radio);
+			header[0] = SPI_RADIO_WRITE_BUFFER;
+			header[1] = 0x80;
+			spi_model_transfer(&radio, driver, 2, header, 2, payload, NULL, len, &result);
+			if(driver == SPI_MODEL_SPLIT){
+				first = result;
+			}
+			if((result.mosi_len != len + 2) || (result.overruns != 0) ||
+				(memcmp(result.mosi, first.mosi, result.mosi_len) != 0)){
+				printf("spi model: %s write of %u bytes differs on MOSI\n", names[driver], len);
+				return 1;
+			}
+			for(i = 0; i < len; i++){
+				if(radio.buffer[(uint8_t)(0x80 + i)] != payload[i]){
+					printf("spi model: %s write of %u bytes, buffer byte %u wrong\n", names[driver], len, i);
+					return 1;
+				}
+			}
+			if(len > FRAME_MAX_LEN){
+				checked++;
+				continue;
+			}
+
+			// read it back into a slot, a guard slot behind it
+			memset(slot, 0xEE, sizeof(slot));
+			header[0] = SPI_RADIO_READ_BUFFER;
+			slot[0].len = (uint8_t)len;
+			spi_model_transfer(&radio, driver, 2, header, 2, NULL, packet_slot_read_to(&slot[0]),
+				PACKET_READ_LEN(len), &result);
+			if((result.overruns != 0) || (slot[0].status != SPI_MODEL_STATUS) ||
+				(memcmp(slot[0].payload, payload, len) != 0)){
+				printf("spi model: %s read of %u bytes wrong in the slot\n", names[driver], len);
+				return 1;
+			}
+			for(i = len; i < PACKET_MAX_LEN; i++){
+				if(slot[0].payload[i] != 0xEE){
+					printf("spi model: %s read of %u bytes ran past the frame\n", names[driver], len);
+					return 1;
+				}
+			}
+			if(slot[1].status != 0xEE){
+				printf("spi model: %s read of %u bytes ran into the next slot\n", names[driver], len);
+				return 1;
+			}
+			checked++;
+		}
+	}
+	printf("spi model: %u writes and reads byte exact, same MOSI for split, burst and dma, ok\n", checked);
+	return 0;
+}
+
+static void spi_model_table(uint32_t prescaler)
+{
+	static const uint32_t sizes[] = {8, 16, 32, 64, 127, 255};
+	spi_model_radio_t radio;
+	spi_model_result_t result;
+	uint8_t header[2] = {SPI_RADIO_WRITE_BUFFER, 0x00};
+	uint8_t payload[255];
+	uint32_t i;
+	int driver;
+
+	uint32_t slower;
+	double wall[SPI_MODEL_DRIVERS];
+
+	memset(payload, 0x5A, sizeof(payload));
+	spi_model_radio_init(&radio);
+	printf("\nWRITE_BUFFER at SPI /%u, %u MHz: wall us, CPU us, payload bytes/us of wall\n",
+		prescaler, SPI_MODEL_CORE_HZ / 1000000 / prescaler);
+	printf("payload   split                 burst                 dma\n");
+	for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++){
+		printf("%4u B", sizes[i]);
+		for(driver = 0; driver < SPI_MODEL_DRIVERS; driver++){
+			spi_model_transfer(&radio, driver, prescaler, header, 2, payload, NULL, sizes[i], &result);
+			wall[driver] = result.wall_cycles * 1e6 / SPI_MODEL_CORE_HZ;
+			printf("   %6.2f %6.2f %5.2f",
+				result.wall_cycles * 1e6 / SPI_MODEL_CORE_HZ,
+				result.cpu_cycles * 1e6 / SPI_MODEL_CORE_HZ,
+				sizes[i] / (result.wall_cycles * 1e6 / SPI_MODEL_CORE_HZ));
+		}
+		printf("\n");
+	}
+	printf("the dma costs the CPU less than the burst from %u bytes\n", spi_model_dma_crossover(prescaler));
+	slower = spi_model_dma_slower(prescaler);
+	printf("the dma takes longer than the burst at %u of 255 lengths, %.0f us against %.0f us at 255 B: %s\n",
+		slower, wall[SPI_MODEL_DMA], wall[SPI_MODEL_BURST],
+		(slower == 255) ? "it saves CPU time only, never wall time" : "it saves wall time at some lengths");
+}
+
+int main(void)
+{
+	if(spi_model_exact()){
+		return 1;
+	}
+	spi_model_table(2);
+	spi_model_table(8);
+	return 0;
+}
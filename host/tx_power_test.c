@@ -0,0 +1,133 @@
+// tx_power_test.c -- the power and rate control on the host: one peer at
+// each path loss, misses, and a node table's worth of peers
+
+#include "tx_power.h"
+#include "node_table.h"
+#include "phy.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+
+// a peer's level and profile settled for its path loss: heard within the
+// hysteresis of the target unless at a limit, and on the fastest profile
+// the top level reaches with the headroom or, reports taking no profile
+// down, the network profile it started on
+static bool tx_power_settled(const tx_power_peer_t *p, int32_t loss)
+{
+	int32_t rssi = tx_power_levels[p->level].dbm - loss;
+	int32_t target = tx_power_target_dbm(p->profile);
+	int32_t top = tx_power_levels[TX_POWER_MAX].dbm - loss;
+
+	return !(((rssi > target + TX_POWER_HYSTERESIS_DB) && (p->level != 0))
+		|| ((rssi < target - TX_POWER_HYSTERESIS_DB) && (p->level != TX_POWER_MAX))
+		|| (p->profile < PHY_NETWORK)
+		|| ((p->profile != PHY_PROFILES - 1U) &&
+			(top >= phy_profiles[p->profile + 1U].sensitivity + TX_POWER_ADR_MARGIN_DB + TX_POWER_ADR_HEADROOM_DB)));
+}
+
+// as many peers as the node table holds, each at its own path loss and
+// reporting in turn, as the base hears a population: every one settles
+// on its own, a remote with no entry gets the defaults
+static int tx_power_peers_test(void)
+{
+	static tx_power_t power;
+	uint32_t peer[NODE_TABLE_CAPACITY + 1];
+	uint32_t settled = 0;
+	uint32_t tracked = 0;
+	uint32_t round;
+	uint32_t k;
+	uint8_t level;
+
+	node_table_init();
+	tx_power_init(&power);
+	for(k = 0; k <= NODE_TABLE_CAPACITY; k++){
+		peer[k] = node_table_number(node_table_lookup((uint16_t)(0x2000 + k), true));
+		tracked += (peer[k] != TX_POWER_UNTRACKED);
+	}
+	for(round = 0; round < 20; round++){
+		for(k = 0; k <= NODE_TABLE_CAPACITY; k++){
+			level = tx_power_level(&power, peer[k]);
+			tx_power_feedback(&power, peer[k], (int8_t)(tx_power_levels[level].dbm - (int32_t)(60 + k % 71)));
+		}
+	}
+	for(k = 0; k < NODE_TABLE_CAPACITY; k++){
+		settled += (peer[k] != TX_POWER_UNTRACKED) && tx_power_settled(tx_power_peer(&power, peer[k]), 60 + k % 71);
+	}
+	printf("power: %u peers at 60 to 130 dB, %u with a node table entry, %u settled, %u reports untracked, %s\n",
+		NODE_TABLE_CAPACITY + 1, tracked, settled, power.untracked,
+		((tracked == NODE_TABLE_CAPACITY) && (settled == tracked) && (power.untracked == 20)) ? "ok" : "FAILED");
+	node_table_init();
+
+	return ((tracked == NODE_TABLE_CAPACITY) && (settled == tracked) && (power.untracked == 20)) ? 0 : 1;
+}
+
+// the power and rate control against a peer at each path loss from 60
+// to 130 dB: it must settle within 8 reports (going down is 6 dB a step
+// at most) on the fastest profile the top level reaches with the ADR
+// margin and headroom, or the network profile it started on, with the
+// peer hearing the target within the hysteresis, or at the lowest level
+// over it or the highest under it, and stay there. then misses must
+// raise the level one at a time, and at the top level take the profile
+// one slower once the share lost on it costs more than the slower one
+static int tx_power_test(void)
+{
+	tx_power_t power;
+	const tx_power_peer_t *p;
+	int32_t loss;
+	uint32_t settled;
+	uint32_t i;
+	uint8_t level;
+	uint8_t profile;
+	int failed = 0;
+
+	for(loss = 60; loss <= 130; loss += 5){
+		tx_power_init(&power);
+		settled = 0;
+		for(i = 0; i < 20; i++){
+			level = tx_power_level(&power, 0);
+			profile = tx_power_profile(&power, 0);
+			tx_power_feedback(&power, 0, (int8_t)(tx_power_levels[level].dbm - loss));
+			if((tx_power_level(&power, 0) != level) || (tx_power_profile(&power, 0) != profile)){
+				settled = i + 1;
+			}
+		}
+		p = tx_power_peer(&power, 0);
+		printf("power: %3d dB path loss, %6u bps at %+3d dBm after %u reports, heard at %d dBm for %d\n",
+			loss, phy_profiles[p->profile].bit_rate, tx_power_levels[p->level].dbm, settled,
+			tx_power_levels[p->level].dbm - loss, tx_power_target_dbm(p->profile));
+		if((settled > 8) || !tx_power_settled(p, loss)){
+			failed = 1;
+		}
+	}
+
+	tx_power_init(&power);
+	tx_power_feedback(&power, 0, (int8_t)tx_power_target_dbm(PHY_PROFILES - 1U));
+	for(i = 0; i < 2 * TX_POWER_MISSES; i++){
+		tx_power_miss(&power, 0, PHY_NETWORK);
+	}
+	level = tx_power_level(&power, 0);
+	printf("power: %u misses, %+d dBm to %+d dBm\n", 2 * TX_POWER_MISSES,
+		tx_power_levels[TX_POWER_DEFAULT].dbm, tx_power_levels[level].dbm);
+	if((level != TX_POWER_DEFAULT + 2) || (tx_power_level(&power, 1) != TX_POWER_DEFAULT) ||
+		(tx_power_level(&power, TX_POWER_UNTRACKED) != TX_POWER_DEFAULT)){
+		failed = 1;
+	}
+	profile = tx_power_profile(&power, 0);
+	for(i = 0; i < 2 * PHY_PROFILES * TX_POWER_MISSES; i++){
+		tx_power_miss(&power, 0, PHY_NETWORK);
+	}
+	printf("power: %u misses more on %u bps, %u bps to %u bps\n", 2 * PHY_PROFILES * TX_POWER_MISSES,
+		phy_profiles[PHY_NETWORK].bit_rate, phy_profiles[profile].bit_rate,
+		phy_profiles[tx_power_profile(&power, 0)].bit_rate);
+	if((tx_power_level(&power, 0) != TX_POWER_MAX) || (tx_power_profile(&power, 0) != PHY_NETWORK - 1U)){
+		failed = 1;
+	}
+	return failed | tx_power_peers_test();
+}
+
+int main(void)
+{
+	return tx_power_test();
+}
@@ -0,0 +1,166 @@
+/*
+ * arq.h
+ *
+ * stop-and-wait ARQ: one frame outstanding per link, a link being the
+ * peer at the other end. a FRAME_ARQ frame goes out with an RX window
+ * opened once it is sent, and is done when a FRAME_ACK with its
+ * sequence number comes back. a window that closes without one, on its
+ * timeout or on any other frame, sends it again after a backoff drawn
+ * from [b/2, b], b doubling per retry up to backoff_max_us, until the
+ * retries run out.
+ *
+ *   FRAME_ARQ  [header][to lo][to hi][data...]
+ *   FRAME_ACK  [header][to lo][to hi][rssi] seq: the frame acknowledged
+ *
+ * the ACK's rssi is the signed dBm the frame came in at, for the
+ * sender's power control (tx_power.h); an ACK without it is taken too.
+ *
+ * every FRAME_ARQ addressed to this node is acknowledged, repeats too,
+ * since the ACK that got lost may be what caused the repeat. a repeat
+ * is told from a new frame by its sequence number, the same as the last
+ * one taken from that peer.
+ *
+ * the ARQ_LINKS links serve any number of peers: with all of them taken,
+ * the idle one used longest ago goes to the new peer. frames take their
+ * sequence number from one counter for the whole node, so a peer whose
+ * link was handed on can't take the next frame it gets for a repeat, and
+ * the node's frames run in order through a receiver's node table.
+ *
+ * RTT runs from the frame handed to the radio to the ACK's RX time, and
+ * is only sampled on first transmissions (Karn): an ACK after a retry
+ * may answer either copy.
+ *
+ * nothing here depends on the target: the radio is reached through an
+ * arq_send_fn, times come in as arguments, and the host runs the same
+ * code against a simulated radio pair (host/arq_sim.c).
+ * everything is called from one context, the main loop on the target.
+ */
+
+#ifndef __ARQ_H
+#define __ARQ_H
+
+#include "frame.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ARQ_LINKS					8
+#define ARQ_TO_OFFSET				FRAME_HEADER_LEN
+#define ARQ_HEADER_LEN				(FRAME_HEADER_LEN + 2)
+#define ARQ_RSSI_OFFSET				ARQ_HEADER_LEN
+#define ARQ_ACK_LEN					(ARQ_HEADER_LEN + 1)
+#define ARQ_MAX_FRAME				64
+#define ARQ_MAX_DATA				(ARQ_MAX_FRAME - ARQ_HEADER_LEN)
+#define ARQ_MAX_RETRIES				7
+
+#define ARQ_DEFAULT_RETRIES			4
+#define ARQ_DEFAULT_ACK_TIMEOUT_US	10000	// TXDONE to the ACK's sync word
+#define ARQ_DEFAULT_BACKOFF_US		4000
+#define ARQ_DEFAULT_BACKOFF_MAX_US	64000
+
+typedef enum
+{
+	ARQ_IDLE = 0,				// ready for arq_send()
+	ARQ_WAIT,					// with the radio, sent or queued, then in its RX window
+	ARQ_CLOSED,					// window closed without an ACK, arq_poll() decides
+	ARQ_BACKOFF					// sent again at retry_us
+} arq_state_t;
+
+typedef enum
+{
+	ARQ_DELIVERED = 0,
+	ARQ_GAVE_UP
+} arq_result_t;
+
+typedef enum
+{
+	ARQ_RX_PLAIN = 0,			// not an ARQ frame, or too short to be one
+	ARQ_RX_DATA,				// new frame for this node, acknowledged
+	ARQ_RX_DUP,					// repeat of the last frame, acknowledged again
+	ARQ_RX_ACK,					// acknowledgement for this node, consumed
+	ARQ_RX_OTHER				// ARQ frame or ACK for another node
+} arq_rx_t;
+
+typedef struct
+{
+	uint32_t sent;				// frames taken by arq_send()
+	uint32_t delivered;
+	uint32_t failed;			// retries exhausted
+	uint32_t transmissions;		// first sends and retries
+	uint32_t retries;
+	uint32_t no_ack;			// windows closed without the ACK
+	uint32_t busy;				// the radio took no frame, tried again on the next poll
+	uint32_t stale_acks;		// ACKs for a frame no longer outstanding
+	uint32_t rtt_samples;
+	uint32_t rtt_last;			// us
+	uint32_t rtt_min;
+	uint32_t rtt_max;
+	uint64_t rtt_total;
+	uint32_t tries[ARQ_MAX_RETRIES + 1];	// frames delivered after n + 1 transmissions
+	uint32_t rx_frames;			// FRAME_ARQ received from the peer
+	uint32_t rx_dups;
+	uint32_t acks_sent;
+} arq_link_stats_t;
+
+typedef struct arq_link arq_link_t;
+
+typedef void (*arq_done_fn)(const arq_link_t *link, arq_result_t result, void *ctx);
+
+struct arq_link
+{
+	uint16_t peer;
+	uint16_t tx_seq;			// outstanding frame, or the last one when idle
+	uint16_t rx_seq;			// last frame taken from the peer
+	bool rx_valid;
+	bool in_flight;				// handed to the radio, window not closed yet
+	uint8_t state;				// arq_state_t
+	uint8_t attempts;			// transmissions of the outstanding frame
+	uint8_t len;
+	uint32_t used;				// arq_t uses when last sent to or heard from, for recycling
+	uint32_t sent_us;			// last transmission handed to the radio
+	uint32_t retry_us;
+	arq_done_fn done;
+	void *ctx;
+	arq_link_stats_t stats;
+	uint8_t frame[ARQ_MAX_FRAME];
+};
+
+// hands a frame to the radio, false if it can't take it now. reply_us
+// non-zero: open an RX window that long once the frame is sent, and call
+// arq_window_closed() with link when it ends, however it ends
+typedef bool (*arq_send_fn)(void *ctx, arq_link_t *link, const uint8_t *frame, uint8_t len, uint32_t reply_us);
+
+typedef struct
+{
+	uint8_t retries;			// up to ARQ_MAX_RETRIES
+	uint32_t ack_timeout_us;
+	uint32_t backoff_us;
+	uint32_t backoff_max_us;
+} arq_config_t;
+
+typedef struct
+{
+	arq_send_fn send;
+	void *send_ctx;
+	arq_config_t config;
+	uint16_t addr;				// this node
+	uint8_t dst;				// network address byte in every header
+	uint32_t random;			// backoff jitter, xorshift32
+	uint16_t tx_seq;			// next frame's, for every link
+	uint32_t uses;				// frames sent and taken, the links' age
+	uint32_t link_count;
+	uint32_t recycled;			// idle links handed to another peer
+	uint32_t untracked;			// frames from peers with no idle link to take
+	arq_link_t links[ARQ_LINKS];
+} arq_t;
+
+void arq_init(arq_t *arq, uint16_t addr, uint8_t dst, arq_send_fn send, void *send_ctx);
+bool arq_set_config(arq_t *arq, const arq_config_t *config);
+arq_link_t *arq_link(arq_t *arq, uint16_t peer, bool create);
+bool arq_ready(arq_t *arq, uint16_t peer);
+bool arq_send(arq_t *arq, uint16_t peer, const uint8_t *data, uint8_t len, arq_done_fn done, void *ctx, uint32_t now_us);
+arq_rx_t arq_rx(arq_t *arq, const uint8_t *frame, uint8_t len, uint32_t rx_us, int8_t rssi);
+void arq_window_closed(arq_t *arq, arq_link_t *link);
+void arq_poll(arq_t *arq, uint32_t now_us);
+
+#endif /* __ARQ_H */
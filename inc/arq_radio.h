@@ -0,0 +1,34 @@
+/*
+ * arq_radio.h
+ *
+ * the ARQ (arq.h) on this radio. frames go out through the TX queue,
+ * each with its ACK timeout as the frame's reply window, so the wait is
+ * the radio's own RX timeout and no timer runs for it. the queue reports
+ * the window's end from tx_queue_poll(), received frames come in from
+ * subghz_packet_received(); arq_radio_poll() after both takes the retry
+ * decisions. all of it runs in the main loop.
+ *
+ * a remote only receives in its own ACK windows, a frame from the base
+ * gets through when it lands in one (hostlink -a shows what that costs).
+ */
+
+#ifndef __ARQ_RADIO_H
+#define __ARQ_RADIO_H
+
+#include "stm32wlxx_hal_subghz.h"
+#include "packet_pool.h"
+#include "arq.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+void arq_radio_init(uint16_t addr);
+HAL_StatusTypeDef arq_radio_configure(const arq_config_t *config);
+bool arq_radio_ready(uint16_t peer);
+HAL_StatusTypeDef arq_radio_send(uint16_t peer, const uint8_t *data, uint8_t len, arq_done_fn done, void *ctx);
+bool arq_radio_rx(const packet_slot_t *slot);
+void arq_radio_poll(void);
+const arq_link_t *arq_radio_link(uint16_t peer);
+void arq_radio_print_stats(void);
+
+#endif /* __ARQ_RADIO_H */
@@ -0,0 +1,204 @@
+/*
+ * bulk.h
+ *
+ * selective-repeat bulk transfer of a blob to one peer. the blob is cut
+ * into fragments of BULK_FRAGMENT_DATA bytes, one BULK_FRAME_LEN frame
+ * each, and sent in rounds back to back. a round covers the fragments
+ * not yet acknowledged among the BULK_WINDOW from the lowest missing
+ * one; its last frame asks for a SACK and opens a reply window for it.
+ * the SACK names the lowest fragment still missing and maps the
+ * BULK_WINDOW after it, so the next round slides the window up to it and
+ * repeats only the gaps. a window that closes without a SACK sends a
+ * poll, a fragment without data that only asks for one, up to
+ * BULK_MAX_POLLS in a row before the transfer is given up.
+ *
+ *   FRAME_BULK [header][to lo][to hi][session][flags][count lo][count hi][data...]
+ *              seq: the fragment's index, an open's data is the profile byte
+ *   FRAME_SACK [header][to lo][to hi][session][map, 4 bytes][rssi]
+ *              seq: every fragment below it received, map bit n: seq + n received,
+ *              rssi: dBm, the frame that asked for it
+ *
+ * a session opens with a BULK_OPEN poll sent to the network address, as
+ * every other frame, and repeated up to BULK_MAX_OPENS times until the
+ * peer answers: a remote hears it in one of its ACK windows. from then
+ * on the receiver listens without pause and its radio takes the node
+ * address bulk_filter_addr() gives for it, which the sender puts in each
+ * frame after the open; other radios drop the fragments on the address
+ * byte, before their CPU hears of them. the last SACK has its seq at the
+ * fragment count. the receiver answers polls until BULK_IDLE_US pass
+ * without a frame, then goes back to its own schedule.
+ *
+ * the open also names the PHY profile (phy.h) the rest of the session
+ * runs on. it goes out on PHY_NETWORK, where every node listens, and is
+ * answered there; the receiver then moves to the session's profile with
+ * its address. an open whose answer was lost is repeated on the
+ * session's profile every other time, for a receiver already moved.
+ * reply windows grow with the profile's preamble and sync word.
+ *
+ * the sender reads the blob through a bulk_source_fn, a fragment at a
+ * time and again for each repeat, so the blob can stay in flash; the
+ * receiver hands each new fragment to its bulk_sink_fn at its offset, in
+ * whatever order they come.
+ *
+ * like the ARQ (arq.h) nothing here depends on the target, the host runs
+ * it against simulated radios (host/arq_sim.c). everything is called
+ * from the main loop.
+ */
+
+#ifndef __BULK_H
+#define __BULK_H
+
+#include "frame.h"
+#include "phy.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BULK_FRAME_LEN				FRAME_MAX_LEN	// the longest frame a receiver's slot takes
+#define BULK_TO_OFFSET				FRAME_HEADER_LEN
+#define BULK_SESSION_OFFSET			(FRAME_HEADER_LEN + 2)
+#define BULK_FLAGS_OFFSET			(FRAME_HEADER_LEN + 3)
+#define BULK_COUNT_OFFSET			(FRAME_HEADER_LEN + 4)
+#define BULK_HEADER_LEN				(FRAME_HEADER_LEN + 6)
+#define BULK_FRAGMENT_DATA			(BULK_FRAME_LEN - BULK_HEADER_LEN)
+#define BULK_PROFILE_OFFSET			BULK_HEADER_LEN
+#define BULK_OPEN_LEN				(BULK_HEADER_LEN + 1)
+#define BULK_MAP_OFFSET				(FRAME_HEADER_LEN + 3)
+#define BULK_RSSI_OFFSET			(FRAME_HEADER_LEN + 7)
+#define BULK_SACK_LEN				(FRAME_HEADER_LEN + 8)
+
+#define BULK_OPEN					0x01	// flags: start of a session
+#define BULK_POLL					0x02	// flags: SACK wanted
+
+#define BULK_WINDOW					32		// fragments, the bits in a SACK map
+#define BULK_MAX_FRAGMENTS			0xFFFF
+#define BULK_MAX_SIZE				((uint32_t)BULK_MAX_FRAGMENTS * BULK_FRAGMENT_DATA)
+#define BULK_MAX_POLLS				8
+#define BULK_MAX_OPENS				100
+#define BULK_SACK_TIMEOUT_US		10000	// TXDONE to the SACK's sync word on PHY_NETWORK
+#define BULK_IDLE_US				500000
+
+typedef enum
+{
+	BULK_IDLE = 0,				// no transfer, ready for bulk_send()
+	BULK_SENDING,				// the round's fragments going to the radio
+	BULK_WAIT,					// SACK or poll with the radio, then in its reply window
+	BULK_CLOSED					// window closed without a SACK, bulk_poll() polls
+} bulk_state_t;
+
+typedef enum
+{
+	BULK_DELIVERED = 0,			// sender: the last SACK covers every fragment
+	BULK_GAVE_UP,				// sender: polls or opens unanswered
+	BULK_RECEIVED				// receiver: every fragment handed to the sink
+} bulk_result_t;
+
+typedef struct
+{
+	uint32_t sessions;			// transfers started
+	uint32_t delivered;
+	uint32_t failed;
+	uint32_t rounds;
+	uint32_t fragments;			// fragments sent, repeats included
+	uint32_t repeats;			// fragments sent again
+	uint32_t opens;
+	uint32_t polls;
+	uint32_t no_sack;			// reply windows timed out
+	uint32_t busy;				// the radio took no frame, tried again on the next poll
+	uint32_t stale_sacks;		// SACKs not asked for, or for another session
+	uint32_t rx_sessions;		// sessions opened by a peer
+	uint32_t rx_complete;
+	uint32_t rx_fragments;		// new fragments handed to the sink
+	uint32_t rx_dups;
+	uint32_t rx_outside;		// past the window, or past the count
+	uint32_t rx_stray;			// for no open session
+	uint32_t sacks_sent;
+} bulk_stats_t;
+
+typedef struct bulk bulk_t;
+
+// hands a frame to the radio, to go out on the given profile, false if
+// it can't take it now. reply_us non-zero: open an RX window that long
+// on the same profile once the frame is sent, and call
+// bulk_window_closed() when it ends, however it ends
+typedef bool (*bulk_send_fn)(void *ctx, const uint8_t *frame, uint8_t len, uint32_t reply_us, uint8_t profile);
+// receiver: on, listen without pause on profile and filter on addr;
+// off, back to the network address, PHY_NETWORK and the node's own
+// schedule
+typedef void (*bulk_listen_fn)(void *ctx, bool on, uint8_t addr, uint8_t profile);
+// len bytes of the blob from offset into data
+typedef void (*bulk_source_fn)(void *ctx, uint32_t offset, uint8_t *data, uint32_t len);
+typedef void (*bulk_sink_fn)(void *ctx, uint16_t peer, uint32_t offset, const uint8_t *data, uint32_t len);
+typedef void (*bulk_done_fn)(const bulk_t *bulk, bulk_result_t result, void *ctx);
+
+typedef struct
+{
+	uint8_t state;				// bulk_state_t
+	bool in_flight;				// a SACK request with the radio, window not closed yet
+	bool opened;				// the peer answered the open
+	uint8_t session;
+	uint8_t polls;				// polls or opens in a row without a SACK
+	uint8_t peer_addr;			// node address the peer filters on
+	uint8_t profile;			// phy profile past the open
+	uint8_t staged;				// length of a fragment left in frame[] by a busy radio, 0 for none
+	uint16_t peer;
+	uint16_t count;				// fragments
+	uint16_t base;				// every fragment below acknowledged
+	uint16_t next;				// next fragment of the round
+	uint16_t last;				// last fragment of the round, asks for the SACK
+	uint32_t map;				// bit n: base + n acknowledged
+	uint32_t high;				// fragments below it sent at least once
+	uint32_t size;				// bytes
+	uint32_t start_us;
+	uint32_t end_us;
+	bulk_source_fn source;
+	bulk_done_fn done;
+	void *ctx;
+} bulk_tx_t;
+
+typedef struct
+{
+	bool active;				// listening for a peer's session
+	bool complete;
+	uint8_t session;
+	uint8_t profile;
+	int8_t rssi;				// last frame of the session, for the SACK
+	uint16_t peer;
+	uint16_t count;
+	uint16_t base;				// every fragment below received
+	uint32_t map;				// bit n: base + n received
+	uint32_t size;				// bytes handed to the sink
+	uint32_t start_us;
+	uint32_t end_us;
+	uint32_t last_us;			// last frame of the session
+	bulk_sink_fn sink;
+	bulk_done_fn done;
+	void *ctx;
+} bulk_rx_t;
+
+struct bulk
+{
+	bulk_send_fn send;
+	bulk_listen_fn listen;
+	void *ctx;
+	uint16_t addr;				// this node
+	uint8_t dst;				// network address byte
+	uint8_t session;			// last session started
+	bulk_tx_t tx;
+	bulk_rx_t rx;
+	bulk_stats_t stats;
+	uint8_t frame[BULK_FRAME_LEN];
+};
+
+void bulk_init(bulk_t *bulk, uint16_t addr, uint8_t dst, bulk_send_fn send, bulk_listen_fn listen, void *ctx);
+void bulk_accept(bulk_t *bulk, bulk_sink_fn sink, bulk_done_fn done, void *ctx);
+bool bulk_send(bulk_t *bulk, uint16_t peer, uint32_t size, uint8_t profile, bulk_source_fn source, bulk_done_fn done,
+	void *ctx, uint32_t now_us);
+bool bulk_busy(const bulk_t *bulk);
+bool bulk_rx(bulk_t *bulk, const uint8_t *frame, uint8_t len, uint32_t rx_us, int8_t rssi);
+void bulk_window_closed(bulk_t *bulk, bool replied);
+void bulk_poll(bulk_t *bulk, uint32_t now_us);
+uint8_t bulk_filter_addr(uint16_t addr, uint8_t dst);
+uint32_t bulk_goodput_bps(uint32_t bytes, uint32_t us);
+
+#endif /* __BULK_H */
@@ -0,0 +1,38 @@
+/*
+ * bulk_radio.h
+ *
+ * the bulk transfer (bulk.h) on this radio. fragments go out through the
+ * TX queue back to back, each round's last with the SACK timeout as its
+ * reply window; the queue reports the window's end from tx_queue_poll(),
+ * SACKs and fragments come in from subghz_packet_received(), and
+ * bulk_radio_poll() after both keeps the next round going.
+ *
+ * a session being received moves the radio's node address to the one
+ * the sender filters for and leaves it in continuous RX on the session's
+ * profile after every TX, through trx_set_resume() and
+ * trx_set_rx_profile(); all go back when the session goes quiet. the
+ * node holds its own traffic until then. sessions sent go out on the
+ * profile tx_power_radio_profile() gives for the peer, SACKs report
+ * back to it.
+ */
+
+#ifndef __BULK_RADIO_H
+#define __BULK_RADIO_H
+
+#include "stm32wlxx_hal_subghz.h"
+#include "packet_pool.h"
+#include "bulk.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+void bulk_radio_init(uint16_t addr, bulk_sink_fn sink, void *ctx);
+HAL_StatusTypeDef bulk_radio_send(uint16_t peer, uint32_t size, bulk_source_fn source, bulk_done_fn done, void *ctx);
+bool bulk_radio_busy(void);
+bool bulk_radio_receiving(void);
+bool bulk_radio_rx(const packet_slot_t *slot);
+void bulk_radio_poll(void);
+uint32_t bulk_radio_goodput_permille(const bulk_t *bulk);
+void bulk_radio_print_stats(void);
+
+#endif /* __BULK_RADIO_H */
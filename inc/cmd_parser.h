@@ -0,0 +1,59 @@
+/*
+ * cmd_parser.h
+ *
+ * splits host link frames out of a circular receive ring and hands each
+ * record with a good CRC to a callback, see hostlink_proto.h for the
+ * format. frames are COBS decoded in place in the ring, so a payload is
+ * passed as a pointer into the ring; only one that wraps past the ring
+ * end is copied out first. nothing here depends on the target, the host
+ * feeds it byte streams through a ring of its own.
+ *
+ * the producer writes the ring, the parser reads it up to the position
+ * passed to cmd_parser_feed() and may rewrite what it has consumed. the
+ * payload pointer is good until the callback returns.
+ */
+
+#ifndef __CMD_PARSER_H
+#define __CMD_PARSER_H
+
+#include "hostlink_proto.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct
+{
+	uint8_t type;
+	uint8_t len;
+	const uint8_t *payload;
+} cmd_record_t;
+
+typedef void (*cmd_record_fn)(const cmd_record_t *record, void *ctx);
+
+typedef struct
+{
+	uint32_t bytes;
+	uint32_t records;
+	uint32_t crc_errors;
+	uint32_t cobs_errors;		// malformed COBS or length field
+	uint32_t overruns;			// frames longer than HOSTLINK_MAX_FRAME
+	uint32_t wrapped;			// payloads copied out at the ring end
+} cmd_parser_stats_t;
+
+typedef struct
+{
+	uint8_t *ring;
+	uint32_t mask;
+	uint32_t start;				// first byte of the frame in progress, free-running
+	uint32_t scan;				// next byte to look at, free-running
+	bool overrun;				// drop until the next delimiter
+	cmd_record_fn on_record;
+	void *ctx;
+	uint8_t linear[HOSTLINK_MAX_PAYLOAD];
+	cmd_parser_stats_t stats;
+} cmd_parser_t;
+
+void cmd_parser_init(cmd_parser_t *parser, uint8_t *ring, uint32_t size, cmd_record_fn on_record, void *ctx);
+void cmd_parser_feed(cmd_parser_t *parser, uint32_t position);
+
+#endif /* __CMD_PARSER_H */
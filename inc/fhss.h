@@ -0,0 +1,100 @@
+/*
+ * fhss.h
+ *
+ * frequency hopping over the 902-928 MHz band. the channel plan, the
+ * PLL channel words and the image calibration bands are computed once
+ * at fhss_init(), a hop only sends precomputed bytes, and the image
+ * calibration only when the hop enters another 4 MHz band than the one
+ * the radio was last calibrated for.
+ *
+ * hop sequence, shared with the remotes: start from channels 0..N-1 in
+ * order and shuffle with Fisher-Yates, i from N-1 down to 1, swapping
+ * entry i with entry (xorshift32() % (i + 1)). xorshift32 starts from
+ * the seed (0 is replaced by FHSS_DEFAULT_SEED) and steps
+ * x ^= x << 13; x ^= x >> 17; x ^= x << 5 before each draw.
+ *
+ * the sequence is walked one position per FHSS_DWELL_US. the base keeps
+ * the time: right after each hop it sends a FRAME_BEACON with its
+ * position in the sequence and the time since its dwell started, and a
+ * remote takes its own dwell start from the beacon's start on air. a
+ * remote runs FHSS_LEAD_US ahead of the base so it is listening on the
+ * new channel before the beacon goes out; frames are held back
+ * FHSS_GUARD_US from either end of a dwell, which the lead, the clock
+ * drift between beacons and the beacon's own start up all fit in.
+ *
+ *   beacon: [header, FRAME_BEACON][position][us into the dwell, 32-bit LE]
+ *
+ * nothing here depends on the target, the host tests the sequence, the
+ * band caching and the schedule (host/Makefile).
+ */
+
+#ifndef __FHSS_H
+#define __FHSS_H
+
+#include "frame.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FHSS_CHANNELS				50
+#define FHSS_BASE_FREQ				902500000	// channel 0 center, RF_FREQ is channel 25
+#define FHSS_SPACING				500000
+#define FHSS_DWELL_US				400000		// max time on one channel
+#define FHSS_DEFAULT_SEED			0x5A17C0DE
+#define FHSS_OFF_PLAN				(-1)
+
+#define FHSS_GUARD_US				2000
+#define FHSS_LEAD_US				1000		// a remote's dwells start this much before the base's
+
+#define FHSS_BEACON_LEN				(FRAME_HEADER_LEN + 5)
+
+_Static_assert(FHSS_LEAD_US < FHSS_GUARD_US, "a remote's lead stays inside the guard");
+
+// a channel as the radio wants it, big-endian RFFREQUENCY and CALIBRATEIMAGE parameters
+typedef struct
+{
+	uint8_t word[4];
+	uint8_t cal[2];
+} fhss_channel_t;
+
+typedef struct
+{
+	uint32_t hops;
+	uint32_t calibrations;		// retunes that entered a new calibration band
+	uint32_t last_cycles;		// retune latency of the last hop
+	uint32_t max_cycles;
+	uint32_t total_cycles;
+	uint32_t beacons;			// sent by the base
+	uint32_t syncs;				// beacons a remote took its dwells from
+	uint32_t misses;			// beacon windows a remote heard nothing in
+	uint32_t lost;				// times a remote went back to acquisition
+} fhss_stats_t;
+
+typedef struct
+{
+	fhss_channel_t channels[FHSS_CHANNELS];
+	uint8_t sequence[FHSS_CHANNELS];	// channel at each position
+	uint8_t position[FHSS_CHANNELS];	// position of each channel
+	uint32_t index;				// position in the sequence
+	uint8_t channel;
+	uint8_t calibrated_band;	// lower CALIBRATEIMAGE byte in effect, 0 if none
+	bool synced;				// dwell_start follows the base's schedule
+	uint32_t dwell_start;		// us, wraps with the clock
+	fhss_stats_t stats;
+} fhss_t;
+
+void fhss_init(fhss_t *fhss, uint32_t seed);
+uint32_t fhss_frequency(uint8_t channel);
+void fhss_tuning(uint32_t frequency, fhss_channel_t *ch);
+int32_t fhss_position(const fhss_t *fhss, uint32_t frequency);
+const fhss_channel_t *fhss_select(fhss_t *fhss, uint32_t index);
+bool fhss_band_changed(fhss_t *fhss, const uint8_t cal[2]);
+void fhss_invalidate_calibration(fhss_t *fhss);
+void fhss_start(fhss_t *fhss, uint32_t now_us);
+bool fhss_dwell_expired(const fhss_t *fhss, uint32_t now_us);
+uint32_t fhss_advance(fhss_t *fhss, uint32_t now_us);
+bool fhss_tx_allowed(const fhss_t *fhss, uint32_t now_us, uint32_t airtime_us);
+void fhss_beacon(fhss_t *fhss, uint32_t now_us, uint8_t *frame);
+bool fhss_beacon_sync(fhss_t *fhss, const uint8_t *frame, uint32_t len, uint32_t start_us);
+
+#endif /* __FHSS_H */
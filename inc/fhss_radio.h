@@ -0,0 +1,53 @@
+/*
+ * fhss_radio.h
+ *
+ * the hop schedule (fhss.h) on this radio. every retune goes through
+ * here, SetRfFrequency() included: a frequency on the plan takes the
+ * channel's precomputed bytes, one between channels is converted at the
+ * call, and either calibrates the image only on entering a new band.
+ *
+ * the base hops from fhss_radio_poll() once its dwell is over and the
+ * TX queue idle, re-arms its receiver and queues the beacon. a remote
+ * waits on the rendezvous channel, the one the init tuned (RF_FREQ), in
+ * continuous RX until a beacon arrives, then hops on its own clock and
+ * every FHSS_TRACK_HOPS hops opens a FHSS_BEACON_WINDOW_US RX for the
+ * beacon; FHSS_SYNC_MISSES empty windows in a row send it back to the
+ * rendezvous channel. tx_queue asks fhss_radio_tx_allowed() before each
+ * frame, a frame that would cross the end of a dwell waits for the hop.
+ */
+
+#ifndef __FHSS_RADIO_H
+#define __FHSS_RADIO_H
+
+#include "stm32wlxx_hal_subghz.h"
+#include "packet_pool.h"
+#include "fhss.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FHSS_TRACK_HOPS				10
+#define FHSS_BEACON_WINDOW_US		10000
+#define FHSS_SYNC_MISSES			3
+
+typedef enum
+{
+	FHSS_FIXED = 0,				// on the channel last tuned, no dwell
+	FHSS_BASE,					// keeps the schedule, beacons it
+	FHSS_REMOTE					// follows the beacons
+} fhss_role_t;
+
+void fhss_radio_init(SUBGHZ_HandleTypeDef *hsubghz, uint32_t seed);
+HAL_StatusTypeDef fhss_radio_hop_to(uint32_t index);
+HAL_StatusTypeDef fhss_radio_tune(uint32_t frequency);
+void fhss_radio_tuned(uint32_t frequency);
+HAL_StatusTypeDef fhss_radio_start(fhss_role_t role, uint16_t addr);
+bool fhss_radio_hopping(void);
+bool fhss_radio_synced(void);
+bool fhss_radio_tx_allowed(const uint8_t *frame, uint32_t airtime_us);
+bool fhss_radio_rx(const packet_slot_t *slot);
+void fhss_radio_poll(void);
+const fhss_stats_t *fhss_radio_get_stats(void);
+void fhss_radio_print_stats(void);
+
+#endif /* __FHSS_RADIO_H */
@@ -0,0 +1,78 @@
+/*
+ * frame.h
+ *
+ * header at the start of every radio payload. the radio filters on the
+ * destination byte (AddrComp), the rest is for the base station: the
+ * sender's own address, a sequence number it steps once per new frame,
+ * both little-endian, and the frame type.
+ *
+ *   [dst][src lo][src hi][seq lo][seq hi][type][data...]
+ *
+ * FRAME_DATA is sent once and never answered. FRAME_ARQ and FRAME_ACK
+ * belong to the ARQ (arq.h) and carry the 16-bit address of the node
+ * they are for ahead of the data, as do FRAME_BULK and FRAME_SACK of
+ * the bulk transfer (bulk.h). FRAME_BEACON is the base's hop schedule
+ * (fhss.h). the base station sends as FRAME_ADDR_BASE, which remotes
+ * address it by.
+ *
+ * the accessors take the frame from its first byte, [dst]. an RX slot
+ * holds it that way in payload[], the radio status is kept apart.
+ */
+
+#ifndef __FRAME_H
+#define __FRAME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FRAME_DST_OFFSET			0
+#define FRAME_SRC_OFFSET			1
+#define FRAME_SEQ_OFFSET			3
+#define FRAME_TYPE_OFFSET			5
+#define FRAME_HEADER_LEN			6
+#define FRAME_MAX_LEN				127		// longest frame a receiver takes, a bulk fragment (bulk.h)
+
+#define FRAME_DATA					0x00
+#define FRAME_ARQ					0x01	// to be acknowledged
+#define FRAME_ACK					0x02	// seq is the one acknowledged
+#define FRAME_BULK					0x03	// seq is the fragment's index
+#define FRAME_SACK					0x04	// seq is the lowest fragment missing
+#define FRAME_BEACON				0x05	// seq counts the beacons
+
+#define FRAME_ADDR_BASE				0x0000
+
+static inline uint16_t frame_get16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline void frame_put16(uint8_t *p, uint16_t value)
+{
+	p[0] = (uint8_t)value;
+	p[1] = (uint8_t)(value >> 8);
+}
+
+static inline uint16_t frame_src(const uint8_t *frame)
+{
+	return frame_get16(&frame[FRAME_SRC_OFFSET]);
+}
+
+static inline uint16_t frame_seq(const uint8_t *frame)
+{
+	return frame_get16(&frame[FRAME_SEQ_OFFSET]);
+}
+
+static inline uint8_t frame_type(const uint8_t *frame)
+{
+	return frame[FRAME_TYPE_OFFSET];
+}
+
+static inline void frame_header(uint8_t *payload, uint8_t dst, uint16_t src, uint16_t seq, uint8_t type)
+{
+	payload[FRAME_DST_OFFSET] = dst;
+	frame_put16(&payload[FRAME_SRC_OFFSET], src);
+	frame_put16(&payload[FRAME_SEQ_OFFSET], seq);
+	payload[FRAME_TYPE_OFFSET] = type;
+}
+
+#endif /* __FRAME_H */
@@ -0,0 +1,32 @@
+/*
+ * host_cmd.h
+ *
+ * commands from the host: records parsed in place from the LPUART
+ * receive ring and carried out on the radio. each is acknowledged, as
+ * a HOSTLINK_REC_ACK in binary mode and a line of text otherwise.
+ * host_cmd_poll() runs from the main loop, never under the radio IRQ,
+ * and costs nothing until the receiver interrupts.
+ */
+
+#ifndef __HOST_CMD_H
+#define __HOST_CMD_H
+
+#include "cmd_parser.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct
+{
+	uint32_t commands;			// acknowledged, whatever the status
+	uint32_t unknown;			// types or lengths not understood
+	uint32_t failed;			// status other than HAL_OK
+} host_cmd_stats_t;
+
+void host_cmd_init(void);
+void host_cmd_poll(void);
+const cmd_parser_stats_t *host_cmd_parser_stats(void);
+const host_cmd_stats_t *host_cmd_get_stats(void);
+void host_cmd_print_stats(void);
+
+#endif /* __HOST_CMD_H */
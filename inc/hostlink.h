@@ -0,0 +1,46 @@
+/*
+ * hostlink.h
+ *
+ * output to the host. in text mode bytes go to the LPUART as printed,
+ * in binary mode everything leaves as hostlink_proto.h records: radio
+ * packets and telemetry as such, and printf_() output as one log record
+ * per line.
+ */
+
+#ifndef __HOSTLINK_H
+#define __HOSTLINK_H
+
+#include "hostlink_proto.h"
+#include "packet_pool.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define HOSTLINK_LOG_LINE			120		// longer lines are split
+
+typedef enum
+{
+	HOSTLINK_TEXT = 0,
+	HOSTLINK_BINARY
+} hostlink_mode_t;
+
+// mode at start up, SW2 toggles it
+#define HOSTLINK_DEFAULT_MODE		HOSTLINK_BINARY
+
+typedef struct
+{
+	uint32_t frames[HOSTLINK_REC_TYPES];	// per record type, [0] counts unknown types
+	uint32_t bytes;				// on the wire, delimiters included
+	uint32_t truncated;			// records cut to HOSTLINK_MAX_PAYLOAD
+} hostlink_stats_t;
+
+void hostlink_set_mode(hostlink_mode_t mode);
+hostlink_mode_t hostlink_mode(void);
+bool hostlink_binary(void);
+void hostlink_send(uint8_t type, const void *head, uint32_t head_len, const void *body, uint32_t body_len);
+void hostlink_packet(const packet_slot_t *slot);
+void hostlink_telemetry(uint8_t group, const uint32_t *values, uint32_t count);
+void hostlink_putchar(char c);
+const hostlink_stats_t *hostlink_get_stats(void);
+
+#endif /* __HOSTLINK_H */
@@ -0,0 +1,98 @@
+/*
+ * hostlink_proto.h
+ *
+ * binary records between the firmware and the host over LPUART, shared
+ * by the firmware and the host tools in host/. nothing here depends on
+ * the target.
+ *
+ * a record is [type][length][payload: length bytes][crc16 lo][crc16 hi],
+ * CRC-16/CCITT-FALSE over type, length and payload. the record is COBS
+ * encoded and followed by a 0x00 delimiter, so a decoder joining the
+ * stream anywhere resynchronizes at the next delimiter. all multi-byte
+ * fields are little-endian.
+ *
+ * the host sends commands the same way. a command payload starts with a
+ * tag the host picks, every command is answered by a HOSTLINK_REC_ACK
+ * carrying the command type, the tag and a HAL_StatusTypeDef value.
+ */
+
+#ifndef __HOSTLINK_PROTO_H
+#define __HOSTLINK_PROTO_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define HOSTLINK_DELIMITER			0x00
+#define HOSTLINK_MAX_PAYLOAD		250
+#define HOSTLINK_RECORD_OVERHEAD	4		// type, length, CRC
+#define HOSTLINK_MAX_RECORD			(HOSTLINK_MAX_PAYLOAD + HOSTLINK_RECORD_OVERHEAD)
+// COBS adds a byte per 254, plus the delimiter
+#define HOSTLINK_MAX_FRAME			(HOSTLINK_MAX_RECORD + (HOSTLINK_MAX_RECORD / 254) + 2)
+
+#define HOSTLINK_REC_PACKET			0x01	// hostlink_packet_t, then the frame as received
+#define HOSTLINK_REC_TELEMETRY		0x02	// group, then uint32_t counters
+#define HOSTLINK_REC_LOG			0x03	// text, no terminator
+#define HOSTLINK_REC_ACK			0x04	// command type, tag, status
+#define HOSTLINK_REC_TYPES			5
+
+// commands from the host, arguments follow the tag
+#define HOSTLINK_CMD_PING			0x40	// none
+#define HOSTLINK_CMD_LISTEN			0x41	// uint8_t listen mode
+#define HOSTLINK_CMD_FREQUENCY		0x42	// uint32_t Hz, refused while the radio hops (fhss_radio.h)
+#define HOSTLINK_CMD_PREAMBLE		0x43	// uint16_t remote preamble bits
+#define HOSTLINK_CMD_OUTPUT			0x44	// uint8_t 0 text, 1 binary
+#define HOSTLINK_CMD_TX_POLICY		0x45	// uint8_t LPUART overflow policy
+#define HOSTLINK_CMD_SEND			0x46	// radio frame to queue, header included
+#define HOSTLINK_CMD_FALLBACK		0x47	// uint8_t 0x20 STANDBY_RC, 0x30 STANDBY_HSE32, 0x40 FS
+#define HOSTLINK_CMD_ARQ_SEND		0x48	// uint16_t peer, then the data
+#define HOSTLINK_CMD_ARQ			0x49	// uint8_t retries, uint32_t ACK timeout, backoff, max backoff (us)
+#define HOSTLINK_CMD_BULK			0x4A	// uint16_t peer, uint32_t bytes of the firmware image to push
+
+#define HOSTLINK_ACK_LEN			3
+
+// HOSTLINK_REC_PACKET header, the firmware's radio_record_t as is. the
+// frame follows from its [dst] byte, without the radio status byte
+typedef struct __attribute__((__packed__))
+{
+	uint32_t time_us;
+	int8_t rssi_sync;
+	int8_t rssi_avg;
+	uint8_t event;
+	uint8_t flags;
+} hostlink_packet_t;
+
+// HOSTLINK_REC_TELEMETRY groups and the counters they carry, in order
+#define HOSTLINK_TLM_RX				0x01
+
+enum
+{
+	HOSTLINK_TLM_RX_PACKETS = 0,
+	HOSTLINK_TLM_RX_DROPPED,			// no free slot
+	HOSTLINK_TLM_RX_RING_HIGH_WATER,
+	HOSTLINK_TLM_RX_RING_OVERFLOWS,
+	HOSTLINK_TLM_RX_NODES,
+	HOSTLINK_TLM_RX_NODES_UNTRACKED,
+	HOSTLINK_TLM_RX_HOST_FRAMES,
+	HOSTLINK_TLM_RX_HOST_BYTES,
+	HOSTLINK_TLM_RX_COUNT
+};
+
+// CRC-16/CCITT-FALSE, a nibble at a time from a 16-entry table
+static inline uint16_t hostlink_crc16(uint16_t crc, const uint8_t *data, size_t len)
+{
+	static const uint16_t table[16] = {
+		0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+		0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+	};
+
+	while(len--){
+		crc = (uint16_t)((crc << 4) ^ table[(crc >> 12) ^ (*data >> 4)]);
+		crc = (uint16_t)((crc << 4) ^ table[(crc >> 12) ^ (*data & 0x0F)]);
+		data++;
+	}
+	return crc;
+}
+
+#define HOSTLINK_CRC_INIT			0xFFFF
+
+#endif /* __HOSTLINK_PROTO_H */
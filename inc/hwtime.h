@@ -0,0 +1,30 @@
+/*
+ * hwtime.h
+ *
+ * microsecond event timestamps. TIM2 runs free at 1 MHz over its 32 bits
+ * (wraps after 71 min), the RTC on LSE gives the absolute time: an epoch
+ * pairs a TIM2 count with the RTC time of day and sub-second counter.
+ *
+ * the radio IRQ (EXTI line 44) has no route to a timer capture input, the
+ * IRQ edge is recovered from the cycle count taken at the handler entry.
+ */
+
+#ifndef __HWTIME_H
+#define __HWTIME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct
+{
+	uint32_t seconds;		// RTC time of day
+	uint32_t micros;
+} hwtime_abs_t;
+
+void hwtime_init(void);
+uint32_t hwtime_now_us(void);
+uint32_t hwtime_at_cycles(uint32_t cycles);
+void hwtime_resync(void);
+void hwtime_to_abs(uint32_t time_us, hwtime_abs_t *abs);
+
+#endif /* __HWTIME_H */
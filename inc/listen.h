@@ -0,0 +1,65 @@
+/*
+ * listen.h
+ *
+ * how the receiver listens between packets, switchable at run time:
+ * single RX re-armed after each packet, continuous RX, or sniff mode
+ * (RADIO_SET_RXDUTYCYCLE) where the radio sleeps between short RX
+ * windows and stays in RX once a window catches a preamble.
+ *
+ * the sniff windows follow from the preamble the remotes send: a window
+ * must hold a full detector run (PREAMBLE_DETECT_BITS) wherever it
+ * starts, and a window plus a sleep period must fit in the preamble
+ * twice over so a preamble can't fall between two windows.
+ *
+ * radio energy is estimated per mode from the time spent in it and the
+ * typical supply currents below, sniff time split by its duty cycle.
+ */
+
+#ifndef __LISTEN_H
+#define __LISTEN_H
+
+#include "stm32wlxx_hal_subghz.h"
+#include "packet_pool.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// radio alone, typical, 3.3 V supply through the SMPS
+#define LISTEN_SUPPLY_MV			3300
+#define LISTEN_RX_UA				4820
+#define LISTEN_SLEEP_UA				1		// warm start, configuration retained
+
+#define SNIFF_WAKEUP_US				500		// sleep to RX with the TCXO, margin included
+
+// mode entered at start up, SW1 steps through the others
+#define LISTEN_DEFAULT				LISTEN_CONTINUOUS
+
+typedef enum
+{
+	LISTEN_SINGLE = 0,			// one RX per packet, re-armed from listen_poll()
+	LISTEN_CONTINUOUS,			// RX without timeout
+	LISTEN_SNIFF,				// RX duty cycle, re-armed from listen_poll()
+	LISTEN_MODES
+} listen_mode_t;
+
+typedef struct
+{
+	uint64_t time_us[LISTEN_MODES];
+	uint32_t packets[LISTEN_MODES];
+	uint64_t charge[LISTEN_MODES];	// uA x us
+	uint32_t rearms;
+	uint32_t preambles;			// sniff windows that caught a preamble
+	uint32_t awake_us;			// RX past the sniff windows, preamble to RXDONE
+} listen_stats_t;
+
+HAL_StatusTypeDef listen_init(SUBGHZ_HandleTypeDef *hsubghz, uint32_t remote_preamble_bits);
+HAL_StatusTypeDef listen_set_preamble(uint32_t remote_preamble_bits);
+HAL_StatusTypeDef listen_start(listen_mode_t mode);
+HAL_StatusTypeDef listen_resume(void);
+listen_mode_t listen_mode(void);
+void listen_poll(void);
+void listen_rx_record(const radio_record_t *rec);
+const listen_stats_t *listen_get_stats(void);
+void listen_print_stats(void);
+
+#endif /* __LISTEN_H */
@@ -0,0 +1,91 @@
+/*
+ * node_table.h
+ *
+ * per-remote state, keyed on the source address in the frame header.
+ * entries are allocated once, on a remote's first frame, and never
+ * freed. an open-addressed index of entry numbers, four times the entry
+ * count, finds them with a bounded linear probe: a remote whose probe
+ * run is full is not tracked rather than slowing every lookup.
+ *
+ * each remote keeps a window of the last NODE_SEQ_WINDOW sequence
+ * numbers below the highest seen. skipped numbers count as lost when
+ * the sequence jumps and are taken back if they arrive late; repeats
+ * and frames older than the window are duplicates. sequence numbers
+ * compare modulo 2^16, a jump ahead of 2^15 or more is an old frame.
+ *
+ * a remote that reboots starts its sequence over at 0. a jump of
+ * NODE_SEQ_RESYNC_GAP or more either way, or a frame after
+ * NODE_SEQ_STALE_US without one, restarts the window on it as on first
+ * contact, nothing counted lost or duplicate: a late copy is never that
+ * far behind, and frames from before a silence that long are gone.
+ *
+ * the entries fill RAM2 (NODE_TABLE_CAPACITY x 32 bytes), the index
+ * is in RAM (8 KB). nothing else here depends on the target, the table
+ * builds on the host as is (host/Makefile).
+ */
+
+#ifndef __NODE_TABLE_H
+#define __NODE_TABLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define NODE_TABLE_CAPACITY			1024
+#define NODE_INDEX_BITS				12
+#define NODE_INDEX_SIZE				(1U << NODE_INDEX_BITS)	// 4x the entries, short probe runs
+#define NODE_MAX_PROBES				16
+
+// RSSI average: dBm in 1/16 steps, each packet weighs 1/8
+#define NODE_RSSI_FRAC_BITS			4
+#define NODE_RSSI_EWMA_SHIFT		3
+
+// frames a remote may be reordered by before a late one counts as a duplicate
+#define NODE_SEQ_WINDOW				64
+#define NODE_SEQ_RESYNC_GAP			4096
+#define NODE_SEQ_STALE_US			60000000	// under the 2^32 us hwtime wrap
+
+typedef struct
+{
+	uint64_t window;			// bit n: frame last_seq - n received
+	uint16_t addr;
+	uint16_t last_seq;			// highest sequence number seen
+	int16_t rssi_ewma;			// dBm << NODE_RSSI_FRAC_BITS
+	uint16_t reordered;			// late frames that filled a gap, wraps
+	uint32_t packets;			// frames received, duplicates included
+	uint32_t lost;				// sequence numbers missing, less those filled late
+	uint32_t dups;				// frames already seen or older than the window
+	uint32_t last_seen_us;		// hwtime of the last frame
+} node_t;
+
+typedef enum
+{
+	NODE_RX_NEW = 0,			// newer than any frame so far
+	NODE_RX_LATE,				// inside the window, not seen before
+	NODE_RX_DUP,				// drop: seen before or too old to tell
+	NODE_RX_UNTRACKED,			// no header or no table entry
+} node_rx_t;
+
+_Static_assert(NODE_INDEX_SIZE >= 4 * NODE_TABLE_CAPACITY, "index kept at most a quarter full");
+_Static_assert(NODE_TABLE_CAPACITY < UINT16_MAX, "index holds 16-bit entry numbers");
+_Static_assert(sizeof(node_t) == 32, "node_t is packed to 32 bytes");
+_Static_assert(NODE_SEQ_WINDOW == 8 * sizeof(((node_t *)0)->window), "one window bit per frame");
+_Static_assert((NODE_SEQ_RESYNC_GAP > NODE_SEQ_WINDOW) && (NODE_SEQ_RESYNC_GAP < 0x8000), "a resync is past the window, either way");
+
+typedef struct
+{
+	uint32_t nodes;				// entries in use
+	uint32_t full;				// frames from remotes that found no entry
+	uint32_t short_frames;		// too short to carry a header
+	uint32_t max_probes;		// longest index probe so far
+	uint32_t resyncs;			// windows restarted on a reboot or a silence
+} node_table_stats_t;
+
+void node_table_init(void);
+node_t *node_table_lookup(uint16_t addr, bool create);
+node_rx_t node_table_rx(const uint8_t *frame, uint32_t len, uint32_t rx_us, int8_t rssi_dbm, node_t **node);
+uint32_t node_table_count(void);
+uint32_t node_table_number(const node_t *node);
+const node_t *node_table_entry(uint32_t index);
+const node_table_stats_t *node_table_get_stats(void);
+
+#endif /* __NODE_TABLE_H */
@@ -0,0 +1,70 @@
+/*
+ * packet_pool.h
+ *
+ * preallocated slots the RX path reads payloads into. a slot is filled
+ * once from the radio buffer and then passed around by pointer until
+ * its consumer releases it.
+ */
+
+#ifndef __PACKET_POOL_H
+#define __PACKET_POOL_H
+
+#include "frame.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define PACKET_SLOTS				8
+#define PACKET_MAX_LEN				FRAME_MAX_LEN
+
+#define RADIO_EVENT_RX				0x01
+#define RADIO_EVENT_TX				0x02
+
+// flags: RxStatus bits 2..7 of GET_PACKETSTATUS, moved down to bits 0..5
+#define RADIO_REC_ABORT				0x01
+#define RADIO_REC_LENGTH_ERR		0x02
+#define RADIO_REC_CRC_ERR			0x04
+#define RADIO_REC_ADDR_ERR			0x08
+#define RADIO_REC_SYNC_ERR			0x10
+#define RADIO_REC_PREAMBLE_ERR		0x20
+
+// one RX or TX event, fixed size so it can be logged or sent as is
+typedef struct
+{
+	uint32_t time_us;			// hwtime at the radio IRQ edge
+	int8_t rssi_sync;			// dBm, latched on the sync word, RX only
+	int8_t rssi_avg;			// dBm, averaged over the packet, RX only
+	uint8_t event;				// RADIO_EVENT_RX or RADIO_EVENT_TX
+	uint8_t flags;				// RADIO_REC_*
+} radio_record_t;
+
+_Static_assert(sizeof(radio_record_t) == 8, "radio_record_t is an 8 byte record");
+
+typedef struct
+{
+	radio_record_t rec;
+	uint8_t len;				// bytes valid in payload, 0 on a CRC error
+	uint8_t status;				// radio status, READ_BUFFER returns it ahead of the data
+	uint8_t payload[PACKET_MAX_LEN];	// the frame as sent, from its first byte
+} packet_slot_t;
+
+// one ReadBuffer() fills status and payload back to back
+_Static_assert(offsetof(packet_slot_t, payload) == offsetof(packet_slot_t, status) + 1,
+	"the payload follows the status byte");
+
+// where subghz_rx_to_slot() reads a frame to, and how many bytes: the
+// radio status, then the frame
+#define PACKET_READ_LEN(len)		((len) + 1U)
+
+static inline uint8_t *packet_slot_read_to(packet_slot_t *slot)
+{
+	return &slot->status;
+}
+
+packet_slot_t *packet_pool_alloc(void);
+void packet_pool_release(packet_slot_t *slot);
+uint32_t packet_pool_available(void);
+uint32_t packet_pool_exhausted(void);
+
+#endif /* __PACKET_POOL_H */
@@ -0,0 +1,61 @@
+/*
+ * phy.h
+ *
+ * the GFSK operating points a node can switch between at run time, from
+ * 4.8 to 200 kb/s. each keeps the network profile's modulation index,
+ * a deviation of half the bit rate, with the RX bandwidth next to the
+ * Carson bandwidth (2 fdev + bit rate) and widened at the low rates for
+ * the TCXO offset of both ends. the MODULATIONPARAMS bytes are worked
+ * out here at build time, so going to another profile is that one
+ * 9-byte SPI command; the packet format, sync word and address filter
+ * stay the same.
+ *
+ * sensitivity is counted from the network profile's, some 105 dBm, and
+ * scales with the RX bandwidth. every node listens on PHY_NETWORK and
+ * sends its ARQ traffic there; a bulk session (bulk.h) moves both ends
+ * to the profile the sender picked for the peer (tx_power.h).
+ *
+ * nothing here depends on the target, the host simulation times its
+ * frames with it.
+ */
+
+#ifndef __PHY_H
+#define __PHY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PHY_XTAL_FREQ				32000000
+#define PHY_PROFILES				7
+#define PHY_NETWORK					4		// 50 kb/s, BIT_RATE
+
+// the network profile, subghz_support.h builds the boot configuration from it
+#define PHY_NETWORK_BIT_RATE		50000
+#define PHY_NETWORK_FDEV			25000
+#define PHY_NETWORK_RX_BW			0x13	// 93.8 kHz
+
+// the band the radio is tuned in, and the image calibration steps over it
+#define PHY_FREQ_LOWER_LIMIT		902000000
+#define PHY_FREQ_UPPER_LIMIT		928000000
+#define PHY_CAL_STEP				4000000
+
+#define PHY_PREAMBLE_BITS			32
+#define PHY_OVERHEAD_BITS			(32 + 8 + 16)	// sync word, length byte, CRC
+#define PHY_SYNC_BITS				(PHY_PREAMBLE_BITS + 32)	// start of the frame to the end of its sync word
+
+typedef struct
+{
+	uint32_t bit_rate;
+	uint32_t fdev;
+	uint32_t rx_bw_hz;
+	int8_t sensitivity;			// dBm
+	uint8_t modulation[8];		// RADIO_SET_MODULATIONPARAMS: bit rate, pulse shape, RX bandwidth, fdev
+} phy_profile_t;
+
+extern const phy_profile_t phy_profiles[PHY_PROFILES];
+
+uint32_t phy_bits_us(uint8_t profile, uint32_t bits);
+uint32_t phy_airtime_us(uint8_t profile, uint8_t len);
+uint32_t phy_sync_us(uint8_t profile);
+
+#endif /* __PHY_H */
@@ -0,0 +1,72 @@
+/*
+ * spsc_ring.h
+ *
+ * lock-free single-producer/single-consumer ring of pointers. one side
+ * (an interrupt handler) only pushes, the other (the main loop) only
+ * pops. each index is written by one side only and published with
+ * release/acquire ordering, so no interrupt masking is needed.
+ *
+ * nothing here depends on the target, the ring builds on the host as is
+ * and can be driven there by a simulated interrupt source.
+ */
+
+#ifndef __SPSC_RING_H
+#define __SPSC_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SPSC_RING_CAPACITY			8		// power of two
+
+_Static_assert((SPSC_RING_CAPACITY & (SPSC_RING_CAPACITY - 1)) == 0, "capacity must be a power of two");
+
+typedef struct
+{
+	void *items[SPSC_RING_CAPACITY];
+	uint32_t head;			// next push, written by the producer only
+	uint32_t tail;			// next pop, written by the consumer only
+	uint32_t overflows;		// pushes refused on a full ring, producer side
+	uint32_t high_water;	// most items queued at once, producer side
+} spsc_ring_t;
+
+// free-running indices: head - tail is the fill level, even across a wrap
+static inline uint32_t spsc_ring_count(const spsc_ring_t *ring)
+{
+	return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+static inline bool spsc_ring_push(spsc_ring_t *ring, void *item)
+{
+	uint32_t head = ring->head;
+	uint32_t used = head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+	if(used >= SPSC_RING_CAPACITY){
+		ring->overflows++;
+		return false;
+	}
+	ring->items[head & (SPSC_RING_CAPACITY - 1)] = item;
+	// the item must be visible before the consumer sees the new head
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+	if(used + 1 > ring->high_water){
+		ring->high_water = used + 1;
+	}
+	return true;
+}
+
+static inline void *spsc_ring_pop(spsc_ring_t *ring)
+{
+	uint32_t tail = ring->tail;
+	void *item;
+
+	if(__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail){
+		return NULL;
+	}
+	item = ring->items[tail & (SPSC_RING_CAPACITY - 1)];
+	// the slot is free for the producer once the new tail is seen
+	__atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+	return item;
+}
+
+#endif /* __SPSC_RING_H */
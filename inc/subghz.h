@@ -9,12 +9,34 @@
 #define __SUBGHZ_H
 
 #include "stm32wlxx_hal_subghz.h"
+#include "packet_pool.h"
 #include <stdint.h>
 #include <stdbool.h>
 
 #define TX_MODE  0
 #define RX_MODE  1
 
+// transmitter: 1 sends to the base through the ARQ, a frame at a time
+// until it is acknowledged, 0 sends back to back without ACKs
+#define TX_ARQ   1
+
+// 1: hop over the FHSS plan (fhss.h), the base beaconing its schedule and
+// ARQ remotes following it, 0: stay on RF_FREQ. the back to back sender
+// hears no beacons and stays on RF_FREQ either way
+#define FHSS_HOPPING  1
+
+// 1: configure the radio from the pre-encoded init script, 0: command by command
+#define SUBGHZ_INIT_SCRIPT  1
+
+// 1: time a command and a buffer read at each SPI setting during
+// MX_SUBGHZ_Init() and print them, 0: boot without the bench
+#define SUBGHZ_SPI_BENCH  0
+
+// payloads at least this long move through the DMA, shorter ones are
+// cheaper polled (host/spi_model_test). the DMA frees the CPU but
+// takes longer on the wall clock than the polled burst at any length
+#define SUBGHZ_DMA_MIN_LEN  15
+
 typedef enum
 {
   RADIO_SWITCH_OFF    = 0,
@@ -23,11 +45,18 @@ typedef enum
   RADIO_SWITCH_RFO_HP = 3,
 }BSP_RADIO_Switch_TypeDef;
 
+extern SUBGHZ_HandleTypeDef subghz_handle;
+
+int32_t ConfigRFSwitch(BSP_RADIO_Switch_TypeDef Config);
 void MX_SUBGHZ_Init(void);
 HAL_StatusTypeDef subghz_init(SUBGHZ_HandleTypeDef *hsubghz);
-void subghz_write_tx_buffer(uint8_t value);
-HAL_StatusTypeDef tx_packet(void);
-void subghz_read_rx_buffer(void);
+uint16_t subghz_source_address(void);
+void subghz_decode_record(radio_record_t *rec, uint8_t event, uint32_t irq_cycles, const uint8_t *pkt_status);
+packet_slot_t *subghz_rx_to_slot(SUBGHZ_HandleTypeDef *hsubghz);
+void subghz_packet_received(packet_slot_t *slot);
+uint32_t subghz_rx_poll(void);
+void subghz_rx_print_stats(void);
+void subghz_rx_send_telemetry(void);
 HAL_StatusTypeDef continuous_rx(void);
 HAL_StatusTypeDef single_rx_blocking(void);
 
@@ -3,6 +3,8 @@
 
 #include "stm32wlxx_ll_gpio.h"
 #include "stm32wlxx_hal_subghz.h"
+#include "frame.h"
+#include "phy.h"
 
 #include <stdint.h>
 #include <stdbool.h>
@@ -10,9 +12,29 @@
 #define ADDRESS						0x5A
 
 #define RF_FREQ						915000000
-#define BIT_RATE					50000
-#define FREQ_DEVIATION				25000
-#define XTAL_FREQ					32000000
+#define BIT_RATE					PHY_NETWORK_BIT_RATE	// the profiles in phy.h, every node's outside a bulk session
+#define FREQ_DEVIATION				PHY_NETWORK_FDEV
+#define RX_BANDWIDTH				PHY_NETWORK_RX_BW
+#define XTAL_FREQ					PHY_XTAL_FREQ
+
+#define RX_MAX_PAYLOAD_LEN			FRAME_MAX_LEN	// longest payload accepted in RX mode
+#define TX_PAYLOAD_LEN				(FRAME_HEADER_LEN + 1)
+#define TX_MAX_PAYLOAD_LEN			255			// past 128 bytes the TX buffer wraps into the RX half
+
+#define PREAMBLE_BITS				PHY_PREAMBLE_BITS	// preamble sent, PbLength
+#define PREAMBLE_DETECT				0x07		// PbDetLength, 0x04 + n: 8 * (n + 1) bits
+#define PREAMBLE_DETECT_BITS		(8 * (PREAMBLE_DETECT - 0x03))
+
+// sync word, length byte and CRC around the payload
+#define FRAME_OVERHEAD_BITS			PHY_OVERHEAD_BITS
+
+#define FREQ_LOWER_LIMIT			PHY_FREQ_LOWER_LIMIT
+#define FREQ_UPPER_LIMIT			PHY_FREQ_UPPER_LIMIT
+#define CAL_STEP					PHY_CAL_STEP		// image calibration granularity
+
+// compile-time frequency and bitrate conversions, usable in const initializers
+#define SX_CHANNEL(freq)			((uint32_t)((((uint64_t)(freq)) << 25) / (XTAL_FREQ)))
+#define SX_BITRATE_DIV(rate)		((uint32_t)((32 * (uint64_t)(XTAL_FREQ)) / (rate)))
 
 
 
@@ -25,6 +47,7 @@
 #define RF_SW_CTRL1_GPIO_Port GPIOC
 
 HAL_StatusTypeDef subghz_default_init(SUBGHZ_HandleTypeDef *hsubghz);
+HAL_StatusTypeDef subghz_script_init(SUBGHZ_HandleTypeDef *hsubghz);
 HAL_StatusTypeDef SetPayloadLength(SUBGHZ_HandleTypeDef *hsubghz, uint8_t length);
 HAL_StatusTypeDef SetAddress(SUBGHZ_HandleTypeDef *hsubghz, uint8_t address);
 HAL_StatusTypeDef SetRfFrequency(SUBGHZ_HandleTypeDef *hsubghz, uint32_t frequency);
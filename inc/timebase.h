@@ -0,0 +1,55 @@
+/*
+ * timebase.h
+ *
+ * monotonic time base built on the DWT cycle counter, plus deadlines
+ * for bounded waits. the counter wraps after 2^32 cycles (134 s at
+ * 32 MHz), deadlines must stay well below that.
+ *
+ * the cycle counter is only guaranteed to run while the core is awake,
+ * waits that sleep in WFI measure their timeout in SysTick ticks instead.
+ */
+
+#ifndef __TIMEBASE_H
+#define __TIMEBASE_H
+
+#include "stm32wlxx.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct
+{
+	uint32_t start;		// cycle count when the deadline was armed
+	uint32_t length;	// cycles from start until the deadline expires
+} deadline_t;
+
+void timebase_init(void);
+uint32_t timebase_us_to_cycles(uint32_t us);
+uint32_t timebase_cycles_to_us(uint32_t cycles);
+deadline_t deadline_from_us(uint32_t us);
+deadline_t deadline_from_ms(uint32_t ms);
+void timebase_tick_wakeup(bool enable);
+uint32_t timebase_ticks(void);
+
+static inline uint32_t timebase_now(void)
+{
+	return DWT->CYCCNT;
+}
+
+static inline uint32_t timebase_elapsed(uint32_t start)
+{
+	// unsigned subtraction keeps this correct across a counter wrap
+	return timebase_now() - start;
+}
+
+static inline bool deadline_expired(const deadline_t *deadline)
+{
+	return timebase_elapsed(deadline->start) >= deadline->length;
+}
+
+static inline void deadline_restart(deadline_t *deadline)
+{
+	deadline->start = timebase_now();
+}
+
+#endif /* __TIMEBASE_H */
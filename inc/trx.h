@@ -0,0 +1,84 @@
+/*
+ * trx.h
+ *
+ * turning the radio around between RX and TX without a trip through
+ * STANDBY_RC. after each RX and TX the radio falls back to FS, which
+ * keeps the synthesizer locked, or to STANDBY_HSE32, which keeps the
+ * TCXO running (RADIO_SET_TXFALLBACKMODE covers both directions). the
+ * RF switch is flipped while the radio sits in the fallback mode,
+ * before the TX buffer write rather than after it.
+ *
+ * tx_queue calls trx_tx_begin() before it starts a frame, with the
+ * frame's power level (tx_power.h) and PHY profile (phy.h): PACONFIG,
+ * TXPARAMS and MODULATIONPARAMS go out only as far as they differ from
+ * the last frame's, and the RF switch takes the level's PA. from TXDONE,
+ * with nothing left to send, it calls trx_tx_idle(); the receiver, if
+ * there is one, is then put back on the profile trx_set_rx_profile()
+ * gave and re-armed through the callback given to trx_init(). a TX started within
+ * TRX_REPLY_WINDOW_US of an RXDONE is taken as an answer and its
+ * turnaround, RXDONE IRQ to SET_TX sent, is measured. the PA ramp (200 us, TXPARAMS) follows SET_TX.
+ *
+ * a frame waiting for an answer gets trx_rx_window() from TXDONE
+ * instead: an RX with the radio's timeout, back to the fallback mode
+ * when it ends, on the frame's profile. trx_set_resume() swaps the
+ * receiver callback for a while, a bulk transfer (bulk_radio.h) keeps a
+ * remote in continuous RX on the session's profile. trx_rx_resume()
+ * re-arms the same receiver after a hop (fhss_radio.h).
+ */
+
+#ifndef __TRX_H
+#define __TRX_H
+
+#include "stm32wlxx_hal_subghz.h"
+#include "subghz.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum
+{
+	TRX_FALLBACK_STANDBY_RC = 0x20,
+	TRX_FALLBACK_STANDBY_HSE32 = 0x30,
+	TRX_FALLBACK_FS = 0x40
+} trx_fallback_t;
+
+#define TRX_DEFAULT_FALLBACK		TRX_FALLBACK_FS
+#define TRX_REPLY_WINDOW_US			20000
+
+// re-arms the receiver after TX, from the radio ISR
+typedef HAL_StatusTypeDef (*trx_rx_fn)(void);
+
+typedef struct
+{
+	uint32_t replies;			// TX within the reply window of an RXDONE
+	uint32_t rx_to_tx_last;		// cycles, RXDONE IRQ to SET_TX sent
+	uint32_t rx_to_tx_min;
+	uint32_t rx_to_tx_max;
+	uint32_t resumes;			// RX re-armed after TX
+	uint32_t tx_to_rx_last;		// cycles, TXDONE IRQ to RX armed
+	uint32_t tx_to_rx_min;
+	uint32_t tx_to_rx_max;
+	uint32_t rx_exits;			// RX left through FS for a TX
+	uint32_t windows;			// RX windows opened for an answer
+	uint32_t length_writes;		// PACKETPARAMS sent for a new payload length
+	uint32_t pa_writes;			// PACONFIG sent for a level on another PA configuration
+	uint32_t power_writes;		// TXPARAMS sent for a new power
+	uint32_t profile_writes;	// MODULATIONPARAMS sent for another profile
+} trx_stats_t;
+
+HAL_StatusTypeDef trx_init(SUBGHZ_HandleTypeDef *hsubghz, trx_fallback_t fallback, trx_rx_fn resume_rx);
+trx_rx_fn trx_set_resume(trx_rx_fn resume_rx);
+HAL_StatusTypeDef trx_set_fallback(trx_fallback_t fallback);
+trx_fallback_t trx_fallback(void);
+HAL_StatusTypeDef trx_packet_length(uint8_t len);
+HAL_StatusTypeDef trx_set_rx_profile(uint8_t profile);
+HAL_StatusTypeDef trx_tx_begin(uint8_t power, uint8_t profile);
+void trx_tx_started(void);
+HAL_StatusTypeDef trx_rx_resume(void);
+void trx_tx_idle(uint32_t irq_cycles);
+HAL_StatusTypeDef trx_rx_window(uint32_t timeout_us);
+void trx_rx_end(uint32_t irq_cycles);
+const trx_stats_t *trx_get_stats(void);
+void trx_print_stats(void);
+
+#endif /* __TRX_H */
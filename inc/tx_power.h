@@ -0,0 +1,112 @@
+/*
+ * tx_power.h
+ *
+ * transmit power and data rate per peer, closed loop on the RSSI the
+ * peer reports for our frames (a FRAME_ACK carries it, see arq.h, and a
+ * FRAME_SACK, bulk.h). the level is moved so the peer hears us
+ * TX_POWER_MARGIN_DB over the sensitivity of its profile, or of the
+ * network profile when that is the faster one, since the ARQ stays
+ * there (tx_power_target_dbm(), -90 dBm at 50 kb/s): a report more than
+ * TX_POWER_HYSTERESIS_DB over the target lowers the power, by at most
+ * TX_POWER_MAX_STEP_DOWN_DB at a time, one under it raises the power at
+ * once by the whole shortfall. frames left unanswered TX_POWER_MISSES
+ * times in a row raise it a level. peers not heard from get
+ * TX_POWER_DEFAULT and PHY_NETWORK.
+ *
+ * a peer is its node table entry number (node_table.h), so every remote
+ * the table tracks has its own state, 8 bytes of it; TX_POWER_UNTRACKED
+ * stands for one without an entry, which gets the defaults. the counters
+ * of the loop's moves are kept for all peers together.
+ *
+ * the profile (phy.h) is picked before the power, from the path loss the
+ * reports give, averaged as the RTT of TCP so one fade doesn't move it:
+ * the fastest the top level reaches TX_POWER_ADR_MARGIN_DB over its
+ * sensitivity with TX_POWER_ADR_HEADROOM_DB to spare. rate goes up
+ * before power goes down, as LoRaWAN's ADR does: the shorter frames free
+ * the channel for the other remotes, and the power only comes down once
+ * the fastest profile has more than TX_POWER_MARGIN_DB.
+ *
+ * the margin never takes the profile down: the ARQ delivers well under
+ * it, a 50 kb/s frame lost half the time still beats a 38.4 kb/s one.
+ * the peer's miss rate on its profile, averaged over the frames, does:
+ * at the top level the peer goes to the next slower profile once the
+ * bit rate less the share lost is under that profile's bit rate.
+ *
+ * the levels run from the LP PA at its +10 dBm optimum, where the power
+ * asked of TXPARAMS comes out about 3 dB lower, through the LP PA's own
+ * +14 and +15 dBm settings to the HP PA on RADIO_SWITCH_RFO_HP. each
+ * carries its PACONFIG and TXPARAMS bytes as sent: going between two
+ * levels with the same PA configuration is a TXPARAMS alone (trx.c).
+ *
+ * nothing here depends on the target, the host tests the control loop
+ * (host/tx_power_test) and runs it in the simulation (population_test).
+ */
+
+#ifndef __TX_POWER_H
+#define __TX_POWER_H
+
+#include "phy.h"
+#include "node_table.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TX_POWER_LEVELS				12
+#define TX_POWER_DEFAULT			6		// +10 dBm on the LP PA, the boot configuration
+#define TX_POWER_MAX				(TX_POWER_LEVELS - 1)
+#define TX_POWER_PEERS				NODE_TABLE_CAPACITY	// one per node table entry
+#define TX_POWER_UNTRACKED			TX_POWER_PEERS		// no entry, the defaults
+
+#define TX_POWER_MARGIN_DB			15		// over the sensitivity, for fading
+#define TX_POWER_ADR_MARGIN_DB		5		// the least a profile is picked with, the ARQ takes the fades under it
+#define TX_POWER_ADR_HEADROOM_DB	3
+#define TX_POWER_LOSS_SHIFT			2		// each report moves the path loss a quarter of the way
+#define TX_POWER_HYSTERESIS_DB		4
+#define TX_POWER_MAX_STEP_DOWN_DB	6
+#define TX_POWER_MISSES				2
+#define TX_POWER_MISS_SHIFT			3		// each frame moves the miss rate an eighth of the way
+
+typedef struct
+{
+	int8_t dbm;					// at the antenna port
+	bool hp;					// the HP PA, through RADIO_SWITCH_RFO_HP
+	uint8_t pa_config[4];		// RADIO_SET_PACONFIG: duty cycle, HP max, PA select, 0x01
+	uint8_t tx_params[2];		// RADIO_SET_TXPARAMS: power, ramp
+} tx_power_level_t;
+
+typedef struct
+{
+	uint8_t level;
+	uint8_t profile;			// phy profile for bulk sessions to the peer
+	uint8_t misses;				// frames unanswered in a row
+	int8_t rssi;				// last reported by the peer
+	int16_t loss;				// path loss, 1/8 dB, averaged over the reports
+	bool reported;
+	uint8_t miss_rate;			// share of the frames on its profile unanswered, 1/256, averaged
+} tx_power_peer_t;
+
+_Static_assert(sizeof(tx_power_peer_t) == 8, "tx_power_peer_t is packed to 8 bytes");
+
+typedef struct
+{
+	uint32_t untracked;			// reports and misses from peers with no entry
+	uint32_t reports;
+	uint32_t raised;
+	uint32_t lowered;
+	uint32_t faster;			// profile changes
+	uint32_t slower;
+	tx_power_peer_t peers[TX_POWER_PEERS];
+} tx_power_t;
+
+extern const tx_power_level_t tx_power_levels[TX_POWER_LEVELS];
+
+void tx_power_init(tx_power_t *power);
+uint8_t tx_power_level(const tx_power_t *power, uint32_t peer);
+uint8_t tx_power_profile(const tx_power_t *power, uint32_t peer);
+int32_t tx_power_target_dbm(uint8_t profile);
+const tx_power_peer_t *tx_power_peer(const tx_power_t *power, uint32_t peer);
+uint8_t tx_power_pick(int32_t dbm);
+void tx_power_feedback(tx_power_t *power, uint32_t peer, int8_t rssi);
+void tx_power_miss(tx_power_t *power, uint32_t peer, uint8_t profile);
+
+#endif /* __TX_POWER_H */
@@ -0,0 +1,27 @@
+/*
+ * tx_power_radio.h
+ *
+ * the power and rate control (tx_power.h) for this node's frames.
+ * arq_radio and bulk_radio feed it the RSSI in each ACK and SACK and the
+ * windows that closed without one, ask it for the level of each frame by
+ * the peer it is for, and bulk_radio for the profile of each session;
+ * trx applies both when the frame starts. peers are found by address
+ * in the node table, whose entry number indexes their state.
+ */
+
+#ifndef __TX_POWER_RADIO_H
+#define __TX_POWER_RADIO_H
+
+#include "tx_power.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+void tx_power_radio_init(void);
+uint8_t tx_power_radio_level(uint16_t peer);
+uint8_t tx_power_radio_profile(uint16_t peer);
+void tx_power_radio_feedback(uint16_t peer, int8_t rssi);
+void tx_power_radio_miss(uint16_t peer, uint8_t profile);
+void tx_power_radio_print_stats(void);
+
+#endif /* __TX_POWER_RADIO_H */
@@ -0,0 +1,93 @@
+/*
+ * tx_queue.h
+ *
+ * frames to transmit, sent back to back. the main loop fills frames and
+ * queues them; the radio ISR starts the next one from TXDONE, so the
+ * only gap between two frames is the buffer write and the radio's own
+ * TX start up. a frame the radio doesn't finish within twice its time
+ * on air ends with the RX/TX timeout IRQ instead.
+ *
+ * starting a frame costs one buffer write and one SET_TX over SPI, plus
+ * a PACKETPARAMS write when its length differs from the frame before,
+ * TXPARAMS (and PACONFIG) when its power level does, MODULATIONPARAMS
+ * when its PHY profile does, and a SET_FS when a receiver was listening
+ * (trx.h). payloads are 1 to TX_MAX_PAYLOAD_LEN bytes. a frame that
+ * would run past the end of the channel's dwell waits for the hop.
+ *
+ * outcomes are reported from tx_queue_poll() in the main loop, through
+ * the callback given with the frame, which then goes back to the free
+ * list. a frame belongs to the queue from submit until its callback
+ * returns.
+ */
+
+#ifndef __TX_QUEUE_H
+#define __TX_QUEUE_H
+
+#include "stm32wlxx_hal_subghz.h"
+#include "subghz_support.h"
+#include "packet_pool.h"
+#include "spsc_ring.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TX_QUEUE_DEPTH				SPSC_RING_CAPACITY
+#define TX_TIMEOUT_MARGIN_US		2000	// TCXO, PLL lock and PA ramp before the preamble
+
+typedef enum
+{
+	TX_DONE = 0,				// TXDONE
+	TX_TIMEOUT,					// RX/TX timeout IRQ before TXDONE
+	TX_FAILED,					// the radio refused the buffer write or SET_TX
+	TX_REPLIED,					// TXDONE, then a frame received in the reply window
+	TX_NO_REPLY					// TXDONE, then the reply window timed out
+} tx_result_t;
+
+typedef struct tx_frame tx_frame_t;
+typedef void (*tx_done_fn)(const tx_frame_t *frame, void *ctx);
+
+struct tx_frame
+{
+	radio_record_t rec;			// TXDONE or timeout IRQ time
+	tx_result_t result;
+	tx_done_fn done;
+	void *ctx;
+	uint32_t reply_us;			// RX window after TXDONE, 0 for none
+	uint8_t power;				// tx_power level, TX_POWER_DEFAULT unless set
+	uint8_t profile;			// phy profile, PHY_NETWORK unless set
+	uint8_t len;
+	uint8_t payload[TX_MAX_PAYLOAD_LEN];
+};
+
+typedef struct
+{
+	uint32_t queued;
+	uint32_t sent;
+	uint32_t timeouts;
+	uint32_t failed;
+	uint32_t refused;			// tx_queue_send() found no free frame
+	uint32_t held;				// frames that waited for the next dwell (fhss_radio.h)
+	uint32_t replied;			// reply windows ended by a frame
+	uint32_t no_reply;			// reply windows timed out
+	uint32_t airtime_us;		// frames sent, summed
+	uint32_t spi_start_bytes;	// SPI bytes to start the frames
+	uint32_t spi_irq_bytes;		// SPI bytes from the start to the TXDONE or timeout callback
+	uint32_t dma_writes;		// payloads written through the DMA, SUBGHZ_DMA_MIN_LEN or longer
+	uint32_t turnaround_last;	// cycles from the TXDONE IRQ to the next SET_TX
+	uint32_t turnaround_min;
+	uint32_t turnaround_max;
+} tx_queue_stats_t;
+
+HAL_StatusTypeDef tx_queue_init(SUBGHZ_HandleTypeDef *hsubghz);
+tx_frame_t *tx_queue_alloc(void);
+HAL_StatusTypeDef tx_queue_submit(tx_frame_t *frame, tx_done_fn done, void *ctx);
+HAL_StatusTypeDef tx_queue_send(const uint8_t *payload, uint8_t len, tx_done_fn done, void *ctx);
+void tx_queue_rx_end(SUBGHZ_HandleTypeDef *hsubghz);
+uint32_t tx_queue_poll(void);
+uint32_t tx_queue_pending(void);
+bool tx_queue_busy(void);
+uint32_t tx_queue_airtime_us(const tx_frame_t *frame);
+const tx_queue_stats_t *tx_queue_get_stats(void);
+void tx_queue_print_stats(void);
+
+#endif /* __TX_QUEUE_H */
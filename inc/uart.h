@@ -1,6 +1,66 @@
 #ifndef __UART_H
 #define __UART_H
 
+/*
+ * console and host output goes through a ring that DMA1 channel 3 drains
+ * into LPUART1. writers copy and return, a full ring is handled by the
+ * overflow policy.
+ *
+ * input from the host lands in a circular ring that DMA1 channel 4 fills
+ * without end. the match character, an idle line and the half and full
+ * ring points interrupt, which only flags uart_rx_ready(): the consumer
+ * reads the ring in place up to uart_rx_position() and has to keep up,
+ * the DMA overwrites what is more than a ring behind.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define UART_TX_RING_SIZE           2048        // power of two
+#define UART_TX_DMA_CHUNK           256         // most bytes per DMA transfer
+#define UART_TX_DMA_CHANNEL         LL_DMA_CHANNEL_3
+
+#define UART_RX_RING_SIZE           1024        // power of two, 89 ms at 115200 baud
+#define UART_RX_DMA_CHANNEL         LL_DMA_CHANNEL_4
+#define UART_RX_MATCH_CHAR          0x00        // host link frame delimiter
+
+typedef enum
+{
+    UART_TX_DROP_NEWEST = 0,    // a write that doesn't fit is dropped whole
+    UART_TX_DROP_OLDEST,        // queued bytes not yet in a transfer make room
+    UART_TX_BLOCK               // wait for room, polling the DMA
+} uart_tx_policy_t;
+
+#define UART_TX_DEFAULT_POLICY      UART_TX_DROP_NEWEST
+
+typedef struct
+{
+    uint32_t written;           // bytes offered
+    uint32_t dropped;           // bytes discarded by the policy
+    uint32_t overflows;         // writes that found the ring full
+    uint32_t blocked;           // writes that had to wait
+    uint32_t high_water;        // most bytes queued or in flight
+} uart_tx_stats_t;
+
+typedef struct
+{
+    uint32_t matches;           // match characters, frames ended
+    uint32_t idle;              // idle lines after a burst
+    uint32_t dma;               // half and full ring points
+    uint32_t errors;            // overrun, framing or noise
+} uart_rx_stats_t;
+
 void UART_init(void);
+void uart_write(const uint8_t *data, uint32_t len);
+void uart_tx_service(void);
+void uart_tx_flush(void);
+uint32_t uart_tx_pending(void);
+void uart_tx_set_policy(uart_tx_policy_t new_policy);
+uart_tx_policy_t uart_tx_policy(void);
+const uart_tx_stats_t *uart_tx_get_stats(void);
+uint8_t *uart_rx_buffer(void);
+uint32_t uart_rx_position(void);
+bool uart_rx_ready(void);
+const uart_rx_stats_t *uart_rx_get_stats(void);
 
 #endif /* __UART_H */
@@ -0,0 +1,295 @@
+// arq.c -- stop-and-wait ARQ per link, ACK waits in the radio's RX window
+
+#include "arq.h"
+#include "frame.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+static const arq_config_t default_config = {
+	.retries = ARQ_DEFAULT_RETRIES,
+	.ack_timeout_us = ARQ_DEFAULT_ACK_TIMEOUT_US,
+	.backoff_us = ARQ_DEFAULT_BACKOFF_US,
+	.backoff_max_us = ARQ_DEFAULT_BACKOFF_MAX_US
+};
+
+void arq_init(arq_t *arq, uint16_t addr, uint8_t dst, arq_send_fn send, void *send_ctx)
+{
+	arq->send = send;
+	arq->send_ctx = send_ctx;
+	arq->config = default_config;
+	arq->addr = addr;
+	arq->dst = dst;
+	// never 0, whatever the address
+	arq->random = 0x9E3779B9U ^ addr;
+	arq->tx_seq = 0;
+	arq->uses = 0;
+	arq->link_count = 0;
+	arq->recycled = 0;
+	arq->untracked = 0;
+}
+
+bool arq_set_config(arq_t *arq, const arq_config_t *config)
+{
+	if((config->retries > ARQ_MAX_RETRIES) || (config->ack_timeout_us == 0) || (config->backoff_us < 2) ||
+		(config->backoff_max_us < config->backoff_us)){
+		return false;
+	}
+	arq->config = *config;
+	return true;
+}
+
+// links are taken on first use, a linear search is enough for ARQ_LINKS
+// of them. with none free, the idle one used longest ago is handed on:
+// a link the radio still has a frame of, or waiting to send again, is not
+arq_link_t *arq_link(arq_t *arq, uint16_t peer, bool create)
+{
+	arq_link_t *link = NULL;
+	uint32_t i;
+
+	for(i = 0; i < arq->link_count; i++){
+		if(arq->links[i].peer == peer){
+			return &arq->links[i];
+		}
+	}
+	if(!create){
+		return NULL;
+	}
+	if(arq->link_count < ARQ_LINKS){
+		link = &arq->links[arq->link_count++];
+	}
+	else{
+		for(i = 0; i < ARQ_LINKS; i++){
+			if((arq->links[i].state == ARQ_IDLE) && !arq->links[i].in_flight &&
+				((link == NULL) || ((int32_t)(arq->links[i].used - link->used) < 0))){
+				link = &arq->links[i];
+			}
+		}
+		if(link == NULL){
+			return NULL;
+		}
+		arq->recycled++;
+	}
+	*link = (arq_link_t){0};
+	link->peer = peer;
+	link->stats.rtt_min = UINT32_MAX;
+	return link;
+}
+
+// a new frame can go to peer: none outstanding and the last one's window
+// is over, so the window_closed of one frame can't be taken for the next
+bool arq_ready(arq_t *arq, uint16_t peer)
+{
+	arq_link_t *link = arq_link(arq, peer, false);
+
+	return (link == NULL) || ((link->state == ARQ_IDLE) && !link->in_flight);
+}
+
+static uint32_t arq_random(arq_t *arq)
+{
+	uint32_t x = arq->random;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	arq->random = x;
+	return x;
+}
+
+// wait before transmission attempts + 1: b/2 to b, b doubled per retry
+static uint32_t arq_backoff(arq_t *arq, uint8_t attempts)
+{
+	uint32_t b = arq->config.backoff_us;
+	uint8_t i;
+
+	for(i = 1; (i < attempts) && (b < arq->config.backoff_max_us); i++){
+		b <<= 1;
+	}
+	if(b > arq->config.backoff_max_us){
+		b = arq->config.backoff_max_us;
+	}
+	return b / 2U + arq_random(arq) % (b / 2U + 1U);
+}
+
+static void arq_transmit(arq_t *arq, arq_link_t *link, uint32_t now_us)
+{
+	if(!arq->send(arq->send_ctx, link, link->frame, link->len, arq->config.ack_timeout_us)){
+		link->stats.busy++;
+		link->state = ARQ_BACKOFF;
+		link->retry_us = now_us;
+		return;
+	}
+	link->in_flight = true;
+	link->sent_us = now_us;
+	link->attempts++;
+	link->stats.transmissions++;
+	if(link->attempts > 1){
+		link->stats.retries++;
+	}
+	link->state = ARQ_WAIT;
+}
+
+// the link is free before done runs, so done may send the next frame
+static void arq_finish(arq_link_t *link, arq_result_t result)
+{
+	link->state = ARQ_IDLE;
+	if(result == ARQ_DELIVERED){
+		link->stats.delivered++;
+		link->stats.tries[link->attempts - 1U]++;
+	}
+	else{
+		link->stats.failed++;
+	}
+	if(link->done != NULL){
+		link->done(link, result, link->ctx);
+	}
+}
+
+bool arq_send(arq_t *arq, uint16_t peer, const uint8_t *data, uint8_t len, arq_done_fn done, void *ctx, uint32_t now_us)
+{
+	arq_link_t *link;
+	uint8_t i;
+
+	if(len > ARQ_MAX_DATA){
+		return false;
+	}
+	link = arq_link(arq, peer, true);
+	if((link == NULL) || (link->state != ARQ_IDLE) || link->in_flight){
+		return false;
+	}
+
+	link->tx_seq = arq->tx_seq++;
+	link->used = ++arq->uses;
+	frame_header(link->frame, arq->dst, arq->addr, link->tx_seq, FRAME_ARQ);
+	frame_put16(&link->frame[ARQ_TO_OFFSET], peer);
+	for(i = 0; i < len; i++){
+		link->frame[ARQ_HEADER_LEN + i] = data[i];
+	}
+	link->len = (uint8_t)(ARQ_HEADER_LEN + len);
+	link->attempts = 0;
+	link->done = done;
+	link->ctx = ctx;
+	link->stats.sent++;
+
+	arq_transmit(arq, link, now_us);
+	return true;
+}
+
+static void arq_ack(arq_t *arq, uint16_t peer, uint16_t seq, uint32_t rx_us)
+{
+	arq_link_t *link = arq_link(arq, peer, false);
+	uint32_t rtt;
+
+	if(link == NULL){
+		return;
+	}
+	if((link->state == ARQ_IDLE) || (seq != link->tx_seq) || (link->attempts == 0)){
+		link->stats.stale_acks++;
+		return;
+	}
+	if(link->attempts == 1){
+		rtt = rx_us - link->sent_us;
+		link->stats.rtt_samples++;
+		link->stats.rtt_last = rtt;
+		link->stats.rtt_total += rtt;
+		if(rtt < link->stats.rtt_min){
+			link->stats.rtt_min = rtt;
+		}
+		if(rtt > link->stats.rtt_max){
+			link->stats.rtt_max = rtt;
+		}
+	}
+	arq_finish(link, ARQ_DELIVERED);
+}
+
+// every received frame, ACKs for this node are consumed here. a FRAME_ARQ
+// is acknowledged before the verdict, repeats included, with the rssi it
+// came in at
+arq_rx_t arq_rx(arq_t *arq, const uint8_t *frame, uint8_t len, uint32_t rx_us, int8_t rssi)
+{
+	uint8_t ack[ARQ_ACK_LEN];
+	arq_link_t *link;
+	uint16_t src;
+	uint16_t seq;
+	uint8_t type;
+
+	if(len < ARQ_HEADER_LEN){
+		return ARQ_RX_PLAIN;
+	}
+	type = frame_type(frame);
+	if((type != FRAME_ARQ) && (type != FRAME_ACK)){
+		return ARQ_RX_PLAIN;
+	}
+	if(frame_get16(&frame[ARQ_TO_OFFSET]) != arq->addr){
+		return ARQ_RX_OTHER;
+	}
+	src = frame_src(frame);
+	seq = frame_seq(frame);
+
+	if(type == FRAME_ACK){
+		arq_ack(arq, src, seq, rx_us);
+		return ARQ_RX_ACK;
+	}
+
+	// lost with the radio busy, the sender's retry gets another
+	frame_header(ack, arq->dst, arq->addr, seq, FRAME_ACK);
+	frame_put16(&ack[ARQ_TO_OFFSET], src);
+	ack[ARQ_RSSI_OFFSET] = (uint8_t)rssi;
+	link = arq_link(arq, src, true);
+	if(arq->send(arq->send_ctx, NULL, ack, sizeof(ack), 0) && (link != NULL)){
+		link->stats.acks_sent++;
+	}
+
+	if(link == NULL){
+		arq->untracked++;
+		return ARQ_RX_DATA;
+	}
+	link->used = ++arq->uses;
+	link->stats.rx_frames++;
+	if(link->rx_valid && (seq == link->rx_seq)){
+		link->stats.rx_dups++;
+		return ARQ_RX_DUP;
+	}
+	link->rx_valid = true;
+	link->rx_seq = seq;
+	return ARQ_RX_DATA;
+}
+
+// the radio is done with the link's frame: sent, or not, and its window
+// over. an ACK it brought may be handed to arq_rx() before or after this
+void arq_window_closed(arq_t *arq, arq_link_t *link)
+{
+	(void)arq;
+
+	link->in_flight = false;
+	if(link->state == ARQ_WAIT){
+		link->state = ARQ_CLOSED;
+		link->stats.no_ack++;
+	}
+}
+
+// retries and give ups, after the frames received so far went through
+// arq_rx() so an ACK that closed a window is not missed
+void arq_poll(arq_t *arq, uint32_t now_us)
+{
+	arq_link_t *link;
+	uint32_t i;
+
+	for(i = 0; i < arq->link_count; i++){
+		link = &arq->links[i];
+
+		if(link->state == ARQ_CLOSED){
+			if(link->attempts > arq->config.retries){
+				arq_finish(link, ARQ_GAVE_UP);
+				continue;
+			}
+			link->state = ARQ_BACKOFF;
+			link->retry_us = now_us + arq_backoff(arq, link->attempts);
+		}
+		if((link->state == ARQ_BACKOFF) && ((int32_t)(now_us - link->retry_us) >= 0)){
+			arq_transmit(arq, link, now_us);
+		}
+	}
+}
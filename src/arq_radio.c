@@ -0,0 +1,130 @@
+// arq_radio.c -- the ARQ over the TX queue, ACK waits in the reply window
+
+#include "arq_radio.h"
+#include "arq.h"
+#include "tx_queue.h"
+#include "tx_power_radio.h"
+#include "subghz_support.h"
+
+#include "mprintf.h"
+#include "hwtime.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+_Static_assert(ARQ_MAX_RETRIES + 1 == 8, "the stats line has eight tries counters");
+
+static arq_t arq;
+
+// every end of the frame, ACK or not, closes the link's window; ACKs
+// themselves have no link. a window that timed out counts against the
+// link's power level
+static void arq_radio_done(const tx_frame_t *frame, void *ctx)
+{
+	const arq_link_t *link = ctx;
+
+	if(link != NULL){
+		if(frame->result == TX_NO_REPLY){
+			tx_power_radio_miss(link->peer, frame->profile);
+		}
+		arq_window_closed(&arq, ctx);
+	}
+}
+
+static bool arq_radio_transmit(void *ctx, arq_link_t *link, const uint8_t *data, uint8_t len, uint32_t reply_us)
+{
+	tx_frame_t *frame = tx_queue_alloc();
+	uint32_t i;
+
+	(void)ctx;
+
+	if(frame == NULL){
+		return false;
+	}
+	for(i = 0; i < len; i++){
+		frame->payload[i] = data[i];
+	}
+	frame->len = len;
+	frame->reply_us = reply_us;
+	// frames and ACKs alike, at the power for the node they are for
+	frame->power = tx_power_radio_level(frame_get16(&data[ARQ_TO_OFFSET]));
+	return tx_queue_submit(frame, arq_radio_done, link) == HAL_OK;
+}
+
+void arq_radio_init(uint16_t addr)
+{
+	arq_init(&arq, addr, ADDRESS, arq_radio_transmit, NULL);
+}
+
+HAL_StatusTypeDef arq_radio_configure(const arq_config_t *config)
+{
+	return arq_set_config(&arq, config) ? HAL_OK : HAL_ERROR;
+}
+
+bool arq_radio_ready(uint16_t peer)
+{
+	return arq_ready(&arq, peer);
+}
+
+// HAL_BUSY while the link still has a frame out
+HAL_StatusTypeDef arq_radio_send(uint16_t peer, const uint8_t *data, uint8_t len, arq_done_fn done, void *ctx)
+{
+	if(len > ARQ_MAX_DATA){
+		return HAL_ERROR;
+	}
+	return arq_send(&arq, peer, data, len, done, ctx, hwtime_now_us()) ? HAL_OK : HAL_BUSY;
+}
+
+// true when the frame was an ACK, or ARQ traffic for another node, and
+// has nothing left for the rest of the RX path. frames are acknowledged
+// with their RSSI, an ACK's goes to the power control
+bool arq_radio_rx(const packet_slot_t *slot)
+{
+	arq_rx_t verdict;
+
+	if((arq.send == NULL) || (slot->rec.flags & RADIO_REC_CRC_ERR)){
+		return false;
+	}
+	// payload is the frame from its first byte, the radio status is kept apart
+	verdict = arq_rx(&arq, slot->payload, slot->len, slot->rec.time_us, slot->rec.rssi_sync);
+	if((verdict == ARQ_RX_ACK) && (slot->len >= ARQ_ACK_LEN)){
+		tx_power_radio_feedback(frame_src(slot->payload), (int8_t)slot->payload[ARQ_RSSI_OFFSET]);
+	}
+	return (verdict == ARQ_RX_ACK) || (verdict == ARQ_RX_OTHER);
+}
+
+void arq_radio_poll(void)
+{
+	if(arq.send != NULL){
+		arq_poll(&arq, hwtime_now_us());
+	}
+}
+
+const arq_link_t *arq_radio_link(uint16_t peer)
+{
+	return arq_link(&arq, peer, false);
+}
+
+void arq_radio_print_stats(void)
+{
+	const arq_link_stats_t *s;
+	uint32_t i;
+
+	printf_("arq %#06x: %u links, %u recycled, %u untracked, %u retries, %u us ACK timeout, %u-%u us backoff\r\n",
+		arq.addr, arq.link_count, arq.recycled, arq.untracked, arq.config.retries, arq.config.ack_timeout_us,
+		arq.config.backoff_us, arq.config.backoff_max_us);
+
+	for(i = 0; i < arq.link_count; i++){
+		s = &arq.links[i].stats;
+		printf_("arq %#06x: %u sent, %u delivered, %u failed, %u retries, %u no ACK, %u busy, %u stale ACKs\r\n",
+			arq.links[i].peer, s->sent, s->delivered, s->failed, s->retries, s->no_ack, s->busy, s->stale_acks);
+		printf_("arq %#06x: RTT %u us last, %u min, %u avg, %u max, delivered after 1..8 tries %u %u %u %u %u %u %u %u\r\n",
+			arq.links[i].peer, s->rtt_last, (s->rtt_samples != 0) ? s->rtt_min : 0,
+			(s->rtt_samples != 0) ? (uint32_t)(s->rtt_total / s->rtt_samples) : 0, s->rtt_max,
+			s->tries[0], s->tries[1], s->tries[2], s->tries[3], s->tries[4], s->tries[5], s->tries[6], s->tries[7]);
+		printf_("arq %#06x: %u frames received, %u repeats, %u ACKs sent\r\n",
+			arq.links[i].peer, s->rx_frames, s->rx_dups, s->acks_sent);
+	}
+}
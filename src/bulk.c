@@ -0,0 +1,460 @@
+// bulk.c -- selective-repeat bulk transfer, SACK bitmaps over a sliding window
+
+#include "bulk.h"
+#include "frame.h"
+#include "phy.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+static uint32_t bulk_get32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void bulk_put32(uint8_t *p, uint32_t value)
+{
+	p[0] = (uint8_t)value;
+	p[1] = (uint8_t)(value >> 8);
+	p[2] = (uint8_t)(value >> 16);
+	p[3] = (uint8_t)(value >> 24);
+}
+
+void bulk_init(bulk_t *bulk, uint16_t addr, uint8_t dst, bulk_send_fn send, bulk_listen_fn listen, void *ctx)
+{
+	bulk->send = send;
+	bulk->listen = listen;
+	bulk->ctx = ctx;
+	bulk->addr = addr;
+	bulk->dst = dst;
+	bulk->session = 0;
+	bulk->tx = (bulk_tx_t){0};
+	bulk->rx = (bulk_rx_t){0};
+	bulk->stats = (bulk_stats_t){0};
+}
+
+// where fragments from peers go, and who hears of a completed blob
+void bulk_accept(bulk_t *bulk, bulk_sink_fn sink, bulk_done_fn done, void *ctx)
+{
+	bulk->rx.sink = sink;
+	bulk->rx.done = done;
+	bulk->rx.ctx = ctx;
+}
+
+// the node address a receiver filters on during a session: its own
+// address folded to a byte, anything but the network address. two
+// remotes may share one, the 16-bit address in the frame sorts them out
+uint8_t bulk_filter_addr(uint16_t addr, uint8_t dst)
+{
+	uint8_t filter = (uint8_t)(addr ^ (addr >> 8));
+
+	return (filter != dst) ? filter : (uint8_t)(filter ^ 0x80);
+}
+
+uint32_t bulk_goodput_bps(uint32_t bytes, uint32_t us)
+{
+	if(us == 0){
+		return 0;
+	}
+	return (uint32_t)(((uint64_t)bytes * 8000000U) / us);
+}
+
+// BULK_SACK_TIMEOUT_US holds for the network profile, a slower one's
+// SACK takes longer to its sync word
+static uint32_t bulk_reply_us(uint8_t profile)
+{
+	return BULK_SACK_TIMEOUT_US + phy_sync_us(profile) - phy_sync_us(PHY_NETWORK);
+}
+
+bool bulk_busy(const bulk_t *bulk)
+{
+	return (bulk->tx.state != BULK_IDLE) || bulk->tx.in_flight || bulk->rx.active;
+}
+
+static void bulk_header(bulk_t *bulk, uint16_t seq, uint8_t flags, uint8_t dst)
+{
+	bulk_tx_t *tx = &bulk->tx;
+
+	frame_header(bulk->frame, dst, bulk->addr, seq, FRAME_BULK);
+	frame_put16(&bulk->frame[BULK_TO_OFFSET], tx->peer);
+	bulk->frame[BULK_SESSION_OFFSET] = tx->session;
+	bulk->frame[BULK_FLAGS_OFFSET] = flags;
+	frame_put16(&bulk->frame[BULK_COUNT_OFFSET], tx->count);
+}
+
+// the transfer is over before done runs, so done may start the next one
+static void bulk_finish(bulk_t *bulk, bulk_result_t result)
+{
+	bulk_tx_t *tx = &bulk->tx;
+
+	tx->state = BULK_IDLE;
+	tx->staged = 0;
+	if(result == BULK_DELIVERED){
+		bulk->stats.delivered++;
+	}
+	else{
+		bulk->stats.failed++;
+	}
+	if(tx->done != NULL){
+		tx->done(bulk, result, tx->ctx);
+	}
+}
+
+// an open until the peer answered one, a poll after: no data, a SACK
+// wanted. opens go out on the network profile first, then on it and the
+// session's in turn
+static void bulk_request(bulk_t *bulk)
+{
+	bulk_tx_t *tx = &bulk->tx;
+	uint8_t profile = tx->profile;
+	uint8_t len = BULK_HEADER_LEN;
+
+	if(tx->opened){
+		bulk_header(bulk, tx->base, BULK_POLL, tx->peer_addr);
+	}
+	else{
+		bulk_header(bulk, tx->base, BULK_OPEN | BULK_POLL, bulk->dst);
+		bulk->frame[BULK_PROFILE_OFFSET] = tx->profile;
+		len = BULK_OPEN_LEN;
+		if((tx->polls & 1U) == 0){
+			profile = PHY_NETWORK;
+		}
+	}
+	// the header went over a fragment a busy radio left in frame[]
+	tx->staged = 0;
+	if(!bulk->send(bulk->ctx, bulk->frame, len, bulk_reply_us(profile), profile)){
+		bulk->stats.busy++;
+		tx->state = BULK_CLOSED;
+		return;
+	}
+	if(tx->opened){
+		bulk->stats.polls++;
+	}
+	else{
+		bulk->stats.opens++;
+	}
+	tx->polls++;
+	tx->in_flight = true;
+	tx->state = BULK_WAIT;
+}
+
+bool bulk_send(bulk_t *bulk, uint16_t peer, uint32_t size, uint8_t profile, bulk_source_fn source, bulk_done_fn done,
+	void *ctx, uint32_t now_us)
+{
+	bulk_tx_t *tx = &bulk->tx;
+
+	if((size == 0) || (size > BULK_MAX_SIZE) || (profile >= PHY_PROFILES) || (source == NULL)){
+		return false;
+	}
+	if((tx->state != BULK_IDLE) || tx->in_flight){
+		return false;
+	}
+
+	tx->session = ++bulk->session;
+	tx->peer = peer;
+	tx->peer_addr = bulk_filter_addr(peer, bulk->dst);
+	tx->profile = profile;
+	tx->count = (uint16_t)((size + BULK_FRAGMENT_DATA - 1U) / BULK_FRAGMENT_DATA);
+	tx->size = size;
+	tx->base = 0;
+	tx->map = 0;
+	tx->high = 0;
+	tx->opened = false;
+	tx->polls = 0;
+	tx->staged = 0;
+	tx->start_us = now_us;
+	tx->end_us = now_us;
+	tx->source = source;
+	tx->done = done;
+	tx->ctx = ctx;
+	bulk->stats.sessions++;
+
+	bulk_request(bulk);
+	return true;
+}
+
+static bool bulk_acked(const bulk_tx_t *tx, uint32_t index)
+{
+	return (index < tx->base) || ((index - tx->base < BULK_WINDOW) && (tx->map & (1UL << (index - tx->base))));
+}
+
+// the next round: what the window from base still misses, the last of
+// it asks for the SACK
+static void bulk_round(bulk_t *bulk)
+{
+	bulk_tx_t *tx = &bulk->tx;
+	uint32_t end = (uint32_t)tx->base + BULK_WINDOW;
+	uint32_t i;
+
+	if(end > tx->count){
+		end = tx->count;
+	}
+	tx->next = tx->base;
+	tx->last = tx->base;
+	for(i = tx->base; i < end; i++){
+		if(!bulk_acked(tx, i)){
+			tx->last = (uint16_t)i;
+		}
+	}
+	tx->polls = 0;
+	tx->state = BULK_SENDING;
+	bulk->stats.rounds++;
+}
+
+// one fragment of the round to the radio, false when it took none
+static bool bulk_fragment(bulk_t *bulk)
+{
+	bulk_tx_t *tx = &bulk->tx;
+	uint32_t offset;
+	uint32_t len;
+	bool poll;
+
+	while((tx->next < tx->last) && bulk_acked(tx, tx->next)){
+		tx->next++;
+	}
+	poll = (tx->next == tx->last);
+
+	// read from the source once, however long the radio stays busy
+	if(tx->staged == 0){
+		offset = (uint32_t)tx->next * BULK_FRAGMENT_DATA;
+		len = tx->size - offset;
+		if(len > BULK_FRAGMENT_DATA){
+			len = BULK_FRAGMENT_DATA;
+		}
+		bulk_header(bulk, tx->next, poll ? BULK_POLL : 0, tx->peer_addr);
+		tx->source(tx->ctx, offset, &bulk->frame[BULK_HEADER_LEN], len);
+		tx->staged = (uint8_t)(BULK_HEADER_LEN + len);
+	}
+	if(!bulk->send(bulk->ctx, bulk->frame, tx->staged, poll ? bulk_reply_us(tx->profile) : 0, tx->profile)){
+		return false;
+	}
+	tx->staged = 0;
+
+	bulk->stats.fragments++;
+	if(tx->next < tx->high){
+		bulk->stats.repeats++;
+	}
+	else{
+		tx->high = tx->next + 1U;
+	}
+	if(poll){
+		tx->in_flight = true;
+		tx->state = BULK_WAIT;
+	}
+	else{
+		tx->next++;
+	}
+	return true;
+}
+
+// sender side: the answer to an open, a poll or a round
+static void bulk_sack(bulk_t *bulk, const uint8_t *frame, uint32_t rx_us)
+{
+	bulk_tx_t *tx = &bulk->tx;
+	uint16_t seq = frame_seq(frame);
+
+	// one SACK per request, one seen mid-round is a late answer to an
+	// earlier one and the round's own will follow
+	if((tx->state != BULK_WAIT) && (tx->state != BULK_CLOSED)){
+		bulk->stats.stale_sacks++;
+		return;
+	}
+	if((frame_src(frame) != tx->peer) || (frame[BULK_SESSION_OFFSET] != tx->session) || (seq < tx->base) ||
+		(seq > tx->count)){
+		bulk->stats.stale_sacks++;
+		return;
+	}
+
+	tx->opened = true;
+	tx->base = seq;
+	tx->map = bulk_get32(&frame[BULK_MAP_OFFSET]);
+	tx->end_us = rx_us;
+	if(tx->base == tx->count){
+		bulk_finish(bulk, BULK_DELIVERED);
+		return;
+	}
+	bulk_round(bulk);
+}
+
+// on the profile the request came in on
+static void bulk_answer(bulk_t *bulk, uint8_t profile)
+{
+	bulk_rx_t *rx = &bulk->rx;
+	uint8_t sack[BULK_SACK_LEN];
+
+	frame_header(sack, bulk->dst, bulk->addr, rx->base, FRAME_SACK);
+	frame_put16(&sack[BULK_TO_OFFSET], rx->peer);
+	sack[BULK_SESSION_OFFSET] = rx->session;
+	bulk_put32(&sack[BULK_MAP_OFFSET], rx->map);
+	sack[BULK_RSSI_OFFSET] = (uint8_t)rx->rssi;
+	// lost with the radio busy, the sender polls for another
+	if(bulk->send(bulk->ctx, sack, sizeof(sack), 0, profile)){
+		bulk->stats.sacks_sent++;
+	}
+}
+
+static void bulk_store(bulk_t *bulk, uint16_t index, const uint8_t *data, uint32_t len, uint32_t rx_us)
+{
+	bulk_rx_t *rx = &bulk->rx;
+	uint32_t bit;
+
+	if(index < rx->base){
+		bulk->stats.rx_dups++;
+		return;
+	}
+	if((index >= rx->count) || (index - rx->base >= BULK_WINDOW)){
+		bulk->stats.rx_outside++;
+		return;
+	}
+	bit = 1UL << (index - rx->base);
+	if(rx->map & bit){
+		bulk->stats.rx_dups++;
+		return;
+	}
+
+	if(rx->sink != NULL){
+		rx->sink(rx->ctx, rx->peer, (uint32_t)index * BULK_FRAGMENT_DATA, data, len);
+	}
+	rx->map |= bit;
+	rx->size += len;
+	bulk->stats.rx_fragments++;
+	while(rx->map & 1U){
+		rx->map >>= 1;
+		rx->base++;
+	}
+
+	if((rx->base == rx->count) && !rx->complete){
+		rx->complete = true;
+		rx->end_us = rx_us;
+		bulk->stats.rx_complete++;
+		if(rx->done != NULL){
+			rx->done(bulk, BULK_RECEIVED, rx->ctx);
+		}
+	}
+}
+
+// receiver side: opens, fragments and polls for this node. an open
+// starting the session was heard on the network profile, anything else
+// on the session's
+static void bulk_take(bulk_t *bulk, const uint8_t *frame, uint8_t len, uint32_t rx_us, int8_t rssi)
+{
+	bulk_rx_t *rx = &bulk->rx;
+	uint16_t src = frame_src(frame);
+	uint8_t session = frame[BULK_SESSION_OFFSET];
+	uint8_t flags = frame[BULK_FLAGS_OFFSET];
+	uint16_t count = frame_get16(&frame[BULK_COUNT_OFFSET]);
+	bool same = rx->active && (src == rx->peer) && (session == rx->session) && (count == rx->count);
+	uint8_t heard_on = rx->profile;
+	uint8_t profile;
+
+	if((flags & BULK_OPEN) && !same && (count != 0)){
+		profile = (len > BULK_PROFILE_OFFSET) ? frame[BULK_PROFILE_OFFSET] : PHY_NETWORK;
+		if(profile >= PHY_PROFILES){
+			bulk->stats.rx_stray++;
+			return;
+		}
+		heard_on = PHY_NETWORK;
+		rx->profile = profile;
+		rx->active = true;
+		rx->complete = false;
+		rx->peer = src;
+		rx->session = session;
+		rx->count = count;
+		rx->base = 0;
+		rx->map = 0;
+		rx->size = 0;
+		rx->start_us = rx_us;
+		rx->end_us = rx_us;
+		bulk->stats.rx_sessions++;
+		if(bulk->listen != NULL){
+			bulk->listen(bulk->ctx, true, bulk_filter_addr(bulk->addr, bulk->dst), profile);
+		}
+	}
+	else if(!same){
+		bulk->stats.rx_stray++;
+		return;
+	}
+	rx->last_us = rx_us;
+	rx->rssi = rssi;
+
+	if((len > BULK_HEADER_LEN) && !(flags & BULK_OPEN)){
+		bulk_store(bulk, frame_seq(frame), &frame[BULK_HEADER_LEN], (uint32_t)(len - BULK_HEADER_LEN), rx_us);
+	}
+	if(flags & BULK_POLL){
+		bulk_answer(bulk, heard_on);
+	}
+}
+
+// every received frame: true for bulk traffic, consumed here, whoever
+// it is for. rssi goes back to the sender in the SACK
+bool bulk_rx(bulk_t *bulk, const uint8_t *frame, uint8_t len, uint32_t rx_us, int8_t rssi)
+{
+	uint8_t type;
+
+	if(len < FRAME_HEADER_LEN){
+		return false;
+	}
+	type = frame_type(frame);
+	if(type == FRAME_BULK){
+		if((len >= BULK_HEADER_LEN) && (frame_get16(&frame[BULK_TO_OFFSET]) == bulk->addr)){
+			bulk_take(bulk, frame, len, rx_us, rssi);
+		}
+		return true;
+	}
+	if(type == FRAME_SACK){
+		if((len >= BULK_SACK_LEN) && (frame_get16(&frame[BULK_TO_OFFSET]) == bulk->addr)){
+			bulk_sack(bulk, frame, rx_us);
+		}
+		return true;
+	}
+	return false;
+}
+
+// the radio is done with a SACK request: sent, or not, and its window
+// over, replied when a frame came in it. the SACK it brought may be
+// handed to bulk_rx() before or after this
+void bulk_window_closed(bulk_t *bulk, bool replied)
+{
+	bulk_tx_t *tx = &bulk->tx;
+
+	tx->in_flight = false;
+	if(tx->state == BULK_WAIT){
+		tx->state = BULK_CLOSED;
+		if(!replied){
+			bulk->stats.no_sack++;
+		}
+	}
+}
+
+// polls, give ups and the round's fragments, after the frames received
+// so far went through bulk_rx(); then the end of a quiet session
+void bulk_poll(bulk_t *bulk, uint32_t now_us)
+{
+	bulk_tx_t *tx = &bulk->tx;
+	bulk_rx_t *rx = &bulk->rx;
+
+	// a new request only once the last one's window is over, so its
+	// window_closed can't be taken for the new one's
+	if(!tx->in_flight){
+		if(tx->state == BULK_CLOSED){
+			if(tx->polls >= (tx->opened ? BULK_MAX_POLLS : BULK_MAX_OPENS)){
+				tx->end_us = now_us;
+				bulk_finish(bulk, BULK_GAVE_UP);
+			}
+			else{
+				bulk_request(bulk);
+			}
+		}
+		while((tx->state == BULK_SENDING) && bulk_fragment(bulk)){
+		}
+	}
+
+	if(rx->active && ((int32_t)(now_us - rx->last_us) >= BULK_IDLE_US)){
+		rx->active = false;
+		if(bulk->listen != NULL){
+			bulk->listen(bulk->ctx, false, bulk->dst, PHY_NETWORK);
+		}
+	}
+}
@@ -0,0 +1,169 @@
+// bulk_radio.c -- bulk transfers over the TX queue, SACK waits in the reply window
+
+#include "bulk_radio.h"
+#include "bulk.h"
+#include "tx_queue.h"
+#include "tx_power_radio.h"
+#include "trx.h"
+#include "phy.h"
+#include "subghz.h"
+#include "subghz_support.h"
+
+#include "mprintf.h"
+#include "hwtime.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+_Static_assert(BULK_FRAME_LEN <= RX_MAX_PAYLOAD_LEN, "a fragment longer than the receiver accepts");
+// RX buffer base 0x00, TX base 0x80, see subghz_default_init()
+_Static_assert(PACKET_MAX_LEN <= 0x80, "the RX read runs into the TX half of the radio buffer");
+
+static bulk_t bulk;
+static trx_rx_fn own_resume;		// the receiver's callback outside a session
+static bool listening;
+
+// only a round's last frame, or a poll, has a window to report; one
+// that timed out counts against the peer's power level and profile
+static void bulk_radio_done(const tx_frame_t *frame, void *ctx)
+{
+	(void)ctx;
+
+	if(frame->reply_us != 0){
+		if(frame->result == TX_NO_REPLY){
+			tx_power_radio_miss(frame_get16(&frame->payload[BULK_TO_OFFSET]), frame->profile);
+		}
+		bulk_window_closed(&bulk, frame->result == TX_REPLIED);
+	}
+}
+
+static bool bulk_radio_transmit(void *ctx, const uint8_t *data, uint8_t len, uint32_t reply_us, uint8_t profile)
+{
+	tx_frame_t *frame = tx_queue_alloc();
+	uint32_t i;
+
+	(void)ctx;
+
+	if(frame == NULL){
+		return false;
+	}
+	for(i = 0; i < len; i++){
+		frame->payload[i] = data[i];
+	}
+	frame->len = len;
+	frame->reply_us = reply_us;
+	frame->profile = profile;
+	// fragments, polls and SACKs at the power found for the peer
+	frame->power = tx_power_radio_level(frame_get16(&data[BULK_TO_OFFSET]));
+	return tx_queue_submit(frame, bulk_radio_done, NULL) == HAL_OK;
+}
+
+// the SACK sent for the open leaves the radio receiving, on the node
+// address and the profile the fragments are sent with
+static void bulk_radio_listen(void *ctx, bool on, uint8_t addr, uint8_t profile)
+{
+	(void)ctx;
+
+	SetAddress(&subghz_handle, addr);
+	trx_set_rx_profile(profile);
+	if(on && !listening){
+		own_resume = trx_set_resume(continuous_rx);
+		listening = true;
+	}
+	else if(!on && listening){
+		trx_set_resume(own_resume);
+		listening = false;
+	}
+}
+
+static void bulk_radio_received(const bulk_t *b, bulk_result_t result, void *ctx)
+{
+	const bulk_rx_t *rx = &b->rx;
+	uint32_t us = rx->end_us - rx->start_us;
+
+	(void)result;
+	(void)ctx;
+
+	printf_("bulk from %#06x: %u bytes in %u ms, %u bps\r\n", rx->peer, rx->size, us / 1000U,
+		bulk_goodput_bps(rx->size, us));
+}
+
+// sink NULL: fragments received are counted and dropped
+void bulk_radio_init(uint16_t addr, bulk_sink_fn sink, void *ctx)
+{
+	bulk_init(&bulk, addr, ADDRESS, bulk_radio_transmit, bulk_radio_listen, NULL);
+	bulk_accept(&bulk, sink, bulk_radio_received, ctx);
+	listening = false;
+}
+
+// HAL_BUSY while a transfer is out or a session being received. the
+// session runs on the profile the power control picked for the peer
+HAL_StatusTypeDef bulk_radio_send(uint16_t peer, uint32_t size, bulk_source_fn source, bulk_done_fn done, void *ctx)
+{
+	if((size == 0) || (size > BULK_MAX_SIZE) || (source == NULL)){
+		return HAL_ERROR;
+	}
+	if(bulk_busy(&bulk)){
+		return HAL_BUSY;
+	}
+	return bulk_send(&bulk, peer, size, tx_power_radio_profile(peer), source, done, ctx, hwtime_now_us()) ?
+		HAL_OK : HAL_BUSY;
+}
+
+bool bulk_radio_busy(void)
+{
+	return bulk_busy(&bulk);
+}
+
+bool bulk_radio_receiving(void)
+{
+	return bulk.rx.active;
+}
+
+// true for any bulk frame, it has nothing left for the rest of the RX
+// path. the RSSI a SACK for this node reports goes to the power control
+bool bulk_radio_rx(const packet_slot_t *slot)
+{
+	if((bulk.send == NULL) || (slot->rec.flags & RADIO_REC_CRC_ERR)){
+		return false;
+	}
+	// payload is the frame from its first byte, the radio status is kept apart
+	if(!bulk_rx(&bulk, slot->payload, slot->len, slot->rec.time_us, slot->rec.rssi_sync)){
+		return false;
+	}
+	if((slot->len >= BULK_SACK_LEN) && (frame_type(slot->payload) == FRAME_SACK) &&
+		(frame_get16(&slot->payload[BULK_TO_OFFSET]) == bulk.addr)){
+		tx_power_radio_feedback(frame_src(slot->payload), (int8_t)slot->payload[BULK_RSSI_OFFSET]);
+	}
+	return true;
+}
+
+void bulk_radio_poll(void)
+{
+	if(bulk.send != NULL){
+		bulk_poll(&bulk, hwtime_now_us());
+	}
+}
+
+// a delivered transfer, bulk_send() to the last SACK, as a share of the
+// session profile's raw bit rate
+uint32_t bulk_radio_goodput_permille(const bulk_t *b)
+{
+	uint32_t bps = bulk_goodput_bps(b->tx.size, b->tx.end_us - b->tx.start_us);
+
+	return (uint32_t)(((uint64_t)bps * 1000U) / phy_profiles[b->tx.profile].bit_rate);
+}
+
+void bulk_radio_print_stats(void)
+{
+	const bulk_stats_t *s = &bulk.stats;
+
+	printf_("bulk %#06x: %u sessions, %u delivered, %u failed, %u rounds, %u fragments, %u repeats, %u opens, "
+		"%u polls, %u no SACK, %u busy, %u stale SACKs\r\n", bulk.addr, s->sessions, s->delivered, s->failed,
+		s->rounds, s->fragments, s->repeats, s->opens, s->polls, s->no_sack, s->busy, s->stale_sacks);
+	printf_("bulk %#06x: %u sessions received, %u complete, %u fragments, %u repeats, %u outside, %u stray, "
+		"%u SACKs sent\r\n", bulk.addr, s->rx_sessions, s->rx_complete, s->rx_fragments, s->rx_dups,
+		s->rx_outside, s->rx_stray, s->sacks_sent);
+}
@@ -0,0 +1,129 @@
+// cmd_parser.c -- host link records decoded in place in a receive ring
+
+#include "cmd_parser.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#define RING(p, i)					((p)->ring[(i) & (p)->mask])
+
+// size must be a power of two above HOSTLINK_MAX_FRAME
+void cmd_parser_init(cmd_parser_t *parser, uint8_t *ring, uint32_t size, cmd_record_fn on_record, void *ctx)
+{
+	parser->ring = ring;
+	parser->mask = size - 1U;
+	parser->start = 0;
+	parser->scan = 0;
+	parser->overrun = false;
+	parser->on_record = on_record;
+	parser->ctx = ctx;
+	parser->stats = (cmd_parser_stats_t){0};
+}
+
+// COBS decode of [start, end) onto itself: each run writes no more bytes
+// than it reads, so the output never passes the input. returns the
+// decoded length, 0 if malformed
+static uint32_t cmd_parser_cobs(cmd_parser_t *p, uint32_t start, uint32_t end)
+{
+	uint32_t i = start;
+	uint32_t o = start;
+	uint8_t code;
+	uint8_t n;
+
+	while(i != end){
+		code = RING(p, i);
+		i++;
+		if((code == 0) || ((uint32_t)(code - 1U) > end - i)){
+			return 0;
+		}
+		for(n = 1; n < code; n++){
+			RING(p, o) = RING(p, i);
+			o++;
+			i++;
+		}
+		if((code != 0xFF) && (i != end)){
+			RING(p, o) = 0;
+			o++;
+		}
+	}
+	return o - start;
+}
+
+// CRC over ring bytes, in at most two runs
+static uint16_t cmd_parser_crc(const cmd_parser_t *p, uint32_t start, uint32_t len)
+{
+	uint32_t at = start & p->mask;
+	uint32_t first = p->mask + 1U - at;
+	uint16_t crc;
+
+	if(first >= len){
+		return hostlink_crc16(HOSTLINK_CRC_INIT, &p->ring[at], len);
+	}
+	crc = hostlink_crc16(HOSTLINK_CRC_INIT, &p->ring[at], first);
+	return hostlink_crc16(crc, p->ring, len - first);
+}
+
+static void cmd_parser_frame(cmd_parser_t *p, uint32_t end)
+{
+	cmd_record_t record;
+	uint32_t len;
+	uint32_t at;
+	uint32_t i;
+	uint16_t crc;
+
+	if(end == p->start){
+		return;
+	}
+	len = cmd_parser_cobs(p, p->start, end);
+	if((len < HOSTLINK_RECORD_OVERHEAD) || (RING(p, p->start + 1U) != len - HOSTLINK_RECORD_OVERHEAD)){
+		p->stats.cobs_errors++;
+		return;
+	}
+	len -= 2;
+	crc = (uint16_t)(RING(p, p->start + len) | (RING(p, p->start + len + 1U) << 8));
+	if(cmd_parser_crc(p, p->start, len) != crc){
+		p->stats.crc_errors++;
+		return;
+	}
+
+	record.type = RING(p, p->start);
+	record.len = RING(p, p->start + 1U);
+	at = (p->start + 2U) & p->mask;
+	if(at + record.len <= p->mask + 1U){
+		record.payload = &p->ring[at];
+	}
+	else{
+		for(i = 0; i < record.len; i++){
+			p->linear[i] = RING(p, at + i);
+		}
+		record.payload = p->linear;
+		p->stats.wrapped++;
+	}
+	p->stats.records++;
+	p->on_record(&record, p->ctx);
+}
+
+// parses what the producer wrote up to ring index position; a producer
+// that got a whole ring ahead is taken as having written nothing
+void cmd_parser_feed(cmd_parser_t *parser, uint32_t position)
+{
+	uint32_t end = parser->scan + ((position - parser->scan) & parser->mask);
+
+	parser->stats.bytes += end - parser->scan;
+
+	for(; parser->scan != end; parser->scan++){
+		if(RING(parser, parser->scan) != HOSTLINK_DELIMITER){
+			if(!parser->overrun && (parser->scan - parser->start >= HOSTLINK_MAX_FRAME - 1U)){
+				parser->overrun = true;
+				parser->stats.overruns++;
+			}
+			continue;
+		}
+		if(!parser->overrun){
+			cmd_parser_frame(parser, parser->scan);
+		}
+		parser->overrun = false;
+		parser->start = parser->scan + 1U;
+	}
+}
@@ -0,0 +1,181 @@
+// fhss.c -- frequency hopping with precomputed channel words
+
+#include "fhss.h"
+#include "frame.h"
+#include "phy.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+_Static_assert(FHSS_BASE_FREQ >= PHY_FREQ_LOWER_LIMIT, "FHSS plan starts below the band");
+_Static_assert(FHSS_BASE_FREQ + (FHSS_CHANNELS - 1) * FHSS_SPACING <= PHY_FREQ_UPPER_LIMIT,
+	"FHSS plan ends above the band");
+_Static_assert(FHSS_CHANNELS <= 256, "positions and channels are bytes");
+
+static uint32_t xorshift32(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+void fhss_init(fhss_t *fhss, uint32_t seed)
+{
+	uint32_t i;
+	uint32_t j;
+	uint8_t tmp;
+
+	*fhss = (fhss_t){0};
+
+	// the only 64-bit divides for the plan, hops reuse the results
+	for(i = 0; i < FHSS_CHANNELS; i++){
+		fhss_tuning(fhss_frequency((uint8_t)i), &fhss->channels[i]);
+		fhss->sequence[i] = (uint8_t)i;
+	}
+
+	if(seed == 0){
+		seed = FHSS_DEFAULT_SEED;
+	}
+	for(i = FHSS_CHANNELS - 1; i > 0; i--){
+		j = xorshift32(&seed) % (i + 1);
+		tmp = fhss->sequence[i];
+		fhss->sequence[i] = fhss->sequence[j];
+		fhss->sequence[j] = tmp;
+	}
+	for(i = 0; i < FHSS_CHANNELS; i++){
+		fhss->position[fhss->sequence[i]] = (uint8_t)i;
+	}
+	fhss->channel = fhss->sequence[0];
+}
+
+uint32_t fhss_frequency(uint8_t channel)
+{
+	return FHSS_BASE_FREQ + (uint32_t)channel * FHSS_SPACING;
+}
+
+// RFFREQUENCY and CALIBRATEIMAGE bytes for any frequency in the band, the
+// calibration covering it +/- PHY_CAL_STEP
+void fhss_tuning(uint32_t frequency, fhss_channel_t *ch)
+{
+	uint32_t word = (uint32_t)((((uint64_t)frequency) << 25) / PHY_XTAL_FREQ);
+
+	ch->word[0] = (uint8_t)(word >> 24);
+	ch->word[1] = (uint8_t)(word >> 16);
+	ch->word[2] = (uint8_t)(word >> 8);
+	ch->word[3] = (uint8_t)word;
+	ch->cal[0] = (uint8_t)((frequency - PHY_CAL_STEP) / PHY_CAL_STEP);
+	ch->cal[1] = (uint8_t)((frequency + PHY_CAL_STEP) / PHY_CAL_STEP);
+}
+
+// position in the sequence of the channel on frequency, FHSS_OFF_PLAN
+// for a frequency between channels or outside the plan
+int32_t fhss_position(const fhss_t *fhss, uint32_t frequency)
+{
+	uint32_t offset;
+
+	if(frequency < FHSS_BASE_FREQ){
+		return FHSS_OFF_PLAN;
+	}
+	offset = frequency - FHSS_BASE_FREQ;
+	if(((offset % FHSS_SPACING) != 0) || ((offset / FHSS_SPACING) >= FHSS_CHANNELS)){
+		return FHSS_OFF_PLAN;
+	}
+	return fhss->position[offset / FHSS_SPACING];
+}
+
+const fhss_channel_t *fhss_select(fhss_t *fhss, uint32_t index)
+{
+	fhss->index = index % FHSS_CHANNELS;
+	fhss->channel = fhss->sequence[fhss->index];
+	return &fhss->channels[fhss->channel];
+}
+
+// channels in the same 4 MHz band share the image calibration: true when
+// cal is another band than the one in effect, which it then becomes
+bool fhss_band_changed(fhss_t *fhss, const uint8_t cal[2])
+{
+	if(cal[0] == fhss->calibrated_band){
+		return false;
+	}
+	fhss->calibrated_band = cal[0];
+	fhss->stats.calibrations++;
+	return true;
+}
+
+// the radio loses the image calibration on reset or cold sleep, or the
+// command didn't go out
+void fhss_invalidate_calibration(fhss_t *fhss)
+{
+	fhss->calibrated_band = 0;
+}
+
+// the base: its dwell on the current position starts now
+void fhss_start(fhss_t *fhss, uint32_t now_us)
+{
+	fhss->dwell_start = now_us;
+	fhss->synced = true;
+}
+
+bool fhss_dwell_expired(const fhss_t *fhss, uint32_t now_us)
+{
+	return (now_us - fhss->dwell_start) >= FHSS_DWELL_US;
+}
+
+// the position now_us falls in, whole dwells on from the current one, so
+// a late hop doesn't shift the schedule. the caller hops to it
+uint32_t fhss_advance(fhss_t *fhss, uint32_t now_us)
+{
+	uint32_t dwells = (now_us - fhss->dwell_start) / FHSS_DWELL_US;
+
+	fhss->dwell_start += dwells * FHSS_DWELL_US;
+	return (fhss->index + dwells) % FHSS_CHANNELS;
+}
+
+// a frame must go out FHSS_GUARD_US into the dwell and end FHSS_GUARD_US
+// before it runs out
+bool fhss_tx_allowed(const fhss_t *fhss, uint32_t now_us, uint32_t airtime_us)
+{
+	uint32_t elapsed = now_us - fhss->dwell_start;
+
+	if(!fhss->synced || (elapsed < FHSS_GUARD_US) || (elapsed >= FHSS_DWELL_US)){
+		return false;
+	}
+	return airtime_us + FHSS_GUARD_US <= FHSS_DWELL_US - elapsed;
+}
+
+// the data of a beacon after the header the caller writes
+void fhss_beacon(fhss_t *fhss, uint32_t now_us, uint8_t *frame)
+{
+	uint32_t elapsed = now_us - fhss->dwell_start;
+
+	frame[FRAME_HEADER_LEN] = (uint8_t)fhss->index;
+	frame_put16(&frame[FRAME_HEADER_LEN + 1], (uint16_t)elapsed);
+	frame_put16(&frame[FRAME_HEADER_LEN + 3], (uint16_t)(elapsed >> 16));
+	fhss->stats.beacons++;
+}
+
+// a remote: the base's position and dwell start from a beacon that went
+// on air at start_us, local time. false for anything else
+bool fhss_beacon_sync(fhss_t *fhss, const uint8_t *frame, uint32_t len, uint32_t start_us)
+{
+	uint32_t elapsed;
+
+	if((len < FHSS_BEACON_LEN) || (frame_type(frame) != FRAME_BEACON) ||
+		(frame[FRAME_HEADER_LEN] >= FHSS_CHANNELS)){
+		return false;
+	}
+	elapsed = frame_get16(&frame[FRAME_HEADER_LEN + 1]) | ((uint32_t)frame_get16(&frame[FRAME_HEADER_LEN + 3]) << 16);
+	if(elapsed >= FHSS_DWELL_US){
+		return false;
+	}
+	fhss->index = frame[FRAME_HEADER_LEN];
+	fhss->dwell_start = start_us - elapsed - FHSS_LEAD_US;
+	fhss->synced = true;
+	fhss->stats.syncs++;
+	return true;
+}
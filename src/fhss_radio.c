@@ -0,0 +1,299 @@
+// fhss_radio.c -- retunes from the precomputed plan, the hop schedule and its beacons
+
+#include "fhss_radio.h"
+#include "fhss.h"
+#include "tx_queue.h"
+#include "trx.h"
+#include "bulk_radio.h"
+#include "subghz.h"
+#include "subghz_support.h"
+#include "tx_power.h"
+#include "phy.h"
+#include "frame.h"
+
+#include "stm32wlxx_hal_subghz.h"
+#include "mprintf.h"
+#include "timebase.h"
+#include "hwtime.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+_Static_assert((RF_FREQ >= FHSS_BASE_FREQ) && ((RF_FREQ - FHSS_BASE_FREQ) % FHSS_SPACING == 0) &&
+	((RF_FREQ - FHSS_BASE_FREQ) / FHSS_SPACING < FHSS_CHANNELS), "RF_FREQ, the rendezvous, is a channel of the plan");
+
+static SUBGHZ_HandleTypeDef *radio;
+static fhss_t fhss;
+static fhss_role_t role;
+static uint16_t source;
+static uint16_t beacon_seq;
+static uint32_t rendezvous;			// position the remotes wait on for a beacon
+
+// remote: hops since the last beacon taken, and the beacon window
+static uint32_t hops_since_beacon;
+static bool window;
+static uint32_t window_end;
+static uint32_t missed;				// windows in a row without a beacon
+
+// RFFREQUENCY, and CALIBRATEIMAGE on entering a new band. the calibration
+// takes milliseconds, the next radio access waits for it to finish
+static HAL_StatusTypeDef fhss_radio_retune(fhss_channel_t *ch)
+{
+	HAL_StatusTypeDef result;
+	uint32_t start = timebase_now();
+	uint32_t cycles;
+
+	result = HAL_SUBGHZ_ExecSetCmd(radio, RADIO_SET_RFFREQUENCY, ch->word, sizeof(ch->word));
+	if(result != HAL_OK){
+		return result;
+	}
+	if(fhss_band_changed(&fhss, ch->cal)){
+		result = HAL_SUBGHZ_ExecSetCmd_IT(radio, RADIO_CALIBRATEIMAGE, ch->cal, sizeof(ch->cal));
+		if(result != HAL_OK){
+			fhss_invalidate_calibration(&fhss);
+			return result;
+		}
+	}
+
+	cycles = timebase_elapsed(start);
+	fhss.stats.hops++;
+	fhss.stats.last_cycles = cycles;
+	fhss.stats.total_cycles += cycles;
+	if(cycles > fhss.stats.max_cycles){
+		fhss.stats.max_cycles = cycles;
+	}
+	return HAL_OK;
+}
+
+// the plan and the sequence, before the init tunes the radio
+void fhss_radio_init(SUBGHZ_HandleTypeDef *hsubghz, uint32_t seed)
+{
+	radio = hsubghz;
+	role = FHSS_FIXED;
+	fhss_init(&fhss, seed);
+}
+
+// the radio must be out of RX and TX
+HAL_StatusTypeDef fhss_radio_hop_to(uint32_t index)
+{
+	fhss_select(&fhss, index);
+	return fhss_radio_retune(&fhss.channels[fhss.channel]);
+}
+
+// any frequency in the band, through the plan when it is on it
+HAL_StatusTypeDef fhss_radio_tune(uint32_t frequency)
+{
+	fhss_channel_t off_plan;
+	int32_t index = fhss_position(&fhss, frequency);
+
+	if(index != FHSS_OFF_PLAN){
+		return fhss_radio_hop_to((uint32_t)index);
+	}
+	fhss_tuning(frequency, &off_plan);
+	return fhss_radio_retune(&off_plan);
+}
+
+// the init script tuned and calibrated for frequency without this module
+void fhss_radio_tuned(uint32_t frequency)
+{
+	fhss_channel_t ch;
+	int32_t index = fhss_position(&fhss, frequency);
+
+	if(index != FHSS_OFF_PLAN){
+		fhss_select(&fhss, (uint32_t)index);
+	}
+	fhss_tuning(frequency, &ch);
+	fhss_band_changed(&fhss, ch.cal);
+}
+
+static HAL_StatusTypeDef fhss_radio_standby(void)
+{
+	uint8_t standby_clock = 0x00;
+
+	return HAL_SUBGHZ_ExecSetCmd(radio, RADIO_SET_STANDBY, &standby_clock, 1);
+}
+
+// at the top level, every remote is to hear it
+static HAL_StatusTypeDef fhss_radio_beacon(void)
+{
+	tx_frame_t *frame = tx_queue_alloc();
+
+	if(frame == NULL){
+		return HAL_BUSY;
+	}
+	frame_header(frame->payload, ADDRESS, source, beacon_seq++, FRAME_BEACON);
+	fhss_beacon(&fhss, hwtime_now_us(), frame->payload);
+	frame->len = FHSS_BEACON_LEN;
+	frame->power = TX_POWER_MAX;
+	return tx_queue_submit(frame, NULL, NULL);
+}
+
+// a remote: back on the rendezvous channel, in RX until a beacon comes
+static HAL_StatusTypeDef fhss_radio_acquire(void)
+{
+	HAL_StatusTypeDef result;
+
+	fhss.synced = false;
+	window = false;
+	missed = 0;
+	result = fhss_radio_standby();
+	if(result != HAL_OK){
+		return result;
+	}
+	result = fhss_radio_hop_to(rendezvous);
+	if(result != HAL_OK){
+		return result;
+	}
+	ConfigRFSwitch(RADIO_SWITCH_RX);
+	result = trx_packet_length(RX_MAX_PAYLOAD_LEN);
+	if(result != HAL_OK){
+		return result;
+	}
+	return continuous_rx();
+}
+
+// once trx and the TX queue are up. the base's first dwell starts on the
+// channel the init tuned, where the remotes wait for it
+HAL_StatusTypeDef fhss_radio_start(fhss_role_t new_role, uint16_t addr)
+{
+	role = new_role;
+	source = addr;
+	rendezvous = fhss.index;
+
+	switch(role)
+	{
+		case FHSS_BASE:
+			fhss_start(&fhss, hwtime_now_us());
+			return fhss_radio_beacon();
+		case FHSS_REMOTE:
+			return fhss_radio_acquire();
+		default:
+			return HAL_OK;
+	}
+}
+
+// the schedule owns the frequency
+bool fhss_radio_hopping(void)
+{
+	return role != FHSS_FIXED;
+}
+
+// a remote may send
+bool fhss_radio_synced(void)
+{
+	return (role == FHSS_FIXED) || fhss.synced;
+}
+
+// from either side of the TX queue, before a frame starts. the base's
+// beacon opens the dwell, the remotes already listen on the channel
+bool fhss_radio_tx_allowed(const uint8_t *frame, uint32_t airtime_us)
+{
+	uint32_t now = hwtime_now_us();
+
+	if((role == FHSS_FIXED) || (frame_type(frame) == FRAME_BEACON)){
+		return true;
+	}
+	if(window && ((int32_t)(now - window_end) < 0)){
+		return false;
+	}
+	return fhss_tx_allowed(&fhss, now, airtime_us);
+}
+
+// true when the frame was a beacon, which goes no further. a remote
+// takes its dwells from the base's, the poll moves it to the base's
+// channel if the beacon was heard elsewhere
+bool fhss_radio_rx(const packet_slot_t *slot)
+{
+	uint32_t start_us;
+
+	if((slot->rec.flags & RADIO_REC_CRC_ERR) || (slot->len < FRAME_HEADER_LEN) ||
+		(frame_type(slot->payload) != FRAME_BEACON)){
+		return false;
+	}
+	if((role != FHSS_REMOTE) || (frame_src(slot->payload) != FRAME_ADDR_BASE)){
+		return true;
+	}
+	// the record is the RXDONE edge, the beacon started its airtime before
+	start_us = slot->rec.time_us - phy_airtime_us(PHY_NETWORK, slot->len);
+	if(fhss_beacon_sync(&fhss, slot->payload, slot->len, start_us)){
+		window = false;
+		missed = 0;
+		hops_since_beacon = 0;
+	}
+	return true;
+}
+
+// out of RX and TX: the next channel, then the base re-arms its
+// receiver and beacons, a remote listens for the beacon when due or
+// goes back to a bulk session's RX
+static void fhss_radio_hop(uint32_t now_us)
+{
+	uint32_t index = fhss_advance(&fhss, now_us);
+
+	if((fhss_radio_standby() != HAL_OK) || (fhss_radio_hop_to(index) != HAL_OK)){
+		return;
+	}
+	if(role == FHSS_BASE){
+		trx_rx_resume();
+		fhss_radio_beacon();
+		return;
+	}
+	hops_since_beacon++;
+	if((hops_since_beacon >= FHSS_TRACK_HOPS) && !bulk_radio_receiving() &&
+		(trx_rx_window(FHSS_BEACON_WINDOW_US) == HAL_OK)){
+		window = true;
+		window_end = hwtime_now_us() + FHSS_BEACON_WINDOW_US;
+		return;
+	}
+	trx_rx_resume();
+}
+
+void fhss_radio_poll(void)
+{
+	uint32_t now = hwtime_now_us();
+
+	if(role == FHSS_FIXED){
+		return;
+	}
+	if(role == FHSS_REMOTE){
+		// acquiring: in RX on the rendezvous channel until a beacon
+		if(!fhss.synced){
+			return;
+		}
+		if(window && ((int32_t)(now - window_end) >= 0)){
+			window = false;
+			fhss.stats.misses++;
+			if(++missed >= FHSS_SYNC_MISSES){
+				fhss.stats.lost++;
+				fhss_radio_acquire();
+				return;
+			}
+		}
+	}
+	// a frame or its reply window is never cut short, the hop waits for it
+	if(tx_queue_busy()){
+		return;
+	}
+	if(fhss_dwell_expired(&fhss, now) || (fhss.channel != fhss.sequence[fhss.index])){
+		fhss_radio_hop(now);
+	}
+}
+
+const fhss_stats_t *fhss_radio_get_stats(void)
+{
+	return &fhss.stats;
+}
+
+void fhss_radio_print_stats(void)
+{
+	const fhss_stats_t *s = &fhss.stats;
+	uint32_t avg = (s->hops != 0) ? (s->total_cycles / s->hops) : 0;
+
+	printf_("fhss: %s, channel %u at %u kHz, %u retunes, %u calibrations, retune last %u us, avg %u us, max %u us\r\n",
+		(role == FHSS_BASE) ? "base" : (role == FHSS_REMOTE) ? (fhss.synced ? "remote, synced" : "remote, acquiring") :
+		"fixed", fhss.channel, fhss_frequency(fhss.channel) / 1000U, s->hops, s->calibrations,
+		timebase_cycles_to_us(s->last_cycles), timebase_cycles_to_us(avg), timebase_cycles_to_us(s->max_cycles));
+	printf_("fhss: %u beacons sent, %u taken, %u windows missed, %u times lost\r\n",
+		s->beacons, s->syncs, s->misses, s->lost);
+}
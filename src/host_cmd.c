@@ -0,0 +1,242 @@
+// host_cmd.c -- host commands from the LPUART receive ring to the radio
+
+#include "host_cmd.h"
+#include "cmd_parser.h"
+#include "hostlink.h"
+#include "uart.h"
+#include "listen.h"
+#include "trx.h"
+#include "tx_queue.h"
+#include "arq_radio.h"
+#include "bulk_radio.h"
+#include "fhss_radio.h"
+#include "subghz.h"
+#include "subghz_support.h"
+#include "frame.h"
+#include "phy.h"
+
+#include "mprintf.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+static cmd_parser_t parser;
+static host_cmd_stats_t stats;
+
+static uint32_t host_cmd_get32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// RF frequency changes out of RX only, listening resumes in the same mode.
+// refused while hopping, the schedule owns the frequency
+static HAL_StatusTypeDef host_cmd_frequency(uint32_t frequency)
+{
+	uint8_t standby_clock = 0x00;
+	HAL_StatusTypeDef result;
+
+	if(fhss_radio_hopping()){
+		return HAL_BUSY;
+	}
+
+	result = HAL_SUBGHZ_ExecSetCmd(&subghz_handle, RADIO_SET_STANDBY, &standby_clock, 1);
+	if(result != HAL_OK){
+		return result;
+	}
+	result = SetRfFrequency(&subghz_handle, frequency);
+	if(result != HAL_OK){
+		return result;
+	}
+	return listen_start(listen_mode());
+}
+
+// sniff windows are recomputed for the new preamble, a preamble too short
+// for sniff mode leaves it for continuous RX
+static HAL_StatusTypeDef host_cmd_preamble(uint16_t bits)
+{
+	HAL_StatusTypeDef result = listen_set_preamble(bits);
+
+	if(listen_mode() == LISTEN_SNIFF){
+		if(listen_start(LISTEN_SNIFF) != HAL_OK){
+			listen_start(LISTEN_CONTINUOUS);
+		}
+	}
+	return result;
+}
+
+// the outcome of a HOSTLINK_CMD_ARQ_SEND, which is acknowledged once queued
+static void host_cmd_arq_done(const arq_link_t *link, arq_result_t result, void *ctx)
+{
+	(void)ctx;
+
+	printf_("arq to %#06x seq %u: %s after %u transmissions\r\n", link->peer, link->tx_seq,
+		(result == ARQ_DELIVERED) ? "delivered" : "given up", link->attempts);
+}
+
+static HAL_StatusTypeDef host_cmd_arq(const uint8_t *args)
+{
+	arq_config_t config;
+
+	config.retries = args[0];
+	config.ack_timeout_us = host_cmd_get32(&args[1]);
+	config.backoff_us = host_cmd_get32(&args[5]);
+	config.backoff_max_us = host_cmd_get32(&args[9]);
+	return arq_radio_configure(&config);
+}
+
+// HOSTLINK_CMD_BULK pushes this image as it sits in flash, read a
+// fragment at a time
+static void host_cmd_flash_source(void *ctx, uint32_t offset, uint8_t *data, uint32_t len)
+{
+	const uint8_t *flash = (const uint8_t *)FLASH_BASE;
+	uint32_t i;
+
+	(void)ctx;
+
+	for(i = 0; i < len; i++){
+		data[i] = flash[offset + i];
+	}
+}
+
+// the outcome of a HOSTLINK_CMD_BULK, which is acknowledged once the open is queued
+static void host_cmd_bulk_done(const bulk_t *bulk, bulk_result_t result, void *ctx)
+{
+	const bulk_tx_t *tx = &bulk->tx;
+	uint32_t us = tx->end_us - tx->start_us;
+	uint32_t permille;
+
+	(void)ctx;
+
+	if(result != BULK_DELIVERED){
+		printf_("bulk to %#06x: given up after %u ms, %u of %u fragments acknowledged\r\n", tx->peer, us / 1000U,
+			tx->base, tx->count);
+		return;
+	}
+	permille = bulk_radio_goodput_permille(bulk);
+	printf_("bulk to %#06x: %u bytes delivered in %u ms, goodput %u bps, %u.%u%% of %u bps\r\n", tx->peer,
+		tx->size, us / 1000U, bulk_goodput_bps(tx->size, us), permille / 10U, permille % 10U,
+		phy_profiles[tx->profile].bit_rate);
+}
+
+static HAL_StatusTypeDef host_cmd_bulk(const uint8_t *args)
+{
+	uint32_t size = host_cmd_get32(&args[2]);
+
+	if(size > FLASH_SIZE){
+		return HAL_ERROR;
+	}
+	return bulk_radio_send(frame_get16(args), size, host_cmd_flash_source, host_cmd_bulk_done, NULL);
+}
+
+// args and len past the tag; the argument count is checked here, values
+// by the layer they go to
+static HAL_StatusTypeDef host_cmd_run(uint8_t type, const uint8_t *args, uint32_t len)
+{
+	switch(type)
+	{
+		case HOSTLINK_CMD_PING:
+			return (len == 0) ? HAL_OK : HAL_ERROR;
+		case HOSTLINK_CMD_LISTEN:
+			return (len == 1) ? listen_start((listen_mode_t)args[0]) : HAL_ERROR;
+		case HOSTLINK_CMD_FREQUENCY:
+			return (len == 4) ? host_cmd_frequency(host_cmd_get32(args)) : HAL_ERROR;
+		case HOSTLINK_CMD_PREAMBLE:
+			return (len == 2) ? host_cmd_preamble(frame_get16(args)) : HAL_ERROR;
+		case HOSTLINK_CMD_OUTPUT:
+			if((len != 1) || (args[0] > HOSTLINK_BINARY)){
+				return HAL_ERROR;
+			}
+			hostlink_set_mode((hostlink_mode_t)args[0]);
+			return HAL_OK;
+		case HOSTLINK_CMD_TX_POLICY:
+			if((len != 1) || (args[0] > UART_TX_BLOCK)){
+				return HAL_ERROR;
+			}
+			uart_tx_set_policy((uart_tx_policy_t)args[0]);
+			return HAL_OK;
+		case HOSTLINK_CMD_SEND:
+			// acknowledged once queued, the frame goes out behind any before it
+			return (len != 0) ? tx_queue_send(args, (uint8_t)len, NULL, NULL) : HAL_ERROR;
+		case HOSTLINK_CMD_FALLBACK:
+			if((len != 1) || ((args[0] != TRX_FALLBACK_STANDBY_RC) && (args[0] != TRX_FALLBACK_STANDBY_HSE32) &&
+				(args[0] != TRX_FALLBACK_FS))){
+				return HAL_ERROR;
+			}
+			return trx_set_fallback((trx_fallback_t)args[0]);
+		case HOSTLINK_CMD_ARQ_SEND:
+			if((len < 2) || (len - 2U > ARQ_MAX_DATA)){
+				return HAL_ERROR;
+			}
+			return arq_radio_send(frame_get16(args), &args[2], (uint8_t)(len - 2U), host_cmd_arq_done, NULL);
+		case HOSTLINK_CMD_ARQ:
+			return (len == 13) ? host_cmd_arq(args) : HAL_ERROR;
+		case HOSTLINK_CMD_BULK:
+			return (len == 6) ? host_cmd_bulk(args) : HAL_ERROR;
+		default:
+			stats.unknown++;
+			return HAL_ERROR;
+	}
+}
+
+static void host_cmd_record(const cmd_record_t *record, void *ctx)
+{
+	uint8_t ack[HOSTLINK_ACK_LEN];
+	HAL_StatusTypeDef result;
+
+	(void)ctx;
+
+	if(record->len < 1){
+		stats.unknown++;
+		return;
+	}
+	result = host_cmd_run(record->type, &record->payload[1], record->len - 1U);
+
+	stats.commands++;
+	if(result != HAL_OK){
+		stats.failed++;
+	}
+
+	ack[0] = record->type;
+	ack[1] = record->payload[0];
+	ack[2] = (uint8_t)result;
+	if(hostlink_binary()){
+		hostlink_send(HOSTLINK_REC_ACK, ack, sizeof(ack), NULL, 0);
+	}
+	else{
+		printf_("cmd %#x tag %u: %u\r\n", ack[0], ack[1], ack[2]);
+	}
+}
+
+void host_cmd_init(void)
+{
+	cmd_parser_init(&parser, uart_rx_buffer(), UART_RX_RING_SIZE, host_cmd_record, NULL);
+}
+
+// parses what arrived since the last receiver interrupt
+void host_cmd_poll(void)
+{
+	if(uart_rx_ready()){
+		cmd_parser_feed(&parser, uart_rx_position());
+	}
+}
+
+const cmd_parser_stats_t *host_cmd_parser_stats(void)
+{
+	return &parser.stats;
+}
+
+const host_cmd_stats_t *host_cmd_get_stats(void)
+{
+	return &stats;
+}
+
+void host_cmd_print_stats(void)
+{
+	const uart_rx_stats_t *rx = uart_rx_get_stats();
+
+	printf_("host cmd: %u bytes, %u records, %u commands, %u failed, %u unknown, %u crc errors, %u cobs errors, %u overruns\r\n",
+		parser.stats.bytes, parser.stats.records, stats.commands, stats.failed, stats.unknown,
+		parser.stats.crc_errors, parser.stats.cobs_errors, parser.stats.overruns);
+	printf_("uart rx: %u frames, %u idle, %u dma, %u errors\r\n", rx->matches, rx->idle, rx->dma, rx->errors);
+}
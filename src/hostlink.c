@@ -0,0 +1,134 @@
+// hostlink.c -- COBS framed binary records to the host
+
+#include "hostlink.h"
+#include "uart.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+_Static_assert(sizeof(hostlink_packet_t) == sizeof(radio_record_t), "packet record header is radio_record_t");
+_Static_assert(HOSTLINK_LOG_LINE <= HOSTLINK_MAX_PAYLOAD, "a log line fits one record");
+
+static hostlink_mode_t mode = HOSTLINK_DEFAULT_MODE;
+static hostlink_stats_t stats;
+
+static uint8_t record[HOSTLINK_MAX_RECORD];
+static uint8_t frame[HOSTLINK_MAX_FRAME];
+
+static char log_line[HOSTLINK_LOG_LINE];
+static uint32_t log_len;
+
+void hostlink_set_mode(hostlink_mode_t new_mode)
+{
+	mode = new_mode;
+}
+
+hostlink_mode_t hostlink_mode(void)
+{
+	return mode;
+}
+
+bool hostlink_binary(void)
+{
+	return mode == HOSTLINK_BINARY;
+}
+
+// COBS: each run of non-zero bytes is prefixed by its length + 1, a zero
+// ends a run, runs stop at 254 bytes. returns the bytes written to out
+static uint32_t cobs_encode(const uint8_t *in, uint32_t len, uint8_t *out)
+{
+	uint32_t code_at = 0;
+	uint32_t o = 1;
+	uint8_t code = 1;
+	uint32_t i;
+
+	for(i = 0; i < len; i++){
+		if(in[i] != 0){
+			out[o++] = in[i];
+			code++;
+		}
+		if((in[i] == 0) || (code == 0xFF)){
+			out[code_at] = code;
+			code_at = o++;
+			code = 1;
+		}
+	}
+	out[code_at] = code;
+	return o;
+}
+
+// one record from a header and a body, so callers need not copy them together
+void hostlink_send(uint8_t type, const void *head, uint32_t head_len, const void *body, uint32_t body_len)
+{
+	const uint8_t *src;
+	uint32_t len = 0;
+	uint32_t i;
+	uint16_t crc;
+
+	if(head_len + body_len > HOSTLINK_MAX_PAYLOAD){
+		stats.truncated++;
+		if(head_len > HOSTLINK_MAX_PAYLOAD){
+			head_len = HOSTLINK_MAX_PAYLOAD;
+		}
+		body_len = HOSTLINK_MAX_PAYLOAD - head_len;
+	}
+
+	record[len++] = type;
+	record[len++] = (uint8_t)(head_len + body_len);
+	for(src = head, i = 0; i < head_len; i++){
+		record[len++] = src[i];
+	}
+	for(src = body, i = 0; i < body_len; i++){
+		record[len++] = src[i];
+	}
+	crc = hostlink_crc16(HOSTLINK_CRC_INIT, record, len);
+	record[len++] = (uint8_t)crc;
+	record[len++] = (uint8_t)(crc >> 8);
+
+	len = cobs_encode(record, len, frame);
+	frame[len++] = HOSTLINK_DELIMITER;
+
+	uart_write(frame, len);
+
+	stats.frames[(type < HOSTLINK_REC_TYPES) ? type : 0]++;
+	stats.bytes += len;
+}
+
+// the record, then the frame alone: the radio status the read returns
+// ahead of it stays in slot->status
+void hostlink_packet(const packet_slot_t *slot)
+{
+	hostlink_send(HOSTLINK_REC_PACKET, &slot->rec, sizeof(slot->rec), slot->payload, slot->len);
+}
+
+void hostlink_telemetry(uint8_t group, const uint32_t *values, uint32_t count)
+{
+	hostlink_send(HOSTLINK_REC_TELEMETRY, &group, 1, values, count * sizeof(uint32_t));
+}
+
+// printf_() output, a log record per line in binary mode
+void hostlink_putchar(char c)
+{
+	if(mode == HOSTLINK_TEXT){
+		uart_write((const uint8_t *)&c, 1);
+		return;
+	}
+	if((c == '\r') || (c == '\n')){
+		if(log_len != 0){
+			hostlink_send(HOSTLINK_REC_LOG, log_line, log_len, NULL, 0);
+			log_len = 0;
+		}
+		return;
+	}
+	log_line[log_len++] = c;
+	if(log_len == sizeof(log_line)){
+		hostlink_send(HOSTLINK_REC_LOG, log_line, log_len, NULL, 0);
+		log_len = 0;
+	}
+}
+
+const hostlink_stats_t *hostlink_get_stats(void)
+{
+	return &stats;
+}
@@ -0,0 +1,134 @@
+// hwtime.c -- TIM2 microsecond counter and RTC epoch
+
+#include "hwtime.h"
+#include "timebase.h"
+
+#include "stm32wlxx_ll_bus.h"
+#include "stm32wlxx_ll_pwr.h"
+#include "stm32wlxx_ll_rcc.h"
+#include "stm32wlxx_ll_rtc.h"
+#include "stm32wlxx_ll_tim.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+// RTC clocked at 32768 Hz: ck_apre = 4096 Hz, ck_spre = 1 Hz,
+// the sub-second counter resolves 1/4096 s
+#define RTC_ASYNCH_PREDIV			7
+#define RTC_SYNCH_PREDIV			4095
+#define LSE_STARTUP_MS				2000
+
+static struct
+{
+	uint32_t tim_us;		// TIM2 count when the RTC was sampled
+	uint32_t seconds;		// RTC time of day at that point
+	uint32_t micros;
+} epoch;
+
+static void rtc_init(void)
+{
+	LL_APB1_GRP1_EnableClock(LL_APB1_GRP1_PERIPH_RTCAPB);
+	LL_PWR_EnableBkUpAccess();
+
+	// the RTC keeps running across resets, keep its time
+	if(LL_RTC_IsActiveFlag_INITS(RTC)){
+		return;
+	}
+
+	LL_RCC_LSE_SetDriveCapability(LL_RCC_LSEDRIVE_LOW);
+	LL_RCC_LSE_Enable();
+
+	deadline_t deadline = deadline_from_ms(LSE_STARTUP_MS);
+	while(!LL_RCC_LSE_IsReady() && !deadline_expired(&deadline));
+
+	if(LL_RCC_LSE_IsReady()){
+		LL_RCC_SetRTCClockSource(LL_RCC_RTC_CLKSOURCE_LSE);
+	}
+	else{
+		// no crystal fitted: LSI keeps the epoch running, less accurately
+		LL_RCC_LSI_Enable();
+		while(!LL_RCC_LSI_IsReady());
+		LL_RCC_SetRTCClockSource(LL_RCC_RTC_CLKSOURCE_LSI);
+	}
+	LL_RCC_EnableRTC();
+
+	LL_RTC_InitTypeDef RTC_InitStruct = {
+		.HourFormat = LL_RTC_HOURFORMAT_24HOUR,
+		.AsynchPrescaler = RTC_ASYNCH_PREDIV,
+		.SynchPrescaler = RTC_SYNCH_PREDIV
+	};
+	LL_RTC_Init(RTC, &RTC_InitStruct);
+}
+
+static void tim2_init(void)
+{
+	LL_RCC_ClocksTypeDef clocks;
+
+	LL_APB1_GRP1_EnableClock(LL_APB1_GRP1_PERIPH_TIM2);
+	LL_RCC_GetSystemClocksFreq(&clocks);
+
+	// timer clock is PCLK1 while the APB1 prescaler is 1
+	LL_TIM_InitTypeDef TIM_InitStruct = {
+		.Prescaler = (uint16_t)((clocks.PCLK1_Frequency / 1000000U) - 1U),
+		.CounterMode = LL_TIM_COUNTERMODE_UP,
+		.Autoreload = 0xFFFFFFFFU,
+		.ClockDivision = LL_TIM_CLOCKDIVISION_DIV1,
+		.RepetitionCounter = 0
+	};
+	LL_TIM_Init(TIM2, &TIM_InitStruct);
+	LL_TIM_EnableCounter(TIM2);
+}
+
+void hwtime_init(void)
+{
+	rtc_init();
+	tim2_init();
+	hwtime_resync();
+}
+
+uint32_t hwtime_now_us(void)
+{
+	return LL_TIM_GetCounter(TIM2);
+}
+
+// TIM2 time of an event whose cycle count was taken earlier, the cycles
+// elapsed since are well below the 2^32 cycle wrap
+uint32_t hwtime_at_cycles(uint32_t cycles)
+{
+	uint32_t now_us = hwtime_now_us();
+
+	return now_us - timebase_cycles_to_us(timebase_elapsed(cycles));
+}
+
+// to be called more often than every 71 minutes, before TIM2 wraps
+void hwtime_resync(void)
+{
+	uint32_t ssr;
+	uint32_t tr;
+
+	// reading SSR locks TR and DR until DR is read, TIM2 is sampled in between
+	ssr = LL_RTC_TIME_GetSubSecond(RTC);
+	epoch.tim_us = hwtime_now_us();
+	tr = LL_RTC_TIME_Get(RTC);
+	(void)LL_RTC_DATE_Get(RTC);
+
+	epoch.seconds = __LL_RTC_CONVERT_BCD2BIN(__LL_RTC_GET_HOUR(tr)) * 3600U
+		+ __LL_RTC_CONVERT_BCD2BIN(__LL_RTC_GET_MINUTE(tr)) * 60U
+		+ __LL_RTC_CONVERT_BCD2BIN(__LL_RTC_GET_SECOND(tr));
+	// the sub-second counter counts down from RTC_SYNCH_PREDIV
+	epoch.micros = (uint32_t)(((uint64_t)(RTC_SYNCH_PREDIV - ssr) * 1000000U) / (RTC_SYNCH_PREDIV + 1));
+}
+
+void hwtime_to_abs(uint32_t time_us, hwtime_abs_t *abs)
+{
+	// signed: events may predate the epoch by a little
+	int32_t delta = (int32_t)(time_us - epoch.tim_us);
+	int64_t micros = (int64_t)epoch.seconds * 1000000 + epoch.micros + delta;
+
+	if(micros < 0){
+		micros += 86400LL * 1000000;
+	}
+	abs->seconds = (uint32_t)((micros / 1000000) % 86400);
+	abs->micros = (uint32_t)(micros % 1000000);
+}
@@ -0,0 +1,234 @@
+// listen.c -- RX listen modes, sniff windows and radio energy estimate
+
+#include "listen.h"
+#include "subghz_support.h"
+
+#include "stm32wlxx_hal_subghz.h"
+#include "mprintf.h"
+#include "hwtime.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+// RADIO_SET_RXDUTYCYCLE periods count 15.625 us steps
+#define SNIFF_STEPS_PER_MS			64
+
+static const char *const mode_names[LISTEN_MODES] = { "single", "continuous", "sniff" };
+
+static SUBGHZ_HandleTypeDef *radio;
+static listen_mode_t mode;
+static uint32_t rx_period;			// sniff RX window, 15.625 us steps
+static uint32_t sleep_period;
+static uint32_t max_awake_us;		// longest preamble to RXDONE of one frame
+static uint32_t last_poll_us;
+static listen_stats_t stats;
+
+// written by the radio ISR, consumed by listen_rx_record()
+static volatile uint32_t preamble_us;
+static volatile bool preamble_pending;
+
+static uint32_t bits_to_us(uint32_t bits)
+{
+	return (uint32_t)(((uint64_t)bits * 1000000U) / BIT_RATE);
+}
+
+HAL_StatusTypeDef listen_init(SUBGHZ_HandleTypeDef *hsubghz, uint32_t remote_preamble_bits)
+{
+	radio = hsubghz;
+	mode = LISTEN_SINGLE;
+	last_poll_us = hwtime_now_us();
+
+	return listen_set_preamble(remote_preamble_bits);
+}
+
+// sniff windows for remotes sending remote_preamble_bits, refused when the
+// preamble is too short to sleep at all
+HAL_StatusTypeDef listen_set_preamble(uint32_t remote_preamble_bits)
+{
+	uint32_t preamble = bits_to_us(remote_preamble_bits);
+	uint32_t rx = bits_to_us(2 * PREAMBLE_DETECT_BITS);
+	uint32_t sleep;
+
+	if(preamble <= 2 * rx + SNIFF_WAKEUP_US){
+		rx_period = 0;
+		sleep_period = 0;
+		return HAL_ERROR;
+	}
+	sleep = preamble - 2 * rx - SNIFF_WAKEUP_US;
+
+	rx_period = (rx * SNIFF_STEPS_PER_MS + 999U) / 1000U;
+	sleep_period = (sleep * SNIFF_STEPS_PER_MS) / 1000U;
+	max_awake_us = preamble + bits_to_us(FRAME_OVERHEAD_BITS + 8 * RX_MAX_PAYLOAD_LEN);
+
+	return HAL_OK;
+}
+
+// energy of the time since the last call, at the mode in effect over it
+static void listen_account(void)
+{
+	uint32_t now_us = hwtime_now_us();
+	uint32_t elapsed = now_us - last_poll_us;
+	uint64_t ua;
+
+	last_poll_us = now_us;
+
+	if(mode == LISTEN_SNIFF){
+		ua = ((uint64_t)LISTEN_RX_UA * rx_period + (uint64_t)LISTEN_SLEEP_UA * sleep_period)
+			/ (rx_period + sleep_period);
+	}
+	else{
+		ua = LISTEN_RX_UA;
+	}
+	stats.time_us[mode] += elapsed;
+	stats.charge[mode] += ua * elapsed;
+}
+
+static HAL_StatusTypeDef listen_arm(void)
+{
+	uint8_t buf[6];
+
+	stats.rearms++;
+
+	switch(mode)
+	{
+		case LISTEN_CONTINUOUS:
+			buf[0] = buf[1] = buf[2] = 0xFF;
+			return HAL_SUBGHZ_ExecSetCmd(radio, RADIO_SET_RX, buf, 3);
+		case LISTEN_SNIFF:
+			buf[0] = (uint8_t)(rx_period >> 16);
+			buf[1] = (uint8_t)(rx_period >> 8);
+			buf[2] = (uint8_t)rx_period;
+			buf[3] = (uint8_t)(sleep_period >> 16);
+			buf[4] = (uint8_t)(sleep_period >> 8);
+			buf[5] = (uint8_t)sleep_period;
+			return HAL_SUBGHZ_ExecSetCmd(radio, RADIO_SET_RXDUTYCYCLE, buf, 6);
+		default:
+			buf[0] = buf[1] = buf[2] = 0x00;
+			return HAL_SUBGHZ_ExecSetCmd(radio, RADIO_SET_RX, buf, 3);
+	}
+}
+
+HAL_StatusTypeDef listen_start(listen_mode_t new_mode)
+{
+	const uint8_t standby_clock = 0x00;
+	uint16_t irqs = SUBGHZ_IRQ_RXDONE | SUBGHZ_IRQ_ERROR;
+	HAL_StatusTypeDef result;
+
+	if((new_mode >= LISTEN_MODES) || ((new_mode == LISTEN_SNIFF) && (rx_period == 0))){
+		return HAL_ERROR;
+	}
+
+	listen_account();
+	mode = new_mode;
+
+	// leave any RX first, the radio takes a new RX mode from standby
+	result = HAL_SUBGHZ_ExecSetCmd(radio, RADIO_SET_STANDBY, (uint8_t *)&standby_clock, 1);
+	if(result != HAL_OK){
+		return result;
+	}
+
+	// TX IRQs stay routed for the transmitter sharing the radio, in sniff
+	// mode the preamble IRQ marks the start of the extended RX
+	irqs |= radio->Radio.IrqMask & (SUBGHZ_IRQ_TXDONE | SUBGHZ_IRQ_RX_TX_TIMEOUT);
+	if(mode == LISTEN_SNIFF){
+		irqs |= SUBGHZ_IRQ_PREAMBLE_DETECTED;
+	}
+	preamble_pending = false;
+	result = SUBGHZ_Radio_Set_IRQ(radio, irqs);
+	if(result != HAL_OK){
+		return result;
+	}
+
+	return listen_arm();
+}
+
+// after a TX the radio waits in its fallback mode with the synthesizer
+// or the TCXO running, RX starts from there without the standby above
+HAL_StatusTypeDef listen_resume(void)
+{
+	return listen_arm();
+}
+
+listen_mode_t listen_mode(void)
+{
+	return mode;
+}
+
+// main loop side: account the energy and re-arm a single RX or the
+// duty cycle once the radio fell back to standby or FS after a packet
+void listen_poll(void)
+{
+	SUBGHZ_RadioModeTypeDef radio_mode;
+
+	listen_account();
+
+	if(mode == LISTEN_CONTINUOUS){
+		return;
+	}
+	// known from the state shadow, no SPI access while the radio listens
+	if(HAL_SUBGHZ_GetRadioMode(radio, &radio_mode) != HAL_OK){
+		return;
+	}
+	if((radio_mode == SUBGHZ_RADIO_MODE_STANDBY_RC) || (radio_mode == SUBGHZ_RADIO_MODE_STANDBY_HSE32) ||
+		(radio_mode == SUBGHZ_RADIO_MODE_FS)){
+		listen_arm();
+	}
+}
+
+// called for each received record, charges the RX time a sniff window
+// extended past its nominal length
+void listen_rx_record(const radio_record_t *rec)
+{
+	uint32_t awake;
+
+	stats.packets[mode]++;
+
+	if(!preamble_pending){
+		return;
+	}
+	preamble_pending = false;
+
+	// a preamble with no frame behind it leaves a stale time, skip those
+	awake = rec->time_us - preamble_us;
+	if(awake <= max_awake_us){
+		stats.awake_us += awake;
+		stats.charge[mode] += (uint64_t)(LISTEN_RX_UA - LISTEN_SLEEP_UA) * awake;
+	}
+}
+
+void HAL_SUBGHZ_PreambleDetectedCallback(SUBGHZ_HandleTypeDef *hsubghz)
+{
+	preamble_us = hwtime_at_cycles(hsubghz->IrqCycles);
+	preamble_pending = true;
+	stats.preambles++;
+}
+
+const listen_stats_t *listen_get_stats(void)
+{
+	return &stats;
+}
+
+void listen_print_stats(void)
+{
+	uint32_t i;
+	uint64_t fj;
+
+	listen_account();
+
+	printf_("listen: %s, sniff %u us RX / %u us sleep, %u re-arms, %u preambles, %u us extended RX\r\n",
+		mode_names[mode], (rx_period * 1000U) / SNIFF_STEPS_PER_MS, (sleep_period * 1000U) / SNIFF_STEPS_PER_MS,
+		stats.rearms, stats.preambles, stats.awake_us);
+
+	for(i = 0; i < LISTEN_MODES; i++){
+		if(stats.time_us[i] == 0){
+			continue;
+		}
+		// uA x us x mV is fJ
+		fj = stats.charge[i] * LISTEN_SUPPLY_MV;
+		printf_("listen %s: %u s, %u packets, %u mJ radio, %u uJ per packet\r\n",
+			mode_names[i], (uint32_t)(stats.time_us[i] / 1000000U), stats.packets[i],
+			(uint32_t)(fj / 1000000000000ULL),
+			(stats.packets[i] != 0) ? (uint32_t)(fj / 1000000000U / stats.packets[i]) : 0);
+	}
+}
@@ -3,20 +3,60 @@
 #include "gpio.h"
 #include "subghz.h"
 #include "uart.h"
+#include "timebase.h"
+#include "hwtime.h"
+#include "listen.h"
+#include "node_table.h"
+#include "hostlink.h"
+#include "host_cmd.h"
+#include "tx_queue.h"
+#include "trx.h"
+#include "arq_radio.h"
+#include "bulk_radio.h"
+#include "tx_power_radio.h"
+#include "fhss_radio.h"
+#include "frame.h"
+#include "subghz_support.h"
+#include "mprintf.h"
 
 #include "pin_defs.h"
 #include "stm32wlxx_ll_gpio.h"
 
 #include "stm32wlxx_ll_utils.h"
-#include "stm32wlxx_ll_lpuart.h"
+#include "stm32wlxx_ll_exti.h"
+
+#define BUTTON_DEBOUNCE_MS 200
 
 void Error_Handler(void);
 
+#if (TX_MODE == 1) && (TX_ARQ == 1)
+static void arq_done(const arq_link_t *link, arq_result_t result, void *ctx)
+{
+  (void)link;
+  (void)ctx;
+  if (result == ARQ_DELIVERED)
+  {
+    LL_GPIO_TogglePin(LED1_GPIO_Port, LED1_Pin);
+  }
+}
+#elif (TX_MODE == 1)
+static void tx_done(const tx_frame_t *frame, void *ctx)
+{
+  (void)ctx;
+  if (frame->result == TX_DONE)
+  {
+    LL_GPIO_TogglePin(LED1_GPIO_Port, LED1_Pin);
+  }
+}
+#endif
+
 
 int main(void)
 {
   /* Configure the system clock */
   SystemClock_Config();
+  timebase_init();
+  hwtime_init();
 
   /* Initialize all configured peripherals */
   GPIO_init();
@@ -26,50 +66,200 @@ int main(void)
 #if (RX_MODE == 1)
 
   ConfigRFSwitch(RADIO_SWITCH_RX);
+  node_table_init();
+
+  // answers go out from FS and the receiver is re-armed from there
+  trx_init(&subghz_handle, TRX_DEFAULT_FALLBACK, listen_resume);
+  if (listen_init(&subghz_handle, PREAMBLE_BITS) != HAL_OK)
+  {
+    printf_("sniff unavailable, remotes send a %u bit preamble\r\n", PREAMBLE_BITS);
+  }
+  listen_start(LISTEN_DEFAULT);
+  tx_queue_init(&subghz_handle);
+  // remotes address the base station as FRAME_ADDR_BASE
+  tx_power_radio_init();
+  arq_radio_init(FRAME_ADDR_BASE);
+  bulk_radio_init(FRAME_ADDR_BASE, NULL, NULL);
+  host_cmd_init();
+#if (FHSS_HOPPING == 1)
+  // the first dwell is on RF_FREQ, where the remotes wait for the beacon
+  fhss_radio_start(FHSS_BASE, FRAME_ADDR_BASE);
+#endif
 
-  // continuous_rx();
+  deadline_t stats_period = deadline_from_ms(10000);
+  deadline_t debounce = deadline_from_ms(BUTTON_DEBOUNCE_MS);
 
   while (1)
   {
+    // re-arms the radio in single and sniff mode, continuous RX never leaves
+    listen_poll();
+    // downlink frames and ACKs, before the RX path: a reply window reported
+    // closed here has its frame, if any, in the RX ring already
+    tx_queue_poll();
+    subghz_rx_poll();
+    // commands the host sent since the last LPUART interrupt
+    host_cmd_poll();
+    // ARQ retries and bulk rounds, once the windows, ACKs and SACKs above
+    // are accounted for
+    arq_radio_poll();
+    bulk_radio_poll();
+    // the next channel once the dwell is over and the TX queue idle
+    fhss_radio_poll();
 
-    // subghz_radio_getstatus();
-    single_rx_blocking();
-  	LL_mDelay(500);
+    // SW1 steps through the listen modes, skipping those refused
+    if (LL_EXTI_IsActiveFlag_0_31(LL_EXTI_LINE_0))
+    {
+      LL_EXTI_ClearFlag_0_31(LL_EXTI_LINE_0);
+      if (deadline_expired(&debounce))
+      {
+        deadline_restart(&debounce);
+        listen_mode_t mode = listen_mode();
+        for (uint32_t tries = 0; tries < LISTEN_MODES; tries++)
+        {
+          mode = (listen_mode_t)((mode + 1) % LISTEN_MODES);
+          if (listen_start(mode) == HAL_OK)
+          {
+            break;
+          }
+        }
+        printf_("listen mode %u\r\n", listen_mode());
+      }
+    }
 
+    // SW2 switches the host output between text and binary records
+    if (LL_EXTI_IsActiveFlag_0_31(LL_EXTI_LINE_1))
+    {
+      LL_EXTI_ClearFlag_0_31(LL_EXTI_LINE_1);
+      if (deadline_expired(&debounce))
+      {
+        deadline_restart(&debounce);
+        hostlink_set_mode(hostlink_binary() ? HOSTLINK_TEXT : HOSTLINK_BINARY);
+        printf_("host output %s\r\n", hostlink_binary() ? "binary" : "text");
+      }
+    }
+
+    if (deadline_expired(&stats_period))
+    {
+      deadline_restart(&stats_period);
+      hwtime_resync();
+      subghz_rx_print_stats();
+      listen_print_stats();
+      host_cmd_print_stats();
+      tx_queue_print_stats();
+      trx_print_stats();
+      arq_radio_print_stats();
+      bulk_radio_print_stats();
+      tx_power_radio_print_stats();
+      fhss_radio_print_stats();
+      subghz_rx_send_telemetry();
+
+      const uart_tx_stats_t *tx = uart_tx_get_stats();
+      printf_("uart tx: %u bytes, %u dropped in %u overflows, %u blocked, %u high water\r\n",
+        tx->written, tx->dropped, tx->overflows, tx->blocked, tx->high_water);
+    }
   }
 #endif
 
 #if (TX_MODE == 1)
 
-  ConfigRFSwitch(RADIO_SWITCH_RFO_LP);
+  // the radio waits in FS between frames, the TX path stays switched in
+  trx_init(&subghz_handle, TRX_DEFAULT_FALLBACK, NULL);
+  tx_queue_init(&subghz_handle);
+
+  uint16_t source = subghz_source_address();
+  uint8_t value = 0;
 
-  uint8_t i = 0;
+  deadline_t stats_period = deadline_from_ms(10000);
+
+#if (TX_ARQ == 1)
+
+  // ACKs come back through the RX path, which tracks the base as a node;
+  // a blob the base pushes is counted and dropped
+  node_table_init();
+  tx_power_radio_init();
+  arq_radio_init(source);
+  bulk_radio_init(source, NULL, NULL);
+#if (FHSS_HOPPING == 1)
+  // in RX on RF_FREQ until the base's beacon gives the schedule
+  fhss_radio_start(FHSS_REMOTE, source);
+#endif
 
   while (1)
   {
-    subghz_write_tx_buffer(i++);
-    tx_packet();
-    LL_mDelay(100);
-    subghz_radio_getstatus();
-    LL_GPIO_TogglePin(LED1_GPIO_Port, LED1_Pin);
-  	LL_mDelay(1000);
+    // one frame outstanding, the next goes once the base acknowledged it
+    // or the retries ran out. a bulk session from the base holds both,
+    // this radio can't hear fragments while it sends. nothing goes out
+    // before the hop schedule is known
+    if (fhss_radio_synced() && !bulk_radio_receiving() && arq_radio_ready(FRAME_ADDR_BASE))
+    {
+      arq_radio_send(FRAME_ADDR_BASE, &value, 1, arq_done, NULL);
+      value++;
+    }
+    tx_queue_poll();
+    subghz_rx_poll();
+    if (!bulk_radio_receiving())
+    {
+      arq_radio_poll();
+    }
+    bulk_radio_poll();
+    fhss_radio_poll();
+
+    if (deadline_expired(&stats_period))
+    {
+      deadline_restart(&stats_period);
+      hwtime_resync();
+      tx_queue_print_stats();
+      trx_print_stats();
+      arq_radio_print_stats();
+      bulk_radio_print_stats();
+      tx_power_radio_print_stats();
+      fhss_radio_print_stats();
+    }
   }
 
+#else
+
+  uint16_t seq = 0;
+  tx_frame_t *frame;
+
+  while (1)
+  {
+    // keep every free frame queued, TXDONE starts the next one
+    while ((frame = tx_queue_alloc()) != NULL)
+    {
+      frame_header(frame->payload, ADDRESS, source, seq++, FRAME_DATA);
+      frame->payload[FRAME_HEADER_LEN] = value++;
+      frame->len = TX_PAYLOAD_LEN;
+      tx_queue_submit(frame, tx_done, NULL);
+    }
+    tx_queue_poll();
+
+    if (deadline_expired(&stats_period))
+    {
+      deadline_restart(&stats_period);
+      hwtime_resync();
+      tx_queue_print_stats();
+      trx_print_stats();
+    }
+  }
+
+#endif
+
 #endif
 }
 
 int32_t putchar_(char c)
 {
-  // loop while the LPUART_TDR register is full
-  while(LL_LPUART_IsActiveFlag_TXE_TXFNF(LPUART1) != 1);
-  // once the LPUART_TDR register is empty, fill it with char c
-  LL_LPUART_TransmitData8(LPUART1, (uint8_t)c);
+  // raw in text mode, a log record per line in binary mode
+  hostlink_putchar(c);
   return (c);
 }
 
 void Error_Handler(void)
 {
   __disable_irq();
+  // whatever was printed before the fault still reaches the host
+  uart_tx_flush();
   while (1)
   {
   }
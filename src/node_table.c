@@ -0,0 +1,172 @@
+// node_table.c -- per-remote state with a bounded-probe hash index
+
+#include "node_table.h"
+#include "frame.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+
+#define RAM2_BSS					__attribute__((section(".ram2_bss")))
+
+static node_t nodes[NODE_TABLE_CAPACITY] RAM2_BSS;
+static uint16_t node_index[NODE_INDEX_SIZE];		// entry number + 1, 0 if free
+static node_table_stats_t stats;
+
+// Fibonacci hashing, consecutive addresses land far apart
+static uint32_t node_hash(uint16_t addr)
+{
+	return ((uint32_t)addr * 2654435761U) >> (32 - NODE_INDEX_BITS);
+}
+
+void node_table_init(void)
+{
+	// RAM2 is left alone by the startup code
+	memset(nodes, 0, sizeof(nodes));
+	memset(node_index, 0, sizeof(node_index));
+	memset(&stats, 0, sizeof(stats));
+}
+
+node_t *node_table_lookup(uint16_t addr, bool create)
+{
+	uint32_t slot = node_hash(addr);
+	uint32_t probe;
+	node_t *node;
+
+	for(probe = 0; probe < NODE_MAX_PROBES; probe++){
+		if(node_index[slot] == 0){
+			if(!create || (stats.nodes == NODE_TABLE_CAPACITY)){
+				return NULL;
+			}
+			node = &nodes[stats.nodes];
+			node->addr = addr;
+			node_index[slot] = (uint16_t)++stats.nodes;
+			break;
+		}
+		node = &nodes[node_index[slot] - 1];
+		if(node->addr == addr){
+			break;
+		}
+		slot = (slot + 1) & (NODE_INDEX_SIZE - 1);
+	}
+	if(probe == NODE_MAX_PROBES){
+		return NULL;
+	}
+	if(probe + 1 > stats.max_probes){
+		stats.max_probes = probe + 1;
+	}
+	return node;
+}
+
+// slides the window of a remote to a sequence number, in a few cycles
+static node_rx_t node_seq_update(node_t *node, uint16_t seq)
+{
+	uint16_t ahead = (uint16_t)(seq - node->last_seq);
+	uint16_t behind = (uint16_t)(node->last_seq - seq);
+	uint64_t bit;
+
+	if((ahead != 0) && (ahead < 0x8000U)){
+		node->window = (ahead < NODE_SEQ_WINDOW) ? ((node->window << ahead) | 1U) : 1U;
+		node->lost += ahead - 1U;
+		node->last_seq = seq;
+		return NODE_RX_NEW;
+	}
+	if(behind >= NODE_SEQ_WINDOW){
+		node->dups++;
+		return NODE_RX_DUP;
+	}
+	bit = (uint64_t)1U << behind;
+	if(node->window & bit){
+		node->dups++;
+		return NODE_RX_DUP;
+	}
+	// counted lost when the sequence jumped past it
+	node->window |= bit;
+	node->lost--;
+	node->reordered++;
+	return NODE_RX_LATE;
+}
+
+// the remote rebooted or was gone for long: its window starts over
+static bool node_seq_restarted(const node_t *node, uint16_t seq, uint32_t rx_us)
+{
+	uint16_t ahead = (uint16_t)(seq - node->last_seq);
+	uint16_t behind = (uint16_t)(node->last_seq - seq);
+
+	return (((ahead < 0x8000U) ? ahead : behind) >= NODE_SEQ_RESYNC_GAP) ||
+		((rx_us - node->last_seen_us) >= NODE_SEQ_STALE_US);
+}
+
+// attributes a received frame to its sender and tells whether it is new.
+// frame is the first byte the sender sent, len the frame's length
+node_rx_t node_table_rx(const uint8_t *frame, uint32_t len, uint32_t rx_us, int8_t rssi_dbm, node_t **node)
+{
+	node_t *entry;
+	node_rx_t verdict;
+	int16_t rssi;
+
+	*node = NULL;
+	if(len < FRAME_HEADER_LEN){
+		stats.short_frames++;
+		return NODE_RX_UNTRACKED;
+	}
+
+	entry = node_table_lookup(frame_src(frame), true);
+	if(entry == NULL){
+		stats.full++;
+		return NODE_RX_UNTRACKED;
+	}
+
+	rssi = (int16_t)(rssi_dbm * (1 << NODE_RSSI_FRAC_BITS));
+
+	if(entry->packets == 0){
+		// nothing before the first contact is owed, older frames are duplicates
+		entry->window = UINT64_MAX;
+		entry->last_seq = frame_seq(frame);
+		entry->rssi_ewma = rssi;
+		verdict = NODE_RX_NEW;
+	}
+	else{
+		if(node_seq_restarted(entry, frame_seq(frame), rx_us)){
+			// as on first contact, from the number the remote starts over on
+			entry->window = UINT64_MAX;
+			entry->last_seq = frame_seq(frame);
+			stats.resyncs++;
+			verdict = NODE_RX_NEW;
+		}
+		else{
+			verdict = node_seq_update(entry, frame_seq(frame));
+		}
+		entry->rssi_ewma += (int16_t)((rssi - entry->rssi_ewma) / (1 << NODE_RSSI_EWMA_SHIFT));
+	}
+	entry->packets++;
+	entry->last_seen_us = rx_us;
+
+	*node = entry;
+	return verdict;
+}
+
+uint32_t node_table_count(void)
+{
+	return stats.nodes;
+}
+
+// the entry number of a node, NODE_TABLE_CAPACITY for none: per-remote
+// state kept elsewhere is indexed by it (tx_power.h)
+uint32_t node_table_number(const node_t *node)
+{
+	return (node != NULL) ? (uint32_t)(node - nodes) : NODE_TABLE_CAPACITY;
+}
+
+// entries stay in first-heard order, for walking the table
+const node_t *node_table_entry(uint32_t index)
+{
+	return (index < stats.nodes) ? &nodes[index] : NULL;
+}
+
+const node_table_stats_t *node_table_get_stats(void)
+{
+	return &stats;
+}
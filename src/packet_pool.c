@@ -0,0 +1,61 @@
+// packet_pool.c -- preallocated packet slots
+
+#include "packet_pool.h"
+
+#include "stm32wlxx.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+_Static_assert(PACKET_SLOTS <= 32, "slot bitmap is 32 bits wide");
+
+static packet_slot_t slots[PACKET_SLOTS];
+static uint32_t in_use;			// one bit per slot
+static uint32_t exhausted;		// allocations refused, all slots in use
+
+// slots are taken in interrupt context and released from the main loop,
+// the bitmap update runs with interrupts masked for a few instructions
+packet_slot_t *packet_pool_alloc(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	uint32_t free_slots;
+	uint32_t i;
+
+	__disable_irq();
+	free_slots = ~in_use & ((1UL << PACKET_SLOTS) - 1);
+	if(free_slots == 0){
+		exhausted++;
+		__set_PRIMASK(primask);
+		return NULL;
+	}
+	i = __CLZ(__RBIT(free_slots));
+	in_use |= 1UL << i;
+	__set_PRIMASK(primask);
+
+	return &slots[i];
+}
+
+void packet_pool_release(packet_slot_t *slot)
+{
+	uint32_t primask = __get_PRIMASK();
+	uint32_t i = (uint32_t)(slot - slots);
+
+	if(i >= PACKET_SLOTS){
+		return;
+	}
+	__disable_irq();
+	in_use &= ~(1UL << i);
+	__set_PRIMASK(primask);
+}
+
+uint32_t packet_pool_available(void)
+{
+	return PACKET_SLOTS - (uint32_t)__builtin_popcount(in_use);
+}
+
+uint32_t packet_pool_exhausted(void)
+{
+	return exhausted;
+}
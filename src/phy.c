@@ -0,0 +1,44 @@
+// phy.c -- GFSK profiles, their MODULATIONPARAMS worked out at build time
+
+#include "phy.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#define PHY_BITRATE_DIV(rate)		((uint32_t)((32 * (uint64_t)PHY_XTAL_FREQ) / (rate)))
+#define PHY_CHANNEL(freq)			((uint32_t)((((uint64_t)(freq)) << 25) / PHY_XTAL_FREQ))
+#define PHY_BE24(x)					(uint8_t)((x) >> 16), (uint8_t)((x) >> 8), (uint8_t)(x)
+
+// no pulse shaping, as the boot configuration
+#define PHY_GFSK(rate, fdev, bw, bw_hz, sensitivity) \
+	{ (rate), (fdev), (bw_hz), (sensitivity), \
+		{ PHY_BE24(PHY_BITRATE_DIV(rate)), 0x00, (bw), PHY_BE24(PHY_CHANNEL(fdev)) } }
+
+// slowest first
+const phy_profile_t phy_profiles[PHY_PROFILES] = {
+	PHY_GFSK(4800, 2400, 0x1D, 19500, -112),		// Carson 9.6 kHz, 8 kHz more for the TCXOs
+	PHY_GFSK(9600, 4800, 0x0D, 29300, -110),		// Carson 19.2 kHz, 8 kHz more for the TCXOs
+	PHY_GFSK(19200, 9600, 0x14, 46900, -108),		// Carson 38.4 kHz, 8 kHz more for the TCXOs
+	PHY_GFSK(38400, 19200, 0x1B, 78200, -106),		// Carson 76.8 kHz
+	PHY_GFSK(PHY_NETWORK_BIT_RATE, PHY_NETWORK_FDEV, PHY_NETWORK_RX_BW, 93800, -105),	// Carson 100 kHz
+	PHY_GFSK(100000, 50000, 0x12, 187200, -102),	// Carson 200 kHz
+	PHY_GFSK(200000, 100000, 0x11, 373600, -99),	// Carson 400 kHz
+};
+
+uint32_t phy_bits_us(uint8_t profile, uint32_t bits)
+{
+	return (uint32_t)(((uint64_t)bits * 1000000U) / phy_profiles[profile].bit_rate);
+}
+
+// a frame of len payload bytes, preamble to CRC
+uint32_t phy_airtime_us(uint8_t profile, uint8_t len)
+{
+	return phy_bits_us(profile, PHY_PREAMBLE_BITS + PHY_OVERHEAD_BITS + 8U * len);
+}
+
+// what an answer takes on air before a receiver stops its RX timeout
+uint32_t phy_sync_us(uint8_t profile)
+{
+	return phy_bits_us(profile, PHY_SYNC_BITS);
+}
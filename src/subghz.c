@@ -7,14 +7,32 @@
 
 #include "subghz.h"
 #include "subghz_support.h"
+#include "packet_pool.h"
+#include "spsc_ring.h"
+#include "listen.h"
+#include "node_table.h"
+#include "frame.h"
+#include "hostlink.h"
+#include "trx.h"
+#include "tx_queue.h"
+#include "arq_radio.h"
+#include "bulk_radio.h"
+#include "fhss_radio.h"
+#include "pin_defs.h"
 
 #include "stm32wlxx_hal_subghz.h"
 #include "stm32wlxx_ll_bus.h"
+#include "stm32wlxx_ll_exti.h"
+#include "stm32wlxx_ll_gpio.h"
 #include "stm32wlxx_ll_rcc.h"
+#include "stm32wlxx_ll_utils.h"
 
 #include "mprintf.h"
+#include "timebase.h"
+#include "hwtime.h"
 
 #include <stdint.h>
+#include <stddef.h>
 
 
 #define RADIO_MODE_STANDBY_RC       0x02
@@ -30,6 +48,10 @@ SUBGHZ_HandleTypeDef subghz_handle;
 
 
 static void subghz_irq_init(void);
+static void subghz_dma_irq_init(void);
+#if (SUBGHZ_SPI_BENCH == 1)
+static void subghz_spi_bench(SUBGHZ_HandleTypeDef *hsubghz, uint8_t burst, const char *label);
+#endif
 
 
 void MX_SUBGHZ_Init(void)
@@ -43,27 +65,93 @@ void MX_SUBGHZ_Init(void)
 
   	subghz_handle.Init.BaudratePrescaler = SUBGHZSPI_BAUDRATEPRESCALER_8;
 
+	// radio ready time is counted from the radio reset release in HAL_SUBGHZ_Init
+	uint32_t reset_start = timebase_now();
+
 	if (HAL_SUBGHZ_Init(&subghz_handle) != HAL_OK)
 	{
 		printf_("error\r\n");
 	}
+#if (SUBGHZ_SPI_BENCH == 1)
+	// the bus as the original driver ran it, then what changed, step by step
+	subghz_spi_bench(&subghz_handle, SUBGHZ_SPI_BURST_DISABLE, "/8, split");
+#endif
+	// start at the conservative prescaler above, then go as fast as the radio allows
+	if (HAL_SUBGHZ_ConfigFastestPrescaler(&subghz_handle) != HAL_OK)
+	{
+		printf_("error\r\n");
+	}
+#if (SUBGHZ_SPI_BENCH == 1)
+	subghz_spi_bench(&subghz_handle, SUBGHZ_SPI_BURST_DISABLE, "fastest, split");
+	subghz_spi_bench(&subghz_handle, SUBGHZ_SPI_BURST_ENABLE, "fastest, burst");
+#endif
+	subghz_dma_irq_init();
+	// enabled before the radio configuration so RFBUSY waits can sleep
+	subghz_irq_init();
+
+	uint32_t spin_start = HAL_SUBGHZ_GetSpinCycles(&subghz_handle);
+	uint32_t init_start = timebase_now();
+
 	if(subghz_init(&subghz_handle) != HAL_OK)
 	{
 		printf_("error\r\n");
 	}
 
-#if (RX_MODE == 1)
-	subghz_irq_init();
-#endif
+	uint32_t init_end = timebase_now();
+
+	printf_("subghz_init (%s): %u us, %u cycles busy, ready %u us from reset\r\n",
+		(SUBGHZ_INIT_SCRIPT == 1) ? "script" : "commands",
+		timebase_cycles_to_us(init_end - init_start),
+		HAL_SUBGHZ_GetSpinCycles(&subghz_handle) - spin_start,
+		timebase_cycles_to_us(init_end - reset_start));
+}
+
+#if (SUBGHZ_SPI_BENCH == 1)
+// cycles a short command and a read of the RX half of the buffer take,
+// header and data sent split as before or in one burst. the radio is in
+// STANDBY_RC straight after HAL_SUBGHZ_Init(), the base addresses are
+// the ones the init sets anyway
+static void subghz_spi_bench(SUBGHZ_HandleTypeDef *hsubghz, uint8_t burst, const char *label)
+{
+	uint8_t base_addr[2] = {0x80, 0x00};
+	uint8_t buffer[128];
+	uint32_t start;
+	uint32_t set_cycles;
+	uint32_t read_cycles;
+
+	hsubghz->SpiBurst = burst;
+
+	start = timebase_now();
+	HAL_SUBGHZ_ExecSetCmd(hsubghz, RADIO_SET_BUFFERBASEADDRESS, base_addr, sizeof(base_addr));
+	set_cycles = timebase_elapsed(start);
+
+	start = timebase_now();
+	HAL_SUBGHZ_ReadBuffer(hsubghz, 0x00, buffer, sizeof(buffer));
+	read_cycles = timebase_elapsed(start);
+
+	hsubghz->SpiBurst = SUBGHZ_SPI_BURST_ENABLE;
+
+	printf_("subghz spi %s: ExecSetCmd(%u bytes) %u cycles, ReadBuffer(%u bytes) %u cycles\r\n",
+		label, (uint32_t)sizeof(base_addr), set_cycles, (uint32_t)sizeof(buffer), read_cycles);
 }
+#endif
 
 HAL_StatusTypeDef subghz_init(SUBGHZ_HandleTypeDef *hsubghz)
 {
-	uint8_t RadioResult = 0x00;
-	uint8_t RadioMode   = 0x00;
+	SUBGHZ_RadioModeTypeDef RadioMode;
 
 	HAL_StatusTypeDef result;
 
+	// every retune from here on takes the plan's precomputed bytes
+	fhss_radio_init(hsubghz, FHSS_DEFAULT_SEED);
+
+#if (SUBGHZ_INIT_SCRIPT == 1)
+	result = subghz_script_init(hsubghz);
+	if(result != HAL_OK){
+		return result;
+	}
+	fhss_radio_tuned(RF_FREQ);
+#else
 	subghz_default_init(hsubghz);
 
 	result = SetRfFrequency(hsubghz, RF_FREQ);
@@ -76,17 +164,17 @@ HAL_StatusTypeDef subghz_init(SUBGHZ_HandleTypeDef *hsubghz)
 	if(result != HAL_OK){
 		return result;
 	}
+#endif
 #endif
 	
-	/* Retrieve Status from SUBGHZ Radio */
-	result = HAL_SUBGHZ_ExecGetCmd(hsubghz, RADIO_GET_STATUS, &RadioResult, 1);
+	/* The shadow only follows the commands sent: drop it so the mode is read
+	   back from the radio with RADIO_GET_STATUS, and the shadow resynced */
+	hsubghz->Radio.Mode = SUBGHZ_RADIO_MODE_UNKNOWN;
+	result = HAL_SUBGHZ_GetRadioMode(hsubghz, &RadioMode);
 	if(result != HAL_OK){
 		return result;
 	}
 
-	/* Format Mode and Status receive from SUBGHZ Radio */
-	RadioMode = ((RadioResult & RADIO_MODE_BITFIELD) >> 4);
-
 	/* Check if SUBGHZ Radio is in RADIO_MODE_STANDBY_RC mode */
 	if(RadioMode != RADIO_MODE_STANDBY_RC)
 	{
@@ -96,57 +184,306 @@ HAL_StatusTypeDef subghz_init(SUBGHZ_HandleTypeDef *hsubghz)
 	return HAL_OK;
 }
 
-void subghz_read_rx_buffer(void)
+// cycles from the RXDONE interrupt entry to a slot ready to read
+static struct
+{
+	uint32_t packets;
+	uint32_t dropped;		// no free slot, or a DMA read failed
+	uint32_t dma_reads;		// payloads read through the DMA
+	uint32_t last;
+	uint32_t min;
+	uint32_t max;
+	uint32_t total;
+	uint32_t prev_irq;		// RXDONE entry of the previous packet
+	uint32_t min_spacing;	// closest RXDONEs seen, cycles
+} rx_bench = { .min = UINT32_MAX, .min_spacing = UINT32_MAX };
+
+// bits on air between the end of a frame and the first payload byte of the
+// next one written to the RX buffer: 32-bit sync word and the length byte
+#define RX_OVERWRITE_BITS			(32 + 8)
+
+// received slots, from the radio ISR to the main loop
+static spsc_ring_t rx_ring;
+// the slot a DMA read is filling, radio and DMA ISRs only
+static packet_slot_t *rx_dma_slot;
+
+void subghz_decode_record(radio_record_t *rec, uint8_t event, uint32_t irq_cycles, const uint8_t *pkt_status)
 {
-	uint8_t buf[16];
+	rec->time_us = hwtime_at_cycles(irq_cycles);
+	rec->event = event;
+	if(pkt_status != NULL){
+		rec->flags = (uint8_t)(pkt_status[1] >> 2);
+		rec->rssi_sync = (int8_t)(-(int32_t)(pkt_status[2] >> 1));
+		rec->rssi_avg = (int8_t)(-(int32_t)(pkt_status[3] >> 1));
+	}
+	else{
+		rec->flags = 0;
+		rec->rssi_sync = 0;
+		rec->rssi_avg = 0;
+	}
+}
 
-	HAL_SUBGHZ_ExecGetCmd(&subghz_handle, RADIO_GET_RXBUFFERSTATUS, buf, 4);
+// the read is over: RXDONE to a slot ready to publish
+static void subghz_rx_bench(SUBGHZ_HandleTypeDef *hsubghz)
+{
+	uint32_t cycles;
 
-	uint32_t payload_len = buf[1] + 1;
-  	printf_("Buf Status: %#04x, %#04x, %#04x\r\n", buf[0], buf[1], buf[2]);
-	
-	// read bytes from rx buffer
-	HAL_SUBGHZ_ReadBuffer(&subghz_handle, buf[2], buf, (uint16_t)payload_len);
+	if((rx_bench.packets != 0) && (hsubghz->IrqCycles - rx_bench.prev_irq < rx_bench.min_spacing)){
+		rx_bench.min_spacing = hsubghz->IrqCycles - rx_bench.prev_irq;
+	}
+	rx_bench.prev_irq = hsubghz->IrqCycles;
+
+	cycles = timebase_elapsed(hsubghz->IrqCycles);
+	rx_bench.packets++;
+	rx_bench.last = cycles;
+	rx_bench.total += cycles;
+	if(cycles < rx_bench.min){
+		rx_bench.min = cycles;
+	}
+	if(cycles > rx_bench.max){
+		rx_bench.max = cycles;
+	}
+}
+
+// NULL when no slot was free, or while a long frame is still coming in
+// through the DMA: HAL_SUBGHZ_ReadBufferCpltCallback() has it then
+packet_slot_t *subghz_rx_to_slot(SUBGHZ_HandleTypeDef *hsubghz)
+{
+	uint8_t buf_status[3];		// status, payload length, start offset
+	uint8_t pkt_status[4];		// status, RxStatus, RssiSync, RssiAvg
+	packet_slot_t *slot;
+	uint32_t len;
+
+	slot = packet_pool_alloc();
+	if(slot == NULL){
+		rx_bench.dropped++;
+		return NULL;
+	}
+
+	HAL_SUBGHZ_ExecGetCmd(hsubghz, RADIO_GET_RXBUFFERSTATUS, buf_status, sizeof(buf_status));
+	HAL_SUBGHZ_ExecGetCmd(hsubghz, RADIO_GET_PACKETSTATUS, pkt_status, sizeof(pkt_status));
 
-	uint32_t i;
-	printf_("buf = ");
-	for(i = 0; i < payload_len; i++){
-		printf_("%#04x, ", buf[i]);
+	len = buf_status[1];
+	if(len > sizeof(slot->payload)){
+		len = sizeof(slot->payload);
+	}
+	subghz_decode_record(&slot->rec, RADIO_EVENT_RX, hsubghz->IrqCycles, pkt_status);
+	slot->len = (uint8_t)len;
+
+	// the only copy of the payload, straight from the radio buffer. the HAL
+	// doesn't clock the NOP, so the status byte comes first and lands in
+	// slot->status, the frame follows in slot->payload
+	if((len >= SUBGHZ_DMA_MIN_LEN) &&
+		(HAL_SUBGHZ_ReadBuffer_DMA(hsubghz, buf_status[2], packet_slot_read_to(slot), (uint16_t)PACKET_READ_LEN(len)) == HAL_OK)){
+		rx_dma_slot = slot;
+		rx_bench.dma_reads++;
+		return NULL;
+	}
+	HAL_SUBGHZ_ReadBuffer(hsubghz, buf_status[2], packet_slot_read_to(slot), (uint16_t)PACKET_READ_LEN(len));
+
+	subghz_rx_bench(hsubghz);
+	return slot;
+}
+
+// a slot to the main loop, then the end of the reply window it answered
+static void subghz_rx_publish(SUBGHZ_HandleTypeDef *hsubghz, packet_slot_t *slot)
+{
+	if((slot != NULL) && !spsc_ring_push(&rx_ring, slot)){
+		packet_pool_release(slot);
 	}
-	printf_("\r\n");
+	// after the push: whoever waited on the window finds the frame queued
+	tx_queue_rx_end(hsubghz);
 }
 
-void subghz_write_tx_buffer(uint8_t value)
+// consumers get the slot by reference and release it when done
+void subghz_packet_received(packet_slot_t *slot)
 {
-	uint8_t tx_addr;
-	uint8_t buf[4];
-	uint8_t buf2[3];
-	uint32_t i;
+	hwtime_abs_t at;
+	node_t *node;
 
-	for(i = 0; i < sizeof(buf); i++){
-		buf[i] = value++;
+	// the base's hop schedule, taken by a remote
+	if(fhss_radio_rx(slot)){
+		packet_pool_release(slot);
+		return;
 	}
-	// get the start address of the tx buffer (I think)
-	HAL_SUBGHZ_ReadRegister(&subghz_handle, 0x0802, &tx_addr);
 
-	printf_("tx_addr = %#0x\r\n", tx_addr);
-	
-	// write bytes to the start of the tx buffer
-	HAL_SUBGHZ_WriteBuffer(&subghz_handle, 0x80, buf, sizeof(buf));
+	// ACKs end in the ARQ, ARQ frames are acknowledged and go on
+	if(arq_radio_rx(slot)){
+		packet_pool_release(slot);
+		return;
+	}
+
+	// fragments, polls and SACKs all end in the bulk transfer
+	if(bulk_radio_rx(slot)){
+		packet_pool_release(slot);
+		return;
+	}
+
+	// retransmissions of frames already forwarded stop here, a CRC error
+	// has no sender to attribute it to
+	node = NULL;
+	if(!(slot->rec.flags & RADIO_REC_CRC_ERR) &&
+		(node_table_rx(slot->payload, slot->len, slot->rec.time_us, slot->rec.rssi_avg, &node) == NODE_RX_DUP)){
+		packet_pool_release(slot);
+		return;
+	}
+
+	// binary host output: the record and payload as received, no formatting
+	if(hostlink_binary()){
+		LL_GPIO_TogglePin(LED1_GPIO_Port, LED1_Pin);
+		hostlink_packet(slot);
+		packet_pool_release(slot);
+		return;
+	}
+
+	hwtime_to_abs(slot->rec.time_us, &at);
+	if(slot->rec.flags & RADIO_REC_CRC_ERR){
+		printf_("rx crc error at %u.%u, rssi %d dBm\r\n", at.seconds, at.micros, slot->rec.rssi_sync);
+	}
+	else if(node != NULL){
+		LL_GPIO_TogglePin(LED1_GPIO_Port, LED1_Pin);
+		printf_("rx %u bytes from %#06x seq %u at %u.%u, rssi %d/%d dBm, flags %#04x, %u lost %u dup\r\n",
+			slot->len, node->addr, frame_seq(slot->payload), at.seconds, at.micros,
+			slot->rec.rssi_sync, slot->rec.rssi_avg, slot->rec.flags, node->lost, node->dups);
+	}
+	else{
+		LL_GPIO_TogglePin(LED1_GPIO_Port, LED1_Pin);
+		printf_("rx %u bytes at %u.%u, rssi %d/%d dBm, flags %#04x, first %#04x\r\n",
+			slot->len, at.seconds, at.micros, slot->rec.rssi_sync, slot->rec.rssi_avg,
+			slot->rec.flags, slot->payload[0]);
+	}
+	packet_pool_release(slot);
+}
+
+// main loop side: serve a radio IRQ deferred while the HAL was busy,
+// then process the slots the ISR published
+uint32_t subghz_rx_poll(void)
+{
+	packet_slot_t *slot;
+	uint32_t count = 0;
+
+	HAL_SUBGHZ_ResumeIRQ(&subghz_handle);
+
+	while((slot = spsc_ring_pop(&rx_ring)) != NULL){
+		listen_rx_record(&slot->rec);
+		subghz_packet_received(slot);
+		count++;
+	}
+	return count;
+}
+
+void subghz_rx_print_stats(void)
+{
+	const node_table_stats_t *nodes = node_table_get_stats();
+	uint32_t avg = (rx_bench.packets != 0) ? (rx_bench.total / rx_bench.packets) : 0;
+
+	printf_("rx: %u packets, %u dropped, %u through the DMA, RXDONE to slot %u cycles last, %u min, %u avg, %u max\r\n",
+		rx_bench.packets, rx_bench.dropped, rx_bench.dma_reads, rx_bench.last,
+		(rx_bench.packets != 0) ? rx_bench.min : 0, avg, rx_bench.max);
+	printf_("rx ring: %u queued, %u high water, %u overflows\r\n",
+		spsc_ring_count(&rx_ring), rx_ring.high_water, rx_ring.overflows);
+
+	// in continuous RX the next frame lands at the same RX base address, the
+	// drain has the gap plus the sync word and length byte to complete
+	uint32_t drain_us = timebase_cycles_to_us(rx_bench.max);
+	uint32_t header_us = (RX_OVERWRITE_BITS * 1000000U) / BIT_RATE;
+
+	printf_("rx gap: drain %u us worst, min sustainable gap %u us at %u bps, closest RXDONEs %u us\r\n",
+		drain_us, (drain_us > header_us) ? (drain_us - header_us) : 0, BIT_RATE,
+		(rx_bench.min_spacing != UINT32_MAX) ? timebase_cycles_to_us(rx_bench.min_spacing) : 0);
+	printf_("nodes: %u of %u, %u frames untracked, %u short, %u probes max, %u resyncs\r\n",
+		nodes->nodes, NODE_TABLE_CAPACITY, nodes->full, nodes->short_frames, nodes->max_probes, nodes->resyncs);
+}
+
+// the counters above as a HOSTLINK_TLM_RX record, in binary mode only
+void subghz_rx_send_telemetry(void)
+{
+	const node_table_stats_t *nodes = node_table_get_stats();
+	const hostlink_stats_t *host = hostlink_get_stats();
+	uint32_t values[HOSTLINK_TLM_RX_COUNT];
 
-	printf_("value = %#04x\r\n", value);
+	if(!hostlink_binary()){
+		return;
+	}
+	values[HOSTLINK_TLM_RX_PACKETS] = rx_bench.packets;
+	values[HOSTLINK_TLM_RX_DROPPED] = rx_bench.dropped;
+	values[HOSTLINK_TLM_RX_RING_HIGH_WATER] = rx_ring.high_water;
+	values[HOSTLINK_TLM_RX_RING_OVERFLOWS] = rx_ring.overflows;
+	values[HOSTLINK_TLM_RX_NODES] = nodes->nodes;
+	values[HOSTLINK_TLM_RX_NODES_UNTRACKED] = nodes->full;
+	values[HOSTLINK_TLM_RX_HOST_FRAMES] = host->frames[HOSTLINK_REC_PACKET];
+	values[HOSTLINK_TLM_RX_HOST_BYTES] = host->bytes;
+
+	hostlink_telemetry(HOSTLINK_TLM_RX, values, HOSTLINK_TLM_RX_COUNT);
+}
+
+// interrupt side: only the SPI reads into a slot, the rest runs in subghz_rx_poll()
+void HAL_SUBGHZ_RxCpltCallback(SUBGHZ_HandleTypeDef *hsubghz)
+{
+	packet_slot_t *slot = subghz_rx_to_slot(hsubghz);
+
+	trx_rx_end(hsubghz->IrqCycles);
+	if(rx_dma_slot == NULL){
+		subghz_rx_publish(hsubghz, slot);
+	}
+}
+
+// DMA interrupt: a long frame is in its slot, the radio IRQ deferred
+// meanwhile runs once this returns
+void HAL_SUBGHZ_ReadBufferCpltCallback(SUBGHZ_HandleTypeDef *hsubghz)
+{
+	packet_slot_t *slot = rx_dma_slot;
+
+	rx_dma_slot = NULL;
+	if(slot == NULL){
+		return;
+	}
+	if(hsubghz->ErrorCode & HAL_SUBGHZ_ERROR_DMA){
+		hsubghz->ErrorCode &= ~HAL_SUBGHZ_ERROR_DMA;
+		packet_pool_release(slot);
+		rx_bench.dropped++;
+		slot = NULL;
+	}
+	else{
+		subghz_rx_bench(hsubghz);
+	}
+	subghz_rx_publish(hsubghz, slot);
+}
 
-	HAL_SUBGHZ_ReadBuffer(&subghz_handle, 0x81, buf2, sizeof(buf2));
+// a failed CRC still gets its record, with no payload
+void HAL_SUBGHZ_CRCErrorCallback(SUBGHZ_HandleTypeDef *hsubghz)
+{
+	uint8_t pkt_status[4];
+	packet_slot_t *slot = packet_pool_alloc();
 
-	printf_("buf2 = %#04x\r\n", buf2[1]);
+	if(slot == NULL){
+		rx_bench.dropped++;
+	}
+	else{
+		HAL_SUBGHZ_ExecGetCmd(hsubghz, RADIO_GET_PACKETSTATUS, pkt_status, sizeof(pkt_status));
+		subghz_decode_record(&slot->rec, RADIO_EVENT_RX, hsubghz->IrqCycles, pkt_status);
+		slot->rec.flags |= RADIO_REC_CRC_ERR;
+		slot->len = 0;
+
+		if(!spsc_ring_push(&rx_ring, slot)){
+			packet_pool_release(slot);
+		}
+	}
+	tx_queue_rx_end(hsubghz);
 }
 
-HAL_StatusTypeDef tx_packet(void)
+// this node's address in frame headers, folded from the 96-bit device UID.
+// the base station's address is left to the base station
+uint16_t subghz_source_address(void)
 {
-	uint8_t RadioCmd[3] = {0xff, 0xff, 0x00};	// disable timeout
-	return(HAL_SUBGHZ_ExecSetCmd(&subghz_handle, RADIO_SET_TX, RadioCmd, 3));
+	uint32_t uid = LL_GetUID_Word0() ^ LL_GetUID_Word1() ^ LL_GetUID_Word2();
+	uint16_t addr = (uint16_t)(uid ^ (uid >> 16));
+
+	return (addr != FRAME_ADDR_BASE) ? addr : (uint16_t)~FRAME_ADDR_BASE;
 }
 
+// the radio stays in RX after each RXDONE, the ISR drains every payload
+// before the next frame can be written over it
 HAL_StatusTypeDef continuous_rx(void)
 {
 	uint8_t RadioCmd[3] = {0xFF, 0xFF, 0xFF};
@@ -166,7 +503,26 @@ static void subghz_irq_init(void)
   NVIC_EnableIRQ(SUBGHZ_Radio_IRQn);
 }
 
+static void subghz_dma_irq_init(void)
+{
+  /* completion of buffer transfers done through DMA */
+  NVIC_SetPriority(SUBGHZ_DMA_RX_IRQn, 1);
+  NVIC_EnableIRQ(SUBGHZ_DMA_RX_IRQn);
+}
+
+void DMA1_Channel1_IRQHandler(void)
+{
+  HAL_SUBGHZ_DMA_IRQHandler(&subghz_handle);
+}
+
 void SUBGHZ_Radio_IRQHandler(void)
 {
+  // the vector is shared with the RFBUSY released edge, a radio IRQ
+  // still asserted re-enters the handler once this one returns
+  if (LL_EXTI_IsActiveFlag_32_63(LL_EXTI_LINE_45))
+  {
+    HAL_SUBGHZ_RFBUSY_IRQHandler(&subghz_handle);
+    return;
+  }
   HAL_SUBGHZ_IRQHandler(&subghz_handle);
 }
\ No newline at end of file
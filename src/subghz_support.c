@@ -2,6 +2,7 @@
 
 #include "subghz_support.h"
 #include "subghz.h"
+#include "fhss_radio.h"
 
 #include "stm32wlxx_hal_subghz.h"
 #include "mprintf.h"
@@ -11,11 +12,9 @@
 
 
 
-#define SX_FREQ_TO_CHANNEL( channel, freq )                                  \
-do                                                                           \
-{                                                                            \
-  channel = (uint32_t) ((((uint64_t) freq)<<25)/(XTAL_FREQ) );               \
-}while( 0 )
+#define BE16(x)						(uint8_t)((x) >> 8), (uint8_t)(x)
+#define BE24(x)						(uint8_t)((x) >> 16), BE16(x)
+#define BE32(x)						(uint8_t)((x) >> 24), BE24(x)
 
 struct __attribute__((__packed__)) sRadioParams {
 	uint16_t PbLength;
@@ -43,6 +42,49 @@ static HAL_StatusTypeDef DefaultTxConfig(SUBGHZ_HandleTypeDef *hsubghz);
 static HAL_StatusTypeDef DefaultModulationParams(SUBGHZ_HandleTypeDef *hsubghz);
 static HAL_StatusTypeDef DefaultCRC(SUBGHZ_HandleTypeDef *hsubghz);
 
+#if (RX_MODE == 1)
+#define SCRIPT_PAYLOAD_LEN			RX_MAX_PAYLOAD_LEN
+#endif
+#if (TX_MODE == 1)
+#define SCRIPT_PAYLOAD_LEN			TX_PAYLOAD_LEN
+#endif
+
+_Static_assert((RF_FREQ >= FREQ_LOWER_LIMIT) && (RF_FREQ <= FREQ_UPPER_LIMIT), "RF_FREQ out of band");
+
+// the same configuration as subghz_default_init() + SetRfFrequency(RF_FREQ),
+// encoded at build time. each frame is [length][busy flag][bytes on the wire]
+static const uint8_t init_script[] = {
+	2, SUBGHZ_SCRIPT_SPIN, RADIO_SET_STANDBY, 0x00,
+	3, SUBGHZ_SCRIPT_SPIN, RADIO_SET_BUFFERBASEADDRESS, 0x80, 0x00,
+	2, SUBGHZ_SCRIPT_SPIN, RADIO_SET_PACKETTYPE, 0x00,
+	11, SUBGHZ_SCRIPT_SPIN, SUBGHZ_RADIO_WRITE_REGISTER, BE16(SYNCWORD_BASEADDRESS),
+		0x48, 0xDF, 0x70, 0x72, 0x00, 0x00, 0x00, 0x00,
+	// node and broadcast address registers are contiguous
+	5, SUBGHZ_SCRIPT_SPIN, SUBGHZ_RADIO_WRITE_REGISTER, BE16(NODE_ADDRESS_REG), ADDRESS, ADDRESS,
+	// CRC16-CCITT, init and poly registers are contiguous
+	7, SUBGHZ_SCRIPT_SPIN, SUBGHZ_RADIO_WRITE_REGISTER, BE16(CRC_INIT_MSB_REG), 0x1D, 0x0F, 0x10, 0x21,
+	10, SUBGHZ_SCRIPT_SPIN, RADIO_SET_PACKETPARAMS, BE16(PREAMBLE_BITS), PREAMBLE_DETECT, 32, 0x02, 1, SCRIPT_PAYLOAD_LEN, 2, 0,
+	// both images transmit, the receiver answers remotes
+	5, SUBGHZ_SCRIPT_SPIN, RADIO_SET_PACONFIG, 0x01, 0x00, 0x01, 0x01,
+	3, SUBGHZ_SCRIPT_SPIN, RADIO_SET_TXPARAMS, 0x0D, 0x04,
+	9, SUBGHZ_SCRIPT_SPIN, RADIO_SET_MODULATIONPARAMS, BE24(SX_BITRATE_DIV(BIT_RATE)), 0x00, RX_BANDWIDTH,
+		BE24(SX_CHANNEL(FREQ_DEVIATION)),
+	5, SUBGHZ_SCRIPT_SPIN, RADIO_SET_RFFREQUENCY, BE32(SX_CHANNEL(RF_FREQ)),
+	3, SUBGHZ_SCRIPT_SLEEP, RADIO_CALIBRATEIMAGE,
+		(uint8_t)((RF_FREQ - CAL_STEP) / CAL_STEP), (uint8_t)((RF_FREQ + CAL_STEP) / CAL_STEP),
+#if (RX_MODE == 1)
+	9, SUBGHZ_SCRIPT_SPIN, RADIO_CFG_DIOIRQ, BE16(SUBGHZ_IRQ_RXDONE | SUBGHZ_IRQ_ERROR),
+		BE16(SUBGHZ_IRQ_RXDONE | SUBGHZ_IRQ_ERROR), 0, 0, 0, 0,
+#endif
+};
+
+HAL_StatusTypeDef subghz_script_init(SUBGHZ_HandleTypeDef *hsubghz)
+{
+	// the image calibration is still running when this returns,
+	// the next radio access waits for it
+	return HAL_SUBGHZ_ExecScript(hsubghz, init_script, sizeof(init_script));
+}
+
 HAL_StatusTypeDef subghz_default_init(SUBGHZ_HandleTypeDef *hsubghz)
 {
 	HAL_StatusTypeDef result;
@@ -71,10 +113,17 @@ HAL_StatusTypeDef subghz_default_init(SUBGHZ_HandleTypeDef *hsubghz)
 		return result;
 	}
 
+	// the network address as both node and broadcast address, a bulk
+	// session moves the node address (bulk.h)
 	result = SetAddress(hsubghz, ADDRESS);
 	if(result != HAL_OK){
 		return result;
 	}
+	const uint8_t broadcast = ADDRESS;
+	result = HAL_SUBGHZ_WriteRegisters(hsubghz, BROADCAST_ADDRESS_REG, &broadcast, sizeof(broadcast));
+	if(result != HAL_OK){
+		return result;
+	}
 
 	result = DefaultCRC(hsubghz);
 	if(result != HAL_OK){
@@ -82,10 +131,10 @@ HAL_StatusTypeDef subghz_default_init(SUBGHZ_HandleTypeDef *hsubghz)
 	}
 
 #if (RX_MODE == 1)
-	uint8_t payload_len = 18;
+	uint8_t payload_len = RX_MAX_PAYLOAD_LEN;
 #endif
 #if (TX_MODE == 1)
-	uint8_t payload_len = 3;
+	uint8_t payload_len = TX_PAYLOAD_LEN;
 #endif
 
 
@@ -97,12 +146,10 @@ HAL_StatusTypeDef subghz_default_init(SUBGHZ_HandleTypeDef *hsubghz)
 		return result;
 	}
 
-#if (TX_MODE == 1)
 	result = DefaultTxConfig(hsubghz);
 	if(result != HAL_OK){
 		return result;
 	}
-#endif
 
 	result = DefaultModulationParams(hsubghz);
 	return result;
@@ -115,9 +162,16 @@ HAL_StatusTypeDef SetAddress(SUBGHZ_HandleTypeDef *hsubghz, uint8_t address)
 
 void subghz_radio_getstatus(void)
 {
-	uint8_t RadioResult = 0x00;
-	HAL_SUBGHZ_ExecGetCmd(&subghz_handle, RADIO_GET_STATUS, &RadioResult, 1);
-  	printf_("RR: 0x%02x\r\n", RadioResult);
+	SUBGHZ_RadioModeTypeDef RadioMode = SUBGHZ_RADIO_MODE_UNKNOWN;
+	const SUBGHZ_RadioShadowTypeDef *shadow = HAL_SUBGHZ_GetRadioShadow(&subghz_handle);
+	const SUBGHZ_RegCacheTypeDef *regs = HAL_SUBGHZ_GetRegCache(&subghz_handle);
+
+	// only goes to the radio when the state shadow can't tell
+	HAL_SUBGHZ_GetRadioMode(&subghz_handle, &RadioMode);
+  	printf_("mode: %u, saved: %u wakeup, %u status, %u cmd\r\n", RadioMode,
+		shadow->WakeupSkipped, shadow->StatusSkipped, shadow->CommandSkipped);
+	printf_("regs: %u hits, %u misses, %u SPI bytes saved\r\n",
+		regs->Hits, regs->Misses, regs->SavedBytes);
 }
 
 void subghz_radio_getRxBufferStatus(void)
@@ -185,10 +239,10 @@ HAL_StatusTypeDef SetPayloadLength(SUBGHZ_HandleTypeDef *hsubghz, uint8_t length
 	HAL_StatusTypeDef result;
 
 	struct sRadioParams params = {
-		.PbLength = 32,
-		.PbDetLength = 0x07,
+		.PbLength = __REV16(PREAMBLE_BITS),	// sent MSB first
+		.PbDetLength = PREAMBLE_DETECT,
 		.SyncWordLength = 32,
-		.AddrComp = 0x01,		// filter on node address
+		.AddrComp = 0x02,		// filter on node or broadcast address
 		.PktType = 1,
 		.PayloadLength = length,
 		.CrcType = 2,			// 2 byte CRC
@@ -200,49 +254,20 @@ HAL_StatusTypeDef SetPayloadLength(SUBGHZ_HandleTypeDef *hsubghz, uint8_t length
 	return result;
 }
 
+// a channel of the hop plan goes out as its precomputed word, any other
+// frequency is converted at the call; the image is calibrated only when
+// the frequency is in another 4 MHz band than the last one (fhss_radio.h)
 HAL_StatusTypeDef SetRfFrequency(SUBGHZ_HandleTypeDef *hsubghz, uint32_t frequency)
 {
-    uint8_t buf[4];
-    uint32_t chan = 0;
-	HAL_StatusTypeDef result;
-	const uint32_t freq_lower_limit = 902000000;
-	const uint32_t freq_upper_limit = 928000000;
+	(void)hsubghz;
 
-	if(frequency < freq_lower_limit){
-		frequency = freq_lower_limit;
-	}
-	if(frequency > freq_upper_limit){
-		frequency = freq_upper_limit;
+	if(frequency < FREQ_LOWER_LIMIT){
+		frequency = FREQ_LOWER_LIMIT;
 	}
-
-
-    SX_FREQ_TO_CHANNEL(chan, frequency);
-    buf[0] = ( uint8_t )( ( chan >> 24 ) & 0xFF );
-    buf[1] = ( uint8_t )( ( chan >> 16 ) & 0xFF );
-    buf[2] = ( uint8_t )( ( chan >> 8 ) & 0xFF );
-    buf[3] = ( uint8_t )( chan & 0xFF );
-
-    result = HAL_SUBGHZ_ExecSetCmd(hsubghz, RADIO_SET_RFFREQUENCY, buf, 4);
-	if(result != HAL_OK){
-		return result;
+	if(frequency > FREQ_UPPER_LIMIT){
+		frequency = FREQ_UPPER_LIMIT;
 	}
-
-	// calibrate after setting frequency
-	// calibrate for center frequency +/- 4 MHz
-
-	const uint32_t delta_freq = 4000000;
-
-	uint32_t upper_freq = frequency + delta_freq;
-	uint32_t lower_freq = frequency - delta_freq;
-
-	uint8_t cal_buf[2];
-
-	cal_buf[0] = (uint8_t)(lower_freq / 4000000);
-	cal_buf[1] = (uint8_t)(upper_freq / 4000000);
-
-	result = HAL_SUBGHZ_ExecSetCmd(hsubghz, RADIO_CALIBRATEIMAGE, cal_buf, 2);
-
-	return result;
+	return fhss_radio_tune(frequency);
 }
 
 static HAL_StatusTypeDef DefaultCRC(SUBGHZ_HandleTypeDef *hsubghz)
@@ -262,23 +287,14 @@ static HAL_StatusTypeDef DefaultCRC(SUBGHZ_HandleTypeDef *hsubghz)
 
 }
 
+// the network profile, the one every node listens on (phy.h)
 static HAL_StatusTypeDef DefaultModulationParams(SUBGHZ_HandleTypeDef *hsubghz)
 {
-    uint8_t buf[8] = {0};
-
-	uint32_t tempVal = ( uint32_t )(( 32 * XTAL_FREQ ) / BIT_RATE );
-	buf[0] = ( tempVal >> 16 ) & 0xFF;		// BR
-	buf[1] = ( tempVal >> 8 ) & 0xFF;		// BR
-	buf[2] = tempVal & 0xFF;				// BR
-	buf[3] = 0;					// modulation
-	buf[4] = 0x13;				// RX bandwidth
-	//calculate Fdev
-	SX_FREQ_TO_CHANNEL(tempVal, FREQ_DEVIATION);
-	buf[5] = ( tempVal >> 16 ) & 0xFF;		// FDev
-	buf[6] = ( tempVal >> 8 ) & 0xFF;		// FDev
-	buf[7] = ( tempVal& 0xFF );				// FDev
-
-	return(HAL_SUBGHZ_ExecSetCmd(hsubghz, RADIO_SET_MODULATIONPARAMS, buf, 8));
+	const phy_profile_t *profile = &phy_profiles[PHY_NETWORK];
+
+	// the HAL takes a non-const buffer but only reads it
+	return(HAL_SUBGHZ_ExecSetCmd(hsubghz, RADIO_SET_MODULATIONPARAMS, (uint8_t *)profile->modulation,
+		sizeof(profile->modulation)));
 }
 
 static HAL_StatusTypeDef DefaultTxConfig(SUBGHZ_HandleTypeDef *hsubghz)
@@ -287,7 +303,8 @@ static HAL_StatusTypeDef DefaultTxConfig(SUBGHZ_HandleTypeDef *hsubghz)
 
 	uint8_t buf[4] = {0};
 
-	// configures output power for +10 dBm
+	// configures output power for +10 dBm, TX_POWER_DEFAULT; frames set
+	// their own level from there (tx_power.h, trx_tx_begin())
 	buf[0] = 0x01;	// set PA duty cycle to 1
 	buf[1] = 0x00; 	// set HP PA output power to 0
 	buf[2] = 0x01;	// select the LP PA
@@ -296,7 +313,7 @@ static HAL_StatusTypeDef DefaultTxConfig(SUBGHZ_HandleTypeDef *hsubghz)
 	result = HAL_SUBGHZ_ExecSetCmd(hsubghz, RADIO_SET_PACONFIG, buf, 4);
 
 	// reuse buffer for next command
-	buf[0] = 0x0D;	// set output to +13 dBm (somehow turns into +10 dBm when you actually reach the output)
+	buf[0] = 0x0D;	// +13 dBm asked, +10 dBm out: the LP PA at its +10 dBm optimum (duty cycle 1) runs 3 dB under
 	buf[1] = 0x04;	// set the PA ramp up time to 200 us for no reason other than it's in the middle
 	
 	result = HAL_SUBGHZ_ExecSetCmd(hsubghz, RADIO_SET_TXPARAMS, buf, 2);
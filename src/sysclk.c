@@ -37,4 +37,6 @@ void SystemClock_Config(void)
 
   LL_RCC_GetSystemClocksFreq(&clk_struct);
   LL_Init1msTick(clk_struct.HCLK1_Frequency);
+  // keep SystemCoreClock in step, the time base converts against it
+  LL_SetSystemCoreClock(clk_struct.HCLK1_Frequency);
 }
\ No newline at end of file
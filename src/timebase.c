@@ -0,0 +1,75 @@
+// timebase.c -- DWT cycle counter time base and deadlines
+
+#include "timebase.h"
+
+#include "system_stm32wlxx.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+static volatile uint32_t tick_count = 0;
+
+void timebase_init(void)
+{
+	// already running, keep the count monotonic
+	if(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk){
+		return;
+	}
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+// conversions read SystemCoreClock every time so they follow clock changes
+uint32_t timebase_us_to_cycles(uint32_t us)
+{
+	return (uint32_t)(((uint64_t)us * SystemCoreClock) / 1000000U);
+}
+
+uint32_t timebase_cycles_to_us(uint32_t cycles)
+{
+	return (uint32_t)(((uint64_t)cycles * 1000000U) / SystemCoreClock);
+}
+
+deadline_t deadline_from_us(uint32_t us)
+{
+	deadline_t deadline = {
+		.start = timebase_now(),
+		.length = timebase_us_to_cycles(us)
+	};
+	return deadline;
+}
+
+deadline_t deadline_from_ms(uint32_t ms)
+{
+	deadline_t deadline = {
+		.start = timebase_now(),
+		.length = ms * (SystemCoreClock / 1000U)
+	};
+	return deadline;
+}
+
+// SysTick is already running at 1 kHz for LL_mDelay, enabling its interrupt
+// gives sleeping waits a periodic wakeup to check their timeout against
+void timebase_tick_wakeup(bool enable)
+{
+	if(enable){
+		SysTick->CTRL |= SysTick_CTRL_TICKINT_Msk;
+	}
+	else{
+		SysTick->CTRL &= ~SysTick_CTRL_TICKINT_Msk;
+	}
+}
+
+// milliseconds counted while the SysTick wakeup is enabled
+uint32_t timebase_ticks(void)
+{
+	return tick_count;
+}
+
+void SysTick_Handler(void)
+{
+	tick_count++;
+}
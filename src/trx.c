@@ -0,0 +1,326 @@
+// trx.c -- RX/TX turnaround through the FS or STANDBY_HSE32 fallback
+
+#include "trx.h"
+#include "subghz.h"
+#include "subghz_support.h"
+#include "tx_power.h"
+#include "phy.h"
+
+#include "stm32wlxx_hal_subghz.h"
+#include "mprintf.h"
+#include "timebase.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+// RADIO_SET_RX timeouts count 15.625 us (125/8 us) steps, 0xFFFFFF is
+// continuous RX
+#define RX_TIMEOUT_MAX				0xFFFFFEU
+#define RX_TIMEOUT_MAX_US			((RX_TIMEOUT_MAX / 8U) * 125U)
+
+static SUBGHZ_HandleTypeDef *radio;
+static trx_fallback_t fallback;
+static trx_rx_fn resume_rx;
+static uint32_t reply_window;		// TRX_REPLY_WINDOW_US in cycles
+
+// payload length in the radio's PACKETPARAMS, 0 until written
+static uint8_t packet_len;
+// tx_power level in PACONFIG and TXPARAMS, TX_POWER_LEVELS until written
+static uint8_t power_level;
+// phy profile in MODULATIONPARAMS, and the one receivers are re-armed on
+static uint8_t profile_now;
+static uint8_t rx_profile;
+
+// last RXDONE, written by the radio ISR
+static volatile uint32_t rx_end_cycles;
+static volatile bool rx_end_valid;
+
+static trx_stats_t stats = { .rx_to_tx_min = UINT32_MAX, .tx_to_rx_min = UINT32_MAX };
+
+// resume_rx NULL: the radio stays in the fallback mode with the TX path
+// switched in after TX, for a transmit-only image
+HAL_StatusTypeDef trx_init(SUBGHZ_HandleTypeDef *hsubghz, trx_fallback_t new_fallback, trx_rx_fn resume)
+{
+	radio = hsubghz;
+	resume_rx = resume;
+	reply_window = timebase_us_to_cycles(TRX_REPLY_WINDOW_US);
+	packet_len = 0;
+	power_level = TX_POWER_LEVELS;
+	// the boot configuration (subghz_support.c)
+	profile_now = PHY_NETWORK;
+	rx_profile = PHY_NETWORK;
+
+	return trx_set_fallback(new_fallback);
+}
+
+// the receiver re-armed after TX from now on, the one replaced is
+// returned to be put back. a single store the ISR sees whole
+trx_rx_fn trx_set_resume(trx_rx_fn resume)
+{
+	trx_rx_fn previous = resume_rx;
+
+	resume_rx = resume;
+	return previous;
+}
+
+HAL_StatusTypeDef trx_set_fallback(trx_fallback_t new_fallback)
+{
+	uint8_t mode = (uint8_t)new_fallback;
+	HAL_StatusTypeDef result;
+
+	result = HAL_SUBGHZ_ExecSetCmd(radio, RADIO_SET_TXFALLBACKMODE, &mode, 1);
+	if(result == HAL_OK){
+		fallback = new_fallback;
+	}
+	return result;
+}
+
+trx_fallback_t trx_fallback(void)
+{
+	return fallback;
+}
+
+// PACKETPARAMS carries the TX length and the longest RX payload accepted,
+// it is only rewritten when the length changes
+HAL_StatusTypeDef trx_packet_length(uint8_t len)
+{
+	HAL_StatusTypeDef result;
+
+	if(len == packet_len){
+		return HAL_OK;
+	}
+	result = SetPayloadLength(radio, len);
+	if(result != HAL_OK){
+		packet_len = 0;
+		return result;
+	}
+	packet_len = len;
+	stats.length_writes++;
+	return HAL_OK;
+}
+
+static bool trx_bytes_differ(const uint8_t *a, const uint8_t *b, uint32_t len)
+{
+	uint32_t i;
+
+	for(i = 0; i < len; i++){
+		if(a[i] != b[i]){
+			return true;
+		}
+	}
+	return false;
+}
+
+// PACONFIG when the PA configuration changes, TXPARAMS when the power
+// does: a step between two LP levels at the +10 dBm optimum is 2 bytes.
+// the HAL only reads the bytes of the level table it is given
+static HAL_StatusTypeDef trx_tx_power(uint8_t level)
+{
+	const tx_power_level_t *next = &tx_power_levels[level];
+	const tx_power_level_t *prev = (power_level < TX_POWER_LEVELS) ? &tx_power_levels[power_level] : NULL;
+	HAL_StatusTypeDef result;
+
+	if(level == power_level){
+		return HAL_OK;
+	}
+	power_level = TX_POWER_LEVELS;
+	if((prev == NULL) || trx_bytes_differ(prev->pa_config, next->pa_config, sizeof(next->pa_config))){
+		result = HAL_SUBGHZ_ExecSetCmd(radio, RADIO_SET_PACONFIG, (uint8_t *)next->pa_config, sizeof(next->pa_config));
+		if(result != HAL_OK){
+			return result;
+		}
+		stats.pa_writes++;
+	}
+	if((prev == NULL) || trx_bytes_differ(prev->tx_params, next->tx_params, sizeof(next->tx_params))){
+		result = HAL_SUBGHZ_ExecSetCmd(radio, RADIO_SET_TXPARAMS, (uint8_t *)next->tx_params, sizeof(next->tx_params));
+		if(result != HAL_OK){
+			return result;
+		}
+		stats.power_writes++;
+	}
+	power_level = level;
+	return HAL_OK;
+}
+
+// one MODULATIONPARAMS: bit rate, RX bandwidth and deviation together
+static HAL_StatusTypeDef trx_profile(uint8_t profile)
+{
+	const phy_profile_t *next = &phy_profiles[profile];
+	HAL_StatusTypeDef result;
+
+	if(profile == profile_now){
+		return HAL_OK;
+	}
+	// the HAL only reads the bytes of the profile table it is given
+	result = HAL_SUBGHZ_ExecSetCmd(radio, RADIO_SET_MODULATIONPARAMS, (uint8_t *)next->modulation,
+		sizeof(next->modulation));
+	if(result != HAL_OK){
+		return result;
+	}
+	profile_now = profile;
+	stats.profile_writes++;
+	return HAL_OK;
+}
+
+// the profile receivers are re-armed on, from the next trx_tx_idle()
+HAL_StatusTypeDef trx_set_rx_profile(uint8_t profile)
+{
+	if(profile >= PHY_PROFILES){
+		return HAL_ERROR;
+	}
+	rx_profile = profile;
+	return HAL_OK;
+}
+
+// before a TX: out of RX through FS, the frame's power level and
+// profile, then the TX path of its PA switched in while the buffer write
+// is still to come
+HAL_StatusTypeDef trx_tx_begin(uint8_t power, uint8_t profile)
+{
+	SUBGHZ_RadioModeTypeDef mode;
+	HAL_StatusTypeDef result;
+
+	result = HAL_SUBGHZ_GetRadioMode(radio, &mode);
+	if(result != HAL_OK){
+		return result;
+	}
+	if((mode == SUBGHZ_RADIO_MODE_RX) || (mode == SUBGHZ_RADIO_MODE_RX_DUTYCYCLE)){
+		result = HAL_SUBGHZ_ExecSetCmd(radio, RADIO_SET_FS, NULL, 0);
+		if(result != HAL_OK){
+			return result;
+		}
+		stats.rx_exits++;
+	}
+	if(power >= TX_POWER_LEVELS){
+		power = TX_POWER_DEFAULT;
+	}
+	result = trx_tx_power(power);
+	if(result != HAL_OK){
+		return result;
+	}
+	if(profile >= PHY_PROFILES){
+		profile = PHY_NETWORK;
+	}
+	result = trx_profile(profile);
+	if(result != HAL_OK){
+		return result;
+	}
+	ConfigRFSwitch(tx_power_levels[power].hp ? RADIO_SWITCH_RFO_HP : RADIO_SWITCH_RFO_LP);
+	return HAL_OK;
+}
+
+// SET_TX sent: an answer to the last frame received if it came soon enough
+void trx_tx_started(void)
+{
+	uint32_t cycles;
+
+	if(!rx_end_valid){
+		return;
+	}
+	rx_end_valid = false;
+
+	cycles = timebase_now() - rx_end_cycles;
+	if(cycles > reply_window){
+		return;
+	}
+	stats.replies++;
+	stats.rx_to_tx_last = cycles;
+	if(cycles < stats.rx_to_tx_min){
+		stats.rx_to_tx_min = cycles;
+	}
+	if(cycles > stats.rx_to_tx_max){
+		stats.rx_to_tx_max = cycles;
+	}
+}
+
+// the receiver re-armed on its profile, from the fallback mode or
+// standby. nothing to do for a transmit-only image
+HAL_StatusTypeDef trx_rx_resume(void)
+{
+	if(resume_rx == NULL){
+		return HAL_OK;
+	}
+	ConfigRFSwitch(RADIO_SWITCH_RX);
+	if((trx_profile(rx_profile) != HAL_OK) || (trx_packet_length(RX_MAX_PAYLOAD_LEN) != HAL_OK)){
+		return HAL_ERROR;
+	}
+	return resume_rx();
+}
+
+// interrupt side, nothing left to send: back to RX from the fallback mode
+void trx_tx_idle(uint32_t irq_cycles)
+{
+	uint32_t cycles;
+
+	if((resume_rx == NULL) || (trx_rx_resume() != HAL_OK)){
+		return;
+	}
+	cycles = timebase_now() - irq_cycles;
+	stats.resumes++;
+	stats.tx_to_rx_last = cycles;
+	if(cycles < stats.tx_to_rx_min){
+		stats.tx_to_rx_min = cycles;
+	}
+	if(cycles > stats.tx_to_rx_max){
+		stats.tx_to_rx_max = cycles;
+	}
+}
+
+// interrupt side, after TXDONE: a single RX for the answer that ends on
+// its own, in RXDONE, a CRC error or the RX/TX timeout IRQ. the radio
+// stops the timer on the sync word, so timeout_us only has to reach the
+// start of the answer
+HAL_StatusTypeDef trx_rx_window(uint32_t timeout_us)
+{
+	uint32_t steps;
+	uint8_t buf[3];
+	HAL_StatusTypeDef result;
+
+	if(timeout_us > RX_TIMEOUT_MAX_US){
+		timeout_us = RX_TIMEOUT_MAX_US;
+	}
+	steps = (timeout_us * 8U + 124U) / 125U;
+	ConfigRFSwitch(RADIO_SWITCH_RX);
+	result = trx_packet_length(RX_MAX_PAYLOAD_LEN);
+	if(result != HAL_OK){
+		return result;
+	}
+	buf[0] = (uint8_t)(steps >> 16);
+	buf[1] = (uint8_t)(steps >> 8);
+	buf[2] = (uint8_t)steps;
+	result = HAL_SUBGHZ_ExecSetCmd(radio, RADIO_SET_RX, buf, 3);
+	if(result == HAL_OK){
+		stats.windows++;
+	}
+	return result;
+}
+
+// interrupt side, from RXDONE
+void trx_rx_end(uint32_t irq_cycles)
+{
+	rx_end_cycles = irq_cycles;
+	rx_end_valid = true;
+}
+
+const trx_stats_t *trx_get_stats(void)
+{
+	return &stats;
+}
+
+void trx_print_stats(void)
+{
+	printf_("trx: fallback %s, %u replies, RXDONE to SET_TX %u us last, %u min, %u max\r\n",
+		(fallback == TRX_FALLBACK_FS) ? "FS" : (fallback == TRX_FALLBACK_STANDBY_HSE32) ? "STANDBY_HSE32" : "STANDBY_RC",
+		stats.replies, timebase_cycles_to_us(stats.rx_to_tx_last),
+		(stats.rx_to_tx_min != UINT32_MAX) ? timebase_cycles_to_us(stats.rx_to_tx_min) : 0,
+		timebase_cycles_to_us(stats.rx_to_tx_max));
+	printf_("trx: %u RX resumes, TXDONE to RX %u us last, %u min, %u max, %u RX exits, %u reply windows, %u length writes\r\n",
+		stats.resumes, timebase_cycles_to_us(stats.tx_to_rx_last),
+		(stats.tx_to_rx_min != UINT32_MAX) ? timebase_cycles_to_us(stats.tx_to_rx_min) : 0,
+		timebase_cycles_to_us(stats.tx_to_rx_max), stats.rx_exits, stats.windows, stats.length_writes);
+	printf_("trx: %u PA configurations, %u power writes, %+d dBm last, %u profile writes, %u bps now, %u bps RX\r\n",
+		stats.pa_writes, stats.power_writes, (power_level < TX_POWER_LEVELS) ? tx_power_levels[power_level].dbm : 0,
+		stats.profile_writes, phy_profiles[profile_now].bit_rate, phy_profiles[rx_profile].bit_rate);
+}
@@ -0,0 +1,209 @@
+// tx_power.c -- per-peer transmit power and data rate from the RSSI the peer reports
+
+#include "tx_power.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+// PA ramp 200 us throughout, PACONFIG settings from the optimal ones for
+// the STM32WL's LP and HP PAs
+#define LP_10						{ 0x01, 0x00, 0x01, 0x01 }
+#define RAMP						0x04
+
+const tx_power_level_t tx_power_levels[TX_POWER_LEVELS] = {
+	{ -13, false, LP_10, { (uint8_t)-10, RAMP } },
+	{  -9, false, LP_10, { (uint8_t)-6, RAMP } },
+	{  -5, false, LP_10, { (uint8_t)-2, RAMP } },
+	{  -1, false, LP_10, { 0x02, RAMP } },
+	{   3, false, LP_10, { 0x06, RAMP } },
+	{   7, false, LP_10, { 0x0A, RAMP } },
+	{  10, false, LP_10, { 0x0D, RAMP } },
+	{  14, false, { 0x04, 0x00, 0x01, 0x01 }, { 0x0E, RAMP } },
+	{  15, false, { 0x07, 0x00, 0x01, 0x01 }, { 0x0E, RAMP } },
+	{  17, true,  { 0x02, 0x03, 0x00, 0x01 }, { 0x16, RAMP } },
+	{  20, true,  { 0x03, 0x05, 0x00, 0x01 }, { 0x16, RAMP } },
+	{  22, true,  { 0x04, 0x07, 0x00, 0x01 }, { 0x16, RAMP } },
+};
+
+void tx_power_init(tx_power_t *power)
+{
+	uint32_t i;
+
+	power->untracked = 0;
+	power->reports = 0;
+	power->raised = 0;
+	power->lowered = 0;
+	power->faster = 0;
+	power->slower = 0;
+	for(i = 0; i < TX_POWER_PEERS; i++){
+		power->peers[i] = (tx_power_peer_t){ .level = TX_POWER_DEFAULT, .profile = PHY_NETWORK };
+	}
+}
+
+// peer is the node table entry number, an index and no search
+const tx_power_peer_t *tx_power_peer(const tx_power_t *power, uint32_t peer)
+{
+	return (peer < TX_POWER_PEERS) ? &power->peers[peer] : NULL;
+}
+
+uint8_t tx_power_level(const tx_power_t *power, uint32_t peer)
+{
+	return (peer < TX_POWER_PEERS) ? power->peers[peer].level : TX_POWER_DEFAULT;
+}
+
+uint8_t tx_power_profile(const tx_power_t *power, uint32_t peer)
+{
+	return (peer < TX_POWER_PEERS) ? power->peers[peer].profile : PHY_NETWORK;
+}
+
+// how strong the peer should hear frames at profile, and at PHY_NETWORK
+int32_t tx_power_target_dbm(uint8_t profile)
+{
+	int32_t sensitivity = phy_profiles[profile].sensitivity;
+
+	if(sensitivity < phy_profiles[PHY_NETWORK].sensitivity){
+		sensitivity = phy_profiles[PHY_NETWORK].sensitivity;
+	}
+	return sensitivity + TX_POWER_MARGIN_DB;
+}
+
+// the lowest level reaching dbm, the highest if none does
+uint8_t tx_power_pick(int32_t dbm)
+{
+	uint8_t level;
+
+	for(level = 0; level < TX_POWER_MAX; level++){
+		if(tx_power_levels[level].dbm >= dbm){
+			break;
+		}
+	}
+	return level;
+}
+
+static tx_power_peer_t *tx_power_track(tx_power_t *power, uint32_t peer)
+{
+	if(peer >= TX_POWER_PEERS){
+		power->untracked++;
+		return NULL;
+	}
+	return &power->peers[peer];
+}
+
+static void tx_power_set(tx_power_t *power, tx_power_peer_t *p, uint8_t level)
+{
+	if(level > p->level){
+		power->raised++;
+	}
+	else if(level < p->level){
+		power->lowered++;
+	}
+	p->level = level;
+}
+
+static void tx_power_set_profile(tx_power_t *power, tx_power_peer_t *p, uint8_t profile)
+{
+	if(profile > p->profile){
+		power->faster++;
+	}
+	else if(profile < p->profile){
+		power->slower++;
+	}
+	p->profile = profile;
+}
+
+// the top level over a path loss of loss dB, against what the peer
+// needs to hear a profile TX_POWER_ADR_MARGIN_DB over its sensitivity
+// with TX_POWER_ADR_HEADROOM_DB to spare
+static bool tx_power_reaches(uint8_t profile, int32_t loss)
+{
+	return phy_profiles[profile].sensitivity + TX_POWER_ADR_MARGIN_DB + loss <=
+		tx_power_levels[TX_POWER_MAX].dbm - TX_POWER_ADR_HEADROOM_DB;
+}
+
+// reports only move the peer to a faster profile. a slower one follows
+// from the frames lost on the profile (tx_power_miss()), never from the
+// margin alone: the ARQ gets frames through well under it
+static void tx_power_adapt(tx_power_t *power, tx_power_peer_t *p, int32_t loss)
+{
+	uint8_t fit;
+
+	for(fit = PHY_PROFILES - 1U; fit > p->profile; fit--){
+		if(tx_power_reaches(fit, loss)){
+			tx_power_set_profile(power, p, fit);
+			p->miss_rate = 0;
+			return;
+		}
+	}
+}
+
+// rssi: how strong the peer heard our last frame, sent at the peer's level
+void tx_power_feedback(tx_power_t *power, uint32_t peer, int8_t rssi)
+{
+	tx_power_peer_t *p = tx_power_track(power, peer);
+	int32_t excess;
+	int32_t dbm;
+	int32_t loss;
+
+	if(p == NULL){
+		return;
+	}
+	dbm = tx_power_levels[p->level].dbm;
+	loss = (dbm - rssi) * 8;
+	if(!p->reported){
+		p->loss = (int16_t)loss;
+	}
+	else{
+		p->loss = (int16_t)(p->loss + ((loss - p->loss) >> TX_POWER_LOSS_SHIFT));
+	}
+	p->rssi = rssi;
+	p->reported = true;
+	p->misses = 0;
+	p->miss_rate = (uint8_t)(p->miss_rate - (p->miss_rate >> TX_POWER_MISS_SHIFT));
+	power->reports++;
+
+	tx_power_adapt(power, p, (p->loss + 4) >> 3);
+	excess = (int32_t)rssi - tx_power_target_dbm(p->profile);
+	if(excess > TX_POWER_HYSTERESIS_DB){
+		tx_power_set(power, p, tx_power_pick(dbm - ((excess < TX_POWER_MAX_STEP_DOWN_DB) ? excess : TX_POWER_MAX_STEP_DOWN_DB)));
+	}
+	else if(excess < -TX_POWER_HYSTERESIS_DB){
+		tx_power_set(power, p, tx_power_pick(dbm - excess));
+	}
+}
+
+// a frame to peer on profile went unanswered, which a weak link looks
+// like; one on a faster profile than the peer's says nothing of its own.
+// the misses at a lower level are the lower level's, raising the power
+// forgets them. at the top level the profile comes down once what it
+// delivers, its bit rate less the share lost, is under the bit rate of
+// the next slower one
+void tx_power_miss(tx_power_t *power, uint32_t peer, uint8_t profile)
+{
+	tx_power_peer_t *p = tx_power_track(power, peer);
+	uint32_t delivered;
+
+	if(p == NULL){
+		return;
+	}
+	if(profile <= p->profile){
+		p->miss_rate = (uint8_t)(p->miss_rate + ((255U - p->miss_rate) >> TX_POWER_MISS_SHIFT));
+	}
+	if(++p->misses >= TX_POWER_MISSES){
+		p->misses = 0;
+		if(p->level < TX_POWER_MAX){
+			p->miss_rate = 0;
+			tx_power_set(power, p, (uint8_t)(p->level + 1U));
+			return;
+		}
+	}
+	if((p->level < TX_POWER_MAX) || (p->profile == 0)){
+		return;
+	}
+	delivered = phy_profiles[p->profile].bit_rate * (256U - p->miss_rate);
+	if(delivered < phy_profiles[p->profile - 1U].bit_rate * 256U){
+		p->miss_rate = 0;
+		tx_power_set_profile(power, p, (uint8_t)(p->profile - 1U));
+	}
+}
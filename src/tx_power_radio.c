@@ -0,0 +1,79 @@
+// tx_power_radio.c -- per-peer power levels for the frames this node sends
+
+#include "tx_power_radio.h"
+#include "tx_power.h"
+#include "node_table.h"
+
+#include "mprintf.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+static tx_power_t power;
+
+// a peer's state is at its node table entry; one heard only through its
+// ACKs and SACKs, which stop before the node table, takes its entry here
+static uint32_t tx_power_radio_peer(uint16_t peer, bool create)
+{
+	return node_table_number(node_table_lookup(peer, create));
+}
+
+void tx_power_radio_init(void)
+{
+	tx_power_init(&power);
+}
+
+uint8_t tx_power_radio_level(uint16_t peer)
+{
+	return tx_power_level(&power, tx_power_radio_peer(peer, false));
+}
+
+uint8_t tx_power_radio_profile(uint16_t peer)
+{
+	return tx_power_profile(&power, tx_power_radio_peer(peer, false));
+}
+
+void tx_power_radio_feedback(uint16_t peer, int8_t rssi)
+{
+	tx_power_feedback(&power, tx_power_radio_peer(peer, true), rssi);
+}
+
+void tx_power_radio_miss(uint16_t peer, uint8_t profile)
+{
+	tx_power_miss(&power, tx_power_radio_peer(peer, true), profile);
+}
+
+void tx_power_radio_print_stats(void)
+{
+	uint32_t levels[TX_POWER_LEVELS] = {0};
+	uint32_t profiles[PHY_PROFILES] = {0};
+	uint32_t reported = 0;
+	uint32_t count = node_table_count();
+	const tx_power_peer_t *p;
+	uint32_t i;
+
+	for(i = 0; i < count; i++){
+		p = tx_power_peer(&power, i);
+		if(p->reported){
+			reported++;
+			levels[p->level]++;
+			profiles[p->profile]++;
+		}
+	}
+	printf_("power: %u of %u peers reported, %u untracked, %+d dBm and %u bps to others\r\n", reported, count,
+		power.untracked, tx_power_levels[TX_POWER_DEFAULT].dbm, phy_profiles[PHY_NETWORK].bit_rate);
+	printf_("power: %u reports, %u raised, %u lowered, %u times faster, %u slower\r\n",
+		power.reports, power.raised, power.lowered, power.faster, power.slower);
+	for(i = 0; i < TX_POWER_LEVELS; i++){
+		if(levels[i] != 0){
+			printf_("power: %u peers at %+d dBm on the %s PA\r\n", levels[i], tx_power_levels[i].dbm,
+				tx_power_levels[i].hp ? "HP" : "LP");
+		}
+	}
+	for(i = 0; i < PHY_PROFILES; i++){
+		if(profiles[i] != 0){
+			printf_("power: %u peers take bulk at %u bps\r\n", profiles[i], phy_profiles[i].bit_rate);
+		}
+	}
+}
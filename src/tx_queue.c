@@ -0,0 +1,400 @@
+// tx_queue.c -- back to back transmission, the next frame started from TXDONE
+
+#include "tx_queue.h"
+#include "trx.h"
+#include "fhss_radio.h"
+#include "subghz.h"
+#include "subghz_support.h"
+#include "spsc_ring.h"
+#include "tx_power.h"
+#include "phy.h"
+
+#include "stm32wlxx_hal_subghz.h"
+#include "mprintf.h"
+#include "timebase.h"
+#include "hwtime.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+#define TX_BASE_ADDRESS				0x80
+
+// RADIO_SET_TX timeouts count 15.625 us steps
+#define TX_STEPS_PER_MS				64
+
+static SUBGHZ_HandleTypeDef *radio;
+
+static tx_frame_t frames[TX_QUEUE_DEPTH];
+static tx_frame_t *free_frames[TX_QUEUE_DEPTH];	// main loop only
+static uint32_t free_count;
+
+// queued frames, from the main loop to the radio ISR, and finished
+// frames back to the main loop
+static spsc_ring_t pending;
+static spsc_ring_t finished;
+
+// on air, written by whichever side starts a TX: the ISR while one is
+// in flight, the main loop only when none is
+static tx_frame_t *volatile active;
+// the frame on air is through and its reply window open, radio ISR only
+static bool window;
+// taken from the queue but too long for what is left of the dwell, goes
+// first after the hop. same rule as active
+static tx_frame_t *held;
+
+// the frame on air is still going into the radio buffer through the DMA
+static volatile bool writing;
+// TXDONE the next frame is started from, for the turnaround
+static uint32_t turnaround_start;
+static bool turnaround_valid;
+
+static uint32_t start_spi;			// SPI byte count before the frame on air was started
+static uint32_t started_spi;		// SPI byte count once the frame on air was started
+
+static tx_queue_stats_t stats = { .turnaround_min = UINT32_MAX };
+static uint32_t last_print_us;
+static uint32_t last_print_sent;
+static uint32_t last_print_airtime;
+
+uint32_t tx_queue_airtime_us(const tx_frame_t *frame)
+{
+	return phy_airtime_us(frame->profile, frame->len);
+}
+
+HAL_StatusTypeDef tx_queue_init(SUBGHZ_HandleTypeDef *hsubghz)
+{
+	uint32_t i;
+
+	radio = hsubghz;
+	for(i = 0; i < TX_QUEUE_DEPTH; i++){
+		free_frames[i] = &frames[i];
+	}
+	free_count = TX_QUEUE_DEPTH;
+	last_print_us = hwtime_now_us();
+
+	// added to whatever the receiver already routes to the CPU, reply
+	// windows end in RXDONE or a CRC error when they don't time out
+	return SUBGHZ_Radio_Set_IRQ(radio, radio->Radio.IrqMask | SUBGHZ_IRQ_TXDONE | SUBGHZ_IRQ_RX_TX_TIMEOUT |
+		SUBGHZ_IRQ_RXDONE | SUBGHZ_IRQ_ERROR);
+}
+
+// a free frame for the caller to fill, NULL while all are queued or unreported
+tx_frame_t *tx_queue_alloc(void)
+{
+	tx_frame_t *frame;
+
+	if(free_count == 0){
+		return NULL;
+	}
+	frame = free_frames[--free_count];
+	frame->reply_us = 0;
+	frame->power = TX_POWER_DEFAULT;
+	frame->profile = PHY_NETWORK;
+	return frame;
+}
+
+// SET_TX once the frame is in the radio buffer, with a timeout from the
+// time on air
+static HAL_StatusTypeDef tx_queue_set_tx(tx_frame_t *frame)
+{
+	uint32_t timeout;
+	uint32_t turnaround;
+	uint8_t buf[3];
+	HAL_StatusTypeDef result;
+
+	timeout = ((2U * tx_queue_airtime_us(frame) + TX_TIMEOUT_MARGIN_US) * TX_STEPS_PER_MS) / 1000U;
+	buf[0] = (uint8_t)(timeout >> 16);
+	buf[1] = (uint8_t)(timeout >> 8);
+	buf[2] = (uint8_t)timeout;
+	result = HAL_SUBGHZ_ExecSetCmd(radio, RADIO_SET_TX, buf, 3);
+	if(result == HAL_OK){
+		trx_tx_started();
+	}
+
+	// back to back: from the TXDONE of the frame before
+	if(turnaround_valid){
+		turnaround_valid = false;
+		turnaround = timebase_now() - turnaround_start;
+		stats.turnaround_last = turnaround;
+		if(turnaround < stats.turnaround_min){
+			stats.turnaround_min = turnaround;
+		}
+		if(turnaround > stats.turnaround_max){
+			stats.turnaround_max = turnaround;
+		}
+	}
+
+	started_spi = HAL_SUBGHZ_GetSpiBytes(radio);
+	stats.spi_start_bytes += started_spi - start_spi;
+	return result;
+}
+
+// one buffer write and one SET_TX. the 9-byte PACKETPARAMS only goes
+// out when the length changes, an RX in progress is left through FS
+// first. a long payload goes through the DMA and SET_TX follows from
+// HAL_SUBGHZ_WriteBufferCpltCallback()
+static HAL_StatusTypeDef tx_queue_start(tx_frame_t *frame)
+{
+	HAL_StatusTypeDef result;
+
+	start_spi = HAL_SUBGHZ_GetSpiBytes(radio);
+	if(frame->profile >= PHY_PROFILES){
+		frame->profile = PHY_NETWORK;
+	}
+	result = trx_tx_begin(frame->power, frame->profile);
+	if(result != HAL_OK){
+		return result;
+	}
+	result = trx_packet_length(frame->len);
+	if(result != HAL_OK){
+		return result;
+	}
+	active = frame;
+	if(frame->len >= SUBGHZ_DMA_MIN_LEN){
+		writing = true;
+		result = HAL_SUBGHZ_WriteBuffer_DMA(radio, TX_BASE_ADDRESS, frame->payload, frame->len);
+		if(result == HAL_OK){
+			stats.dma_writes++;
+			return HAL_OK;
+		}
+		writing = false;
+	}
+	result = HAL_SUBGHZ_WriteBuffer(radio, TX_BASE_ADDRESS, frame->payload, frame->len);
+	if(result != HAL_OK){
+		return result;
+	}
+	return tx_queue_set_tx(frame);
+}
+
+// starts the oldest queued frame, those the radio refuses are finished
+// as failed. leaves active NULL when nothing could be started, or the
+// frame has to wait for the next dwell
+static void tx_queue_next(void)
+{
+	tx_frame_t *frame;
+
+	while(((frame = held) != NULL) || ((frame = spsc_ring_pop(&pending)) != NULL)){
+		// no frame crosses the end of a dwell (fhss_radio.h)
+		if(!fhss_radio_tx_allowed(frame->payload, tx_queue_airtime_us(frame))){
+			if(held == NULL){
+				stats.held++;
+			}
+			held = frame;
+			break;
+		}
+		held = NULL;
+		if(tx_queue_start(frame) == HAL_OK){
+			return;
+		}
+		frame->result = TX_FAILED;
+		spsc_ring_push(&finished, frame);
+	}
+	active = NULL;
+}
+
+HAL_StatusTypeDef tx_queue_submit(tx_frame_t *frame, tx_done_fn done, void *ctx)
+{
+	if(frame->len == 0){
+		free_frames[free_count++] = frame;
+		return HAL_ERROR;
+	}
+	frame->done = done;
+	frame->ctx = ctx;
+	if(!spsc_ring_push(&pending, frame)){
+		free_frames[free_count++] = frame;
+		return HAL_BUSY;
+	}
+	stats.queued++;
+
+	// an idle radio has no TXDONE coming to start it
+	if(active == NULL){
+		tx_queue_next();
+	}
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef tx_queue_send(const uint8_t *payload, uint8_t len, tx_done_fn done, void *ctx)
+{
+	tx_frame_t *frame = tx_queue_alloc();
+	uint32_t i;
+
+	if(frame == NULL){
+		stats.refused++;
+		return HAL_BUSY;
+	}
+	for(i = 0; i < len; i++){
+		frame->payload[i] = payload[i];
+	}
+	frame->len = len;
+	return tx_queue_submit(frame, done, ctx);
+}
+
+// interrupt side: the frame on air is over, or its reply window, the next
+// goes out at once
+static void tx_queue_finish(SUBGHZ_HandleTypeDef *hsubghz, tx_result_t result)
+{
+	tx_frame_t *frame = active;
+
+	if(frame == NULL){
+		return;
+	}
+	if(!window){
+		// GET_IRQSTATUS and CLR_IRQSTATUS, the rest of the packet's SPI cost
+		stats.spi_irq_bytes += HAL_SUBGHZ_GetSpiBytes(hsubghz) - started_spi;
+		subghz_decode_record(&frame->rec, RADIO_EVENT_TX, hsubghz->IrqCycles, NULL);
+
+		// a window that can't be opened ends as a plain TXDONE
+		if((result == TX_DONE) && (frame->reply_us != 0) && (trx_rx_window(frame->reply_us) == HAL_OK)){
+			window = true;
+			return;
+		}
+	}
+	window = false;
+	frame->result = result;
+	spsc_ring_push(&finished, frame);
+
+	turnaround_start = hsubghz->IrqCycles;
+	turnaround_valid = true;
+	tx_queue_next();
+
+	if(active == NULL){
+		turnaround_valid = false;
+		trx_tx_idle(hsubghz->IrqCycles);
+	}
+}
+
+// DMA interrupt: the frame on air is in the radio buffer. a SET_TX the
+// radio refuses fails the frame as a refused start would
+void HAL_SUBGHZ_WriteBufferCpltCallback(SUBGHZ_HandleTypeDef *hsubghz)
+{
+	tx_frame_t *frame = active;
+
+	if(!writing || (frame == NULL)){
+		return;
+	}
+	writing = false;
+	if(!(hsubghz->ErrorCode & HAL_SUBGHZ_ERROR_DMA) && (tx_queue_set_tx(frame) == HAL_OK)){
+		return;
+	}
+	hsubghz->ErrorCode &= ~HAL_SUBGHZ_ERROR_DMA;
+	frame->result = TX_FAILED;
+	spsc_ring_push(&finished, frame);
+	tx_queue_next();
+	if(active == NULL){
+		turnaround_valid = false;
+		trx_tx_idle(timebase_now());
+	}
+}
+
+void HAL_SUBGHZ_TxCpltCallback(SUBGHZ_HandleTypeDef *hsubghz)
+{
+	tx_queue_finish(hsubghz, TX_DONE);
+}
+
+void HAL_SUBGHZ_RxTxTimeoutCallback(SUBGHZ_HandleTypeDef *hsubghz)
+{
+	tx_queue_finish(hsubghz, window ? TX_NO_REPLY : TX_TIMEOUT);
+}
+
+// interrupt side, from RXDONE and CRC errors: the end of a reply window,
+// if one is open
+void tx_queue_rx_end(SUBGHZ_HandleTypeDef *hsubghz)
+{
+	if(window){
+		tx_queue_finish(hsubghz, TX_REPLIED);
+	}
+}
+
+// main loop side: report finished frames and restart an idle queue.
+// returns the frames reported
+uint32_t tx_queue_poll(void)
+{
+	tx_frame_t *frame;
+	uint32_t count = 0;
+
+	// a TXDONE deferred while the HAL was busy is served here
+	HAL_SUBGHZ_ResumeIRQ(radio);
+
+	while((frame = spsc_ring_pop(&finished)) != NULL){
+		switch(frame->result)
+		{
+			case TX_REPLIED:
+				stats.replied++;
+				stats.sent++;
+				stats.airtime_us += tx_queue_airtime_us(frame);
+				break;
+			case TX_NO_REPLY:
+				stats.no_reply++;
+				// fall through
+			case TX_DONE:
+				stats.sent++;
+				stats.airtime_us += tx_queue_airtime_us(frame);
+				break;
+			case TX_TIMEOUT:
+				stats.timeouts++;
+				break;
+			default:
+				stats.failed++;
+				break;
+		}
+		if(frame->done != NULL){
+			frame->done(frame, frame->ctx);
+		}
+		free_frames[free_count++] = frame;
+		count++;
+	}
+
+	// a frame queued just as the ISR found the queue empty, or held over
+	// the hop
+	if((active == NULL) && ((held != NULL) || (spsc_ring_count(&pending) != 0))){
+		tx_queue_next();
+	}
+	return count;
+}
+
+uint32_t tx_queue_pending(void)
+{
+	return TX_QUEUE_DEPTH - free_count;
+}
+
+// a frame on air or in its reply window, main loop side
+bool tx_queue_busy(void)
+{
+	return active != NULL;
+}
+
+const tx_queue_stats_t *tx_queue_get_stats(void)
+{
+	return &stats;
+}
+
+// rates since the previous call
+void tx_queue_print_stats(void)
+{
+	uint32_t now_us = hwtime_now_us();
+	uint32_t elapsed_ms = (now_us - last_print_us) / 1000U;
+	uint32_t sent = stats.sent - last_print_sent;
+	uint32_t airtime_ms = (stats.airtime_us - last_print_airtime) / 1000U;
+	uint32_t finished_count;
+
+	last_print_us = now_us;
+	last_print_sent = stats.sent;
+	last_print_airtime = stats.airtime_us;
+
+	printf_("tx: %u queued, %u sent, %u timeouts, %u failed, %u refused, %u pending, %u held for the next dwell, reply windows %u answered, %u timed out\r\n",
+		stats.queued, stats.sent, stats.timeouts, stats.failed, stats.refused, tx_queue_pending(), stats.held,
+		stats.replied, stats.no_reply);
+	finished_count = stats.sent + stats.timeouts;
+	printf_("tx: SPI %u bytes per packet, %u to start, %u in the IRQ, %u payloads through the DMA\r\n",
+		(finished_count != 0) ? (stats.spi_start_bytes + stats.spi_irq_bytes) / finished_count : 0,
+		(finished_count != 0) ? stats.spi_start_bytes / finished_count : 0,
+		(finished_count != 0) ? stats.spi_irq_bytes / finished_count : 0, stats.dma_writes);
+	printf_("tx: %u packets/s, %u%% on air, TXDONE to SET_TX %u us last, %u min, %u max\r\n",
+		(elapsed_ms != 0) ? (sent * 1000U) / elapsed_ms : 0,
+		(elapsed_ms != 0) ? (airtime_ms * 100U) / elapsed_ms : 0,
+		timebase_cycles_to_us(stats.turnaround_last),
+		(stats.turnaround_min != UINT32_MAX) ? timebase_cycles_to_us(stats.turnaround_min) : 0,
+		timebase_cycles_to_us(stats.turnaround_max));
+}
@@ -4,9 +4,37 @@
 #include "stm32wlxx_ll_rcc.h"
 // #include "stm32wlxx_ll_gpio.h"
 #include "stm32wlxx_ll_lpuart.h"
+#include "stm32wlxx_ll_dma.h"
+#include "stm32wlxx_ll_dmamux.h"
 
+#include <stdint.h>
+#include <stdbool.h>
 
 
+#define UART_TX_MASK                (UART_TX_RING_SIZE - 1)
+#define UART_RX_MASK                (UART_RX_RING_SIZE - 1)
+
+_Static_assert((UART_TX_RING_SIZE & UART_TX_MASK) == 0, "ring size must be a power of two");
+_Static_assert((UART_RX_RING_SIZE & UART_RX_MASK) == 0, "ring size must be a power of two");
+
+// free-running indices, busy <= send <= head:
+// [busy, busy + dma_len) is being sent by the DMA, [send, head) is queued
+static uint8_t tx_ring[UART_TX_RING_SIZE];
+static uint32_t head;
+static uint32_t send;
+static uint32_t busy;
+static uint32_t dma_len;
+static uart_tx_policy_t policy = UART_TX_DEFAULT_POLICY;
+static uart_tx_stats_t stats;
+
+// written by DMA1 channel 4 round and round, read in place by the consumer
+static uint8_t rx_ring[UART_RX_RING_SIZE];
+static volatile bool rx_event;
+static uart_rx_stats_t rx_stats;
+
+static void uart_tx_dma_init(void);
+static void uart_rx_dma_init(void);
+
 
 void UART_init(void)
 {
@@ -37,8 +65,272 @@ void UART_init(void)
         .HardwareFlowControl = LL_LPUART_HWCONTROL_NONE
     };
     LL_LPUART_Init(LPUART1, &LPUART_InitStruct);
+
+    // the match character ends a frame, only writable while the LPUART is disabled
+    LL_LPUART_ConfigNodeAddress(LPUART1, LL_LPUART_ADDRESS_DETECT_7B, UART_RX_MATCH_CHAR);
     LL_LPUART_Enable(LPUART1);
 
     // wait for the LPUART module to send an idle frame and finish initialization
     while(!(LL_LPUART_IsActiveFlag_TEACK(LPUART1)) || !(LL_LPUART_IsActiveFlag_REACK(LPUART1)));
-}
\ No newline at end of file
+
+    uart_tx_dma_init();
+    uart_rx_dma_init();
+}
+
+static void uart_tx_dma_init(void)
+{
+    LL_AHB1_GRP1_EnableClock(LL_AHB1_GRP1_PERIPH_DMAMUX1);
+    LL_AHB1_GRP1_EnableClock(LL_AHB1_GRP1_PERIPH_DMA1);
+
+    LL_DMA_ConfigTransfer(DMA1, UART_TX_DMA_CHANNEL,
+                          LL_DMA_DIRECTION_MEMORY_TO_PERIPH | LL_DMA_MODE_NORMAL | LL_DMA_PERIPH_NOINCREMENT |
+                          LL_DMA_MEMORY_INCREMENT | LL_DMA_PDATAALIGN_BYTE | LL_DMA_MDATAALIGN_BYTE |
+                          LL_DMA_PRIORITY_LOW);
+    LL_DMA_SetPeriphRequest(DMA1, UART_TX_DMA_CHANNEL, LL_DMAMUX_REQ_LPUART1_TX);
+    LL_DMA_SetPeriphAddress(DMA1, UART_TX_DMA_CHANNEL,
+                            LL_LPUART_DMA_GetRegAddr(LPUART1, LL_LPUART_DMA_REG_DATA_TRANSMIT));
+    LL_DMA_EnableIT_TC(DMA1, UART_TX_DMA_CHANNEL);
+    LL_DMA_EnableIT_TE(DMA1, UART_TX_DMA_CHANNEL);
+    LL_LPUART_EnableDMAReq_TX(LPUART1);
+
+    // below the radio and its SPI DMA, console output can wait
+    NVIC_SetPriority(DMA1_Channel3_IRQn, 2);
+    NVIC_EnableIRQ(DMA1_Channel3_IRQn);
+}
+
+static void uart_rx_dma_init(void)
+{
+    LL_DMA_ConfigTransfer(DMA1, UART_RX_DMA_CHANNEL,
+                          LL_DMA_DIRECTION_PERIPH_TO_MEMORY | LL_DMA_MODE_CIRCULAR | LL_DMA_PERIPH_NOINCREMENT |
+                          LL_DMA_MEMORY_INCREMENT | LL_DMA_PDATAALIGN_BYTE | LL_DMA_MDATAALIGN_BYTE |
+                          LL_DMA_PRIORITY_MEDIUM);
+    LL_DMA_SetPeriphRequest(DMA1, UART_RX_DMA_CHANNEL, LL_DMAMUX_REQ_LPUART1_RX);
+    LL_DMA_SetPeriphAddress(DMA1, UART_RX_DMA_CHANNEL,
+                            LL_LPUART_DMA_GetRegAddr(LPUART1, LL_LPUART_DMA_REG_DATA_RECEIVE));
+    LL_DMA_SetMemoryAddress(DMA1, UART_RX_DMA_CHANNEL, (uint32_t)rx_ring);
+    LL_DMA_SetDataLength(DMA1, UART_RX_DMA_CHANNEL, UART_RX_RING_SIZE);
+    // half and full ring wake the consumer even when no frame ends
+    LL_DMA_EnableIT_HT(DMA1, UART_RX_DMA_CHANNEL);
+    LL_DMA_EnableIT_TC(DMA1, UART_RX_DMA_CHANNEL);
+    LL_DMA_EnableChannel(DMA1, UART_RX_DMA_CHANNEL);
+    LL_LPUART_EnableDMAReq_RX(LPUART1);
+
+    // a frame delimiter or a pause in the stream means there is something to parse
+    LL_LPUART_ClearFlag_CM(LPUART1);
+    LL_LPUART_ClearFlag_IDLE(LPUART1);
+    LL_LPUART_EnableIT_CM(LPUART1);
+    LL_LPUART_EnableIT_IDLE(LPUART1);
+    LL_LPUART_EnableIT_ERROR(LPUART1);
+
+    NVIC_SetPriority(DMA1_Channel4_IRQn, 2);
+    NVIC_EnableIRQ(DMA1_Channel4_IRQn);
+    NVIC_SetPriority(LPUART1_IRQn, 2);
+    NVIC_EnableIRQ(LPUART1_IRQn);
+}
+
+// hands the next contiguous run of queued bytes to the DMA, interrupts masked
+static void uart_tx_start(void)
+{
+    uint32_t len = head - send;
+    uint32_t to_end = UART_TX_RING_SIZE - (send & UART_TX_MASK);
+
+    if((dma_len != 0) || (len == 0)){
+        return;
+    }
+    if(len > to_end){
+        len = to_end;
+    }
+    if(len > UART_TX_DMA_CHUNK){
+        len = UART_TX_DMA_CHUNK;
+    }
+    busy = send;
+    dma_len = len;
+    send += len;
+
+    LL_DMA_SetMemoryAddress(DMA1, UART_TX_DMA_CHANNEL, (uint32_t)&tx_ring[busy & UART_TX_MASK]);
+    LL_DMA_SetDataLength(DMA1, UART_TX_DMA_CHANNEL, len);
+    LL_DMA_EnableChannel(DMA1, UART_TX_DMA_CHANNEL);
+}
+
+// retires a finished transfer and starts the next, from the DMA interrupt
+// or polled by writers that block
+void uart_tx_service(void)
+{
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    if((dma_len != 0) && (LL_DMA_IsActiveFlag_TC3(DMA1) || LL_DMA_IsActiveFlag_TE3(DMA1))){
+        LL_DMA_ClearFlag_GI3(DMA1);
+        LL_DMA_DisableChannel(DMA1, UART_TX_DMA_CHANNEL);
+        busy += dma_len;
+        dma_len = 0;
+        uart_tx_start();
+    }
+    __set_PRIMASK(primask);
+}
+
+// copies as much of data as fits, interrupts masked
+static uint32_t uart_tx_copy(const uint8_t *data, uint32_t len)
+{
+    uint32_t space = UART_TX_RING_SIZE - (head - busy);
+    uint32_t i;
+
+    if(len > space){
+        len = space;
+    }
+    for(i = 0; i < len; i++){
+        tx_ring[head++ & UART_TX_MASK] = data[i];
+    }
+    if(head - busy > stats.high_water){
+        stats.high_water = head - busy;
+    }
+    return len;
+}
+
+// never waits unless the policy is UART_TX_BLOCK, callable from any context
+void uart_write(const uint8_t *data, uint32_t len)
+{
+    uint32_t primask = __get_PRIMASK();
+    uint32_t space;
+    uint32_t done;
+
+    __disable_irq();
+    stats.written += len;
+    space = UART_TX_RING_SIZE - (head - busy);
+
+    if(len > space){
+        switch(policy)
+        {
+            case UART_TX_DROP_OLDEST:
+                // the queue behind the transfer in flight goes, it is the only
+                // space that can be reclaimed at once
+                stats.dropped += head - send;
+                head = send;
+                space = UART_TX_RING_SIZE - (head - busy);
+                if(len > space){
+                    // the newest bytes must at least fit the space left
+                    stats.dropped += len - space;
+                    data += len - space;
+                    len = space;
+                }
+                stats.overflows++;
+                break;
+            case UART_TX_BLOCK:
+                stats.blocked++;
+                while(len != 0){
+                    done = uart_tx_copy(data, len);
+                    data += done;
+                    len -= done;
+                    uart_tx_start();
+                    // polled with interrupts masked, so this works from handlers too
+                    while((len != 0) && (head - busy == UART_TX_RING_SIZE)){
+                        __set_PRIMASK(primask);
+                        uart_tx_service();
+                        __disable_irq();
+                    }
+                }
+                break;
+            default:
+                // whole writes only, a cut record is worse than a missing one
+                stats.dropped += len;
+                stats.overflows++;
+                len = 0;
+                break;
+        }
+    }
+    uart_tx_copy(data, len);
+    uart_tx_start();
+    __set_PRIMASK(primask);
+}
+
+void uart_tx_set_policy(uart_tx_policy_t new_policy)
+{
+    policy = new_policy;
+}
+
+uart_tx_policy_t uart_tx_policy(void)
+{
+    return policy;
+}
+
+uint32_t uart_tx_pending(void)
+{
+    return head - busy;
+}
+
+// drains everything queued by polling, for fault handlers running with
+// interrupts disabled
+void uart_tx_flush(void)
+{
+    while(head != busy){
+        uart_tx_service();
+        uart_tx_start();
+    }
+    while(!LL_LPUART_IsActiveFlag_TC(LPUART1));
+}
+
+const uart_tx_stats_t *uart_tx_get_stats(void)
+{
+    return &stats;
+}
+
+void DMA1_Channel3_IRQHandler(void)
+{
+    uart_tx_service();
+}
+
+uint8_t *uart_rx_buffer(void)
+{
+    return rx_ring;
+}
+
+// ring index the DMA writes next
+uint32_t uart_rx_position(void)
+{
+    return (UART_RX_RING_SIZE - LL_DMA_GetDataLength(DMA1, UART_RX_DMA_CHANNEL)) & UART_RX_MASK;
+}
+
+// true once per burst of interrupts, the consumer then parses up to
+// uart_rx_position()
+bool uart_rx_ready(void)
+{
+    if(!rx_event){
+        return false;
+    }
+    rx_event = false;
+    return true;
+}
+
+const uart_rx_stats_t *uart_rx_get_stats(void)
+{
+    return &rx_stats;
+}
+
+void DMA1_Channel4_IRQHandler(void)
+{
+    if(LL_DMA_IsActiveFlag_HT4(DMA1) || LL_DMA_IsActiveFlag_TC4(DMA1)){
+        rx_stats.dma++;
+    }
+    LL_DMA_ClearFlag_GI4(DMA1);
+    rx_event = true;
+}
+
+void LPUART1_IRQHandler(void)
+{
+    if(LL_LPUART_IsActiveFlag_CM(LPUART1)){
+        LL_LPUART_ClearFlag_CM(LPUART1);
+        rx_stats.matches++;
+    }
+    if(LL_LPUART_IsActiveFlag_IDLE(LPUART1)){
+        LL_LPUART_ClearFlag_IDLE(LPUART1);
+        rx_stats.idle++;
+    }
+    // the byte is stored regardless, the frame CRC rejects it
+    if(LL_LPUART_IsActiveFlag_ORE(LPUART1) || LL_LPUART_IsActiveFlag_FE(LPUART1) || LL_LPUART_IsActiveFlag_NE(LPUART1)){
+        LL_LPUART_ClearFlag_ORE(LPUART1);
+        LL_LPUART_ClearFlag_FE(LPUART1);
+        LL_LPUART_ClearFlag_NE(LPUART1);
+        rx_stats.errors++;
+    }
+    rx_event = true;
+}